@@ -8,6 +8,8 @@
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <mfapi.h>
+#include <strmif.h>
+#include <codecapi.h>
 #include <windows.media.h>
 #include <windows.media.core.interop.h>
 #include <windows.foundation.h>
@@ -45,6 +47,17 @@ constexpr uint16_t SecureServerPort = 6554;
 // Using Mediacapture Record-to-Sink APIs takes the per sample handling burden away from the App
 //#define USE_FR 
 
+// Uncomment the following to keep the last minutes of /h264 in a timeshift file, clients can then PLAY it
+// from an earlier time with an RTSP Range header and at another speed with a Scale header
+//#define USE_TIMESHIFT
+
+// Uncomment the following to also record /h264 to one minute CMAF segments, from the same encode
+//#define USE_RECORDING
+
+// Uncomment the following to also serve /h264 as LL-HLS on http://<host>:8080/h264/index.m3u8
+//#define USE_HTTP_EGRESS
+constexpr uint16_t HttpEgressPort = 8080;
+
 // sample test code to get localhost test certificate
 std::vector<PCCERT_CONTEXT> getServerCertificate()
 {
@@ -104,6 +117,29 @@ std::map<winrt::hstring, std::vector<GUID>> streamMap =
     {L"/h264", {MFVideoFormat_H264}},
 };
 
+#ifdef USE_FR
+// Layers of the simulcast streams as fractions of the capture frame size, e.g. 1080p/720p/360p. The sink
+// writer scales the frames for the encoder of each layer.
+std::map<winrt::hstring, std::vector<std::pair<uint32_t, uint32_t>>> simulcastMap =
+{
+    {L"/simulcast", {{1, 1}, {2, 3}, {1, 3}}},
+};
+#endif
+
+winrt::com_ptr<IMFMediaType> CreateVideoOutputType(GUID subType, uint32_t width, uint32_t height, MediaRatio frameRate)
+{
+    winrt::com_ptr<IMFMediaType> spOutType;
+    winrt::check_hresult(MFCreateMediaType(spOutType.put()));
+    winrt::check_hresult(spOutType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    winrt::check_hresult(spOutType->SetGUID(MF_MT_SUBTYPE, subType));
+    winrt::check_hresult(spOutType->SetUINT32(MF_MT_AVG_BITRATE, width * 1000));
+
+    winrt::check_hresult(spOutType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    winrt::check_hresult(MFSetAttributeSize(spOutType.get(), MF_MT_FRAME_SIZE, width, height));
+    winrt::check_hresult(MFSetAttributeRatio(spOutType.get(), MF_MT_FRAME_RATE, frameRate.Numerator() * 100, frameRate.Denominator() * 100));
+    return spOutType;
+}
+
 #ifdef USE_FR
 IMFSinkWriter* InitSinkWriter(IMFMediaSink* pMediaSink, MediaFrameFormat format)
 {
@@ -131,15 +167,37 @@ IMFSinkWriter* InitSinkWriter(IMFMediaSink* pMediaSink, MediaFrameFormat format)
     check_hresult(spSWAttributes->SetUINT32(MF_LOW_LATENCY, TRUE));
     HRESULT hr = S_OK;
     BOOL bEnableHWTransforms = FALSE;
+    DWORD streamCount = 0;
+    check_hresult(pMediaSink->GetStreamSinkCount(&streamCount));
     do
     {
         spSinkWriter = nullptr;
         check_hresult(spSWAttributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, bEnableHWTransforms));
         check_hresult(MFCreateSinkWriterFromMediaSink(pMediaSink, spSWAttributes.get(), spSinkWriter.put()));
-        hr = spSinkWriter->SetInputMediaType(0, spInType.get(), nullptr);
+        hr = S_OK;
+        for (DWORD i = 0; (i < streamCount) && SUCCEEDED(hr); i++)
+        {
+            hr = spSinkWriter->SetInputMediaType(i, spInType.get(), nullptr);
+        }
         bEnableHWTransforms = !bEnableHWTransforms;
     } while (hr == MF_E_TOPO_CODEC_NOT_FOUND);
     check_hresult(hr);
+
+    // clients of a simulcast sink switch layers at IDRs, a one second GOP on every encoder lines them up
+    if (streamCount > 1)
+    {
+        for (DWORD i = 0; i < streamCount; i++)
+        {
+            com_ptr<ICodecAPI> spCodecApi;
+            if (SUCCEEDED(spSinkWriter->GetServiceForStream(i, GUID_NULL, IID_PPV_ARGS(spCodecApi.put()))))
+            {
+                VARIANT gopSize;
+                gopSize.vt = VT_UI4;
+                gopSize.ulVal = (format.FrameRate().Numerator() + format.FrameRate().Denominator() - 1) / format.FrameRate().Denominator();
+                (void)spCodecApi->SetValue(&CODECAPI_AVEncMPVGOPSize, &gopSize);
+            }
+        }
+    }
     check_hresult(spSinkWriter->BeginWriting());
 
     return spSinkWriter.detach();
@@ -278,15 +336,13 @@ int main()
         for (auto&& strm : streamMap)
         {
             std::vector<IMFMediaType*> mediaTypes;
-            winrt::com_ptr<IMFMediaType> spOutType;
-            winrt::check_hresult(MFCreateMediaType(spOutType.put()));
-            winrt::check_hresult(spOutType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-            winrt::check_hresult(spOutType->SetGUID(MF_MT_SUBTYPE, strm.second[0]));
-            winrt::check_hresult(spOutType->SetUINT32(MF_MT_AVG_BITRATE, sz.Width * 1000));
-
-            winrt::check_hresult(spOutType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
-            winrt::check_hresult(MFSetAttributeSize(spOutType.get(), MF_MT_FRAME_SIZE, sz.Width, sz.Height));
-            winrt::check_hresult(MFSetAttributeRatio(spOutType.get(), MF_MT_FRAME_RATE, frameRate.Numerator() * 100, frameRate.Denominator() * 100));
+            auto spOutType = CreateVideoOutputType(strm.second[0], sz.Width, sz.Height, frameRate);
+#ifdef USE_TIMESHIFT
+            winrt::check_hresult(spOutType->SetString(MF_NETWORKSTREAM_TIMESHIFT_FILE, L"timeshift.bin"));
+#endif
+#ifdef USE_RECORDING
+            winrt::check_hresult(spOutType->SetString(MF_NETWORKSTREAM_RECORDING_PATH, L"recording"));
+#endif
             mediaTypes.push_back(spOutType.get());
             IMediaExtension mediaExtSink;
             winrt::check_hresult(CreateRTPMediaSink(mediaTypes.data(), (DWORD)mediaTypes.size(), (IMFMediaSink**)put_abi(mediaExtSink)));
@@ -294,6 +350,24 @@ int main()
             mediaTypes.clear();
             spOutType = nullptr;
         }
+#ifdef USE_FR
+        for (auto&& strm : simulcastMap)
+        {
+            std::vector<winrt::com_ptr<IMFMediaType>> layerTypes;
+            std::vector<IMFMediaType*> mediaTypes;
+            for (auto&& scale : strm.second)
+            {
+                // even sizes for 4:2:0
+                uint32_t width = (sz.Width * scale.first / scale.second) & ~1u;
+                uint32_t height = (sz.Height * scale.first / scale.second) & ~1u;
+                layerTypes.push_back(CreateVideoOutputType(MFVideoFormat_H264, width, height, frameRate));
+                mediaTypes.push_back(layerTypes.back().get());
+            }
+            IMediaExtension mediaExtSink;
+            winrt::check_hresult(CreateRTPSimulcastMediaSink(mediaTypes.data(), (DWORD)mediaTypes.size(), (IMFMediaSink**)put_abi(mediaExtSink)));
+            streamers.Insert(winrt::hstring(strm.first), mediaExtSink);
+        }
+#endif
 
         com_ptr<IRTSPServerControl> serverHandle, serverHandleSecure;
         com_ptr<IRTSPAuthProvider> m_spAuthProvider;
@@ -343,6 +417,9 @@ int main()
         {
             winrt::check_hresult(serverHandleSecure->StartServer());
         }
+#ifdef USE_HTTP_EGRESS
+        winrt::check_hresult(serverHandle.as<IRTSPServerHttpEgress>()->StartHttpEgress(nullptr, HttpEgressPort, 333, 2000));
+#endif
 #ifdef USE_FR
         auto fsources = mc.FrameSources();
         MediaFrameSource selectedFs(nullptr);
@@ -357,13 +434,16 @@ int main()
         auto fr = mc.CreateFrameReaderAsync(selectedFs, selectedFs.CurrentFormat().Subtype(), sz).get();
         fr.AcquisitionMode(MediaFrameReaderAcquisitionMode::Realtime);
         slim_mutex m;
-        std::vector<com_ptr<IMFSinkWriter>> spSinkWriters;
+        std::vector<std::pair<com_ptr<IMFSinkWriter>, DWORD>> spSinkWriters;     // and the stream count
         auto strmIter = streamers.First();
         for (uint32_t i = 0; i < streamers.Size(); i++)
         {
             winrt::com_ptr<IMFSinkWriter> spSW;
-            spSW.attach(InitSinkWriter(strmIter.Current().Value().as<IMFMediaSink>().get(), selectedFs.CurrentFormat()));
-            spSinkWriters.push_back(spSW);
+            auto spMediaSink = strmIter.Current().Value().as<IMFMediaSink>();
+            DWORD streamCount = 0;
+            check_hresult(spMediaSink->GetStreamSinkCount(&streamCount));
+            spSW.attach(InitSinkWriter(spMediaSink.get(), selectedFs.CurrentFormat()));
+            spSinkWriters.push_back({ spSW, streamCount });
             strmIter.MoveNext();
         }
         fr.FrameArrived([&](MediaFrameReader mfr, MediaFrameArrivedEventArgs args)
@@ -376,7 +456,10 @@ int main()
                 check_hresult(spGetService->GetService(MF_WRAPPED_SAMPLE_SERVICE, IID_PPV_ARGS(spSample.put())));
                 for (auto&& sinkWriter : spSinkWriters)
                 {
-                    check_hresult(sinkWriter->WriteSample(0, spSample.get()));
+                    for (DWORD i = 0; i < sinkWriter.second; i++)
+                    {
+                        check_hresult(sinkWriter.first->WriteSample(i, spSample.get()));
+                    }
                 }
             });
 
@@ -34,8 +34,70 @@ template <> struct winrt::impl::category<winrt::PacketHandler> { using type = wi
 template <> inline constexpr winrt::guid winrt::impl::guid_v<winrt::PacketHandler> {__uuidof(ABI::PacketHandler)};
 
 
+// Stages of the path of a sample through a stream sink, latencies are measured from the sample time on
+// the presentation clock, which for live capture is the capture time
+enum class NetworkStreamLatencyStage
+{
+    SampleArrival = 0,          // sample reached the stream sink: capture, encoder and pipeline queues
+    Packetized,                 // all the RTP packets of the sample were handed to the transports
+    FirstPacketSent,            // first packet of the sample sent to a client, recorded once per client
+    LastPacketSent,             // last packet of the sample sent to a client, recorded once per client
+    Count
+};
+
+struct NetworkStreamLatencyStats
+{
+    uint64_t count;
+    uint64_t minUs;
+    uint64_t maxUs;
+    uint64_t meanUs;
+    uint64_t p50Us;
+    uint64_t p99Us;
+    uint64_t p999Us;
+};
+
+// RTP packets of one client of a stream sink
+struct NetworkStreamClientStats
+{
+    uint64_t packetsSent;
+    uint64_t bytesSent;
+    uint64_t packetsDropped;    // failed to send, or skipped while a transport handler was backed up
+    uint32_t layer;             // simulcast layer streamed to the client, 0 is the best quality
+    uint32_t layerSwitches;
+    uint64_t retransmits;       // packets sent again at the request of an "srt" client
+};
+
+// UINT32 set on the media types of the stream sinks of a simulcast media sink: the layer a stream sink
+// takes the samples of. Layer 0 is the track the clients stream from, the others only feed it samples
+// and are not tracks of their own.
+// {3C1D9E5A-8F62-4B7C-A1D4-6E2B9F0C7A31}
+inline constexpr GUID MF_NETWORKSTREAM_SIMULCAST_LAYER = { 0x3c1d9e5a, 0x8f62, 0x4b7c, { 0xa1, 0xd4, 0x6e, 0x2b, 0x9f, 0x0c, 0x7a, 0x31 } };
+
+// String set on the media type of an H.264 stream sink: file the stream is kept in for the clients that
+// play it from an earlier time (RTSP Range/Scale). The file is preallocated to
+// MF_NETWORKSTREAM_TIMESHIFT_SIZE bytes (UINT64) and overwritten as a ring.
+// {7B52E0C4-1F3A-4D86-9E0B-2C5A8D17F6E9}
+inline constexpr GUID MF_NETWORKSTREAM_TIMESHIFT_FILE = { 0x7b52e0c4, 0x1f3a, 0x4d86, { 0x9e, 0x0b, 0x2c, 0x5a, 0x8d, 0x17, 0xf6, 0xe9 } };
+// {A4C3F17D-6B28-4E51-8D9A-03E7B5C2194F}
+inline constexpr GUID MF_NETWORKSTREAM_TIMESHIFT_SIZE = { 0xa4c3f17d, 0x6b28, 0x4e51, { 0x8d, 0x9a, 0x03, 0xe7, 0xb5, 0xc2, 0x19, 0x4f } };
+
+// String set on the media type of an H.264 stream sink: the stream is also recorded to CMAF segment files
+// <path>_<n>.mp4. MF_NETWORKSTREAM_RECORDING_FRAGMENT_DURATION and MF_NETWORKSTREAM_RECORDING_SEGMENT_DURATION
+// (UINT64, 100ns units) default to 1 second and 1 minute; MF_NETWORKSTREAM_RECORDING_UNBUFFERED (UINT32)
+// writes the files without the system cache.
+// {5E0D8B73-2C4F-4A19-B6E8-91D37F0A4C25}
+inline constexpr GUID MF_NETWORKSTREAM_RECORDING_PATH = { 0x5e0d8b73, 0x2c4f, 0x4a19, { 0xb6, 0xe8, 0x91, 0xd3, 0x7f, 0x0a, 0x4c, 0x25 } };
+// {C83A6F12-94D7-4B0E-A5C1-6F2E8D3B7A90}
+inline constexpr GUID MF_NETWORKSTREAM_RECORDING_FRAGMENT_DURATION = { 0xc83a6f12, 0x94d7, 0x4b0e, { 0xa5, 0xc1, 0x6f, 0x2e, 0x8d, 0x3b, 0x7a, 0x90 } };
+// {1F6B94E2-7A3C-4D58-8E0F-B24C6A9D1357}
+inline constexpr GUID MF_NETWORKSTREAM_RECORDING_SEGMENT_DURATION = { 0x1f6b94e2, 0x7a3c, 0x4d58, { 0x8e, 0x0f, 0xb2, 0x4c, 0x6a, 0x9d, 0x13, 0x57 } };
+// {9A2E57C1-3B8D-4F60-9C74-E5A1D08B62F3}
+inline constexpr GUID MF_NETWORKSTREAM_RECORDING_UNBUFFERED = { 0x9a2e57c1, 0x3b8d, 0x4f60, { 0x9c, 0x74, 0xe5, 0xa1, 0xd0, 0x8b, 0x62, 0xf3 } };
+
 //EXTERN_C const IID IID_IVideoStreamer;
-MIDL_INTERFACE("022C6CB9-64D5-472F-8753-76382CC5F4DA")
+// The IID changed from {022C6CB9-64D5-472F-8753-76382CC5F4DA} when the stats and RTCP methods were added,
+// so a binary built against the old layout fails QueryInterface instead of calling into the wrong slots
+MIDL_INTERFACE("0B6E9478-1057-499F-A081-9CFA7295106C")
 INetworkMediaStreamSink : public IMFStreamSink
 {
 public:
@@ -48,5 +110,24 @@ public:
     virtual STDMETHODIMP Stop(MFTIME hnsSystemTime) = 0;
     virtual STDMETHODIMP Pause(MFTIME hnsSystemTime) = 0;
     virtual STDMETHODIMP Shutdown() = 0;
+    virtual STDMETHODIMP GetLatencyStats(NetworkStreamLatencyStage stage, NetworkStreamLatencyStats* pStats) = 0;
+    virtual STDMETHODIMP ResetLatencyStats() = 0;
+    virtual STDMETHODIMP GetNetworkClientStats(LPCWSTR pDestination, NetworkStreamClientStats* pStats) = 0;
+    virtual STDMETHODIMP GetTransportHandlerStats(ABI::PacketHandler* pPacketHandler, NetworkStreamClientStats* pStats) = 0;
+    // RTCP compound packet from a client whose transport is not handled by the stream sink itself
+    virtual STDMETHODIMP ProcessRtcpPacket(const uint8_t* pPacket, size_t size) = 0;
 
 };
+
+// Timeshift store of a stream sink (MF_NETWORKSTREAM_TIMESHIFT_FILE). Every stream sink implements it, those
+// without a store return MF_E_NOT_AVAILABLE and those with nothing stored yet HRESULT_FROM_WIN32(ERROR_NO_DATA).
+MIDL_INTERFACE("B87F08A0-3183-4A6C-BA7E-447CB069511A")
+INetworkMediaStreamTimeshift : public ::IUnknown
+{
+public:
+    // Sample times of the oldest stored IDR and of the newest access unit, and the access units dropped
+    // because the disk could not keep up
+    virtual STDMETHODIMP GetTimeshiftRange(LONGLONG* phnsOldest, LONGLONG* phnsNewest, uint64_t* pAccessUnitsDropped) = 0;
+    // Sample time of the IDR a client added with npt=hnsTime starts from
+    virtual STDMETHODIMP GetTimeshiftStart(LONGLONG hnsTime, LONGLONG* phnsStart) = 0;
+};
@@ -13,4 +13,8 @@
 #define RTPMEDIASTREAMER_API __declspec(dllimport)
 #endif
 
-RTPMEDIASTREAMER_API STDMETHODIMP CreateRTPMediaSink(IMFMediaType** apMediaTypes, DWORD dwMediaTypeCount, IMFMediaSink** ppMediaSink);
\ No newline at end of file
+RTPMEDIASTREAMER_API STDMETHODIMP CreateRTPMediaSink(IMFMediaType** apMediaTypes, DWORD dwMediaTypeCount, IMFMediaSink** ppMediaSink);
+
+// Simulcast sink: one H264 track from several encodings of the same capture, best quality first. Stream sink
+// N takes the samples of layer N and each client is switched between the layers from its RTCP reports.
+RTPMEDIASTREAMER_API STDMETHODIMP CreateRTPSimulcastMediaSink(IMFMediaType** apLayerTypes, DWORD dwLayerCount, IMFMediaSink** ppMediaSink);
\ No newline at end of file
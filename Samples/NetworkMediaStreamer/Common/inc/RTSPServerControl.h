@@ -63,6 +63,79 @@ IRTSPAuthProviderCredStore : public ::IUnknown
     virtual STDMETHODIMP RemoveUser(LPCWSTR pUserName) = 0;
 };
 
+// Auth provider issuing stateless nonces: HMAC(key, timestamp, client address).
+// A nonce can be validated by any server sharing the key without keeping per session state.
+//EXTERN_C const IID IID_IRTSPAuthProviderStateless;
+MIDL_INTERFACE("65187123-9070-4B2E-8DC4-D816A88CFB63")
+IRTSPAuthProviderStateless : public ::IUnknown
+{
+    virtual STDMETHODIMP GetNewAuthSessionMessageForClient(LPCWSTR pClientAddress, BOOL bStale, HSTRING* pAuthSessionMessage) = 0;
+    virtual STDMETHODIMP AuthorizeClient(LPCWSTR pAuthResp, LPCWSTR pClientAddress, LPCWSTR pMethod) = 0;
+    virtual STDMETHODIMP SetNonceKey(const BYTE* pKey, UINT32 cbKey, UINT32 uNonceLifetimeSeconds) = 0;
+};
+
+#define RTSP_METRICS_MAX_TRACKS      8
+#define RTSP_METRICS_ADDRESS_SIZE    16
+
+// RTP packets sent by the stream sinks to the clients
+struct RTSPStreamMetrics
+{
+    uint64_t bytesSent;
+    uint64_t packetsSent;
+    uint64_t packetsDropped;                    // failed to send, or skipped while the connection was backed up
+    uint64_t retransmits;                       // packets sent again at the request of a client
+};
+
+struct RTSPSessionMetrics
+{
+    uint32_t sessionId;
+    char clientAddress[RTSP_METRICS_ADDRESS_SIZE];
+    BOOL bPlaying;
+    uint64_t requests;
+    uint64_t authFailures;                      // requests with credentials that were rejected
+    uint64_t requestLatencyTotalUs;             // time to handle the requests and queue the responses
+    uint64_t requestLatencyMaxUs;
+    uint64_t rttUs;                             // last round trip time from the receiver reports of the client, 0 if unknown
+    RTSPStreamMetrics total;
+    uint32_t trackCount;
+    RTSPStreamMetrics tracks[RTSP_METRICS_MAX_TRACKS];
+};
+
+struct RTSPServerMetrics
+{
+    uint64_t sessionsStarted;
+    uint64_t activeSessions;
+    uint64_t activeClients;                     // sessions that are playing
+    uint64_t requests;
+    uint64_t authFailures;
+    uint64_t requestLatencyTotalUs;
+    uint64_t requestLatencyMaxUs;
+    RTSPStreamMetrics total;                    // all the sessions, ended ones included
+};
+
+// Counters of the RTSP server, queried from the IRTSPServerControl instance.
+// Reads are snapshots, the counters keep changing while sessions stream.
+//EXTERN_C const IID IID_IRTSPServerMetrics;
+MIDL_INTERFACE("8C0E4F2B-5D7A-4E61-9B3C-2A6F1D8E7C45")
+IRTSPServerMetrics : public ::IUnknown
+{
+    virtual STDMETHODIMP GetServerMetrics(RTSPServerMetrics* pMetrics) = 0;
+    virtual STDMETHODIMP GetSessionMetrics(RTSPSessionMetrics* pMetrics, UINT32 uMaxSessions, UINT32* puSessionCount) = 0;
+    virtual STDMETHODIMP StartMetricsExporter(uint16_t port) = 0;
+    virtual STDMETHODIMP StopMetricsExporter() = 0;
+};
+
+// LL-HLS egress of the streams of the server over HTTP, for viewers without an RTSP client: each media sink
+// of the server is served at http://<pAddress>:<port>/<url suffix>/index.m3u8, fed CMAF parts of at most
+// uPartDurationMs by its H264 stream sink, in segments of at most uSegmentDurationMs rounded up to a second.
+// pAddress is an IPv4 address of the host, null for all of them.
+MIDL_INTERFACE("5B7C91E4-3A2D-4F08-B6E1-9D4C2F7A8E13")
+IRTSPServerHttpEgress : public ::IUnknown
+{
+    virtual STDMETHODIMP StartHttpEgress(LPCWSTR pAddress, uint16_t port, UINT32 uPartDurationMs, UINT32 uSegmentDurationMs) = 0;
+    virtual STDMETHODIMP StopHttpEgress() = 0;
+};
+
 namespace ABI
 {
     using namespace ABI::Windows::Foundation;
@@ -99,3 +172,5 @@ public:
 
 RTSPSERVER_API STDMETHODIMP CreateRTSPServer(ABI::RTSPSuffixSinkMap* pStreamers, uint16_t socketPort, bool bSecure, IRTSPAuthProvider* pAuthProvider, PCCERT_CONTEXT* aServerCerts, size_t uCertCount, IRTSPServerControl** ppRTSPServerControl);
 RTSPSERVER_API STDMETHODIMP GetAuthProviderInstance(AuthType authType, LPCWSTR pResourceName, IRTSPAuthProvider** ppRTSPAuthProvider);
+// With bStatelessNonces the provider also implements IRTSPAuthProviderStateless
+RTSPSERVER_API STDMETHODIMP GetAuthProviderInstanceEx(AuthType authType, LPCWSTR pResourceName, BOOL bStatelessNonces, IRTSPAuthProvider** ppRTSPAuthProvider);
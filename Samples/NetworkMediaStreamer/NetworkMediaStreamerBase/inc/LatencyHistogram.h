@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Log linear latency histogram in microseconds, HDR histogram style: values below 32us get a bucket each,
+// above that every power of 2 range is split in 16 buckets, so a percentile is within ~6% of the true value
+// up to ~71 minutes. Recording is one relaxed atomic increment per counter, so the sample thread never
+// blocks and queries can read it from any thread while it is being written.
+class CLatencyHistogram
+{
+public:
+    static constexpr uint32_t subBucketBits = 5;
+    static constexpr uint32_t subBucketCount = 1 << subBucketBits;
+    static constexpr uint32_t subBucketHalfCount = subBucketCount / 2;
+    static constexpr uint32_t bucketCount = subBucketCount + (32 - subBucketBits) * subBucketHalfCount;
+
+    CLatencyHistogram();
+    void Record(MFTIME hnsLatency);
+    void GetStats(NetworkStreamLatencyStats* pStats) const;
+    void Reset();
+
+private:
+    static uint32_t IndexOf(uint32_t valueUs);
+    static uint64_t HighestValueOf(uint32_t index);
+
+    std::atomic<uint64_t> m_buckets[bucketCount];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sumUs;
+    std::atomic<uint32_t> m_minUs;
+    std::atomic<uint32_t> m_maxUs;
+};
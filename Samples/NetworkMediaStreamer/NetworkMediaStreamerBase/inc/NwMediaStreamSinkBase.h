@@ -7,7 +7,7 @@
 #define RETURN_IF_NULL(p) if(!p) return E_POINTER;
 #define HRESULT_EXCEPTION_BOUNDARY_FUNC catch(...) { auto hr = winrt::to_hresult(); return hr;}
 
-class NwMediaStreamSinkBase : public winrt::implements<NwMediaStreamSinkBase, INetworkMediaStreamSink, IMFStreamSink, IMFMediaEventGenerator>
+class NwMediaStreamSinkBase : public winrt::implements<NwMediaStreamSinkBase, INetworkMediaStreamSink, INetworkMediaStreamTimeshift, IMFStreamSink, IMFMediaEventGenerator>
 {
 protected:
     uint8_t* m_pVideoHeader;
@@ -17,11 +17,17 @@ protected:
     winrt::com_ptr<IMFMediaEventQueue> m_spEventQueue;
     winrt::com_ptr<IMFMediaTypeHandler> m_spMTHandler;
     DWORD m_dwStreamID;
+    MFTIME m_llSampleTime;                              // sample being sent, latencies are measured from it
+    CLatencyHistogram m_latency[(int)NetworkStreamLatencyStage::Count];
     NwMediaStreamSinkBase(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID);
 
     virtual ~NwMediaStreamSinkBase();
 
     virtual STDMETHODIMP PacketizeAndSend(IMFSample* pSample) = 0;
+    void RecordLatency(NetworkStreamLatencyStage stage, MFTIME hnsNow)
+    {
+        m_latency[(int)stage].Record(hnsNow - m_llSampleTime);
+    }
 
 public:
 
@@ -30,6 +36,12 @@ public:
     STDMETHODIMP Stop(MFTIME hnsSystemTime);
     STDMETHODIMP Pause(MFTIME hnsSystemTime);
     STDMETHODIMP Shutdown();
+    STDMETHODIMP GetLatencyStats(NetworkStreamLatencyStage stage, NetworkStreamLatencyStats* pStats);
+    STDMETHODIMP ResetLatencyStats();
+
+    // INetworkMediaStreamTimeshift, overridden by the stream sinks that keep a timeshift store
+    STDMETHODIMP GetTimeshiftRange(LONGLONG* phnsOldest, LONGLONG* phnsNewest, uint64_t* pAccessUnitsDropped);
+    STDMETHODIMP GetTimeshiftStart(LONGLONG hnsTime, LONGLONG* phnsStart);
 
     // IMFMediaEventGenerator
     STDMETHODIMP BeginGetEvent(IMFAsyncCallback* pCallback, IUnknown* pState);
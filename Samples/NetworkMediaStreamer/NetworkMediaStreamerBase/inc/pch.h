@@ -8,6 +8,7 @@
 #include <mfreadwrite.h>
 #include <mferror.h>
 #include <Shlwapi.h>
+#include <atomic>
 #include <windows.media.h>
 #include <mfidl.h>
 #include <windows.foundation.h>
@@ -16,4 +17,5 @@
 #include <winrt\Windows.Foundation.h>
 #include <winrt\Windows.storage.streams.h>
 #include "NetworkMediaStreamer.h"
+#include "LatencyHistogram.h"
 #include "NwMediaStreamSinkBase.h"
\ No newline at end of file
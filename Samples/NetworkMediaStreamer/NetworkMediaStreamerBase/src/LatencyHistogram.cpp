@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+CLatencyHistogram::CLatencyHistogram()
+{
+    Reset();
+}
+
+uint32_t CLatencyHistogram::IndexOf(uint32_t valueUs)
+{
+    if (valueUs < subBucketCount)
+    {
+        return valueUs;
+    }
+    unsigned long msb;
+    _BitScanReverse(&msb, valueUs);
+    // shift so the value lands in the upper half of the sub buckets
+    uint32_t shift = msb - (subBucketBits - 1);
+    return subBucketCount + (shift - 1) * subBucketHalfCount + ((valueUs >> shift) - subBucketHalfCount);
+}
+
+uint64_t CLatencyHistogram::HighestValueOf(uint32_t index)
+{
+    if (index < subBucketCount)
+    {
+        return index;
+    }
+    uint32_t shift = (index - subBucketCount) / subBucketHalfCount + 1;
+    uint64_t subBucket = (index - subBucketCount) % subBucketHalfCount + subBucketHalfCount;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void CLatencyHistogram::Record(MFTIME hnsLatency)
+{
+    // sample times ahead of the system clock are counted as 0
+    auto valueUs = (uint32_t)__min(__max(hnsLatency, 0ll) / 10, (MFTIME)UINT32_MAX);
+    m_buckets[IndexOf(valueUs)].fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(valueUs, std::memory_order_relaxed);
+    auto minUs = m_minUs.load(std::memory_order_relaxed);
+    while ((valueUs < minUs) && !m_minUs.compare_exchange_weak(minUs, valueUs, std::memory_order_relaxed));
+    auto maxUs = m_maxUs.load(std::memory_order_relaxed);
+    while ((valueUs > maxUs) && !m_maxUs.compare_exchange_weak(maxUs, valueUs, std::memory_order_relaxed));
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+// The snapshot is not atomic across buckets, a sample recorded while it is taken may be missing from it
+void CLatencyHistogram::GetStats(NetworkStreamLatencyStats* pStats) const
+{
+    uint64_t counts[bucketCount];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < bucketCount; i++)
+    {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->count = total;
+    if (total == 0)
+    {
+        return;
+    }
+    pStats->minUs = m_minUs.load(std::memory_order_relaxed);
+    pStats->maxUs = m_maxUs.load(std::memory_order_relaxed);
+    pStats->meanUs = m_sumUs.load(std::memory_order_relaxed) / __max(m_count.load(std::memory_order_acquire), 1ull);
+
+    struct { double quantile; uint64_t* pValue; } percentiles[] =
+    {
+        { 0.5, &pStats->p50Us },
+        { 0.99, &pStats->p99Us },
+        { 0.999, &pStats->p999Us }
+    };
+    uint64_t cumulative = 0;
+    uint32_t index = 0;
+    for (auto& p : percentiles)
+    {
+        auto rank = (uint64_t)ceil(p.quantile * total);
+        while ((cumulative + counts[index] < rank) && (index < bucketCount - 1))
+        {
+            cumulative += counts[index++];
+        }
+        *p.pValue = __min(HighestValueOf(index), (uint64_t)pStats->maxUs);
+    }
+}
+
+void CLatencyHistogram::Reset()
+{
+    for (auto& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_sumUs.store(0, std::memory_order_relaxed);
+    m_minUs.store(UINT32_MAX, std::memory_order_relaxed);
+    m_maxUs.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_release);
+}
@@ -10,6 +10,7 @@ NwMediaStreamSinkBase::NwMediaStreamSinkBase(IMFMediaType* pMediaType, IMFMediaS
     , m_VideoHeaderSize(0)
     , m_bIsShutdown(false)
     , m_dwStreamID(dwStreamID)
+    , m_llSampleTime(0)
 {
     winrt::com_ptr<IMFMediaSink> spParent;
     spParent.copy_from(pParent);
@@ -130,6 +131,11 @@ STDMETHODIMP NwMediaStreamSinkBase::GetMediaTypeHandler(IMFMediaTypeHandler** pp
 STDMETHODIMP NwMediaStreamSinkBase::ProcessSample(IMFSample* pSample)
 {
     RETURN_IF_SHUTDOWN;
+    RETURN_IF_NULL(pSample);
+    if (SUCCEEDED(pSample->GetSampleTime(&m_llSampleTime)))
+    {
+        RecordLatency(NetworkStreamLatencyStage::SampleArrival, MFGetSystemTime());
+    }
     auto hr = PacketizeAndSend(pSample);
     if (SUCCEEDED(hr))
     {
@@ -139,6 +145,36 @@ STDMETHODIMP NwMediaStreamSinkBase::ProcessSample(IMFSample* pSample)
     return hr;
 }
 
+STDMETHODIMP NwMediaStreamSinkBase::GetLatencyStats(NetworkStreamLatencyStage stage, NetworkStreamLatencyStats* pStats)
+{
+    RETURN_IF_NULL(pStats);
+    if ((stage < NetworkStreamLatencyStage::SampleArrival) || (stage >= NetworkStreamLatencyStage::Count))
+    {
+        return E_INVALIDARG;
+    }
+    m_latency[(int)stage].GetStats(pStats);
+    return S_OK;
+}
+
+STDMETHODIMP NwMediaStreamSinkBase::ResetLatencyStats()
+{
+    for (auto& histogram : m_latency)
+    {
+        histogram.Reset();
+    }
+    return S_OK;
+}
+
+STDMETHODIMP NwMediaStreamSinkBase::GetTimeshiftRange(LONGLONG* phnsOldest, LONGLONG* phnsNewest, uint64_t* pAccessUnitsDropped)
+{
+    return MF_E_NOT_AVAILABLE;
+}
+
+STDMETHODIMP NwMediaStreamSinkBase::GetTimeshiftStart(LONGLONG hnsTime, LONGLONG* phnsStart)
+{
+    return MF_E_NOT_AVAILABLE;
+}
+
 STDMETHODIMP NwMediaStreamSinkBase::PlaceMarker(MFSTREAMSINK_MARKER_TYPE eMarkerType, const PROPVARIANT* pvarMarkerValue, const PROPVARIANT* pvarContextValue)
 {
     RETURN_IF_SHUTDOWN;
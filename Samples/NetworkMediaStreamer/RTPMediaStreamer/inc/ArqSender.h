@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr uint32_t arqDefaultLatencyMs = 120;                   // the SRT default
+constexpr uint32_t arqMaxLatencyMs = 2000;
+constexpr size_t arqKeySize = 16;                               // AES-128
+constexpr size_t arqSaltSize = 14;
+
+// Sender side of an SRT style reliable UDP transport for one client: the RTP packets sent during the
+// latency window are kept, and the ones the client lists as lost in RTCP generic NACKs (RFC 4585 section
+// 6.2.1) are sent again. A packet older than the window is not, the receiver has already played past it.
+// Params: latency=<ms>, and key=<32 hex digits> with an optional salt=<28 hex digits> to encrypt the
+// payloads with AES-128 in counter mode, the counter laid out as the SRTP AES-CM one (RFC 3711 section
+// 4.1.1) from the key and salt as given. The RTP header stays in the clear and there is no authentication.
+// The window and the NACKs are handled by CArqWindow, this adds the socket, the clock and the encryption.
+class CArqSender
+{
+    std::mutex m_lock;                                          // a timeshift player sends while the sink handles the NACKs
+    SOCKET m_socket;
+    sockaddr_in m_remoteAddr;
+    uint32_t m_ssrc;
+    CArqWindow m_window;                                        // packets as sent, encrypted if there is a key
+    BCRYPT_ALG_HANDLE m_hAlgorithm;
+    BCRYPT_KEY_HANDLE m_hKey;
+    BYTE m_salt[arqSaltSize];
+    uint32_t m_uRolloverCounter;                                // SRTP ROC of the sequence numbers
+    uint16_t m_uLastSequenceNumber;
+    bool m_bStarted;
+    std::vector<BYTE> m_keystream;
+
+    void Encrypt(BYTE* pPacket, size_t size);
+    bool SendStored(std::vector<BYTE> const& data);
+    static MFTIME ParseLatency(std::string const& params);
+
+public:
+    CArqSender(std::string const& params, SOCKET socket, sockaddr_in const& remoteAddr, uint32_t ssrc);
+    ~CArqSender();
+
+    bool Send(const BYTE* pPacket, size_t size);
+    // Sends again the packets of a NACK entry: pid and the bitmask of the 16 packets following it.
+    // rttUs keeps a packet from being sent again before the previous retransmission could have arrived.
+    uint32_t Retransmit(uint16_t pid, uint16_t blp, uint32_t rttUs);
+};
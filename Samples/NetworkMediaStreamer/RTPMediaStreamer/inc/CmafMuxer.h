@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr uint32_t cmafTimescale = 90000;                       // same clock as the RTP timestamps
+
+// CMAF (ISO/IEC 23000-19) muxer of an H.264 track: an init segment (ftyp + moov) once the parameter sets
+// are known, then chunks (moof + mdat) of the access units added since the last one. A CMAF fragment is the
+// chunks from one IDR up to the next chunk starting with an IDR, so the caller ends fragments by cutting at
+// an IDR; cuts in between are chunks of the same fragment, like the parts of LL-HLS. The Annex B
+// access units are stored with 4 byte NAL lengths and without their parameter sets, which are in the avcC
+// of the init segment. The decode times are the sample times: the encoders of the sample do not reorder
+// frames, so a presentation time offset is never needed.
+class CCmafMuxer
+{
+public:
+    CCmafMuxer(uint32_t width, uint32_t height);
+
+    // Annex B SPS and PPS, e.g. MF_MT_MPEG_SEQUENCE_HEADER; the first ones found in an IDR are used otherwise
+    void SetParameterSets(const uint8_t* pData, size_t size);
+    // false if the access unit was dropped because no IDR came yet
+    bool AddSample(int64_t hnsTime, int64_t hnsDuration, bool bIdr, const uint8_t* pData, size_t size);
+    // moof + mdat of the access units added since the last chunk, empty if there are none
+    std::vector<uint8_t> Chunk();
+    // styp box starting a segment, before its first chunk
+    static std::vector<uint8_t> SegmentType();
+
+    bool HasInitSegment() const { return !m_initSegment.empty(); }
+    std::vector<uint8_t> const& InitSegment() const { return m_initSegment; }
+    size_t PendingSamples() const { return m_samples.size(); }
+    bool PendingStartsWithIdr() const { return !m_samples.empty() && m_samples.front().bIdr; }
+    int64_t PendingDuration() const { return m_hnsPendingDuration; }
+
+private:
+    struct Sample
+    {
+        uint32_t duration;
+        uint32_t size;
+        bool bIdr;
+    };
+
+    void ReadParameterSets(const uint8_t* pData, size_t size);
+    void BuildInitSegment();
+
+    uint32_t m_width, m_height;
+    std::vector<uint8_t> m_sps, m_pps;
+    std::vector<uint8_t> m_initSegment;
+    std::vector<Sample> m_samples;                              // of the next chunk
+    std::vector<uint8_t> m_mdat;                                // their data, as it goes in the mdat
+    int64_t m_hnsFirstTime;                                     // sample time at decode time 0, -1 until the first sample
+    int64_t m_hnsChunkTime;                                     // of the first sample of the next chunk
+    int64_t m_hnsPendingDuration;
+    int64_t m_hnsLastDuration;
+    uint32_t m_uSequenceNumber;
+};
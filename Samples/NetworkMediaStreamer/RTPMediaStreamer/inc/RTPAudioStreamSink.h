@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr size_t auHeaderSectionSize = 4;                       // RFC 3640 AU-headers-length + one 16 bit AU-header
+constexpr uint32_t aacSamplesPerFrame = 1024;
+constexpr uint32_t adtsHeaderSize = 7;
+
+// Audio stream sink, AAC as RFC 3640 mpeg4-generic AAC-hbr and Opus as RFC 7587.
+// Timestamps come from the same presentation clock as the video stream sink of the media sink, so both
+// tracks of an RTSP session stay in sync.
+class RTPAudioStreamSink final : public RTPStreamSinkBase
+{
+    winrt::Windows::Storage::Streams::Buffer m_pTxBuf;
+    size_t m_mtuSize;
+    GUID m_subType;
+    uint32_t m_sampleRate;
+    uint32_t m_numChannels;
+    uint32_t m_aacPayloadType;                                  // MF_MT_AAC_PAYLOAD_TYPE: 0 raw, 1 ADTS
+    std::vector<BYTE> m_audioSpecificConfig;
+
+    RTPAudioStreamSink(IMFMediaType* pMT, IMFMediaSink* pParent, DWORD dwStreamID);
+    virtual ~RTPAudioStreamSink() = default;
+    STDMETHODIMP PacketizeAndSend(IMFSample* pSample) noexcept;
+    void PacketizeAAC(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime);
+    void PacketizeOpus(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime);
+    void SendAccessUnit(BYTE* pAU, size_t szAU, LONGLONG ts);
+
+public:
+    static bool IsSupported(IMFMediaType* pMediaType);
+    static INetworkMediaStreamSink* CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID);
+
+    STDMETHODIMP GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) override;
+};
@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr uint8_t simulcastLossStepDown = 26;                   // fraction lost above which a client steps down a layer, ~10%
+constexpr uint8_t simulcastLossStepUp = 5;                      // and below which it may step up, ~2%
+constexpr uint32_t simulcastRttStepDownUs = 400000;
+constexpr uint32_t simulcastRttStepUpUs = 200000;
+constexpr MFTIME simulcastStepUpHoldTime = 10 * 10000000ll;     // time on a layer before trying a better one
+
+// Track of a simulcast media sink: the same capture encoded at several qualities, layer 0 the best.
+// Every client streams one layer picked from its receiver reports and from transport backpressure, and
+// moves to another layer at an IDR of that layer so its decoder never references a frame of the layer
+// it left. The sequence numbers are per client, a switch looks like one continuous stream to it. The SDP is
+// the one of layer 0, the other layers carry their parameter sets in band with their IDRs.
+class RTPSimulcastStreamSink final : public RTPVideoStreamSink
+{
+    uint32_t m_uLayerCount;
+    uint32_t m_uSendingLayer;                                   // layer of the access unit being packetized
+
+    RTPSimulcastStreamSink(IMFMediaType* pMT, IMFMediaSink* pParent, uint32_t layerCount);
+    virtual ~RTPSimulcastStreamSink() = default;
+    STDMETHODIMP PacketizeAndSend(IMFSample* pSample) noexcept override;
+    void OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker) override;
+    void OnReceiverReport(TxContext& client) override;
+    void SelectLayer(TxContext& client, MFTIME now);
+
+public:
+    static RTPSimulcastStreamSink* CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, uint32_t layerCount);
+
+    HRESULT PacketizeLayer(uint32_t layer, IMFSample* pSample) noexcept;
+    STDMETHODIMP AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override;
+};
+
+// Input of one of the other layers of a simulcast track. The clients all belong to the track, the
+// network calls are forwarded to it.
+class RTPSimulcastLayerSink final : public NwMediaStreamSinkBase
+{
+    winrt::com_ptr<RTPSimulcastStreamSink> m_spTrack;
+    uint32_t m_uLayer;
+
+    RTPSimulcastLayerSink(IMFMediaType* pMT, IMFMediaSink* pParent, RTPSimulcastStreamSink* pTrack, uint32_t layer);
+    virtual ~RTPSimulcastLayerSink() = default;
+    STDMETHODIMP PacketizeAndSend(IMFSample* pSample) noexcept override;
+
+public:
+    static INetworkMediaStreamSink* CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, RTPSimulcastStreamSink* pTrack, uint32_t layer);
+
+    STDMETHODIMP AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override;
+    STDMETHODIMP RemoveTransportHandler(ABI::PacketHandler* packetHandler) override;
+    STDMETHODIMP AddNetworkClient(LPCWSTR destination, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override;
+    STDMETHODIMP RemoveNetworkClient(LPCWSTR destination) override;
+    STDMETHODIMP GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) override;
+    STDMETHODIMP GetNetworkClientStats(LPCWSTR destination, NetworkStreamClientStats* pStats) override;
+    STDMETHODIMP GetTransportHandlerStats(ABI::PacketHandler* packetHandler, NetworkStreamClientStats* pStats) override;
+    STDMETHODIMP ProcessRtcpPacket(const uint8_t* pPacket, size_t size) override;
+};
@@ -3,51 +3,118 @@
 
 #pragma once
 
-constexpr BYTE h264payloadType = 96;
-constexpr size_t rtpHeaderSize = 12;
-constexpr size_t stapAtypeHeaderSize = 1;
-constexpr size_t stapASzHeaderSize = 2;
+constexpr BYTE aacPayloadType = 97;
+constexpr BYTE opusPayloadType = 98;
+constexpr uint32_t opusClockRate = 48000;                       // RFC 7587: always 48KHz whatever the encoded rate
+constexpr size_t rtcpSenderReportSize = 28;
+constexpr MFTIME rtcpSenderReportInterval = 5 * 10000000ll;     // 5 seconds in 100ns units
+constexpr size_t rtcpMaxPacketSize = 1500;
+constexpr LONGLONG cmafDefaultPartDuration = 3333333;          // 1/3 second, 10 frames at 30fps
+
 class TxContext final
 {
     uint16_t m_localRTPPort, m_localRTCPPort, m_remotePort;
-    sockaddr_in m_remoteAddr;
+    sockaddr_in m_remoteAddr, m_remoteRtcpAddr;
     SOCKET m_rtpSocket, m_rtcpSocket;
     winrt::PacketHandler m_packetHandler;
+    winrt::Windows::Storage::Streams::Buffer m_rtcpBuf;
 
 public:
-    TxContext(std::string destination, winrt::PacketHandler packetHandler = nullptr);
+    TxContext(std::string destination, winrt::PacketHandler packetHandler = nullptr, bool bArq = false);
     ~TxContext();
-    void SendPacket(winrt::Windows::Storage::Streams::IBuffer buf);
+    bool SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, bool bEndOfAccessUnit);
+    void SendSenderReport(uint32_t rtpTime, uint64_t wallClockTime);
+    size_t ReceiveRtcp(BYTE* pBuf, size_t size);
+    void OnNack(uint16_t pid, uint16_t blp);
 
     uint32_t m_ssrc;
     uint64_t m_u64StartTime;
     uint32_t m_uSequenceNumber;
+    bool m_bDropAccessUnit;                 // transport handler signalled backpressure
+    uint32_t m_uAccessUnitsDropped;
+    uint32_t m_uPacketCount;                // sender report counters
+    uint32_t m_uOctetCount;
+    MFTIME m_llLastSenderReport;
+    bool m_bSampleStarted;                  // a packet of the current sample was sent
+    MFTIME m_llLastPacketTime;
+    NetworkStreamClientStats m_stats;
+    uint8_t m_fractionLost;                 // from the last receiver report, in 1/256
+    uint32_t m_uRttUs;
+    bool m_bFeedback;                       // a receiver report came since the last layer decision
+    uint32_t m_uTargetLayer;                // simulcast layer to switch to at its next IDR
+    MFTIME m_llLastLayerChange;
+    LONGLONG m_llLastSampleTime;            // sample time of the last access unit sent
+    uint32_t m_uAccessUnitsDroppedSeen;     // m_uAccessUnitsDropped at the last layer decision
+    LONGLONG m_llTimeshiftStart;            // sample time to play from, -1 for live
+    double m_scale;
+    std::unique_ptr<CTimeshiftPlayer> m_spTimeshift;    // sends to the client instead of the live path
+    std::unique_ptr<CArqSender> m_spArq;                // UDP client of the "srt" protocol
 };
 
-class RTPVideoStreamSink  final : public NwMediaStreamSinkBase
+// RTP session handling shared by the audio and video stream sinks: the list of clients, the RTP header
+// and periodic RTCP sender reports.
+class RTPStreamSinkBase : public NwMediaStreamSinkBase
 {
+protected:
     std::mutex m_guardlock;
     std::map<std::string, std::unique_ptr<TxContext>> m_rtpStreamers;
-    winrt::Windows::Storage::Streams::Buffer m_pTxBuf;
-    size_t m_mtuSize;
-    uint32_t m_packetizationMode;
     uint32_t m_uSequenceNumber;
+    BYTE m_payloadType;
+    uint32_t m_clockRate;
+    LONGLONG m_llWallClockBase;                                 // FILETIME at presentation time 0
+
+    RTPStreamSinkBase(IMFMediaType* pMT, IMFMediaSink* pParent, DWORD dwStreamID, BYTE payloadType, uint32_t clockRate);
+    virtual ~RTPStreamSinkBase() = default;
+    // bEndOfAccessUnit closes the client's write batch and ends an access unit dropped on backpressure, it is not
+    // always the marker bit: audio payloads end an access unit in every packet but the AAC fragments
+    void SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, LONGLONG ts, bool bMarker, bool bEndOfAccessUnit);
+    void SendPacketToClient(TxContext& client, winrt::Windows::Storage::Streams::IBuffer buf, uint16_t sequenceNumber, uint32_t ts, bool bMarker, bool bEndOfAccessUnit);
+    void SendSenderReports(LONGLONG hnsSampleTime);
+    void EndSample(LONGLONG hnsSampleTime);
+    HRESULT GetClientStats(std::string const& key, NetworkStreamClientStats* pStats);
+    std::unique_ptr<TxContext> ExtractClient(std::string const& key);
+    void HandleRtcp(const BYTE* pPacket, size_t size, TxContext* pSource);
+    virtual void OnReceiverReport(TxContext& client) {}
+    virtual void OnClientAdded(TxContext& client) {}
+
+public:
+    STDMETHODIMP Start(MFTIME hnsSystemTime, LONGLONG llClockStartOffset) override;
+    STDMETHODIMP AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override;
+    STDMETHODIMP AddNetworkClient(LPCWSTR destination, LPCWSTR protocol = L"rtp", LPCWSTR param = L"") override;
+    STDMETHODIMP RemoveNetworkClient(LPCWSTR destination) override;
+    STDMETHODIMP RemoveTransportHandler(ABI::PacketHandler* packetHandler) override;
+    STDMETHODIMP GetNetworkClientStats(LPCWSTR destination, NetworkStreamClientStats* pStats) override;
+    STDMETHODIMP GetTransportHandlerStats(ABI::PacketHandler* packetHandler, NetworkStreamClientStats* pStats) override;
+    STDMETHODIMP ProcessRtcpPacket(const uint8_t* pPacket, size_t size) override;
+};
+
+// Adapter of the H.264 packetizer core: hands it the sample buffers and sends the packets it emits
+class RTPVideoStreamSink : public RTPStreamSinkBase, public IRtpPacketSink
+{
+protected:
+    CH264Packetizer m_packetizer;
+    winrt::Windows::Storage::Streams::Buffer m_pTxBuf;
+    std::shared_ptr<CTimeshiftStore> m_spTimeshift;             // shared with the players of the clients
+    winrt::com_ptr<RecordingStreamSink> m_spRecorder;           // records the samples sent
+    std::map<std::string, winrt::PacketHandler> m_cmafHandlers; // get CMAF parts instead of RTP packets
+    std::unique_ptr<CCmafMuxer> m_spCmafMuxer;
+    LONGLONG m_llCmafPartDuration;
+    winrt::Windows::Storage::Streams::IBuffer m_cmafInitSegment;
     RTPVideoStreamSink(IMFMediaType* pMT, IMFMediaSink* pParent, DWORD dwStreamID);
     virtual ~RTPVideoStreamSink() = default;
-    BYTE* FindSC(BYTE* bufStart, BYTE* bufEnd);
     STDMETHODIMP PacketizeAndSend(IMFSample* pSample) noexcept;
-    void PacketizeMode0(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime);
-
-    void SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, LONGLONG ts, bool bLastNalOfFrame);
-    void PacketizeMode1(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime);
+    void OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker) override;
+    void OnClientAdded(TxContext& client) override;
+    void SendCmaf(LONGLONG hnsTime, LONGLONG hnsDuration, bool bIdr, const BYTE* pData, size_t size);
+    void SendCmafBuffer(winrt::Windows::Storage::Streams::IBuffer const& buf);
 public:
     static INetworkMediaStreamSink* CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID);
 
+    STDMETHODIMP GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) override;
+    STDMETHODIMP Stop(MFTIME hnsSystemTime) override;
+    STDMETHODIMP Shutdown() override;
     STDMETHODIMP AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override;
-    STDMETHODIMP AddNetworkClient(LPCWSTR destination, LPCWSTR protocol = L"rtp", LPCWSTR param = L"") override;
-    STDMETHODIMP RemoveNetworkClient(LPCWSTR destination) override;
     STDMETHODIMP RemoveTransportHandler(ABI::PacketHandler* packetHandler) override;
-    STDMETHODIMP GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) override;
-
+    STDMETHODIMP GetTimeshiftRange(LONGLONG* phnsOldest, LONGLONG* phnsNewest, uint64_t* pAccessUnitsDropped) override;
+    STDMETHODIMP GetTimeshiftStart(LONGLONG hnsTime, LONGLONG* phnsStart) override;
 };
-
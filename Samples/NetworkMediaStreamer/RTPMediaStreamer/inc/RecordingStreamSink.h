@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr LONGLONG recordingDefaultFragmentDuration = 10000000;         // 1 second in 100ns units
+constexpr LONGLONG recordingDefaultSegmentDuration = 60 * 10000000ll;   // 1 minute
+constexpr uint64_t recordingDefaultPreallocation = 64 * 1024 * 1024;    // per segment when the bitrate is unknown
+constexpr size_t recordingBlockSize = 4096;                             // unbuffered writes are multiples of it
+constexpr size_t recordingStagingSize = 4 * 1024 * 1024;
+constexpr size_t recordingMaxQueuedBytes = 64 * 1024 * 1024;
+
+// Stream sink recording an H.264 stream to CMAF segments: <path>_<n>.mp4, each an init segment followed by
+// fragments that end at the first IDR once they lasted MF_NETWORKSTREAM_RECORDING_FRAGMENT_DURATION, a
+// longer GOP is written in chunks of that duration. A segment starts at an IDR once the last one lasted
+// MF_NETWORKSTREAM_RECORDING_SEGMENT_DURATION. The RTP video stream sink feeds it the samples it sends, so
+// one encode serves both the clients and the recording.
+// The completed chunks are written by a thread of their own, batched through an aligned staging buffer
+// to files preallocated from the bitrate; with MF_NETWORKSTREAM_RECORDING_UNBUFFERED the files bypass the
+// system cache. A segment file is truncated to its size when it is closed.
+class RecordingStreamSink final : public NwMediaStreamSinkBase
+{
+    struct WriteRequest
+    {
+        uint32_t segment;
+        std::vector<BYTE> data;
+        bool bClose;                                            // last data of the segment
+    };
+
+    std::mutex m_lock;
+    CCmafMuxer m_muxer;
+    std::wstring m_path;
+    LONGLONG m_llFragmentDuration;
+    LONGLONG m_llSegmentDuration;
+    uint64_t m_preallocation;
+    bool m_bUnbuffered;
+    uint32_t m_uSegment;                                        // 0 while no segment is open
+    uint32_t m_uSegmentCount;
+    LONGLONG m_llSegmentStart;
+    LONGLONG m_llFragmentStart;                                 // time of the IDR starting the current fragment
+
+    std::mutex m_queueLock;
+    std::condition_variable m_queued;
+    std::deque<WriteRequest> m_queue;
+    size_t m_queuedBytes;
+    bool m_bStop;
+    std::atomic<uint64_t> m_uFragmentsDropped;
+    std::atomic<HRESULT> m_hrWrite;                             // first write error, the recording stops at it
+    std::thread m_writer;
+
+    // writer thread state
+    winrt::file_handle m_file;
+    uint32_t m_uFileSegment;
+    uint64_t m_fileSize;                                        // bytes of the segment, written or staged
+    BYTE* m_pStaging;
+    size_t m_stagedBytes;
+
+    RecordingStreamSink(IMFMediaType* pMT, IMFMediaSink* pParent, DWORD dwStreamID);
+    virtual ~RecordingStreamSink();
+    STDMETHODIMP PacketizeAndSend(IMFSample* pSample) noexcept override;
+    void Queue(std::vector<BYTE>&& data, bool bClose, bool bDroppable);
+    void CloseSegment();
+    void WriterThread();
+    void Write(WriteRequest const& request);
+    void WriteStaged(bool bFlush);
+    void CloseFile();
+
+public:
+    static RecordingStreamSink* CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID);
+
+    HRESULT WriteAccessUnit(LONGLONG hnsTime, LONGLONG hnsDuration, bool bIdr, const BYTE* pData, size_t size) noexcept;
+    uint64_t FragmentsDropped() const { return m_uFragmentsDropped.load(std::memory_order_relaxed); }
+
+    STDMETHODIMP Stop(MFTIME hnsSystemTime) override;
+    STDMETHODIMP Shutdown() override;
+
+    // a recording has no network clients
+    STDMETHODIMP AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override { return E_NOTIMPL; }
+    STDMETHODIMP RemoveTransportHandler(ABI::PacketHandler* packetHandler) override { return E_NOTIMPL; }
+    STDMETHODIMP AddNetworkClient(LPCWSTR destination, LPCWSTR protocol = L"rtp", LPCWSTR params = L"") override { return E_NOTIMPL; }
+    STDMETHODIMP RemoveNetworkClient(LPCWSTR destination) override { return E_NOTIMPL; }
+    STDMETHODIMP GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) override { return E_NOTIMPL; }
+    STDMETHODIMP GetNetworkClientStats(LPCWSTR destination, NetworkStreamClientStats* pStats) override { return E_NOTIMPL; }
+    STDMETHODIMP GetTransportHandlerStats(ABI::PacketHandler* packetHandler, NetworkStreamClientStats* pStats) override { return E_NOTIMPL; }
+    STDMETHODIMP ProcessRtcpPacket(const uint8_t* pPacket, size_t size) override { return E_NOTIMPL; }
+};
@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr uint64_t timeshiftDefaultSize = 600ull * 1024 * 1024;         // ~10 minutes at 8Mbit/s
+constexpr size_t timeshiftMaxQueuedBytes = 16 * 1024 * 1024;            // access units waiting for the disk
+
+class TxContext;
+
+struct TimeshiftAccessUnit
+{
+    LONGLONG hnsTime;
+    bool bIdr;
+    std::vector<BYTE> data;
+};
+
+// Timeshift store of the access units of a stream: a preallocated file mapped in memory, written as a ring
+// of records that never wrap, with a sparse index of the IDRs by time. Positions are logical byte offsets
+// that only grow, the record at a position is still there while position >= write position - size.
+// The live path only queues a copy of the access unit, a writer thread copies it to the file, so a slow
+// disk drops access units (until the next IDR) instead of delaying the stream.
+class CTimeshiftStore
+{
+public:
+    enum class ReadResult
+    {
+        Ok,
+        Pending,                                                        // nothing written at the position yet
+        Overwritten                                                     // the reader fell more than the store size behind
+    };
+
+    CTimeshiftStore(std::wstring const& path, uint64_t size);
+    ~CTimeshiftStore();
+    CTimeshiftStore(CTimeshiftStore const&) = delete;
+    CTimeshiftStore& operator=(CTimeshiftStore const&) = delete;
+
+    void Append(LONGLONG hnsTime, bool bIdr, const BYTE* pData, size_t size);
+    bool Seek(LONGLONG hnsTime, uint64_t& position, LONGLONG& hnsIdrTime);
+    ReadResult Read(uint64_t& position, TimeshiftAccessUnit& au);
+    void WaitForData(uint64_t position, std::chrono::milliseconds timeout);
+    bool GetRange(LONGLONG& hnsOldest, LONGLONG& hnsNewest);
+    uint64_t AccessUnitsDropped() const { return m_uDropped.load(std::memory_order_relaxed); }
+
+private:
+    struct RecordHeader
+    {
+        uint32_t size;                                                  // of the data, 0 pads to the end of the file
+        uint32_t flags;
+        int64_t hnsTime;
+    };
+    static constexpr uint32_t recordIdr = 1;
+
+    struct IndexEntry
+    {
+        LONGLONG hnsTime;
+        uint64_t position;
+    };
+
+    void WriterThread();
+    void Write(TimeshiftAccessUnit const& au);
+    void ExpireIndex();
+
+    winrt::file_handle m_file;
+    winrt::handle m_mapping;
+    BYTE* m_pView;
+    uint64_t m_size;
+
+    std::mutex m_indexLock;
+    std::condition_variable m_written;
+    std::deque<IndexEntry> m_index;                                     // IDRs, by time and position
+    LONGLONG m_llNewestTime;
+    std::atomic<uint64_t> m_writePosition;                              // end of the last record written
+    std::atomic<uint64_t> m_reservedPosition;                           // end of the record being written
+
+    std::mutex m_queueLock;
+    std::condition_variable m_queued;
+    std::deque<TimeshiftAccessUnit> m_queue;
+    size_t m_queuedBytes;
+    bool m_bDropUntilIdr;
+    bool m_bStop;
+    std::atomic<uint64_t> m_uDropped;
+    std::thread m_writer;
+};
+
+// Sends a stream from the timeshift store to one client, from the IDR at or before the start time, at the
+// pace of the sample times divided by the scale. The RTP timestamps are scaled the same way, so the client
+// sees a normal stream that runs faster or slower. Once it catches up with the live edge it stays just
+// behind it. It sends under clientLock, the lock of the sink that guards the state of its clients, which
+// must not be held while the player is destroyed.
+class CTimeshiftPlayer : public IRtpPacketSink
+{
+public:
+    CTimeshiftPlayer(std::shared_ptr<CTimeshiftStore> spStore, TxContext& client, std::mutex& clientLock, CH264Packetizer const& packetizer,
+        BYTE payloadType, uint32_t clockRate, LONGLONG hnsStart, double scale);
+    ~CTimeshiftPlayer();
+
+private:
+    void PlayerThread();
+    bool WaitUntil(std::chrono::steady_clock::time_point time);
+    void OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker) override;
+
+    std::shared_ptr<CTimeshiftStore> m_spStore;
+    TxContext& m_client;
+    std::mutex& m_clientLock;
+    CH264Packetizer m_packetizer;
+    winrt::Windows::Storage::Streams::Buffer m_pTxBuf;
+    BYTE m_payloadType;
+    uint32_t m_clockRate;
+    LONGLONG m_llStart;
+    double m_scale;
+    std::mutex m_lock;
+    std::condition_variable m_stopped;
+    bool m_bStop;
+    std::thread m_player;
+};
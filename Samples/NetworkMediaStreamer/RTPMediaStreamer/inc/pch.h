@@ -5,7 +5,19 @@
 #include <mferror.h>
 #include <ws2tcpip.h>
 #include <mfidl.h>
+#include <mfapi.h>
+#include <mmreg.h>
+#include <bcrypt.h>
 #include<mutex>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <charconv>
 #include <windows.foundation.h>
 #include <windows.Storage.streams.h>
 #include <winrt\base.h>
@@ -14,6 +26,15 @@
 #include <winrt\Windows.Media.h>
 #include <winrt\Windows.Foundation.h>
 #include "NetworkMediaStreamer.h"
+#include "LatencyHistogram.h"
 #include "NwMediaStreamSinkBase.h"
 #include "RTPMediaStreamer.h"
-#include "RTPStreamSink.h"
\ No newline at end of file
+#include "H264Packetizer.h"
+#include "ArqWindow.h"
+#include "ArqSender.h"
+#include "TimeshiftStore.h"
+#include "CmafMuxer.h"
+#include "RecordingStreamSink.h"
+#include "RTPStreamSink.h"
+#include "RTPAudioStreamSink.h"
+#include "RTPSimulcastStreamSink.h"
\ No newline at end of file
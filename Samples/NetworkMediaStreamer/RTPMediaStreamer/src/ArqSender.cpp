@@ -0,0 +1,157 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+namespace
+{
+    // value of name=<value> in params, empty if it is missing
+    std::string Param(std::string const& params, std::string const& name)
+    {
+        auto pos = params.find(name + "=");
+        if (pos == std::string::npos)
+        {
+            return std::string();
+        }
+        pos += name.size() + 1;
+        return params.substr(pos, params.find('&', pos) - pos);
+    }
+
+    void ParseHex(std::string const& hex, BYTE* pOut, size_t size)
+    {
+        if (hex.size() != size * 2)
+        {
+            winrt::throw_hresult(E_INVALIDARG);
+        }
+        for (size_t i = 0; i < size; i++)
+        {
+            pOut[i] = (BYTE)std::stoul(hex.substr(i * 2, 2), nullptr, 16);
+        }
+    }
+}
+
+CArqSender::CArqSender(std::string const& params, SOCKET socket, sockaddr_in const& remoteAddr, uint32_t ssrc)
+    : m_socket(socket)
+    , m_remoteAddr(remoteAddr)
+    , m_ssrc(ssrc)
+    , m_window(ParseLatency(params))
+    , m_hAlgorithm(nullptr)
+    , m_hKey(nullptr)
+    , m_salt{ 0 }
+    , m_uRolloverCounter(0)
+    , m_uLastSequenceNumber(0)
+    , m_bStarted(false)
+{
+    auto key = Param(params, "key");
+    if (!key.empty())
+    {
+        BYTE keyBytes[arqKeySize];
+        ParseHex(key, keyBytes, sizeof(keyBytes));
+        auto salt = Param(params, "salt");
+        if (!salt.empty())
+        {
+            ParseHex(salt, m_salt, sizeof(m_salt));
+        }
+        // counter mode is ECB encryption of the counter blocks, done for a whole packet at once
+        winrt::check_nt(BCryptOpenAlgorithmProvider(&m_hAlgorithm, BCRYPT_AES_ALGORITHM, nullptr, 0));
+        try
+        {
+            winrt::check_nt(BCryptSetProperty(m_hAlgorithm, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_ECB, sizeof(BCRYPT_CHAIN_MODE_ECB), 0));
+            winrt::check_nt(BCryptGenerateSymmetricKey(m_hAlgorithm, &m_hKey, nullptr, 0, keyBytes, sizeof(keyBytes), 0));
+        }
+        catch (...)
+        {
+            BCryptCloseAlgorithmProvider(m_hAlgorithm, 0);
+            throw;
+        }
+        SecureZeroMemory(keyBytes, sizeof(keyBytes));
+    }
+}
+
+CArqSender::~CArqSender()
+{
+    if (m_hKey)
+    {
+        BCryptDestroyKey(m_hKey);
+    }
+    if (m_hAlgorithm)
+    {
+        BCryptCloseAlgorithmProvider(m_hAlgorithm, 0);
+    }
+}
+
+MFTIME CArqSender::ParseLatency(std::string const& params)
+{
+    auto latency = Param(params, "latency");
+    return (MFTIME)(latency.empty() ? arqDefaultLatencyMs : std::min((uint32_t)std::stoul(latency), arqMaxLatencyMs)) * 10000;
+}
+
+// Keeps a copy of the packet, encrypted if there is a key, and sends it. The packet buffer is shared with
+// the other clients, so it is left as it is.
+bool CArqSender::Send(const BYTE* pPacket, size_t size)
+{
+    auto lock = std::lock_guard(m_lock);
+    uint16_t sequenceNumber = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+    if (m_bStarted && (sequenceNumber < m_uLastSequenceNumber) && ((m_uLastSequenceNumber - sequenceNumber) > 0x8000))
+    {
+        m_uRolloverCounter++;
+    }
+    m_uLastSequenceNumber = sequenceNumber;
+    m_bStarted = true;
+
+    auto& packet = m_window.Store(pPacket, size, MFGetSystemTime());
+    if (m_hKey)
+    {
+        Encrypt(packet.data.data(), size);
+    }
+    return SendStored(packet.data);
+}
+
+uint32_t CArqSender::Retransmit(uint16_t pid, uint16_t blp, uint32_t rttUs)
+{
+    auto lock = std::lock_guard(m_lock);
+    return m_window.Retransmit(pid, blp, rttUs, MFGetSystemTime(), [this](std::vector<BYTE> const& data) { return SendStored(data); });
+}
+
+bool CArqSender::SendStored(std::vector<BYTE> const& data)
+{
+    return sendto(m_socket, (const char*)data.data(), (int)data.size(), 0, (SOCKADDR*)&m_remoteAddr, sizeof(m_remoteAddr)) != SOCKET_ERROR;
+}
+
+// AES-CM of RFC 3711 section 4.1.1: the counter block of the packet is (salt << 16) ^ (SSRC << 64) ^
+// (index << 16) with the 48 bit index ROC || sequence number, plus the block number in the low 16 bits
+void CArqSender::Encrypt(BYTE* pPacket, size_t size)
+{
+    if (size <= rtpHeaderSize)
+    {
+        return;
+    }
+    auto pPayload = pPacket + rtpHeaderSize;
+    size_t payloadSize = size - rtpHeaderSize;
+    size_t blocks = (payloadSize + 15) / 16;
+
+    BYTE iv[16] = { 0 };
+    memcpy(iv, m_salt, arqSaltSize);
+    uint64_t index = ((uint64_t)m_uRolloverCounter << 16) | m_uLastSequenceNumber;
+    for (int i = 0; i < 4; i++)
+    {
+        iv[4 + i] ^= (BYTE)(m_ssrc >> (24 - 8 * i));
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        iv[8 + i] ^= (BYTE)(index >> (40 - 8 * i));
+    }
+    m_keystream.resize(blocks * 16);
+    for (size_t j = 0; j < blocks; j++)
+    {
+        memcpy(&m_keystream[j * 16], iv, 16);
+        m_keystream[j * 16 + 14] = (BYTE)(j >> 8);
+        m_keystream[j * 16 + 15] = (BYTE)j;
+    }
+    ULONG written = 0;
+    winrt::check_nt(BCryptEncrypt(m_hKey, m_keystream.data(), (ULONG)m_keystream.size(), nullptr, nullptr, 0, m_keystream.data(), (ULONG)m_keystream.size(), &written, 0));
+    for (size_t i = 0; i < payloadSize; i++)
+    {
+        pPayload[i] ^= m_keystream[i];
+    }
+}
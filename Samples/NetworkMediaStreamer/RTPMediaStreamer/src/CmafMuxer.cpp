@@ -0,0 +1,339 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+namespace
+{
+    constexpr uint8_t nalTypeSps = 7;
+    constexpr uint8_t nalTypePps = 8;
+    constexpr uint8_t nalTypeAud = 9;
+    constexpr uint32_t sampleFlagsSync = 0x02000000;            // depends on no other sample
+    constexpr uint32_t sampleFlagsNonSync = 0x01010000;         // depends on others, is not a sync sample
+    constexpr uint32_t trackId = 1;
+
+    // Big endian writer of ISO BMFF boxes, the size of a box is filled in when it ends
+    class CBoxWriter
+    {
+    public:
+        CBoxWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        void U8(uint8_t v) { m_out.push_back(v); }
+        void U16(uint16_t v) { U8((uint8_t)(v >> 8)); U8((uint8_t)v); }
+        void U32(uint32_t v) { U16((uint16_t)(v >> 16)); U16((uint16_t)v); }
+        void U64(uint64_t v) { U32((uint32_t)(v >> 32)); U32((uint32_t)v); }
+        void Zeros(size_t count) { m_out.insert(m_out.end(), count, 0); }
+        void Bytes(const uint8_t* p, size_t size) { m_out.insert(m_out.end(), p, p + size); }
+        void FourCC(const char* type) { Bytes((const uint8_t*)type, 4); }
+        void Matrix()
+        {
+            const uint32_t unity[] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+            for (auto v : unity)
+            {
+                U32(v);
+            }
+        }
+
+        size_t Begin(const char* type)
+        {
+            auto start = m_out.size();
+            U32(0);
+            FourCC(type);
+            return start;
+        }
+        size_t BeginFull(const char* type, uint8_t version, uint32_t flags)
+        {
+            auto start = Begin(type);
+            U32(((uint32_t)version << 24) | flags);
+            return start;
+        }
+        void End(size_t start) { Patch32(start, (uint32_t)(m_out.size() - start)); }
+        void Patch32(size_t offset, uint32_t v)
+        {
+            m_out[offset] = (uint8_t)(v >> 24);
+            m_out[offset + 1] = (uint8_t)(v >> 16);
+            m_out[offset + 2] = (uint8_t)(v >> 8);
+            m_out[offset + 3] = (uint8_t)v;
+        }
+        size_t Size() const { return m_out.size(); }
+
+    private:
+        std::vector<uint8_t>& m_out;
+    };
+
+    // Calls f(pNal, size) for each NAL unit of an Annex B buffer
+    template <typename F>
+    void ForEachNal(const uint8_t* pData, size_t size, F f)
+    {
+        auto end = pData + size;
+        auto sc = CH264Packetizer::FindStartCode(pData, end);
+        while (sc < end)
+        {
+            while ((sc < end) && !(*sc++));
+            auto sc1 = CH264Packetizer::FindStartCode(sc, end);
+            if (sc1 > sc)
+            {
+                f(sc, (size_t)(sc1 - sc));
+            }
+            sc = sc1;
+        }
+    }
+}
+
+CCmafMuxer::CCmafMuxer(uint32_t width, uint32_t height)
+    : m_width(width)
+    , m_height(height)
+    , m_hnsFirstTime(-1)
+    , m_hnsChunkTime(0)
+    , m_hnsPendingDuration(0)
+    , m_hnsLastDuration(0)
+    , m_uSequenceNumber(1)
+{
+}
+
+void CCmafMuxer::SetParameterSets(const uint8_t* pData, size_t size)
+{
+    ReadParameterSets(pData, size);
+}
+
+void CCmafMuxer::ReadParameterSets(const uint8_t* pData, size_t size)
+{
+    ForEachNal(pData, size, [this](const uint8_t* pNal, size_t nalSize)
+        {
+            auto type = pNal[0] & 0x1F;
+            if ((type == nalTypeSps) && m_sps.empty() && (nalSize >= 4))
+            {
+                m_sps.assign(pNal, pNal + nalSize);
+            }
+            else if ((type == nalTypePps) && m_pps.empty())
+            {
+                m_pps.assign(pNal, pNal + nalSize);
+            }
+        });
+    if (m_initSegment.empty() && !m_sps.empty() && !m_pps.empty())
+    {
+        BuildInitSegment();
+    }
+}
+
+bool CCmafMuxer::AddSample(int64_t hnsTime, int64_t hnsDuration, bool bIdr, const uint8_t* pData, size_t size)
+{
+    if (bIdr && m_initSegment.empty())
+    {
+        ReadParameterSets(pData, size);
+    }
+    // the track starts with an IDR
+    if (m_initSegment.empty() || ((m_hnsFirstTime < 0) && !bIdr))
+    {
+        return false;
+    }
+    if (m_hnsFirstTime < 0)
+    {
+        m_hnsFirstTime = hnsTime;
+    }
+    if (m_samples.empty())
+    {
+        m_hnsChunkTime = hnsTime;
+    }
+    hnsDuration = (hnsDuration > 0) ? hnsDuration : m_hnsLastDuration;
+    m_hnsLastDuration = hnsDuration;
+
+    Sample sample = { (uint32_t)HnsToRtpTime(hnsDuration, cmafTimescale), 0, bIdr };
+    auto start = m_mdat.size();
+    ForEachNal(pData, size, [this](const uint8_t* pNal, size_t nalSize)
+        {
+            auto type = pNal[0] & 0x1F;
+            if ((type != nalTypeSps) && (type != nalTypePps) && (type != nalTypeAud))
+            {
+                CBoxWriter w(m_mdat);
+                w.U32((uint32_t)nalSize);
+                w.Bytes(pNal, nalSize);
+            }
+        });
+    sample.size = (uint32_t)(m_mdat.size() - start);
+    m_samples.push_back(sample);
+    m_hnsPendingDuration += hnsDuration;
+    return true;
+}
+
+std::vector<uint8_t> CCmafMuxer::Chunk()
+{
+    std::vector<uint8_t> chunk;
+    if (m_samples.empty())
+    {
+        return chunk;
+    }
+    chunk.reserve(m_mdat.size() + 128 + m_samples.size() * 12);
+    CBoxWriter w(chunk);
+    auto moof = w.Begin("moof");
+    auto mfhd = w.BeginFull("mfhd", 0, 0);
+    w.U32(m_uSequenceNumber++);
+    w.End(mfhd);
+    auto traf = w.Begin("traf");
+    auto tfhd = w.BeginFull("tfhd", 0, 0x020000);               // default-base-is-moof
+    w.U32(trackId);
+    w.End(tfhd);
+    auto tfdt = w.BeginFull("tfdt", 1, 0);
+    w.U64((uint64_t)(((m_hnsChunkTime - m_hnsFirstTime) * cmafTimescale) / 10000000));
+    w.End(tfdt);
+    auto trun = w.BeginFull("trun", 0, 0x000701);               // data offset, sample durations, sizes and flags
+    w.U32((uint32_t)m_samples.size());
+    auto dataOffset = w.Size();
+    w.U32(0);
+    for (auto& sample : m_samples)
+    {
+        w.U32(sample.duration);
+        w.U32(sample.size);
+        w.U32(sample.bIdr ? sampleFlagsSync : sampleFlagsNonSync);
+    }
+    w.End(trun);
+    w.End(traf);
+    w.End(moof);
+    w.Patch32(dataOffset, (uint32_t)(w.Size() + 8));            // from the moof to the data in the mdat
+    w.U32((uint32_t)(m_mdat.size() + 8));
+    w.FourCC("mdat");
+    w.Bytes(m_mdat.data(), m_mdat.size());
+
+    m_samples.clear();
+    m_mdat.clear();
+    m_hnsPendingDuration = 0;
+    return chunk;
+}
+
+std::vector<uint8_t> CCmafMuxer::SegmentType()
+{
+    std::vector<uint8_t> styp;
+    CBoxWriter w(styp);
+    auto box = w.Begin("styp");
+    w.FourCC("cmfs");
+    w.U32(0);
+    w.FourCC("cmfs");
+    w.FourCC("msdh");
+    w.End(box);
+    return styp;
+}
+
+void CCmafMuxer::BuildInitSegment()
+{
+    CBoxWriter w(m_initSegment);
+    auto ftyp = w.Begin("ftyp");
+    w.FourCC("cmfc");
+    w.U32(0);
+    w.FourCC("cmfc");
+    w.FourCC("iso6");
+    w.FourCC("mp41");
+    w.End(ftyp);
+
+    auto moov = w.Begin("moov");
+    auto mvhd = w.BeginFull("mvhd", 0, 0);
+    w.U32(0);                                                   // creation and modification times
+    w.U32(0);
+    w.U32(1000);
+    w.U32(0);                                                   // duration, in the chunks
+    w.U32(0x00010000);                                          // rate 1.0
+    w.U16(0x0100);                                              // volume 1.0
+    w.Zeros(10);
+    w.Matrix();
+    w.Zeros(24);
+    w.U32(trackId + 1);
+    w.End(mvhd);
+
+    auto trak = w.Begin("trak");
+    auto tkhd = w.BeginFull("tkhd", 0, 3);                      // enabled, in movie
+    w.U32(0);
+    w.U32(0);
+    w.U32(trackId);
+    w.U32(0);
+    w.U32(0);
+    w.Zeros(16);                                                // reserved, layer, alternate group, volume, reserved
+    w.Matrix();
+    w.U32(m_width << 16);
+    w.U32(m_height << 16);
+    w.End(tkhd);
+
+    auto mdia = w.Begin("mdia");
+    auto mdhd = w.BeginFull("mdhd", 0, 0);
+    w.U32(0);
+    w.U32(0);
+    w.U32(cmafTimescale);
+    w.U32(0);
+    w.U16(0x55C4);                                              // "und"
+    w.U16(0);
+    w.End(mdhd);
+    auto hdlr = w.BeginFull("hdlr", 0, 0);
+    w.U32(0);
+    w.FourCC("vide");
+    w.Zeros(12);
+    w.Bytes((const uint8_t*)"VideoHandler", 13);
+    w.End(hdlr);
+
+    auto minf = w.Begin("minf");
+    auto vmhd = w.BeginFull("vmhd", 0, 1);
+    w.Zeros(8);
+    w.End(vmhd);
+    auto dinf = w.Begin("dinf");
+    auto dref = w.BeginFull("dref", 0, 0);
+    w.U32(1);
+    auto url = w.BeginFull("url ", 0, 1);                       // media in the same file
+    w.End(url);
+    w.End(dref);
+    w.End(dinf);
+
+    auto stbl = w.Begin("stbl");
+    auto stsd = w.BeginFull("stsd", 0, 0);
+    w.U32(1);
+    auto avc1 = w.Begin("avc1");
+    w.Zeros(6);
+    w.U16(1);                                                   // data reference index
+    w.Zeros(16);
+    w.U16((uint16_t)m_width);
+    w.U16((uint16_t)m_height);
+    w.U32(0x00480000);                                          // 72 dpi
+    w.U32(0x00480000);
+    w.U32(0);
+    w.U16(1);                                                   // frame count
+    w.Zeros(32);                                                // compressor name
+    w.U16(0x0018);
+    w.U16(0xFFFF);
+    auto avcC = w.Begin("avcC");
+    w.U8(1);
+    w.U8(m_sps[1]);                                             // profile, compatibility and level
+    w.U8(m_sps[2]);
+    w.U8(m_sps[3]);
+    w.U8(0xFF);                                                 // 4 byte NAL lengths
+    w.U8(0xE1);                                                 // one SPS
+    w.U16((uint16_t)m_sps.size());
+    w.Bytes(m_sps.data(), m_sps.size());
+    w.U8(1);
+    w.U16((uint16_t)m_pps.size());
+    w.Bytes(m_pps.data(), m_pps.size());
+    w.End(avcC);
+    w.End(avc1);
+    w.End(stsd);
+    // the sample tables are empty, the samples are in the chunks
+    for (auto type : { "stts", "stsc", "stco" })
+    {
+        auto box = w.BeginFull(type, 0, 0);
+        w.U32(0);
+        w.End(box);
+    }
+    auto stsz = w.BeginFull("stsz", 0, 0);
+    w.U32(0);
+    w.U32(0);
+    w.End(stsz);
+    w.End(stbl);
+    w.End(minf);
+    w.End(mdia);
+    w.End(trak);
+
+    auto mvex = w.Begin("mvex");
+    auto trex = w.BeginFull("trex", 0, 0);
+    w.U32(trackId);
+    w.U32(1);                                                   // sample description index
+    w.U32(0);
+    w.U32(0);
+    w.U32(0);
+    w.End(trex);
+    w.End(mvex);
+    w.End(moov);
+}
@@ -0,0 +1,216 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+RTPAudioStreamSink::RTPAudioStreamSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
+    : RTPStreamSinkBase(pMediaType, pParent, dwStreamID, aacPayloadType, 0)
+    , m_mtuSize(1500)
+    , m_pTxBuf(nullptr)
+    , m_subType(GUID_NULL)
+    , m_sampleRate(0)
+    , m_numChannels(0)
+    , m_aacPayloadType(0)
+{
+    winrt::check_hresult(pMediaType->GetGUID(MF_MT_SUBTYPE, &m_subType));
+    winrt::check_hresult(pMediaType->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &m_sampleRate));
+    winrt::check_hresult(pMediaType->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &m_numChannels));
+
+    if (m_subType == MFAudioFormat_Opus)
+    {
+        m_payloadType = opusPayloadType;
+        m_clockRate = opusClockRate;
+    }
+    else
+    {
+        m_payloadType = aacPayloadType;
+        m_clockRate = m_sampleRate;
+        m_aacPayloadType = MFGetAttributeUINT32(pMediaType, MF_MT_AAC_PAYLOAD_TYPE, 0);
+
+        // MF_MT_USER_DATA is the part of HEAACWAVEINFO after the WAVEFORMATEX followed by the AudioSpecificConfig
+        constexpr UINT32 heaacInfoSize = sizeof(HEAACWAVEINFO) - sizeof(WAVEFORMATEX);
+        UINT32 cbUserData = 0;
+        if (SUCCEEDED(pMediaType->GetBlobSize(MF_MT_USER_DATA, &cbUserData)) && (cbUserData > heaacInfoSize))
+        {
+            std::vector<BYTE> userData(cbUserData);
+            winrt::check_hresult(pMediaType->GetBlob(MF_MT_USER_DATA, userData.data(), cbUserData, nullptr));
+            m_audioSpecificConfig.assign(userData.begin() + heaacInfoSize, userData.end());
+        }
+        else
+        {
+            // AAC-LC AudioSpecificConfig: 5 bits object type, 4 bits frequency index, 4 bits channel configuration
+            constexpr uint32_t frequencies[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+            auto it = std::find(std::begin(frequencies), std::end(frequencies), m_sampleRate);
+            if (it == std::end(frequencies))
+            {
+                winrt::check_hresult(MF_E_INVALIDMEDIATYPE);
+            }
+            BYTE freqIdx = (BYTE)(it - std::begin(frequencies));
+            constexpr BYTE aacLC = 2;
+            m_audioSpecificConfig = { (BYTE)((aacLC << 3) | (freqIdx >> 1)), (BYTE)(((freqIdx & 1) << 7) | ((m_numChannels & 0xF) << 3)) };
+        }
+    }
+    m_pTxBuf = winrt::Windows::Storage::Streams::Buffer((uint32_t)m_mtuSize);
+}
+
+bool RTPAudioStreamSink::IsSupported(IMFMediaType* pMediaType)
+{
+    GUID subType = GUID_NULL;
+    if (FAILED(pMediaType->GetGUID(MF_MT_SUBTYPE, &subType)))
+    {
+        return false;
+    }
+    if (subType == MFAudioFormat_AAC)
+    {
+        // raw or ADTS framed AAC
+        return MFGetAttributeUINT32(pMediaType, MF_MT_AAC_PAYLOAD_TYPE, 0) <= 1;
+    }
+    return (subType == MFAudioFormat_Opus);
+}
+
+// One AU per packet, larger AUs are fragmented with the marker bit on the last fragment (RFC 3640 section 3.2.3)
+void RTPAudioStreamSink::SendAccessUnit(BYTE* pAU, size_t szAU, LONGLONG ts)
+{
+    BYTE* pOut = m_pTxBuf.data();
+    size_t maxPayload = m_mtuSize - rtpHeaderSize - auHeaderSectionSize;
+    size_t offset = 0;
+    do
+    {
+        auto szToSend = __min(szAU - offset, maxPayload);
+        auto pHdr = &pOut[rtpHeaderSize];
+        pHdr[0] = 0;                                            // AU-headers-length in bits
+        pHdr[1] = 16;
+        pHdr[2] = (BYTE)(szAU >> 5);                            // 13 bit AU-size of the whole AU, 3 bit AU-index 0
+        pHdr[3] = (BYTE)((szAU & 0x1F) << 3);
+        memcpy(&pOut[rtpHeaderSize + auHeaderSectionSize], pAU + offset, szToSend);
+        m_pTxBuf.Length((uint32_t)(rtpHeaderSize + auHeaderSectionSize + szToSend));
+        offset += szToSend;
+        SendPacket(m_pTxBuf, ts, offset == szAU, offset == szAU);
+    } while (offset < szAU);
+}
+
+void RTPAudioStreamSink::PacketizeAAC(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime)
+{
+    if (m_aacPayloadType == 0)
+    {
+        SendAccessUnit(bufIn, szIn, llSampleTime);
+        return;
+    }
+
+    // ADTS: strip the header of each frame, a sample can carry several frames
+    auto pEnd = bufIn + szIn;
+    auto ts = llSampleTime;
+    while ((size_t)(pEnd - bufIn) > adtsHeaderSize)
+    {
+        if ((bufIn[0] != 0xFF) || ((bufIn[1] & 0xF0) != 0xF0))
+        {
+            break;
+        }
+        size_t headerSize = (bufIn[1] & 0x01) ? adtsHeaderSize : adtsHeaderSize + 2;   // protection_absent
+        size_t frameSize = ((bufIn[3] & 0x03) << 11) | (bufIn[4] << 3) | (bufIn[5] >> 5);
+        if ((frameSize <= headerSize) || (frameSize > (size_t)(pEnd - bufIn)))
+        {
+            break;
+        }
+        SendAccessUnit(bufIn + headerSize, frameSize - headerSize, ts);
+        bufIn += frameSize;
+        ts += aacSamplesPerFrame;
+    }
+}
+
+// RFC 7587: one Opus packet per RTP packet, the marker bit is not used but each packet is a whole access unit
+void RTPAudioStreamSink::PacketizeOpus(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime)
+{
+    if ((szIn + rtpHeaderSize) > m_pTxBuf.Capacity())
+    {
+        m_pTxBuf = winrt::Windows::Storage::Streams::Buffer((uint32_t)(szIn + rtpHeaderSize));
+    }
+    memcpy(&m_pTxBuf.data()[rtpHeaderSize], bufIn, szIn);
+    m_pTxBuf.Length((uint32_t)(szIn + rtpHeaderSize));
+    SendPacket(m_pTxBuf, llSampleTime, false, true);
+}
+
+STDMETHODIMP RTPAudioStreamSink::GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) try
+{
+    auto destination = winrt::to_string(dest);
+    auto sep = destination.find(":");
+    auto destIP = destination.substr(0, sep);
+    auto destPort = destination.substr(sep + 1, destination.find("?") - sep);
+    auto pt = std::to_string(m_payloadType);
+    std::string sdp =
+        "v=0\n"
+        "o=- " + std::to_string(rand()) + " 0 IN IP4 127.0.0.1\n"
+        "s=MSFT VideoStreamer\n"
+        "c=IN IP4 " + destIP + "\n"
+        "t=0 0\n"
+        "m=audio " + destPort + " RTP/AVP " + pt + "\n";
+    if (m_subType == MFAudioFormat_Opus)
+    {
+        sdp += "a=rtpmap:" + pt + " opus/48000/2\n"
+            "a=fmtp:" + pt + " sprop-stereo=" + std::to_string(m_numChannels > 1 ? 1 : 0) + "\n";
+    }
+    else
+    {
+        winrt::Windows::Storage::Streams::Buffer config((uint32_t)m_audioSpecificConfig.size());
+        memcpy(config.data(), m_audioSpecificConfig.data(), m_audioSpecificConfig.size());
+        config.Length((uint32_t)m_audioSpecificConfig.size());
+        sdp += "a=rtpmap:" + pt + " mpeg4-generic/" + std::to_string(m_sampleRate) + "/" + std::to_string(m_numChannels) + "\n"
+            "a=fmtp:" + pt + " streamtype=5; profile-level-id=1; mode=AAC-hbr; sizelength=13; indexlength=3; indexdeltalength=3; config="
+            + winrt::to_string(winrt::Windows::Security::Cryptography::CryptographicBuffer::EncodeToHexString(config)) + "\n";
+    }
+    if (sdp.size() >= maxSize)
+    {
+        winrt::check_hresult(MF_E_BUFFERTOOSMALL);
+    }
+    winrt::check_win32(memcpy_s(buf, maxSize, sdp.c_str(), sdp.size()));
+    buf[sdp.size()] = 0;
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTPAudioStreamSink::PacketizeAndSend(IMFSample* pSample) noexcept
+{
+    auto lock = std::lock_guard(m_guardlock);
+    winrt::com_ptr<IMFMediaBuffer> spMediaBuf;
+    LONGLONG llSampleTime;
+    DWORD dwSampleSize, maxLen;
+    BYTE* pSampleBuffer = nullptr;
+    HRESULT hr = S_OK;
+    try
+    {
+        winrt::check_pointer(pSample);
+        winrt::check_hresult(pSample->GetBufferByIndex(0, spMediaBuf.put()));
+        winrt::check_hresult(spMediaBuf->Lock(&pSampleBuffer, &maxLen, &dwSampleSize));
+        winrt::check_hresult(pSample->GetSampleTime(&llSampleTime));
+        auto ts = HnsToRtpTime(llSampleTime, m_clockRate);
+        if (m_subType == MFAudioFormat_Opus)
+        {
+            PacketizeOpus(pSampleBuffer, dwSampleSize, ts);
+        }
+        else
+        {
+            PacketizeAAC(pSampleBuffer, dwSampleSize, ts);
+        }
+        EndSample(llSampleTime);
+    }
+    catch (winrt::hresult_error const& ex)
+    {
+        hr = ex.code();
+    }
+
+    if (spMediaBuf && pSampleBuffer)
+    {
+        spMediaBuf->Unlock();
+    }
+    return hr;
+}
+
+INetworkMediaStreamSink* RTPAudioStreamSink::CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
+{
+    if (!IsSupported(pMediaType))
+    {
+        winrt::check_hresult(MF_E_INVALIDMEDIATYPE);
+    }
+    winrt::com_ptr<RTPAudioStreamSink> pAS;
+    pAS.attach(new RTPAudioStreamSink(pMediaType, pParent, dwStreamID));
+    return pAS.as<INetworkMediaStreamSink>().detach();
+}
@@ -18,7 +18,47 @@ protected:
 
         for (DWORD i = 0; i < streamMediaTypes.size(); i++)
         {
-            m_spStreamSinks[i].attach(RTPVideoStreamSink::CreateInstance(streamMediaTypes[i].get(), this, i));
+            GUID majorType = GUID_NULL;
+            winrt::check_hresult(streamMediaTypes[i]->GetGUID(MF_MT_MAJOR_TYPE, &majorType));
+            if (majorType == MFMediaType_Audio)
+            {
+                m_spStreamSinks[i].attach(RTPAudioStreamSink::CreateInstance(streamMediaTypes[i].get(), this, i));
+            }
+            else
+            {
+                m_spStreamSinks[i].attach(RTPVideoStreamSink::CreateInstance(streamMediaTypes[i].get(), this, i));
+            }
+        }
+    }
+
+    // Stream sink 0 is the simulcast track, the others feed it the samples of the other layers
+    RTPMediaSink(std::vector<winrt::com_ptr<IMFMediaType>> layerMediaTypes, bool bSimulcast)
+        :m_bIsShutdown(false)
+    {
+        m_spStreamSinks.resize(layerMediaTypes.size());
+        winrt::com_ptr<RTPSimulcastStreamSink> spTrack;
+        for (DWORD i = 0; i < layerMediaTypes.size(); i++)
+        {
+            GUID subType = GUID_NULL;
+            winrt::check_hresult(layerMediaTypes[i]->GetGUID(MF_MT_SUBTYPE, &subType));
+            if (subType != MFVideoFormat_H264)
+            {
+                winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+            }
+            // a copy of the type so the layer attribute does not show on the caller's
+            winrt::com_ptr<IMFMediaType> spLayerType;
+            winrt::check_hresult(MFCreateMediaType(spLayerType.put()));
+            winrt::check_hresult(layerMediaTypes[i]->CopyAllItems(spLayerType.get()));
+            winrt::check_hresult(spLayerType->SetUINT32(MF_NETWORKSTREAM_SIMULCAST_LAYER, i));
+            if (i == 0)
+            {
+                spTrack.attach(RTPSimulcastStreamSink::CreateInstance(spLayerType.get(), this, (uint32_t)layerMediaTypes.size()));
+                m_spStreamSinks[i] = spTrack.as<INetworkMediaStreamSink>();
+            }
+            else
+            {
+                m_spStreamSinks[i].attach(RTPSimulcastLayerSink::CreateInstance(spLayerType.get(), this, spTrack.get(), i));
+            }
         }
     }
 
@@ -36,6 +76,18 @@ public:
         }
     }
 
+    static IMFMediaSink* CreateSimulcastInstance(std::vector<winrt::com_ptr<IMFMediaType>> layerMediaTypes)
+    {
+        if (layerMediaTypes.size())
+        {
+            return new RTPMediaSink(layerMediaTypes, true);
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
     //IMFMediaSink
     STDMETHODIMP GetCharacteristics(
         /* [out] */ __RPC__out DWORD* pdwCharacteristics) noexcept override
@@ -89,7 +141,7 @@ public:
         {
             return E_POINTER;
         }
-        if (dwIndex > 0)
+        if (dwIndex >= m_spStreamSinks.size())
         {
             return MF_E_INVALIDINDEX;
         }
@@ -102,7 +154,11 @@ public:
         /* [out] */ __RPC__deref_out_opt IMFStreamSink** ppStreamSink) noexcept override
     {
         RETURN_IF_SHUTDOWN;
-        if (dwStreamSinkIdentifier > m_spStreamSinks.size())
+        if (!ppStreamSink)
+        {
+            return E_POINTER;
+        }
+        if (dwStreamSinkIdentifier >= m_spStreamSinks.size())
         {
             return MF_E_INVALIDSTREAMNUMBER;
         }
@@ -221,4 +277,17 @@ RTPMEDIASTREAMER_API STDMETHODIMP CreateRTPMediaSink(IMFMediaType** apMediaTypes
     }
     *ppMediaSink = RTPMediaSink::CreateInstance(mediaTypes);
     return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+RTPMEDIASTREAMER_API STDMETHODIMP CreateRTPSimulcastMediaSink(IMFMediaType** apLayerTypes, DWORD dwLayerCount, IMFMediaSink** ppMediaSink) try
+{
+    winrt::check_pointer(ppMediaSink);
+    std::vector<winrt::com_ptr<IMFMediaType>> layerTypes(dwLayerCount);
+    for (DWORD i = 0; i < dwLayerCount; i++)
+    {
+        winrt::check_pointer(apLayerTypes[i]);
+        layerTypes[i].copy_from(apLayerTypes[i]);
+    }
+    *ppMediaSink = RTPMediaSink::CreateSimulcastInstance(layerTypes);
+    return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
\ No newline at end of file
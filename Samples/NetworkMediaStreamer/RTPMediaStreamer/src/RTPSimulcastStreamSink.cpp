@@ -0,0 +1,203 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+RTPSimulcastStreamSink::RTPSimulcastStreamSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, uint32_t layerCount)
+    : RTPVideoStreamSink(pMediaType, pParent, 0)
+    , m_uLayerCount(layerCount)
+    , m_uSendingLayer(0)
+{
+}
+
+RTPSimulcastStreamSink* RTPSimulcastStreamSink::CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, uint32_t layerCount)
+{
+    winrt::com_ptr<RTPSimulcastStreamSink> pVS;
+    pVS.attach(new RTPSimulcastStreamSink(pMediaType, pParent, layerCount));
+    return pVS.detach();
+}
+
+STDMETHODIMP RTPSimulcastStreamSink::PacketizeAndSend(IMFSample* pSample) noexcept
+{
+    return PacketizeLayer(0, pSample);
+}
+
+// Packets go only to the clients streaming the layer being packetized, each with its own sequence number
+void RTPSimulcastStreamSink::OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker)
+{
+    m_pTxBuf.Length((uint32_t)size);
+    for (auto& ct : m_rtpStreamers)
+    {
+        if (ct.second->m_stats.layer == m_uSendingLayer)
+        {
+            SendPacketToClient(*ct.second, m_pTxBuf, (uint16_t)ct.second->m_uSequenceNumber, timestamp, bMarker, bMarker);
+        }
+    }
+}
+
+void RTPSimulcastStreamSink::OnReceiverReport(TxContext& client)
+{
+    SelectLayer(client, MFGetSystemTime());
+}
+
+// Steps one layer down on loss, a long round trip or access units dropped by a backed up transport, and
+// one layer up after a while without any. A new target is only picked once the client reached the last one.
+void RTPSimulcastStreamSink::SelectLayer(TxContext& client, MFTIME now)
+{
+    bool bDropped = (client.m_uAccessUnitsDropped != client.m_uAccessUnitsDroppedSeen);
+    client.m_uAccessUnitsDroppedSeen = client.m_uAccessUnitsDropped;
+    bool bCongested = bDropped
+        || (client.m_bFeedback && ((client.m_fractionLost > simulcastLossStepDown) || (client.m_uRttUs > simulcastRttStepDownUs)));
+    bool bClear = !bDropped && client.m_bFeedback
+        && (client.m_fractionLost <= simulcastLossStepUp) && (client.m_uRttUs <= simulcastRttStepUpUs);
+    client.m_bFeedback = false;
+
+    auto layer = client.m_stats.layer;
+    if (client.m_uTargetLayer != layer)
+    {
+        return;
+    }
+    if (bCongested && ((layer + 1) < m_uLayerCount))
+    {
+        client.m_uTargetLayer = layer + 1;
+        client.m_llLastLayerChange = now;
+    }
+    else if (bClear && (layer > 0) && ((now - client.m_llLastLayerChange) >= simulcastStepUpHoldTime))
+    {
+        client.m_uTargetLayer = layer - 1;
+        client.m_llLastLayerChange = now;
+    }
+}
+
+// Called by the stream sink of each layer. Clients waiting for this layer switch to it at an IDR they
+// have not received the sample time of from their current layer; the layer is only packetized when a
+// client streams it.
+HRESULT RTPSimulcastStreamSink::PacketizeLayer(uint32_t layer, IMFSample* pSample) noexcept
+{
+    auto lock = std::lock_guard(m_guardlock);
+    winrt::com_ptr<IMFMediaBuffer> spMediaBuf;
+    LONGLONG llSampleTime;
+    DWORD dwSampleSize, maxLen;
+    BYTE* pSampleBuffer = nullptr;
+    HRESULT hr = S_OK;
+    try
+    {
+        winrt::check_pointer(pSample);
+        winrt::check_hresult(pSample->GetSampleTime(&llSampleTime));
+        bool bIdr = (MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE);
+        bool bSend = false;
+        for (auto& ct : m_rtpStreamers)
+        {
+            auto& client = *ct.second;
+            if (bIdr && (client.m_uTargetLayer == layer) && (client.m_stats.layer != layer) && (llSampleTime > client.m_llLastSampleTime))
+            {
+                client.m_stats.layer = layer;
+                client.m_stats.layerSwitches++;
+            }
+            bSend = bSend || (client.m_stats.layer == layer);
+        }
+
+        if (bSend)
+        {
+            m_llSampleTime = llSampleTime;
+            winrt::check_hresult(pSample->GetBufferByIndex(0, spMediaBuf.put()));
+            winrt::check_hresult(spMediaBuf->Lock(&pSampleBuffer, &maxLen, &dwSampleSize));
+            m_uSendingLayer = layer;
+            m_packetizer.Packetize(pSampleBuffer, dwSampleSize, HnsToRtpTime(llSampleTime, m_clockRate), m_pTxBuf.data(), *this);
+            auto now = MFGetSystemTime();
+            for (auto& ct : m_rtpStreamers)
+            {
+                if (ct.second->m_stats.layer == layer)
+                {
+                    ct.second->m_llLastSampleTime = llSampleTime;
+                    SelectLayer(*ct.second, now);
+                }
+            }
+            EndSample(llSampleTime);
+        }
+        else
+        {
+            SendSenderReports(llSampleTime);
+        }
+    }
+    catch (winrt::hresult_error const& ex)
+    {
+        hr = ex.code();
+    }
+
+    if (spMediaBuf && pSampleBuffer)
+    {
+        spMediaBuf->Unlock();
+    }
+    return hr;
+}
+
+// The layers are only packetized to RTP
+STDMETHODIMP RTPSimulcastStreamSink::AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*= L""*/)
+{
+    RETURN_IF_NULL(protocol);
+    if (std::wstring(protocol) != L"rtp")
+    {
+        return E_INVALID_PROTOCOL_FORMAT;
+    }
+    return RTPVideoStreamSink::AddTransportHandler(packetHandler, protocol, params);
+}
+
+RTPSimulcastLayerSink::RTPSimulcastLayerSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, RTPSimulcastStreamSink* pTrack, uint32_t layer)
+    : NwMediaStreamSinkBase(pMediaType, pParent, layer)
+    , m_uLayer(layer)
+{
+    m_spTrack.copy_from(pTrack);
+}
+
+INetworkMediaStreamSink* RTPSimulcastLayerSink::CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, RTPSimulcastStreamSink* pTrack, uint32_t layer)
+{
+    winrt::com_ptr<RTPSimulcastLayerSink> pLS;
+    pLS.attach(new RTPSimulcastLayerSink(pMediaType, pParent, pTrack, layer));
+    return pLS.as<INetworkMediaStreamSink>().detach();
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::PacketizeAndSend(IMFSample* pSample) noexcept
+{
+    return m_spTrack->PacketizeLayer(m_uLayer, pSample);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*= L""*/)
+{
+    return m_spTrack->AddTransportHandler(packetHandler, protocol, params);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::RemoveTransportHandler(ABI::PacketHandler* packetHandler)
+{
+    return m_spTrack->RemoveTransportHandler(packetHandler);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::AddNetworkClient(LPCWSTR destination, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*= L""*/)
+{
+    return m_spTrack->AddNetworkClient(destination, protocol, params);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::RemoveNetworkClient(LPCWSTR destination)
+{
+    return m_spTrack->RemoveNetworkClient(destination);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest)
+{
+    return m_spTrack->GenerateSDP(buf, maxSize, dest);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::GetNetworkClientStats(LPCWSTR destination, NetworkStreamClientStats* pStats)
+{
+    return m_spTrack->GetNetworkClientStats(destination, pStats);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::GetTransportHandlerStats(ABI::PacketHandler* packetHandler, NetworkStreamClientStats* pStats)
+{
+    return m_spTrack->GetTransportHandlerStats(packetHandler, pStats);
+}
+
+STDMETHODIMP RTPSimulcastLayerSink::ProcessRtcpPacket(const uint8_t* pPacket, size_t size)
+{
+    return m_spTrack->ProcessRtcpPacket(pPacket, size);
+}
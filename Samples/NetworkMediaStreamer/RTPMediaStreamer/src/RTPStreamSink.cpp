@@ -3,7 +3,37 @@
 
 #include <pch.h>
 
-TxContext::TxContext(std::string destination, winrt::PacketHandler packetHandler /*= nullptr*/)
+// Value of the number after param in a destination or parameter string, up to the next '&'. False, with
+// value unchanged, if param is missing or not followed by a number.
+template<typename T>
+static bool ParseParam(std::string const& params, char const* param, T& value)
+{
+    auto pos = params.find(param);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    auto p = params.data() + pos + strlen(param);
+    auto end = params.data() + params.size();
+    T parsed;
+    std::from_chars_result result;
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        result = std::from_chars(p, end, parsed, std::chars_format::fixed);
+    }
+    else
+    {
+        result = std::from_chars(p, end, parsed);
+    }
+    if ((result.ec != std::errc()) || ((result.ptr != end) && (*result.ptr != '&')))
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+TxContext::TxContext(std::string destination, winrt::PacketHandler packetHandler /*= nullptr*/, bool bArq /*= false*/)
     : m_u64StartTime(0)
     , m_packetHandler(packetHandler)
     , m_ssrc(0)
@@ -13,26 +43,41 @@ TxContext::TxContext(std::string destination, winrt::PacketHandler packetHandler
     , m_localRTCPPort(0)
     , m_remotePort(0)
     , m_uSequenceNumber(0)
+    , m_bDropAccessUnit(false)
+    , m_uAccessUnitsDropped(0)
+    , m_uPacketCount(0)
+    , m_uOctetCount(0)
+    , m_llLastSenderReport(0)
+    , m_bSampleStarted(false)
+    , m_llLastPacketTime(0)
+    , m_rtcpBuf((uint32_t)rtcpSenderReportSize)
+    , m_stats({ 0 })
+    , m_fractionLost(0)
+    , m_uRttUs(0)
+    , m_bFeedback(false)
+    , m_uTargetLayer(0)
+    , m_llLastLayerChange(0)
+    , m_llLastSampleTime(-1)
+    , m_uAccessUnitsDroppedSeen(0)
+    , m_llTimeshiftStart(-1)
+    , m_scale(1)
 {
     memset(&m_remoteAddr, 0, sizeof(m_remoteAddr));
+    memset(&m_remoteRtcpAddr, 0, sizeof(m_remoteRtcpAddr));
     m_ssrc = 0;
-    std::string param = "ssrc=";
-    auto sep2 = destination.find(param);
-    if (sep2 != std::string::npos)
-    {
-        auto sep3 = destination.find("&", sep2);
-        if (sep3 != std::string::npos)
-        {
-            m_ssrc = std::stoi(destination.substr(sep2 + param.size(), sep3 - sep2));
-        }
-    }
+    // a value that is not a number leaves the default: ssrc 0, live at scale 1
+    ParseParam(destination, "ssrc=", m_ssrc);
+    ParseParam(destination, "npt=", m_llTimeshiftStart);
+    double scale = 1;
+    ParseParam(destination, "scale=", scale);
+    m_scale = (scale > 0) ? scale : 1;
 
     if (!packetHandler)
     {
-        param = "localrtpport=";
+        std::string param = "localrtpport=";
         auto sep1 = destination.find(":");
         auto ipaddr = destination.substr(0, sep1);
-        sep2 = destination.find(param);
+        auto sep2 = destination.find(param);
         m_remotePort = std::stoi(destination.substr(sep1 + 1, sep2 - sep1 - 1));
         if (sep2 != std::string::npos)
         {
@@ -59,6 +104,9 @@ TxContext::TxContext(std::string destination, winrt::PacketHandler packetHandler
                 {
                     m_localRTPPort = P;
                     m_localRTCPPort = P + 1;
+                    // the receiver reports of the client are polled after each sample
+                    u_long nonBlocking = 1;
+                    ioctlsocket(m_rtcpSocket, FIONBIO, &nonBlocking);
                     break;
                 }
                 else
@@ -79,11 +127,20 @@ TxContext::TxContext(std::string destination, winrt::PacketHandler packetHandler
         inet_pton(AF_INET, destination.c_str(), &(m_remoteAddr.sin_addr));
         m_remoteAddr.sin_port = htons(m_remotePort);
         m_remoteAddr.sin_family = AF_INET;
+        m_remoteRtcpAddr = m_remoteAddr;
+        m_remoteRtcpAddr.sin_port = htons(m_remotePort + 1);
+        if (bArq)
+        {
+            auto sep = destination.find("?");
+            m_spArq = std::make_unique<CArqSender>((sep != std::string::npos) ? destination.substr(sep + 1) : std::string(), m_rtpSocket, m_remoteAddr, m_ssrc);
+        }
     }
 }
 
 TxContext::~TxContext()
 {
+    // the player sends on the sockets
+    m_spTimeshift.reset();
     if (m_rtpSocket != INVALID_SOCKET)
     {
         closesocket(m_rtpSocket);
@@ -94,198 +151,285 @@ TxContext::~TxContext()
     }
 }
 
-void TxContext::SendPacket(winrt::Windows::Storage::Streams::IBuffer buf)
+// returns false if the packet was dropped
+bool TxContext::SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, bool bEndOfAccessUnit)
 {
+    bool bSent = true;
     if (m_packetHandler)
     {
-        m_packetHandler(nullptr, buf);
+        // a transport handler throws E_PENDING when it cannot take more data, a partial access unit
+        // is of no use to the client so the rest of it is skipped and sending resumes with the next one
+        if (!m_bDropAccessUnit)
+        {
+            try
+            {
+                m_packetHandler(nullptr, buf);
+            }
+            catch (winrt::hresult_error const& ex)
+            {
+                if (ex.code() != E_PENDING)
+                {
+                    throw;
+                }
+                m_bDropAccessUnit = true;
+                m_uAccessUnitsDropped++;
+            }
+        }
+        bSent = !m_bDropAccessUnit;
+        if (bEndOfAccessUnit)
+        {
+            m_bDropAccessUnit = false;
+        }
     }
     else
     {
         auto pBuf = buf.data();
         auto sz = buf.Length();
-        sendto(m_rtpSocket, (char*)pBuf, (int)sz, 0, (SOCKADDR*)&m_remoteAddr, sizeof(m_remoteAddr));
+        bSent = m_spArq ? m_spArq->Send(pBuf, sz) : (sendto(m_rtpSocket, (char*)pBuf, (int)sz, 0, (SOCKADDR*)&m_remoteAddr, sizeof(m_remoteAddr)) != SOCKET_ERROR);
+    }
+    if (bSent)
+    {
+        m_stats.packetsSent++;
+        m_stats.bytesSent += buf.Length();
+    }
+    else
+    {
+        m_stats.packetsDropped++;
     }
     m_uSequenceNumber++;
+    m_uPacketCount++;
+    m_uOctetCount += (uint32_t)(buf.Length() - rtpHeaderSize);
+    return bSent;
 }
 
+// RTCP sender report (RFC 3550 section 6.4.1) pairing rtpTime with a wall clock time given as a FILETIME
+void TxContext::SendSenderReport(uint32_t rtpTime, uint64_t wallClockTime)
+{
+    constexpr uint64_t ntpEpochAsFileTime = 94354848000000000;  // 1900-01-01 in 100ns units since 1601-01-01
+    uint64_t ntpTime = wallClockTime - ntpEpochAsFileTime;
+    uint32_t fields[] =
+    {
+        m_ssrc,
+        (uint32_t)(ntpTime / 10000000),                                 // NTP seconds
+        (uint32_t)(((ntpTime % 10000000) << 32) / 10000000),            // NTP fraction
+        rtpTime,
+        m_uPacketCount,
+        m_uOctetCount
+    };
+
+    BYTE* pOut = m_rtcpBuf.data();
+    pOut[0] = 0x80;                                     // version 2, no report blocks
+    pOut[1] = 200;                                      // SR
+    pOut[2] = 0;
+    pOut[3] = (BYTE)(rtcpSenderReportSize / 4 - 1);     // length in 32 bit words minus one
+    for (int i = 0; i < ARRAYSIZE(fields); i++)
+    {
+        pOut[4 + i * 4] = (BYTE)(fields[i] >> 24);
+        pOut[5 + i * 4] = (BYTE)(fields[i] >> 16);
+        pOut[6 + i * 4] = (BYTE)(fields[i] >> 8);
+        pOut[7 + i * 4] = (BYTE)(fields[i]);
+    }
+    m_rtcpBuf.Length((uint32_t)rtcpSenderReportSize);
 
-RTPVideoStreamSink::RTPVideoStreamSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
-    : NwMediaStreamSinkBase(pMediaType, pParent, dwStreamID)
-    , m_packetizationMode(1)
-    , m_uSequenceNumber(0)
-    , m_pTxBuf(nullptr)
+    if (m_packetHandler)
+    {
+        try
+        {
+            m_packetHandler(nullptr, m_rtcpBuf);
+        }
+        catch (winrt::hresult_error const& ex)
+        {
+            // a backed up transport skips the report, the next one follows in a few seconds
+            if (ex.code() != E_PENDING)
+            {
+                throw;
+            }
+        }
+    }
+    else if (m_rtcpSocket != INVALID_SOCKET)
+    {
+        sendto(m_rtcpSocket, (char*)pOut, (int)rtcpSenderReportSize, 0, (SOCKADDR*)&m_remoteRtcpAddr, sizeof(m_remoteRtcpAddr));
+    }
+}
+
+// Next RTCP packet the client sent to the local RTCP port, 0 if there is none
+size_t TxContext::ReceiveRtcp(BYTE* pBuf, size_t size)
 {
-    // TODO: Add arguments to contructor to enable m_packetizationMode = 0;
-    if (m_packetizationMode == 1)
+    if (m_rtcpSocket == INVALID_SOCKET)
     {
-        m_mtuSize = 1500;
+        return 0;
     }
-    else
+    auto received = recv(m_rtcpSocket, (char*)pBuf, (int)size, 0);
+    return (received > 0) ? (size_t)received : 0;
+}
+
+// Generic NACK entry from the client: a client without ARQ ignores it
+void TxContext::OnNack(uint16_t pid, uint16_t blp)
+{
+    if (m_spArq)
     {
-        //TODO: find a way to control encoder's max NAL size and edit this param to a better value
-        m_mtuSize = 65535; // max size to allow any size NAL into one packet
+        m_stats.retransmits += m_spArq->Retransmit(pid, blp, m_uRttUs);
     }
-    m_pTxBuf = winrt::Windows::Storage::Streams::Buffer((uint32_t)m_mtuSize);
+}
 
+RTPStreamSinkBase::RTPStreamSinkBase(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID, BYTE payloadType, uint32_t clockRate)
+    : NwMediaStreamSinkBase(pMediaType, pParent, dwStreamID)
+    , m_uSequenceNumber(0)
+    , m_payloadType(payloadType)
+    , m_clockRate(clockRate)
+    , m_llWallClockBase(0)
+{
 }
 
-BYTE* RTPVideoStreamSink::FindSC(BYTE* bufStart, BYTE* bufEnd)
+void RTPStreamSinkBase::SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, LONGLONG ts, bool bMarker, bool bEndOfAccessUnit)
 {
-    for (auto it = bufStart; it < bufEnd - 3; it++)
+    auto sequenceNumber = (uint16_t)m_uSequenceNumber++;       // each packet is counted with a sequence counter
+    for (auto& ct : m_rtpStreamers)
     {
-        if (it[0] == 0)
+        if (!ct.second->m_spTimeshift)
         {
-            if ((it[1] == 0) && (it[2] == 1)
-                || (*((uint32_t*)it) == 0x01000000))
-            {
-                return it;
-            }
+            SendPacketToClient(*ct.second, buf, sequenceNumber, (uint32_t)ts, bMarker, bEndOfAccessUnit);
         }
     }
-    return bufEnd;
 }
 
-void RTPVideoStreamSink::PacketizeMode0(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime)
+void RTPStreamSinkBase::SendPacketToClient(TxContext& client, winrt::Windows::Storage::Streams::IBuffer buf, uint16_t sequenceNumber, uint32_t ts, bool bMarker, bool bEndOfAccessUnit)
 {
-    BYTE* sc = FindSC(bufIn, bufIn + szIn);
-    size_t szOut = m_mtuSize;
-    while (sc < (bufIn + szIn))
+    WriteRtpHeader(buf.data(), m_payloadType, bMarker, sequenceNumber, ts, client.m_ssrc);
+    if (client.SendPacket(buf, bEndOfAccessUnit))
     {
-        while ((sc < bufIn + szIn) && !(*sc++));
-        BYTE* sc1 = FindSC(sc, bufIn + szIn);
-        size_t nalsz = sc1 - sc;
-        auto nalStart = sc;
-        while (nalsz)
+        // for UDP this is when the packet left sendto, for a transport handler when the handler took it
+        auto now = MFGetSystemTime();
+        if (!client.m_bSampleStarted)
         {
-            auto szToSend = __min(nalsz, szOut);
-            auto bufptr = m_pTxBuf.data();
-            memcpy(&bufptr[rtpHeaderSize], nalStart, szToSend);
-            m_pTxBuf.Length((uint32_t)(szToSend + rtpHeaderSize));
-            SendPacket(m_pTxBuf, llSampleTime, sc1 == (bufIn + szIn));
-            nalStart += szToSend;
-            nalsz -= szToSend;
+            RecordLatency(NetworkStreamLatencyStage::FirstPacketSent, now);
+            client.m_bSampleStarted = true;
         }
-        sc = sc1;
+        client.m_llLastPacketTime = now;
     }
 }
 
-void RTPVideoStreamSink::SendPacket(winrt::Windows::Storage::Streams::IBuffer buf, LONGLONG ts, bool bLastNalOfFrame)
+// Called once all the packets of a sample are sent
+void RTPStreamSinkBase::EndSample(LONGLONG hnsSampleTime)
 {
-    auto pOut = buf.data();
-    // Prepare the 12 byte RTP header
-    pOut[0] = (byte)0x80;                               // RTP version
-
-    if (bLastNalOfFrame)
-    {
-        pOut[1] = (byte)(h264payloadType | 1 << 7);  // last packet of frame marker bit
-    }
-    else
+    RecordLatency(NetworkStreamLatencyStage::Packetized, MFGetSystemTime());
+    for (auto& ct : m_rtpStreamers)
     {
-        pOut[1] = (byte)(h264payloadType);
+        if (ct.second->m_bSampleStarted)
+        {
+            RecordLatency(NetworkStreamLatencyStage::LastPacketSent, ct.second->m_llLastPacketTime);
+            ct.second->m_bSampleStarted = false;
+        }
     }
-    pOut[2] = m_uSequenceNumber >> 8;
-    pOut[3] = m_uSequenceNumber & 0x0FF;           // each packet is counted with a sequence counter
-    m_uSequenceNumber++;
+    SendSenderReports(hnsSampleTime);
+}
+
+// Called after each sample. A report pairs the wall clock time it is sent at with the RTP time of the same
+// instant on the presentation clock (RFC 3550 section 6.4.1), so clients can compute the round trip time
+// from it; since all the stream sinks of a media sink share the presentation clock, the receiver can line
+// the tracks up from these reports.
+void RTPStreamSinkBase::SendSenderReports(LONGLONG hnsSampleTime)
+{
+    MFTIME now = MFGetSystemTime();
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    uint64_t wallClockTime = (((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    LONGLONG hnsPresentationTime = m_llWallClockBase ? ((LONGLONG)wallClockTime - m_llWallClockBase) : hnsSampleTime;
+    BYTE rtcpBuf[rtcpMaxPacketSize];
     for (auto& ct : m_rtpStreamers)
     {
-        auto ssrc = ct.second->m_ssrc;
-        auto ts1 = ts;
-        pOut[4] = (BYTE)((ts1 & 0xFF000000) >> 24);   // each image gets a timestamp
-        pOut[5] = (BYTE)((ts1 & 0x00FF0000) >> 16);
-        pOut[6] = (BYTE)((ts1 & 0x0000FF00) >> 8);
-        pOut[7] = (BYTE)((ts1 & 0x000000FF));
-
-        pOut[8] = (BYTE)((ssrc & 0xFF000000) >> 24); // 4 BYTE SSRC (synchronization source identifier)
-        pOut[9] = (BYTE)((ssrc & 0x00FF0000) >> 16);
-        pOut[10] = (BYTE)((ssrc & 0x0000FF00) >> 8);
-        pOut[11] = (BYTE)((ssrc & 0x000000FF));
-
-        ct.second->SendPacket(buf);
+        if (!ct.second->m_spTimeshift && ((now - ct.second->m_llLastSenderReport) >= rtcpSenderReportInterval))
+        {
+            ct.second->m_llLastSenderReport = now;
+            ct.second->SendSenderReport(HnsToRtpTime(hnsPresentationTime, m_clockRate), wallClockTime);
+        }
+        size_t received;
+        while ((received = ct.second->ReceiveRtcp(rtcpBuf, sizeof(rtcpBuf))) != 0)
+        {
+            HandleRtcp(rtcpBuf, received, ct.second.get());
+        }
     }
 }
 
-void RTPVideoStreamSink::PacketizeMode1(BYTE* bufIn, size_t szIn, LONGLONG llSampleTime)
-{
-    BYTE* sc = FindSC(bufIn, bufIn + szIn);
-    BYTE* pOut = m_pTxBuf.data();
-    size_t szOut = m_mtuSize;
-    BYTE* pOutEnd = pOut + szOut;
-    BYTE* sc1 = sc;
-    auto pOutCurr = pOut + rtpHeaderSize + stapAtypeHeaderSize;
-    uint32_t numNalsToSend = 0;
-    while (sc < (bufIn + szIn))
-    {
-        auto sc0 = sc;
-        while ((sc < bufIn + szIn) && !(*sc++));
-        sc1 = FindSC(sc, bufIn + szIn);
-        size_t nalsz = sc1 - sc;
-        if (pOutCurr + nalsz + stapASzHeaderSize > pOutEnd)
+// Loss and round trip time from the report blocks about our clients (RFC 3550 section 6.4.1). The round
+// trip time is the arrival time - LSR - DLSR, all in the middle 32 bits of the NTP time. pSource is the
+// client the packet came from when it was received on its own RTCP socket, else the client is found by
+// the SSRC of the block. Generic NACKs (RFC 4585 section 6.2.1) are the loss lists of the ARQ clients.
+void RTPStreamSinkBase::HandleRtcp(const BYTE* pPacket, size_t size, TxContext* pSource)
+{
+    constexpr uint64_t ntpEpochAsFileTime = 94354848000000000;  // 1900-01-01 in 100ns units since 1601-01-01
+    constexpr size_t reportBlockSize = 24;
+    auto read32 = [](BYTE const* p) { return (uint32_t)((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]); };
+
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    uint64_t ntpTime = ((((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime) - ntpEpochAsFileTime;
+    uint32_t arrival = (uint32_t)(((ntpTime / 10000000) << 16) | ((((ntpTime % 10000000) << 16) / 10000000) & 0xFFFF));
+
+    auto findClient = [this, pSource](uint32_t ssrc) -> TxContext*
+    {
+        if (pSource)
         {
-            if (numNalsToSend == 0)
+            return (pSource->m_ssrc == ssrc) ? pSource : nullptr;
+        }
+        auto it = std::find_if(m_rtpStreamers.begin(), m_rtpStreamers.end(), [ssrc](auto const& ct) { return ct.second->m_ssrc == ssrc; });
+        return (it != m_rtpStreamers.end()) ? it->second.get() : nullptr;
+    };
+
+    size_t offset = 0;
+    while ((size - offset) >= 8)
+    {
+        auto pRtcp = pPacket + offset;
+        size_t length = ((size_t)((pRtcp[2] << 8) | pRtcp[3]) + 1) * 4;
+        if (length > (size - offset))
+        {
+            break;
+        }
+        if (ReadGenericNack(pRtcp, length, [&findClient](uint32_t mediaSsrc, uint16_t pid, uint16_t blp)
             {
-                // STAP-A FU
-                pOut[rtpHeaderSize] = 28; // STAP-A FU type
-                pOut[rtpHeaderSize] |= (sc[0] & 0x60);
-                pOut[rtpHeaderSize + 1] = sc[0] & 0x1F;
-                pOut[rtpHeaderSize + 1] |= (1 << 7);
-                sc++; nalsz--;
-                auto maxSz = szOut - (rtpHeaderSize + stapAtypeHeaderSize + 1);
-                while (nalsz > maxSz)
+                if (auto pClient = findClient(mediaSsrc))
                 {
-                    memcpy(&pOut[rtpHeaderSize + stapAtypeHeaderSize + 1], sc, maxSz);
-                    m_pTxBuf.Length((uint32_t)szOut);
-                    SendPacket(m_pTxBuf, llSampleTime, false);
-                    nalsz -= maxSz;
-                    sc += maxSz;
-                    pOut[rtpHeaderSize + 1] &= (~(1 << 7));
+                    pClient->OnNack(pid, blp);
                 }
-
-                memcpy(&pOut[rtpHeaderSize + stapAtypeHeaderSize + 1], sc, nalsz);
-                pOut[rtpHeaderSize + 1] |= (1 << 6);
-                m_pTxBuf.Length(uint32_t(nalsz + rtpHeaderSize + stapAtypeHeaderSize + 1));
-                SendPacket(m_pTxBuf, llSampleTime, (sc1 == (bufIn + szIn)));
-                sc += nalsz;
-                sc = sc1;
+            }))
+        {
+            offset += length;
+            continue;
+        }
+        // the report blocks follow the header of an RR or the sender info of an SR
+        size_t blockOffset = (pRtcp[1] == 201) ? 8 : ((pRtcp[1] == 200) ? 28 : length);
+        for (BYTE i = 0; (i < (pRtcp[0] & 0x1F)) && ((blockOffset + reportBlockSize) <= length); i++, blockOffset += reportBlockSize)
+        {
+            auto pBlock = pRtcp + blockOffset;
+            uint32_t lsr = read32(pBlock + 16), dlsr = read32(pBlock + 20);
+            auto pClient = findClient(read32(pBlock));
+            if (!pClient)
+            {
+                continue;
             }
-            //else if (numNalsToSend == 1)
-            //{
-            //    //if only this one nal fit into this packet, send as single non-stap nal
-            //    //PacketizeMode0(sc0, sc1 - sc0, llSampleTime);
-            //    
-            //}
-            else
+            pClient->m_fractionLost = pBlock[4];
+            if (lsr && ((arrival - lsr) > dlsr))
             {
-                pOut[rtpHeaderSize] = 24; //STAP-A type
-                m_pTxBuf.Length((uint32_t)(pOutCurr - pOut));
-                SendPacket(m_pTxBuf, llSampleTime, (sc1 == (bufIn + szIn)));
-                sc = sc0;
+                pClient->m_uRttUs = (uint32_t)(((uint64_t)(arrival - lsr - dlsr) * 1000000) >> 16);
             }
-            numNalsToSend = 0;
-            pOutCurr = pOut + rtpHeaderSize + stapAtypeHeaderSize;
-        }
-        else
-        {
-            pOutCurr[0] = (BYTE)((nalsz & 0xFF00) >> 8);
-            pOutCurr[1] = (BYTE)(nalsz & 0x00FF);
-            memcpy(&pOutCurr[stapASzHeaderSize], sc, nalsz);
-            pOutCurr += (nalsz + stapASzHeaderSize);
-            numNalsToSend++;
-            sc = sc1;
+            pClient->m_bFeedback = true;
+            OnReceiverReport(*pClient);
         }
-
-    }
-
-    if (numNalsToSend)
-    {
-        pOut[rtpHeaderSize] = 24;
-        m_pTxBuf.Length((uint32_t)(pOutCurr - pOut));
-        SendPacket(m_pTxBuf, llSampleTime, true);
+        offset += length;
     }
+}
 
+STDMETHODIMP RTPStreamSinkBase::Start(MFTIME hnsSystemTime, LONGLONG llClockStartOffset)
+{
+    // wall clock time at presentation time 0
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    auto wallClockNow = (LONGLONG)((((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime);
+    m_llWallClockBase = wallClockNow - (MFGetSystemTime() - hnsSystemTime) - llClockStartOffset;
+    return NwMediaStreamSinkBase::Start(hnsSystemTime, llClockStartOffset);
 }
 
-STDMETHODIMP RTPVideoStreamSink::AddTransportHandler(ABI::PacketHandler* packethandler, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*=L""*/) try
+STDMETHODIMP RTPStreamSinkBase::AddTransportHandler(ABI::PacketHandler* packethandler, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*=L""*/) try
 {
     auto lock = std::lock_guard(m_guardlock);
     winrt::check_pointer(packethandler);
@@ -299,41 +443,123 @@ STDMETHODIMP RTPVideoStreamSink::AddTransportHandler(ABI::PacketHandler* packeth
     std::string destination = std::to_string((intptr_t)packethandler);
     winrt::PacketHandler t;
     winrt::copy_from_abi(t, packethandler);
-    m_rtpStreamers.insert({ destination, std::make_unique<TxContext>((destination + "?" + winrt::to_string(params)),t) });
+    auto result = m_rtpStreamers.insert({ destination, std::make_unique<TxContext>((destination + "?" + winrt::to_string(params)),t) });
+    if (result.second)
+    {
+        OnClientAdded(*result.first->second);
+    }
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
-STDMETHODIMP RTPVideoStreamSink::AddNetworkClient(LPCWSTR destination, LPCWSTR protocol /*=L"rtp"*/, LPCWSTR params /*= L""*/) try
+STDMETHODIMP RTPStreamSinkBase::AddNetworkClient(LPCWSTR destination, LPCWSTR protocol /*=L"rtp"*/, LPCWSTR params /*= L""*/) try
 {
     auto lock = std::lock_guard(m_guardlock);
     winrt::check_pointer(destination);
     winrt::check_pointer(protocol);
     winrt::check_pointer(params);
     auto dest = winrt::to_string(destination);
+    bool bArq = (std::wstring(protocol) == L"srt");
+    if (!bArq && (std::wstring(protocol) != L"rtp"))
+    {
+        winrt::check_hresult(E_INVALID_PROTOCOL_FORMAT);
+    }
 
-    m_rtpStreamers.insert({ dest, std::make_unique<TxContext>(dest + "?" + winrt::to_string(params)) });
+    auto result = m_rtpStreamers.insert({ dest, std::make_unique<TxContext>(dest + "?" + winrt::to_string(params), nullptr, bArq) });
+    if (result.second)
+    {
+        OnClientAdded(*result.first->second);
+    }
 
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
-STDMETHODIMP RTPVideoStreamSink::RemoveNetworkClient(LPCWSTR destination) try
+// The client is destroyed after the lock is released, its timeshift player sends under it
+std::unique_ptr<TxContext> RTPStreamSinkBase::ExtractClient(std::string const& key)
 {
     auto lock = std::lock_guard(m_guardlock);
+    auto it = m_rtpStreamers.find(key);
+    if (it == m_rtpStreamers.end())
+    {
+        return nullptr;
+    }
+    auto spClient = std::move(it->second);
+    m_rtpStreamers.erase(it);
+    return spClient;
+}
+
+STDMETHODIMP RTPStreamSinkBase::RemoveNetworkClient(LPCWSTR destination) try
+{
     winrt::check_pointer(destination);
-    auto dest = winrt::to_string(destination);
-    m_rtpStreamers.erase(dest);
+    ExtractClient(winrt::to_string(destination));
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
-STDMETHODIMP RTPVideoStreamSink::RemoveTransportHandler(ABI::PacketHandler* packetHandler) try
+STDMETHODIMP RTPStreamSinkBase::RemoveTransportHandler(ABI::PacketHandler* packetHandler) try
 {
-    auto lock = std::lock_guard(m_guardlock);
     winrt::check_pointer(packetHandler);
-    std::string destination = std::to_string((intptr_t)packetHandler);
-    m_rtpStreamers.erase(destination);
+    ExtractClient(std::to_string((intptr_t)packetHandler));
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
+HRESULT RTPStreamSinkBase::GetClientStats(std::string const& key, NetworkStreamClientStats* pStats)
+{
+    RETURN_IF_NULL(pStats);
+    auto lock = std::lock_guard(m_guardlock);
+    auto it = m_rtpStreamers.find(key);
+    if (it == m_rtpStreamers.end())
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+    *pStats = it->second->m_stats;
+    return S_OK;
+}
+
+STDMETHODIMP RTPStreamSinkBase::GetNetworkClientStats(LPCWSTR destination, NetworkStreamClientStats* pStats) try
+{
+    winrt::check_pointer(destination);
+    return GetClientStats(winrt::to_string(destination), pStats);
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTPStreamSinkBase::GetTransportHandlerStats(ABI::PacketHandler* packetHandler, NetworkStreamClientStats* pStats) try
+{
+    winrt::check_pointer(packetHandler);
+    return GetClientStats(std::to_string((intptr_t)packetHandler), pStats);
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTPStreamSinkBase::ProcessRtcpPacket(const uint8_t* pPacket, size_t size)
+{
+    RETURN_IF_NULL(pPacket);
+    auto lock = std::lock_guard(m_guardlock);
+    HandleRtcp(pPacket, size, nullptr);
+    return S_OK;
+}
+
+
+RTPVideoStreamSink::RTPVideoStreamSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
+    : RTPStreamSinkBase(pMediaType, pParent, dwStreamID, h264payloadType, videoClockRate)
+    , m_packetizer(1, 1500)
+    , m_pTxBuf(nullptr)
+    , m_llCmafPartDuration(cmafDefaultPartDuration)
+{
+    // TODO: Add arguments to contructor to enable packetization mode 0, with a 65535 byte MTU to allow any size NAL into one packet
+    m_pTxBuf = winrt::Windows::Storage::Streams::Buffer((uint32_t)m_packetizer.MtuSize());
+}
+
+void RTPVideoStreamSink::OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker)
+{
+    m_pTxBuf.Length((uint32_t)size);
+    SendPacket(m_pTxBuf, timestamp, bMarker, bMarker);
+}
+
+// A client asking for a start time gets its own player reading the timeshift store
+void RTPVideoStreamSink::OnClientAdded(TxContext& client)
+{
+    if (m_spTimeshift && (client.m_llTimeshiftStart >= 0))
+    {
+        client.m_spTimeshift = std::make_unique<CTimeshiftPlayer>(m_spTimeshift, client, m_guardlock, m_packetizer, m_payloadType, m_clockRate, client.m_llTimeshiftStart, client.m_scale);
+    }
+}
+
 STDMETHODIMP RTPVideoStreamSink::GenerateSDP(uint8_t* buf, size_t maxSize, LPCWSTR dest) try
 {
     std::string paramSets;
@@ -342,11 +568,11 @@ STDMETHODIMP RTPVideoStreamSink::GenerateSDP(uint8_t* buf, size_t maxSize, LPCWS
     if (m_pVideoHeader)
     {
         auto vend = m_pVideoHeader + m_VideoHeaderSize;
-        auto sc = FindSC(m_pVideoHeader, vend);
+        const BYTE* sc = CH264Packetizer::FindStartCode(m_pVideoHeader, vend);
         while (sc < vend)
         {
             while ((sc < vend) && !(*sc++));
-            BYTE* sc1 = FindSC(sc, vend);
+            const BYTE* sc1 = CH264Packetizer::FindStartCode(sc, vend);
             auto nalsz = sc1 - sc;
 
             winrt::Windows::Storage::Streams::Buffer p((uint32_t)nalsz);
@@ -385,13 +611,14 @@ STDMETHODIMP RTPVideoStreamSink::GenerateSDP(uint8_t* buf, size_t maxSize, LPCWS
         "m=video " + destPort + " RTP/AVP " + std::to_string(h264payloadType) + "\n"
         "a=ts-refclk:ntp=time.windows.com\n"
         "a=rtpmap:" + std::to_string(h264payloadType) + " H264/90000\n"
-        "a=fmtp:" + std::to_string(h264payloadType) + " packetization-mode=" + std::to_string(m_packetizationMode);
+        "a=fmtp:" + std::to_string(h264payloadType) + " packetization-mode=" + std::to_string(m_packetizer.PacketizationMode());
     if (!paramSets.empty())
     {
         sdp = sdp
             + "; sprop-parameter-sets="
-            + paramSets + "; profile-level-id=" + profileIdc + "\n";
+            + paramSets + "; profile-level-id=" + profileIdc;
     }
+    sdp += "\n";
     winrt::check_win32(memcpy_s(buf, maxSize, sdp.c_str(), sdp.size()));
     buf[sdp.size()] = 0;
     return S_OK;
@@ -413,17 +640,23 @@ STDMETHODIMP RTPVideoStreamSink::PacketizeAndSend(IMFSample* pSample) noexcept
         winrt::check_hresult(spMediaBuf->Lock(&pSampleBuffer, &maxLen, &dwSampleSize));
         winrt::check_hresult(pSample->GetSampleTime(&llSampleTime));
         winrt::check_hresult(pSample->GetSampleDuration(&llSampleDur));
-        MFTIME latency = MFGetSystemTime() - llSampleTime;
         // convert timestamp from 100ns units to 90Khz clock as per RTP standard 
-        auto ts = ((llSampleTime) * 90) / 10000;
-        if (m_packetizationMode == 1)
+        auto ts = HnsToRtpTime(llSampleTime, m_clockRate);
+        m_packetizer.Packetize(pSampleBuffer, dwSampleSize, ts, m_pTxBuf.data(), *this);
+        if (m_spTimeshift)
         {
-            PacketizeMode1(pSampleBuffer, dwSampleSize, ts);
+            m_spTimeshift->Append(llSampleTime, MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE, pSampleBuffer, dwSampleSize);
         }
-        else
+        if (m_spRecorder)
         {
-            PacketizeMode0(pSampleBuffer, dwSampleSize, ts);
+            // a failed recording does not stop the stream
+            (void)m_spRecorder->WriteAccessUnit(llSampleTime, llSampleDur, MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE, pSampleBuffer, dwSampleSize);
         }
+        if (m_spCmafMuxer)
+        {
+            SendCmaf(llSampleTime, llSampleDur, MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE, pSampleBuffer, dwSampleSize);
+        }
+        EndSample(llSampleTime);
     }
     catch (winrt::hresult_error const& ex)
     {
@@ -441,6 +674,166 @@ INetworkMediaStreamSink* RTPVideoStreamSink::CreateInstance(IMFMediaType* pMedia
 {
     winrt::com_ptr<RTPVideoStreamSink> pVS;
     pVS.attach(new RTPVideoStreamSink(pMediaType, pParent, dwStreamID));
+    UINT32 pathLength = 0;
+    if (SUCCEEDED(pMediaType->GetStringLength(MF_NETWORKSTREAM_TIMESHIFT_FILE, &pathLength)))
+    {
+        std::wstring path(pathLength + 1, L'\0');
+        winrt::check_hresult(pMediaType->GetString(MF_NETWORKSTREAM_TIMESHIFT_FILE, path.data(), pathLength + 1, nullptr));
+        path.resize(pathLength);
+        pVS->m_spTimeshift = std::make_shared<CTimeshiftStore>(path, MFGetAttributeUINT64(pMediaType, MF_NETWORKSTREAM_TIMESHIFT_SIZE, timeshiftDefaultSize));
+    }
+    if (SUCCEEDED(pMediaType->GetStringLength(MF_NETWORKSTREAM_RECORDING_PATH, &pathLength)))
+    {
+        pVS->m_spRecorder.attach(RecordingStreamSink::CreateInstance(pMediaType, pParent, dwStreamID));
+    }
     return pVS.as<INetworkMediaStreamSink>().detach();
 }
 
+// A transport handler with the "cmaf" protocol gets the stream as CMAF instead of RTP: the init segment,
+// then parts of the params "part=<duration in 100ns units>" each in one buffer. A part that starts a
+// segment, at each IDR, begins with a styp box. The buffers are shared by all the cmaf handlers.
+STDMETHODIMP RTPVideoStreamSink::AddTransportHandler(ABI::PacketHandler* packetHandler, LPCWSTR protocol /*= L"rtp"*/, LPCWSTR params /*= L""*/) try
+{
+    winrt::check_pointer(protocol);
+    if (std::wstring(protocol) != L"cmaf")
+    {
+        return RTPStreamSinkBase::AddTransportHandler(packetHandler, protocol, params);
+    }
+    auto lock = std::lock_guard(m_guardlock);
+    winrt::check_pointer(packetHandler);
+    winrt::check_pointer(params);
+    winrt::PacketHandler handler;
+    winrt::copy_from_abi(handler, packetHandler);
+    if (!m_spCmafMuxer)
+    {
+        winrt::com_ptr<IMFMediaType> spMediaType;
+        winrt::check_hresult(m_spMTHandler->GetCurrentMediaType(spMediaType.put()));
+        UINT32 width = 0, height = 0;
+        winrt::check_hresult(MFGetAttributeSize(spMediaType.get(), MF_MT_FRAME_SIZE, &width, &height));
+        m_spCmafMuxer = std::make_unique<CCmafMuxer>(width, height);
+        if (m_pVideoHeader)
+        {
+            m_spCmafMuxer->SetParameterSets(m_pVideoHeader, m_VideoHeaderSize);
+        }
+        m_llCmafPartDuration = cmafDefaultPartDuration;
+        LONGLONG hnsPartDuration;
+        if (ParseParam(winrt::to_string(params), "part=", hnsPartDuration) && (hnsPartDuration > 0))
+        {
+            m_llCmafPartDuration = hnsPartDuration;
+        }
+    }
+    m_cmafHandlers.insert({ std::to_string((intptr_t)packetHandler), handler });
+    if (m_cmafInitSegment)
+    {
+        // it starts with the next segment
+        handler(nullptr, m_cmafInitSegment);
+    }
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTPVideoStreamSink::RemoveTransportHandler(ABI::PacketHandler* packetHandler) try
+{
+    {
+        auto lock = std::lock_guard(m_guardlock);
+        winrt::check_pointer(packetHandler);
+        if (m_cmafHandlers.erase(std::to_string((intptr_t)packetHandler)))
+        {
+            if (m_cmafHandlers.empty())
+            {
+                m_spCmafMuxer.reset();
+                m_cmafInitSegment = nullptr;
+            }
+            return S_OK;
+        }
+    }
+    return RTPStreamSinkBase::RemoveTransportHandler(packetHandler);
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+// A part ends before the sample that would make it longer than the part duration, which the playlists
+// advertise as the part target, and at each IDR so that a segment can start with one
+void RTPVideoStreamSink::SendCmaf(LONGLONG hnsTime, LONGLONG hnsDuration, bool bIdr, const BYTE* pData, size_t size)
+{
+    auto pending = m_spCmafMuxer->PendingSamples();
+    // the muxer gives a sample without a duration the one of the last sample, the average stands for it here
+    auto hnsNext = (hnsDuration > 0) ? hnsDuration : (pending ? m_spCmafMuxer->PendingDuration() / (LONGLONG)pending : 0);
+    if (pending && (bIdr || (m_spCmafMuxer->PendingDuration() + hnsNext > m_llCmafPartDuration)))
+    {
+        auto part = m_spCmafMuxer->PendingStartsWithIdr() ? CCmafMuxer::SegmentType() : std::vector<BYTE>();
+        auto chunk = m_spCmafMuxer->Chunk();
+        part.insert(part.end(), chunk.begin(), chunk.end());
+        winrt::Windows::Storage::Streams::Buffer buf((uint32_t)part.size());
+        memcpy(buf.data(), part.data(), part.size());
+        buf.Length((uint32_t)part.size());
+        SendCmafBuffer(buf);
+    }
+    m_spCmafMuxer->AddSample(hnsTime, hnsDuration, bIdr, pData, size);
+    if (!m_cmafInitSegment && m_spCmafMuxer->HasInitSegment())
+    {
+        auto& init = m_spCmafMuxer->InitSegment();
+        winrt::Windows::Storage::Streams::Buffer buf((uint32_t)init.size());
+        memcpy(buf.data(), init.data(), init.size());
+        buf.Length((uint32_t)init.size());
+        m_cmafInitSegment = buf;
+        SendCmafBuffer(m_cmafInitSegment);
+    }
+}
+
+void RTPVideoStreamSink::SendCmafBuffer(winrt::Windows::Storage::Streams::IBuffer const& buf)
+{
+    for (auto& handler : m_cmafHandlers)
+    {
+        try
+        {
+            handler.second(nullptr, buf);
+        }
+        catch (winrt::hresult_error const&)
+        {
+            // a handler that fails misses the part, the others still get it
+        }
+    }
+}
+
+// The recording ends its segment when the stream stops
+STDMETHODIMP RTPVideoStreamSink::Stop(MFTIME hnsSystemTime)
+{
+    if (m_spRecorder)
+    {
+        (void)m_spRecorder->Stop(hnsSystemTime);
+    }
+    return RTPStreamSinkBase::Stop(hnsSystemTime);
+}
+
+STDMETHODIMP RTPVideoStreamSink::Shutdown()
+{
+    if (m_spRecorder)
+    {
+        (void)m_spRecorder->Shutdown();
+    }
+    return RTPStreamSinkBase::Shutdown();
+}
+
+STDMETHODIMP RTPVideoStreamSink::GetTimeshiftRange(LONGLONG* phnsOldest, LONGLONG* phnsNewest, uint64_t* pAccessUnitsDropped)
+{
+    RETURN_IF_NULL(phnsOldest);
+    RETURN_IF_NULL(phnsNewest);
+    RETURN_IF_NULL(pAccessUnitsDropped);
+    if (!m_spTimeshift)
+    {
+        return MF_E_NOT_AVAILABLE;
+    }
+    *pAccessUnitsDropped = m_spTimeshift->AccessUnitsDropped();
+    return m_spTimeshift->GetRange(*phnsOldest, *phnsNewest) ? S_OK : HRESULT_FROM_WIN32(ERROR_NO_DATA);
+}
+
+// The same IDR a player added now for hnsTime would start from
+STDMETHODIMP RTPVideoStreamSink::GetTimeshiftStart(LONGLONG hnsTime, LONGLONG* phnsStart)
+{
+    RETURN_IF_NULL(phnsStart);
+    if (!m_spTimeshift)
+    {
+        return MF_E_NOT_AVAILABLE;
+    }
+    uint64_t position;
+    return m_spTimeshift->Seek(hnsTime, position, *phnsStart) ? S_OK : HRESULT_FROM_WIN32(ERROR_NO_DATA);
+}
+
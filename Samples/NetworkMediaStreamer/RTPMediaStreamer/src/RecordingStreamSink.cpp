@@ -0,0 +1,323 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+namespace
+{
+    uint32_t FrameWidth(IMFMediaType* pMediaType)
+    {
+        UINT32 width = 0, height = 0;
+        (void)MFGetAttributeSize(pMediaType, MF_MT_FRAME_SIZE, &width, &height);
+        return width;
+    }
+
+    uint32_t FrameHeight(IMFMediaType* pMediaType)
+    {
+        UINT32 width = 0, height = 0;
+        (void)MFGetAttributeSize(pMediaType, MF_MT_FRAME_SIZE, &width, &height);
+        return height;
+    }
+}
+
+RecordingStreamSink::RecordingStreamSink(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
+    : NwMediaStreamSinkBase(pMediaType, pParent, dwStreamID)
+    , m_muxer(FrameWidth(pMediaType), FrameHeight(pMediaType))
+    , m_llFragmentDuration((LONGLONG)MFGetAttributeUINT64(pMediaType, MF_NETWORKSTREAM_RECORDING_FRAGMENT_DURATION, recordingDefaultFragmentDuration))
+    , m_llSegmentDuration((LONGLONG)MFGetAttributeUINT64(pMediaType, MF_NETWORKSTREAM_RECORDING_SEGMENT_DURATION, recordingDefaultSegmentDuration))
+    , m_preallocation(recordingDefaultPreallocation)
+    , m_bUnbuffered(MFGetAttributeUINT32(pMediaType, MF_NETWORKSTREAM_RECORDING_UNBUFFERED, FALSE) != FALSE)
+    , m_uSegment(0)
+    , m_uSegmentCount(0)
+    , m_llSegmentStart(0)
+    , m_llFragmentStart(0)
+    , m_queuedBytes(0)
+    , m_bStop(false)
+    , m_uFragmentsDropped(0)
+    , m_hrWrite(S_OK)
+    , m_uFileSegment(0)
+    , m_fileSize(0)
+    , m_pStaging(nullptr)
+    , m_stagedBytes(0)
+{
+    UINT32 pathLength = 0;
+    winrt::check_hresult(pMediaType->GetStringLength(MF_NETWORKSTREAM_RECORDING_PATH, &pathLength));
+    m_path.resize(pathLength + 1);
+    winrt::check_hresult(pMediaType->GetString(MF_NETWORKSTREAM_RECORDING_PATH, m_path.data(), pathLength + 1, nullptr));
+    m_path.resize(pathLength);
+
+    // a quarter more than the segment takes at the average bitrate, a segment that needs more grows its file
+    UINT32 bitrate = MFGetAttributeUINT32(pMediaType, MF_MT_AVG_BITRATE, 0);
+    if (bitrate)
+    {
+        m_preallocation = ((uint64_t)bitrate / 8) * (uint64_t)(m_llSegmentDuration / 10000000) * 5 / 4;
+    }
+    if (m_pVideoHeader)
+    {
+        m_muxer.SetParameterSets(m_pVideoHeader, m_VideoHeaderSize);
+    }
+
+    // page aligned, as unbuffered writes require
+    m_pStaging = (BYTE*)VirtualAlloc(nullptr, recordingStagingSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!m_pStaging)
+    {
+        winrt::throw_last_error();
+    }
+    m_writer = std::thread(&RecordingStreamSink::WriterThread, this);
+}
+
+RecordingStreamSink::~RecordingStreamSink()
+{
+    (void)Shutdown();
+    if (m_pStaging)
+    {
+        VirtualFree(m_pStaging, 0, MEM_RELEASE);
+    }
+}
+
+RecordingStreamSink* RecordingStreamSink::CreateInstance(IMFMediaType* pMediaType, IMFMediaSink* pParent, DWORD dwStreamID)
+{
+    winrt::com_ptr<RecordingStreamSink> pRS;
+    pRS.attach(new RecordingStreamSink(pMediaType, pParent, dwStreamID));
+    return pRS.detach();
+}
+
+STDMETHODIMP RecordingStreamSink::PacketizeAndSend(IMFSample* pSample) noexcept
+{
+    winrt::com_ptr<IMFMediaBuffer> spMediaBuf;
+    LONGLONG llSampleTime, llSampleDur = 0;
+    DWORD dwSampleSize, maxLen;
+    BYTE* pSampleBuffer = nullptr;
+    HRESULT hr = S_OK;
+    try
+    {
+        winrt::check_pointer(pSample);
+        winrt::check_hresult(pSample->GetBufferByIndex(0, spMediaBuf.put()));
+        winrt::check_hresult(spMediaBuf->Lock(&pSampleBuffer, &maxLen, &dwSampleSize));
+        winrt::check_hresult(pSample->GetSampleTime(&llSampleTime));
+        (void)pSample->GetSampleDuration(&llSampleDur);
+        hr = WriteAccessUnit(llSampleTime, llSampleDur, MFGetAttributeUINT32(pSample, MFSampleExtension_CleanPoint, FALSE) != FALSE, pSampleBuffer, dwSampleSize);
+    }
+    catch (winrt::hresult_error const& ex)
+    {
+        hr = ex.code();
+    }
+
+    if (spMediaBuf && pSampleBuffer)
+    {
+        spMediaBuf->Unlock();
+    }
+    return hr;
+}
+
+// Adds the access unit to the chunk being built. An IDR that comes once the fragment is long enough ends it,
+// and once the segment is long enough the segment too; the chunk is queued for the writer first. A chunk
+// that lasts the fragment duration without an IDR is queued as well, the fragment goes on in the next one.
+HRESULT RecordingStreamSink::WriteAccessUnit(LONGLONG hnsTime, LONGLONG hnsDuration, bool bIdr, const BYTE* pData, size_t size) noexcept try
+{
+    auto lock = std::lock_guard(m_lock);
+    RETURN_IF_SHUTDOWN;
+    winrt::check_hresult(m_hrWrite.load());
+    bool bFragmentEnd = bIdr && ((hnsTime - m_llFragmentStart) >= m_llFragmentDuration);
+    if (m_uSegment && bIdr && ((hnsTime - m_llSegmentStart) >= m_llSegmentDuration))
+    {
+        CloseSegment();
+    }
+    else if (bFragmentEnd || (m_muxer.PendingDuration() >= m_llFragmentDuration))
+    {
+        Queue(m_muxer.Chunk(), false, true);
+    }
+    // a segment starts with an IDR
+    if ((!m_uSegment && !bIdr) || !m_muxer.AddSample(hnsTime, hnsDuration, bIdr, pData, size))
+    {
+        return S_OK;
+    }
+    if (!m_uSegment)
+    {
+        m_uSegment = ++m_uSegmentCount;
+        m_llSegmentStart = hnsTime;
+        m_llFragmentStart = hnsTime;
+        Queue(std::vector<BYTE>(m_muxer.InitSegment()), false, false);
+    }
+    else if (bFragmentEnd)
+    {
+        m_llFragmentStart = hnsTime;
+    }
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+// m_lock is held
+void RecordingStreamSink::CloseSegment()
+{
+    if (m_uSegment)
+    {
+        Queue(m_muxer.Chunk(), true, false);
+        m_uSegment = 0;
+    }
+}
+
+// Fragments beyond the queue limit are dropped rather than holding up the live path, the segment then
+// has a gap in its decode times
+void RecordingStreamSink::Queue(std::vector<BYTE>&& data, bool bClose, bool bDroppable)
+{
+    {
+        auto lock = std::lock_guard(m_queueLock);
+        if (bDroppable && ((m_queuedBytes + data.size()) > recordingMaxQueuedBytes))
+        {
+            m_uFragmentsDropped++;
+            return;
+        }
+        m_queuedBytes += data.size();
+        m_queue.push_back({ m_uSegment, std::move(data), bClose });
+    }
+    m_queued.notify_one();
+}
+
+STDMETHODIMP RecordingStreamSink::Stop(MFTIME hnsSystemTime)
+{
+    {
+        auto lock = std::lock_guard(m_lock);
+        CloseSegment();
+    }
+    return NwMediaStreamSinkBase::Stop(hnsSystemTime);
+}
+
+STDMETHODIMP RecordingStreamSink::Shutdown()
+{
+    {
+        auto lock = std::lock_guard(m_lock);
+        CloseSegment();
+        auto queueLock = std::lock_guard(m_queueLock);
+        m_bStop = true;
+    }
+    m_queued.notify_one();
+    if (m_writer.joinable())
+    {
+        m_writer.join();
+    }
+    auto lock = std::lock_guard(m_lock);
+    return NwMediaStreamSinkBase::Shutdown();
+}
+
+// Takes all the queued requests at once, so the fragments that piled up while the disk was busy go out in
+// as few writes as the staging buffer allows
+void RecordingStreamSink::WriterThread()
+{
+    std::deque<WriteRequest> batch;
+    std::unique_lock lock(m_queueLock);
+    while (true)
+    {
+        m_queued.wait(lock, [this] { return m_bStop || !m_queue.empty(); });
+        if (m_queue.empty())
+        {
+            break;
+        }
+        batch.swap(m_queue);
+        m_queuedBytes = 0;
+        lock.unlock();
+        for (auto& request : batch)
+        {
+            if (SUCCEEDED(m_hrWrite.load()))
+            {
+                try
+                {
+                    Write(request);
+                }
+                catch (winrt::hresult_error const& ex)
+                {
+                    m_hrWrite = ex.code();
+                    m_file.close();
+                }
+            }
+        }
+        if (SUCCEEDED(m_hrWrite.load()) && m_file)
+        {
+            try
+            {
+                WriteStaged(false);
+            }
+            catch (winrt::hresult_error const& ex)
+            {
+                m_hrWrite = ex.code();
+                m_file.close();
+            }
+        }
+        batch.clear();
+        lock.lock();
+    }
+}
+
+void RecordingStreamSink::Write(WriteRequest const& request)
+{
+    if (request.segment != m_uFileSegment)
+    {
+        CloseFile();
+        auto path = m_path + L"_" + std::to_wstring(request.segment) + L".mp4";
+        DWORD flags = m_bUnbuffered ? (FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH) : FILE_FLAG_SEQUENTIAL_SCAN;
+        m_file.attach(CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | flags, nullptr));
+        if (!m_file)
+        {
+            winrt::throw_last_error();
+        }
+        // allocate the clusters up front so the file does not fragment as it grows
+        LARGE_INTEGER position;
+        position.QuadPart = (LONGLONG)((m_preallocation + recordingBlockSize - 1) & ~(uint64_t)(recordingBlockSize - 1));
+        winrt::check_bool(SetFilePointerEx(m_file.get(), position, nullptr, FILE_BEGIN));
+        winrt::check_bool(SetEndOfFile(m_file.get()));
+        position.QuadPart = 0;
+        winrt::check_bool(SetFilePointerEx(m_file.get(), position, nullptr, FILE_BEGIN));
+        m_uFileSegment = request.segment;
+        m_fileSize = 0;
+        m_stagedBytes = 0;
+    }
+
+    size_t offset = 0;
+    while (offset < request.data.size())
+    {
+        auto count = std::min(request.data.size() - offset, recordingStagingSize - m_stagedBytes);
+        memcpy(m_pStaging + m_stagedBytes, request.data.data() + offset, count);
+        m_stagedBytes += count;
+        m_fileSize += count;
+        offset += count;
+        if (m_stagedBytes == recordingStagingSize)
+        {
+            WriteStaged(false);
+        }
+    }
+    if (request.bClose)
+    {
+        CloseFile();
+    }
+}
+
+// Writes the whole blocks of the staging buffer and keeps the rest for the next write, or with bFlush
+// writes everything padded to a whole block
+void RecordingStreamSink::WriteStaged(bool bFlush)
+{
+    size_t size = bFlush ? ((m_stagedBytes + recordingBlockSize - 1) & ~(recordingBlockSize - 1)) : (m_stagedBytes & ~(recordingBlockSize - 1));
+    if (!size)
+    {
+        return;
+    }
+    memset(m_pStaging + m_stagedBytes, 0, size - std::min(size, m_stagedBytes));
+    DWORD written = 0;
+    winrt::check_bool(WriteFile(m_file.get(), m_pStaging, (DWORD)size, &written, nullptr));
+    auto remaining = (size > m_stagedBytes) ? 0 : (m_stagedBytes - size);
+    memmove(m_pStaging, m_pStaging + size, remaining);
+    m_stagedBytes = remaining;
+}
+
+// Writes what is staged and truncates the preallocated file to the size of the segment
+void RecordingStreamSink::CloseFile()
+{
+    if (!m_file)
+    {
+        return;
+    }
+    WriteStaged(true);
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)m_fileSize;
+    winrt::check_bool(SetFilePointerEx(m_file.get(), position, nullptr, FILE_BEGIN));
+    winrt::check_bool(SetEndOfFile(m_file.get()));
+    m_file.close();
+}
@@ -0,0 +1,349 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+constexpr auto timeshiftPollInterval = std::chrono::milliseconds(100);
+
+CTimeshiftStore::CTimeshiftStore(std::wstring const& path, uint64_t size)
+    : m_pView(nullptr)
+    , m_size(size & ~7ull)
+    , m_llNewestTime(0)
+    , m_writePosition(0)
+    , m_reservedPosition(0)
+    , m_queuedBytes(0)
+    , m_bDropUntilIdr(true)
+    , m_bStop(false)
+    , m_uDropped(0)
+{
+    m_file.attach(CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!m_file)
+    {
+        winrt::throw_last_error();
+    }
+    // preallocated, the writes never grow the file
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = (LONGLONG)m_size;
+    winrt::check_bool(SetFilePointerEx(m_file.get(), fileSize, nullptr, FILE_BEGIN));
+    winrt::check_bool(SetEndOfFile(m_file.get()));
+    m_mapping.attach(CreateFileMappingW(m_file.get(), nullptr, PAGE_READWRITE, (DWORD)(m_size >> 32), (DWORD)m_size, nullptr));
+    if (!m_mapping)
+    {
+        winrt::throw_last_error();
+    }
+    m_pView = (BYTE*)MapViewOfFile(m_mapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)m_size);
+    if (!m_pView)
+    {
+        winrt::throw_last_error();
+    }
+    m_writer = std::thread(&CTimeshiftStore::WriterThread, this);
+}
+
+CTimeshiftStore::~CTimeshiftStore()
+{
+    {
+        auto lock = std::lock_guard(m_queueLock);
+        m_bStop = true;
+    }
+    m_queued.notify_one();
+    if (m_writer.joinable())
+    {
+        m_writer.join();
+    }
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+}
+
+// Called on the live path: copies the access unit to the write queue, or drops it if the writer is too far
+// behind. After a drop the store resumes at the next IDR so that every stored access unit is decodable.
+void CTimeshiftStore::Append(LONGLONG hnsTime, bool bIdr, const BYTE* pData, size_t size)
+{
+    if (!size)
+    {
+        return;
+    }
+    TimeshiftAccessUnit au = { hnsTime, bIdr, std::vector<BYTE>(pData, pData + size) };
+    {
+        auto lock = std::lock_guard(m_queueLock);
+        bool bFits = ((m_queuedBytes + size) <= timeshiftMaxQueuedBytes) && ((sizeof(RecordHeader) + size) <= (m_size / 2));
+        if (bIdr && bFits)
+        {
+            m_bDropUntilIdr = false;
+        }
+        if (m_bDropUntilIdr || !bFits)
+        {
+            m_bDropUntilIdr = true;
+            m_uDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_queuedBytes += size;
+        m_queue.push_back(std::move(au));
+    }
+    m_queued.notify_one();
+}
+
+void CTimeshiftStore::WriterThread()
+{
+    std::unique_lock lock(m_queueLock);
+    while (true)
+    {
+        m_queued.wait(lock, [this] { return m_bStop || !m_queue.empty(); });
+        if (m_bStop)
+        {
+            break;
+        }
+        auto au = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_queuedBytes -= au.data.size();
+        lock.unlock();
+        Write(au);
+        lock.lock();
+    }
+}
+
+// The reserved position is published before the bytes change and readers check it after they copied a
+// record, seqlock style, so a reader never returns a record that was overwritten under it.
+void CTimeshiftStore::Write(TimeshiftAccessUnit const& au)
+{
+    size_t recordSize = (sizeof(RecordHeader) + au.data.size() + 7) & ~(size_t)7;
+    uint64_t start = m_writePosition.load(std::memory_order_relaxed);
+    auto offset = (size_t)(start % m_size);
+    bool bPad = recordSize > (m_size - offset);
+    if (bPad)
+    {
+        // records do not wrap, skip the end of the file
+        start += m_size - offset;
+    }
+    m_reservedPosition.store(start + recordSize, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (bPad && ((m_size - offset) >= sizeof(RecordHeader)))
+    {
+        RecordHeader padding = { 0, 0, 0 };
+        memcpy(m_pView + offset, &padding, sizeof(padding));
+    }
+
+    RecordHeader header = { (uint32_t)au.data.size(), au.bIdr ? recordIdr : 0, au.hnsTime };
+    auto pRecord = m_pView + (size_t)(start % m_size);
+    memcpy(pRecord, &header, sizeof(header));
+    memcpy(pRecord + sizeof(header), au.data.data(), au.data.size());
+
+    {
+        auto lock = std::lock_guard(m_indexLock);
+        if (au.bIdr)
+        {
+            m_index.push_back({ au.hnsTime, start });
+        }
+        m_llNewestTime = au.hnsTime;
+        m_writePosition.store(start + recordSize, std::memory_order_release);
+        ExpireIndex();
+    }
+    m_written.notify_all();
+}
+
+// Drops the index entries of the records the writer went over, the index lock is held
+void CTimeshiftStore::ExpireIndex()
+{
+    auto reserved = m_reservedPosition.load(std::memory_order_relaxed);
+    while (!m_index.empty() && ((m_index.front().position + m_size) < reserved))
+    {
+        m_index.pop_front();
+    }
+}
+
+// Position and time of the last IDR at or before hnsTime, or of the oldest one if they are all later. False
+// if the store has no IDR yet.
+bool CTimeshiftStore::Seek(LONGLONG hnsTime, uint64_t& position, LONGLONG& hnsIdrTime)
+{
+    auto lock = std::lock_guard(m_indexLock);
+    ExpireIndex();
+    if (m_index.empty())
+    {
+        return false;
+    }
+    auto it = std::upper_bound(m_index.begin(), m_index.end(), hnsTime, [](LONGLONG t, IndexEntry const& e) { return t < e.hnsTime; });
+    auto& entry = (it == m_index.begin()) ? *it : *std::prev(it);
+    position = entry.position;
+    hnsIdrTime = entry.hnsTime;
+    return true;
+}
+
+// Copies the access unit at position and moves position to the next one
+CTimeshiftStore::ReadResult CTimeshiftStore::Read(uint64_t& position, TimeshiftAccessUnit& au)
+{
+    while (true)
+    {
+        if (position >= m_writePosition.load(std::memory_order_acquire))
+        {
+            return ReadResult::Pending;
+        }
+        if ((position + m_size) < m_reservedPosition.load(std::memory_order_relaxed))
+        {
+            return ReadResult::Overwritten;
+        }
+        auto offset = (size_t)(position % m_size);
+        if ((m_size - offset) < sizeof(RecordHeader))
+        {
+            position += m_size - offset;
+            continue;
+        }
+        RecordHeader header;
+        memcpy(&header, m_pView + offset, sizeof(header));
+        if (header.size == 0)
+        {
+            position += m_size - offset;
+            continue;
+        }
+        if (header.size > (m_size - offset - sizeof(header)))
+        {
+            return ReadResult::Overwritten;
+        }
+        au.hnsTime = header.hnsTime;
+        au.bIdr = (header.flags & recordIdr) != 0;
+        au.data.assign(m_pView + offset + sizeof(header), m_pView + offset + sizeof(header) + header.size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((position + m_size) < m_reservedPosition.load(std::memory_order_relaxed))
+        {
+            return ReadResult::Overwritten;
+        }
+        position += (sizeof(RecordHeader) + header.size + 7) & ~(uint64_t)7;
+        return ReadResult::Ok;
+    }
+}
+
+void CTimeshiftStore::WaitForData(uint64_t position, std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(m_indexLock);
+    m_written.wait_for(lock, timeout, [this, position] { return m_writePosition.load(std::memory_order_relaxed) > position; });
+}
+
+bool CTimeshiftStore::GetRange(LONGLONG& hnsOldest, LONGLONG& hnsNewest)
+{
+    auto lock = std::lock_guard(m_indexLock);
+    ExpireIndex();
+    if (m_index.empty())
+    {
+        return false;
+    }
+    hnsOldest = m_index.front().hnsTime;
+    hnsNewest = m_llNewestTime;
+    return true;
+}
+
+CTimeshiftPlayer::CTimeshiftPlayer(std::shared_ptr<CTimeshiftStore> spStore, TxContext& client, std::mutex& clientLock, CH264Packetizer const& packetizer,
+    BYTE payloadType, uint32_t clockRate, LONGLONG hnsStart, double scale)
+    : m_spStore(spStore)
+    , m_client(client)
+    , m_clientLock(clientLock)
+    , m_packetizer(packetizer)
+    , m_pTxBuf((uint32_t)packetizer.MtuSize())
+    , m_payloadType(payloadType)
+    , m_clockRate(clockRate)
+    , m_llStart(hnsStart)
+    , m_scale(scale)
+    , m_bStop(false)
+{
+    m_player = std::thread(&CTimeshiftPlayer::PlayerThread, this);
+}
+
+CTimeshiftPlayer::~CTimeshiftPlayer()
+{
+    {
+        auto lock = std::lock_guard(m_lock);
+        m_bStop = true;
+    }
+    m_stopped.notify_one();
+    if (m_player.joinable())
+    {
+        m_player.join();
+    }
+}
+
+// false once the player is stopped
+bool CTimeshiftPlayer::WaitUntil(std::chrono::steady_clock::time_point time)
+{
+    std::unique_lock lock(m_lock);
+    return !m_stopped.wait_until(lock, time, [this] { return m_bStop; });
+}
+
+void CTimeshiftPlayer::OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker)
+{
+    m_pTxBuf.Length((uint32_t)size);
+    WriteRtpHeader(pPacket, m_payloadType, bMarker, (uint16_t)m_client.m_uSequenceNumber, timestamp, m_client.m_ssrc);
+    m_client.SendPacket(m_pTxBuf, bMarker);
+}
+
+// The stream is anchored at the first access unit sent: it goes out now with the RTP time of its sample
+// time, and the next ones (sample time - anchor) / scale later. A reader that falls so far behind that the
+// store overwrote its position starts again from the oldest IDR with a new anchor.
+void CTimeshiftPlayer::PlayerThread()
+{
+    uint64_t position = 0;
+    bool bPositioned = false;
+    bool bAnchored = false;
+    LONGLONG llAnchorTime = 0;
+    std::chrono::steady_clock::time_point anchor;
+    auto lastSenderReport = std::chrono::steady_clock::now() - std::chrono::seconds(rtcpSenderReportInterval / 10000000);
+    TimeshiftAccessUnit au;
+    try
+    {
+        while (WaitUntil(std::chrono::steady_clock::now()))
+        {
+            if (!bPositioned)
+            {
+                LONGLONG hnsIdrTime;
+                bPositioned = m_spStore->Seek(m_llStart, position, hnsIdrTime);
+                if (!bPositioned && !WaitUntil(std::chrono::steady_clock::now() + timeshiftPollInterval))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            auto result = m_spStore->Read(position, au);
+            if (result == CTimeshiftStore::ReadResult::Pending)
+            {
+                m_spStore->WaitForData(position, timeshiftPollInterval);
+                continue;
+            }
+            if (result == CTimeshiftStore::ReadResult::Overwritten)
+            {
+                m_llStart = LLONG_MIN;
+                bPositioned = bAnchored = false;
+                continue;
+            }
+
+            if (!bAnchored)
+            {
+                llAnchorTime = au.hnsTime;
+                anchor = std::chrono::steady_clock::now();
+                bAnchored = true;
+            }
+            auto hnsOffset = (LONGLONG)((au.hnsTime - llAnchorTime) / m_scale);
+            if (!WaitUntil(anchor + std::chrono::nanoseconds(hnsOffset * 100)))
+            {
+                break;
+            }
+
+            // the client state is shared with GetClientStats and the RTCP handling of the sink
+            auto clientLock = std::lock_guard(m_clientLock);
+            m_packetizer.Packetize(au.data.data(), au.data.size(), HnsToRtpTime(llAnchorTime + hnsOffset, m_clockRate), m_pTxBuf.data(), *this);
+
+            // sender reports map the scaled timeline to the wall clock, like the live ones
+            auto now = std::chrono::steady_clock::now();
+            if ((now - lastSenderReport) >= std::chrono::seconds(rtcpSenderReportInterval / 10000000))
+            {
+                lastSenderReport = now;
+                FILETIME ft;
+                GetSystemTimePreciseAsFileTime(&ft);
+                auto hnsElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - anchor).count() / 100;
+                m_client.SendSenderReport(HnsToRtpTime(llAnchorTime + hnsElapsed, m_clockRate), (((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime);
+            }
+        }
+    }
+    catch (winrt::hresult_error const&)
+    {
+        // the transport of the client failed, it stops receiving the stream until it is removed
+    }
+}
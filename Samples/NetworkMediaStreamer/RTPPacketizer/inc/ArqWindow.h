@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Retransmission core of the ARQ transport on plain byte buffers: the window of the RTP packets sent, the
+// RTCP generic NACKs (RFC 4585 section 6.2.1) asking for them again, and the latency past which they are
+// not sent again. It has no Windows dependency so it can be tested over loopback on any platform;
+// CArqSender is an adapter over it that adds the socket and the encryption.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t arqHistorySize = 4096;                         // packets kept for retransmission, power of 2
+constexpr uint8_t rtcpTypeRtpfb = 205;
+constexpr uint8_t rtcpFmtGenericNack = 1;
+constexpr size_t rtcpGenericNackHeaderSize = 12;                // header, sender SSRC, media SSRC
+
+class CArqWindow
+{
+public:
+    struct SentPacket
+    {
+        std::vector<uint8_t> data;                              // as sent
+        uint16_t sequenceNumber;
+        int64_t hnsSendTime;
+        int64_t hnsLastRetransmit;                              // 0 if it was not sent again
+    };
+
+    // hnsLatency is the latency window of the receiver, in 100ns units
+    CArqWindow(int64_t hnsLatency)
+        : m_hnsLatency(hnsLatency)
+        , m_history(arqHistorySize)
+    {
+        for (auto& packet : m_history)
+        {
+            packet.sequenceNumber = 0;
+            packet.hnsSendTime = 0;
+            packet.hnsLastRetransmit = 0;
+        }
+    }
+
+    int64_t Latency() const { return m_hnsLatency; }
+
+    // Keeps a copy of an RTP packet sent at hnsNow, in place of the one with the same sequence number modulo
+    // arqHistorySize. The copy is what is sent again, the caller can change it, e.g. encrypt it, and send it.
+    SentPacket& Store(const uint8_t* pPacket, size_t size, int64_t hnsNow)
+    {
+        uint16_t sequenceNumber = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+        auto& packet = m_history[sequenceNumber & (arqHistorySize - 1)];
+        packet.data.assign(pPacket, pPacket + size);
+        packet.sequenceNumber = sequenceNumber;
+        packet.hnsSendTime = hnsNow;
+        packet.hnsLastRetransmit = 0;
+        return packet;
+    }
+
+    // Calls send(data) for the packets of a NACK entry, pid and the bitmask of the 16 packets following it,
+    // that are still in the window. A packet sent more than the latency ago is not, the receiver has played
+    // past it, nor one sent again less than rttUs ago, before the previous retransmission could have arrived.
+    // Returns the number of packets send returned true for.
+    template <typename SendFn>
+    uint32_t Retransmit(uint16_t pid, uint16_t blp, uint32_t rttUs, int64_t hnsNow, SendFn&& send)
+    {
+        int64_t hnsMinInterval = (int64_t)rttUs * 10;
+        uint32_t count = 0;
+        for (uint32_t i = 0; i <= 16; i++)
+        {
+            if (i && !(blp & (1 << (i - 1))))
+            {
+                continue;
+            }
+            uint16_t sequenceNumber = (uint16_t)(pid + i);
+            auto& packet = m_history[sequenceNumber & (arqHistorySize - 1)];
+            if (packet.data.empty() || (packet.sequenceNumber != sequenceNumber) || ((hnsNow - packet.hnsSendTime) > m_hnsLatency)
+                || (packet.hnsLastRetransmit && ((hnsNow - packet.hnsLastRetransmit) < hnsMinInterval)))
+            {
+                continue;
+            }
+            packet.hnsLastRetransmit = hnsNow;
+            if (send(packet.data))
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+private:
+    int64_t m_hnsLatency;
+    std::vector<SentPacket> m_history;                          // indexed by sequence number
+};
+
+// Calls onNack(mediaSsrc, pid, blp) for each entry of an RTCP packet, one of a compound packet of length
+// bytes, if it is a generic NACK: RTPFB with FMT 1, sender SSRC, media SSRC, then PID and BLP pairs.
+// False if it is not one.
+template <typename NackFn>
+inline bool ReadGenericNack(const uint8_t* pRtcp, size_t length, NackFn&& onNack)
+{
+    if ((length < rtcpGenericNackHeaderSize) || (pRtcp[1] != rtcpTypeRtpfb) || ((pRtcp[0] & 0x1F) != rtcpFmtGenericNack))
+    {
+        return false;
+    }
+    uint32_t mediaSsrc = ((uint32_t)pRtcp[8] << 24) | ((uint32_t)pRtcp[9] << 16) | ((uint32_t)pRtcp[10] << 8) | pRtcp[11];
+    for (size_t fci = rtcpGenericNackHeaderSize; (fci + 4) <= length; fci += 4)
+    {
+        onNack(mediaSsrc, (uint16_t)((pRtcp[fci] << 8) | pRtcp[fci + 1]), (uint16_t)((pRtcp[fci + 2] << 8) | pRtcp[fci + 3]));
+    }
+    return true;
+}
+
+// Generic NACK of the lost sequence numbers, in sending order: a lost packet within the 16 following the
+// PID of the last entry is a bit of its BLP, any other starts an entry
+inline std::vector<uint8_t> WriteGenericNack(uint32_t senderSsrc, uint32_t mediaSsrc, std::vector<uint16_t> const& lost)
+{
+    std::vector<uint8_t> out(rtcpGenericNackHeaderSize);
+    out[0] = 0x80 | rtcpFmtGenericNack;                         // RTCP version
+    out[1] = rtcpTypeRtpfb;
+    for (int i = 0; i < 4; i++)
+    {
+        out[4 + i] = (uint8_t)(senderSsrc >> (24 - 8 * i));
+        out[8 + i] = (uint8_t)(mediaSsrc >> (24 - 8 * i));
+    }
+    uint16_t pid = 0;
+    for (auto sequenceNumber : lost)
+    {
+        uint16_t offset = (uint16_t)(sequenceNumber - pid);
+        if ((out.size() > rtcpGenericNackHeaderSize) && (offset >= 1) && (offset <= 16))
+        {
+            uint16_t blp = (uint16_t)((out[out.size() - 2] << 8) | out.back()) | (uint16_t)(1 << (offset - 1));
+            out[out.size() - 2] = (uint8_t)(blp >> 8);
+            out.back() = (uint8_t)blp;
+            continue;
+        }
+        pid = sequenceNumber;
+        out.insert(out.end(), { (uint8_t)(pid >> 8), (uint8_t)pid, 0, 0 });
+    }
+    // length in 32 bit words minus one
+    uint16_t words = (uint16_t)(out.size() / 4 - 1);
+    out[2] = (uint8_t)(words >> 8);
+    out[3] = (uint8_t)words;
+    return out;
+}
@@ -0,0 +1,201 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// H.264 RTP packetization (RFC 6184) on plain byte buffers. It has no Windows dependency so the
+// packetizer can be tested and benchmarked on any platform; RTPVideoStreamSink is an adapter over it.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+constexpr uint8_t h264payloadType = 96;
+constexpr uint32_t videoClockRate = 90000;
+constexpr size_t rtpHeaderSize = 12;
+constexpr size_t stapAtypeHeaderSize = 1;
+constexpr size_t stapASzHeaderSize = 2;
+
+// RTP timestamp of a presentation time in 100ns units. Every stream sink converts from the same
+// presentation clock, so the tracks of a session share one time base; the RTCP sender reports map it
+// to wall clock time for the receiver to line up audio and video.
+inline uint32_t HnsToRtpTime(int64_t hnsTime, uint32_t clockRate)
+{
+    // split to keep hnsTime * clockRate from overflowing
+    return (uint32_t)((hnsTime / 10000000) * clockRate + ((hnsTime % 10000000) * clockRate) / 10000000);
+}
+
+// 12 byte RTP header (RFC 3550 section 5.1), no CSRC
+inline void WriteRtpHeader(uint8_t* pOut, uint8_t payloadType, bool bMarker, uint16_t sequenceNumber, uint32_t timestamp, uint32_t ssrc)
+{
+    pOut[0] = 0x80;                                             // RTP version
+    pOut[1] = (uint8_t)(bMarker ? (payloadType | (1 << 7)) : payloadType);
+    pOut[2] = (uint8_t)(sequenceNumber >> 8);
+    pOut[3] = (uint8_t)(sequenceNumber & 0xFF);
+    pOut[4] = (uint8_t)(timestamp >> 24);
+    pOut[5] = (uint8_t)(timestamp >> 16);
+    pOut[6] = (uint8_t)(timestamp >> 8);
+    pOut[7] = (uint8_t)(timestamp);
+    pOut[8] = (uint8_t)(ssrc >> 24);
+    pOut[9] = (uint8_t)(ssrc >> 16);
+    pOut[10] = (uint8_t)(ssrc >> 8);
+    pOut[11] = (uint8_t)(ssrc);
+}
+
+// Receives the packets of a packetizer. The first rtpHeaderSize bytes of a packet are left for the
+// RTP header, which depends on the client. The packet buffer is reused for the next packet.
+class IRtpPacketSink
+{
+public:
+    virtual ~IRtpPacketSink() = default;
+    virtual void OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker) = 0;
+};
+
+class CH264Packetizer
+{
+public:
+    // mode 0 sends one NAL unit per packet, mode 1 aggregates small NAL units in STAP-A packets and
+    // fragments large ones in FU-A packets
+    CH264Packetizer(uint32_t packetizationMode = 1, size_t mtuSize = 1500)
+        : m_packetizationMode(packetizationMode)
+        , m_mtuSize(mtuSize)
+    {
+    }
+
+    uint32_t PacketizationMode() const { return m_packetizationMode; }
+    size_t MtuSize() const { return m_mtuSize; }
+
+    // Packetizes an Annex B access unit; pPacket is the packet buffer of MtuSize() bytes. Returns the number of
+    // NAL units dropped, which in mode 0 are those that do not fit in one packet
+    size_t Packetize(const uint8_t* pIn, size_t szIn, uint32_t timestamp, uint8_t* pPacket, IRtpPacketSink& sink) const
+    {
+        if (m_packetizationMode == 1)
+        {
+            PacketizeMode1(pIn, szIn, timestamp, pPacket, sink);
+            return 0;
+        }
+        return PacketizeMode0(pIn, szIn, timestamp, pPacket, sink);
+    }
+
+    // Next 00 00 01 or 00 00 00 01 start code, bufEnd if there is none
+    static const uint8_t* FindStartCode(const uint8_t* bufStart, const uint8_t* bufEnd)
+    {
+        for (auto it = bufStart; it + 3 < bufEnd; it++)
+        {
+            if ((it[0] == 0) && (it[1] == 0)
+                && ((it[2] == 1) || ((it[2] == 0) && (it[3] == 1))))
+            {
+                return it;
+            }
+        }
+        return bufEnd;
+    }
+
+private:
+    // Single NAL unit mode (RFC 6184 section 6.2) has no fragmentation, so a NAL unit larger than the packet
+    // is dropped. Each NAL unit is sent once the next one is found, so the marker goes on the last one sent.
+    size_t PacketizeMode0(const uint8_t* bufIn, size_t szIn, uint32_t timestamp, uint8_t* pOut, IRtpPacketSink& sink) const
+    {
+        const uint8_t* bufEnd = bufIn + szIn;
+        const uint8_t* sc = FindStartCode(bufIn, bufEnd);
+        size_t maxPayload = m_mtuSize - rtpHeaderSize;
+        size_t dropped = 0;
+        size_t szPending = 0;
+        while (sc < bufEnd)
+        {
+            while ((sc < bufEnd) && !(*sc++));
+            const uint8_t* sc1 = FindStartCode(sc, bufEnd);
+            size_t nalsz = sc1 - sc;
+            if (nalsz > maxPayload)
+            {
+                dropped++;
+            }
+            else if (nalsz)
+            {
+                if (szPending)
+                {
+                    sink.OnPacket(pOut, szPending + rtpHeaderSize, timestamp, false);
+                }
+                memcpy(&pOut[rtpHeaderSize], sc, nalsz);
+                szPending = nalsz;
+            }
+            sc = sc1;
+        }
+        if (szPending)
+        {
+            sink.OnPacket(pOut, szPending + rtpHeaderSize, timestamp, true);
+        }
+        return dropped;
+    }
+
+    void PacketizeMode1(const uint8_t* bufIn, size_t szIn, uint32_t timestamp, uint8_t* pOut, IRtpPacketSink& sink) const
+    {
+        const uint8_t* bufEnd = bufIn + szIn;
+        const uint8_t* sc = FindStartCode(bufIn, bufEnd);
+        size_t szOut = m_mtuSize;
+        uint8_t* pOutEnd = pOut + szOut;
+        const uint8_t* sc1 = sc;
+        auto pOutCurr = pOut + rtpHeaderSize + stapAtypeHeaderSize;
+        uint32_t numNalsToSend = 0;
+        while (sc < bufEnd)
+        {
+            auto sc0 = sc;
+            while ((sc < bufEnd) && !(*sc++));
+            sc1 = FindStartCode(sc, bufEnd);
+            size_t nalsz = sc1 - sc;
+            if (pOutCurr + nalsz + stapASzHeaderSize > pOutEnd)
+            {
+                if (numNalsToSend == 0)
+                {
+                    // FU-A
+                    pOut[rtpHeaderSize] = 28;                   // FU-A type
+                    pOut[rtpHeaderSize] |= (sc[0] & 0x60);      // NRI
+                    pOut[rtpHeaderSize + 1] = sc[0] & 0x1F;
+                    pOut[rtpHeaderSize + 1] |= (1 << 7);        // start bit
+                    sc++; nalsz--;
+                    auto maxSz = szOut - (rtpHeaderSize + stapAtypeHeaderSize + 1);
+                    while (nalsz > maxSz)
+                    {
+                        memcpy(&pOut[rtpHeaderSize + stapAtypeHeaderSize + 1], sc, maxSz);
+                        sink.OnPacket(pOut, szOut, timestamp, false);
+                        nalsz -= maxSz;
+                        sc += maxSz;
+                        pOut[rtpHeaderSize + 1] &= (~(1 << 7));
+                    }
+
+                    memcpy(&pOut[rtpHeaderSize + stapAtypeHeaderSize + 1], sc, nalsz);
+                    pOut[rtpHeaderSize + 1] |= (1 << 6);        // end bit
+                    sink.OnPacket(pOut, nalsz + rtpHeaderSize + stapAtypeHeaderSize + 1, timestamp, (sc1 == bufEnd));
+                    sc = sc1;
+                }
+                else
+                {
+                    // this NAL unit goes in the next packet
+                    pOut[rtpHeaderSize] = 24;                   // STAP-A type
+                    sink.OnPacket(pOut, pOutCurr - pOut, timestamp, false);
+                    sc = sc0;
+                }
+                numNalsToSend = 0;
+                pOutCurr = pOut + rtpHeaderSize + stapAtypeHeaderSize;
+            }
+            else
+            {
+                pOutCurr[0] = (uint8_t)((nalsz & 0xFF00) >> 8);
+                pOutCurr[1] = (uint8_t)(nalsz & 0x00FF);
+                memcpy(&pOutCurr[stapASzHeaderSize], sc, nalsz);
+                pOutCurr += (nalsz + stapASzHeaderSize);
+                numNalsToSend++;
+                sc = sc1;
+            }
+        }
+
+        if (numNalsToSend)
+        {
+            pOut[rtpHeaderSize] = 24;
+            sink.OnPacket(pOut, pOutCurr - pOut, timestamp, true);
+        }
+    }
+
+    uint32_t m_packetizationMode;
+    size_t m_mtuSize;
+};
@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <stdexcept>
+#include <vector>
+#include "H264Packetizer.h"
+#include "ArqLoopback.h"
+
+namespace
+{
+#ifdef _WIN32
+    const ArqSocket invalidSocket = INVALID_SOCKET;
+    void CloseSocket(ArqSocket s) { closesocket(s); }
+#else
+    const ArqSocket invalidSocket = -1;
+    void CloseSocket(ArqSocket s) { close(s); }
+#endif
+
+    // Non blocking UDP socket on an ephemeral loopback port
+    ArqSocket OpenLoopbackSocket(uint16_t& port)
+    {
+        ArqSocket s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (s == invalidSocket)
+        {
+            throw std::runtime_error("cannot create a UDP socket");
+        }
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrSize = sizeof(addr);
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        bool bNonBlocking = ioctlsocket(s, FIONBIO, &nonBlocking) == 0;
+#else
+        bool bNonBlocking = true;                               // recv is called with MSG_DONTWAIT
+#endif
+        // a receive buffer for a whole access unit at max speed
+        int bufferSize = 4 << 20;
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferSize, sizeof(bufferSize));
+        if (!bNonBlocking || (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0) || (getsockname(s, (sockaddr*)&addr, &addrSize) != 0))
+        {
+            CloseSocket(s);
+            throw std::runtime_error("cannot bind a UDP socket to the loopback interface");
+        }
+        port = ntohs(addr.sin_port);
+        return s;
+    }
+
+    // Next datagram waiting on the socket, 0 if there is none
+    size_t Receive(ArqSocket s, uint8_t* pBuf, size_t size)
+    {
+#ifdef _WIN32
+        int received = recv(s, (char*)pBuf, (int)size, 0);
+#else
+        auto received = recv(s, pBuf, size, MSG_DONTWAIT);
+#endif
+        return (received > 0) ? (size_t)received : 0;
+    }
+}
+
+CArqLoopback::CArqLoopback(double lossRate, int64_t hnsLatency, uint32_t seed)
+    : m_senderSocket(invalidSocket)
+    , m_receiverSocket(invalidSocket)
+    , m_senderPort(0)
+    , m_receiverPort(0)
+    , m_window(hnsLatency)
+    , m_random(seed)
+    , m_loss(lossRate)
+    , m_stats{}
+    , m_ssrc(0)
+    , m_firstSequenceNumber(0)
+    , m_lastSequenceNumber(0)
+    , m_highest(-1)
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(0x202, &wsaData) != 0)
+    {
+        throw std::runtime_error("WSAStartup failed");
+    }
+#endif
+    try
+    {
+        m_senderSocket = OpenLoopbackSocket(m_senderPort);
+        m_receiverSocket = OpenLoopbackSocket(m_receiverPort);
+    }
+    catch (...)
+    {
+        if (m_senderSocket != invalidSocket)
+        {
+            CloseSocket(m_senderSocket);
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        throw;
+    }
+}
+
+CArqLoopback::~CArqLoopback()
+{
+    CloseSocket(m_senderSocket);
+    CloseSocket(m_receiverSocket);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void CArqLoopback::Send(const uint8_t* pPacket, size_t size, int64_t hnsNow)
+{
+    m_lastSequenceNumber = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+    if (!m_stats.packets)
+    {
+        m_firstSequenceNumber = m_lastSequenceNumber;
+        m_ssrc = ((uint32_t)pPacket[8] << 24) | ((uint32_t)pPacket[9] << 16) | ((uint32_t)pPacket[10] << 8) | pPacket[11];
+    }
+    m_stats.packets++;
+    auto& packet = m_window.Store(pPacket, size, hnsNow);
+    SendShaped(m_senderSocket, m_receiverPort, packet.data.data(), packet.data.size());
+    Pump(hnsNow);
+}
+
+void CArqLoopback::Finish(int64_t hnsLast)
+{
+    for (int64_t hnsNow = hnsLast; (hnsNow <= hnsLast + m_window.Latency() + arqLoopbackNackInterval) && !m_lost.empty(); hnsNow += arqLoopbackNackInterval / 2)
+    {
+        Pump(hnsNow);
+    }
+    m_stats.unrecovered += m_lost.size();
+    m_lost.clear();
+    m_stats.undetected = m_stats.packets - (uint64_t)(m_highest + 1);
+}
+
+uint32_t CArqLoopback::RetransmitLast(int64_t hnsNow)
+{
+    return m_window.Retransmit(m_lastSequenceNumber, 0, 0, hnsNow, [](std::vector<uint8_t> const&) { return true; });
+}
+
+// Sends a datagram to the port, unless the shaper drops it
+bool CArqLoopback::SendShaped(ArqSocket socket, uint16_t port, const uint8_t* pData, size_t size)
+{
+    if (m_loss(m_random))
+    {
+        m_stats.dropped++;
+        return true;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return sendto(socket, (const char*)pData, (int)size, 0, (sockaddr*)&addr, sizeof(addr)) == (int)size;
+}
+
+// The datagrams are on the loopback interface as soon as they are sent, so the exchange is over once
+// neither socket has one
+void CArqLoopback::Pump(int64_t hnsNow)
+{
+    uint8_t buf[2048];
+    bool bReceived = true;
+    while (bReceived)
+    {
+        bReceived = false;
+        while (size_t size = Receive(m_receiverSocket, buf, sizeof(buf)))
+        {
+            OnPacket(buf, size, hnsNow);
+            bReceived = true;
+        }
+        SendNacks(hnsNow);
+        while (size_t size = Receive(m_senderSocket, buf, sizeof(buf)))
+        {
+            OnRtcp(buf, size, hnsNow);
+            bReceived = true;
+        }
+    }
+}
+
+// Receiver: a packet past the highest one received makes the ones in between lost, an older one fills a gap
+void CArqLoopback::OnPacket(const uint8_t* pPacket, size_t size, int64_t hnsNow)
+{
+    if (size < rtpHeaderSize)
+    {
+        return;
+    }
+    uint16_t sequenceNumber = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+    int64_t index = m_highest + (int16_t)(uint16_t)(sequenceNumber - m_firstSequenceNumber - (uint16_t)m_highest);
+    if (index > m_highest)
+    {
+        for (int64_t i = m_highest + 1; i < index; i++)
+        {
+            m_lost[i] = { hnsNow, hnsNow - arqLoopbackNackInterval };
+            m_stats.lost++;
+        }
+        m_highest = index;
+    }
+    else if (m_lost.erase(index))
+    {
+        m_stats.recovered++;
+    }
+}
+
+// Receiver: one NACK for the lost packets not asked for in the last interval; the ones older than the
+// latency are given up, the sender would not send them anymore
+void CArqLoopback::SendNacks(int64_t hnsNow)
+{
+    std::vector<uint16_t> nack;
+    for (auto it = m_lost.begin(); it != m_lost.end();)
+    {
+        auto& lost = it->second;
+        if ((hnsNow - lost.hnsFound) > m_window.Latency())
+        {
+            m_stats.unrecovered++;
+            it = m_lost.erase(it);
+            continue;
+        }
+        if ((hnsNow - lost.hnsLastNack) >= arqLoopbackNackInterval)
+        {
+            lost.hnsLastNack = hnsNow;
+            nack.push_back((uint16_t)(m_firstSequenceNumber + it->first));
+        }
+        ++it;
+    }
+    if (!nack.empty())
+    {
+        auto packet = WriteGenericNack(m_ssrc + 1, m_ssrc, nack);
+        m_stats.nacks++;
+        SendShaped(m_receiverSocket, m_senderPort, packet.data(), packet.size());
+    }
+}
+
+// Sender: the packets of each NACK entry still in the window are sent again
+void CArqLoopback::OnRtcp(const uint8_t* pRtcp, size_t size, int64_t hnsNow)
+{
+    ReadGenericNack(pRtcp, size, [this, hnsNow](uint32_t mediaSsrc, uint16_t pid, uint16_t blp)
+        {
+            if (mediaSsrc != m_ssrc)
+            {
+                return;
+            }
+            m_stats.retransmits += m_window.Retransmit(pid, blp, arqLoopbackRttUs, hnsNow, [this](std::vector<uint8_t> const& data)
+                {
+                    return SendShaped(m_senderSocket, m_receiverPort, data.data(), data.size());
+                });
+        });
+}
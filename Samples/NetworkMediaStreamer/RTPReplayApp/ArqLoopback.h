@@ -0,0 +1,82 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <random>
+#include "ArqWindow.h"
+
+#ifdef _WIN32
+typedef uintptr_t ArqSocket;
+#else
+typedef int ArqSocket;
+#endif
+
+constexpr uint32_t arqLoopbackRttUs = 10000;                    // shortest interval between two retransmissions of a packet
+constexpr int64_t arqLoopbackNackInterval = 200000;             // the receiver asks again for a lost packet every 20 ms
+
+struct ArqLoopbackStats
+{
+    uint64_t packets;               // packets of the stream
+    uint64_t dropped;               // by the loss shaper, retransmissions and NACKs included
+    uint64_t lost;                  // packets of the stream found missing by the receiver
+    uint64_t recovered;             // of them, received once sent again
+    uint64_t unrecovered;           // of them, given up once older than the latency
+    uint64_t undetected;            // lost after the last packet received, the receiver cannot know of them
+    uint64_t nacks;                 // NACK packets sent
+    uint64_t retransmits;
+};
+
+// ARQ of CArqWindow between two UDP sockets on the loopback interface: the sender keeps the packets and
+// answers the generic NACKs of the receiver, which asks for the gaps in the sequence numbers until they are
+// filled or older than the latency. A loss shaper drops a share of the datagrams both ways, the same ones
+// for a seed. The clock is the presentation time of the stream rather than the wall clock, so a replay at
+// max speed has the latency window of a real time stream.
+class CArqLoopback
+{
+public:
+    CArqLoopback(double lossRate, int64_t hnsLatency, uint32_t seed = 1);
+    ~CArqLoopback();
+
+    // Sends a packet at hnsNow, then runs the receiver and the sender until neither has a datagram waiting
+    void Send(const uint8_t* pPacket, size_t size, int64_t hnsNow);
+    // Runs them for the latency after the last packet, sent at hnsLast, so every loss is recovered or given up
+    void Finish(int64_t hnsLast);
+    // Packets the sender sends again for a NACK of the last packet at hnsNow, 0 once it is out of the window
+    uint32_t RetransmitLast(int64_t hnsNow);
+
+    ArqLoopbackStats const& Stats() const { return m_stats; }
+    int64_t Latency() const { return m_window.Latency(); }
+
+private:
+    struct LostPacket
+    {
+        int64_t hnsFound;
+        int64_t hnsLastNack;                                    // a NACK interval before hnsFound until the first NACK
+    };
+
+    bool SendShaped(ArqSocket socket, uint16_t port, const uint8_t* pData, size_t size);
+    void Pump(int64_t hnsNow);
+    void OnPacket(const uint8_t* pPacket, size_t size, int64_t hnsNow);
+    void OnRtcp(const uint8_t* pRtcp, size_t size, int64_t hnsNow);
+    void SendNacks(int64_t hnsNow);
+
+    ArqSocket m_senderSocket;
+    ArqSocket m_receiverSocket;
+    uint16_t m_senderPort;
+    uint16_t m_receiverPort;
+    CArqWindow m_window;
+    std::mt19937 m_random;
+    std::bernoulli_distribution m_loss;
+    ArqLoopbackStats m_stats;
+    uint32_t m_ssrc;
+    uint16_t m_firstSequenceNumber;
+    uint16_t m_lastSequenceNumber;
+
+    // receiver: packets by index in the stream, from the sequence numbers extended past their wrap around
+    int64_t m_highest;                                          // highest index received, -1 for none
+    std::map<int64_t, LostPacket> m_lost;
+};
@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdexcept>
+#include <string>
+#include "ElementaryStream.h"
+
+#ifdef _WIN32
+CMappedFile::CMappedFile(const char* path)
+    : m_pData(nullptr)
+    , m_size(0)
+    , m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(nullptr)
+{
+    m_hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    LARGE_INTEGER size = { 0 };
+    if ((m_hFile == INVALID_HANDLE_VALUE) || !GetFileSizeEx(m_hFile, &size))
+    {
+        throw std::runtime_error(std::string("cannot open ") + path);
+    }
+    m_size = (size_t)size.QuadPart;
+    if (m_size)
+    {
+        m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        m_pData = m_hMapping ? (const uint8_t*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!m_pData)
+        {
+            if (m_hMapping)
+            {
+                CloseHandle(m_hMapping);
+            }
+            CloseHandle(m_hFile);
+            throw std::runtime_error(std::string("cannot map ") + path);
+        }
+    }
+}
+
+CMappedFile::~CMappedFile()
+{
+    if (m_pData)
+    {
+        UnmapViewOfFile(m_pData);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+    }
+    CloseHandle(m_hFile);
+}
+#else
+CMappedFile::CMappedFile(const char* path)
+    : m_pData(nullptr)
+    , m_size(0)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw std::runtime_error(std::string("cannot open ") + path);
+    }
+    m_size = (size_t)st.st_size;
+    if (m_size)
+    {
+        void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error(std::string("cannot map ") + path);
+        }
+        madvise(p, m_size, MADV_SEQUENTIAL);
+        m_pData = (const uint8_t*)p;
+    }
+    close(fd);
+}
+
+CMappedFile::~CMappedFile()
+{
+    if (m_pData)
+    {
+        munmap((void*)m_pData, m_size);
+    }
+}
+#endif
+
+// Start of the next 00 00 01 start code, including a leading zero byte of a 4 byte start code
+static const uint8_t* FindStartCode(const uint8_t* p, const uint8_t* pEnd)
+{
+    for (; p + 3 <= pEnd; p++)
+    {
+        if ((p[0] == 0) && (p[1] == 0) && (p[2] == 1))
+        {
+            return p;
+        }
+    }
+    return pEnd;
+}
+
+struct NalUnit
+{
+    const uint8_t* pStart;      // start code
+    const uint8_t* pHeader;     // NAL header byte
+    const uint8_t* pEnd;
+};
+
+static std::vector<NalUnit> FindNalUnits(const uint8_t* pData, size_t size)
+{
+    std::vector<NalUnit> nals;
+    const uint8_t* pEnd = pData + size;
+    const uint8_t* sc = FindStartCode(pData, pEnd);
+    while (sc < pEnd)
+    {
+        auto pHeader = sc + 3;
+        auto next = FindStartCode(pHeader, pEnd);
+        auto pStart = ((sc > pData) && (sc[-1] == 0)) ? sc - 1 : sc;
+        // a zero before the next start code belongs to it, it is a 4 byte start code
+        auto pNalEnd = ((next < pEnd) && (next > pHeader) && (next[-1] == 0)) ? next - 1 : next;
+        if (pHeader < pNalEnd)
+        {
+            nals.push_back({ pStart, pHeader, pNalEnd });
+        }
+        sc = next;
+    }
+    return nals;
+}
+
+std::vector<AccessUnit> SplitAccessUnits(const uint8_t* pData, size_t size)
+{
+    std::vector<AccessUnit> aus;
+    const uint8_t* pAuStart = nullptr;
+    bool bHasSlice = false;
+    for (auto& nal : FindNalUnits(pData, size))
+    {
+        uint8_t type = nal.pHeader[0] & 0x1F;
+        bool bSlice = (type >= 1) && (type <= 5);
+        // first_mb_in_slice is the first ue(v) of the slice header, 0 is coded as a single 1 bit
+        bool bFirstSlice = bSlice && ((nal.pHeader + 1) < nal.pEnd) && (nal.pHeader[1] & 0x80);
+        bool bStartsAu = (type == 9) || (type == 6) || (type == 7) || (type == 8) || ((type >= 14) && (type <= 18)) || bFirstSlice;
+        if (pAuStart && bHasSlice && bStartsAu)
+        {
+            aus.push_back({ pAuStart, (size_t)(nal.pStart - pAuStart) });
+            pAuStart = nullptr;
+            bHasSlice = false;
+        }
+        if (!pAuStart)
+        {
+            pAuStart = nal.pStart;
+        }
+        bHasSlice |= bSlice;
+    }
+    if (pAuStart)
+    {
+        aus.push_back({ pAuStart, (size_t)(pData + size - pAuStart) });
+    }
+    return aus;
+}
@@ -0,0 +1,40 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read only view of a whole file, memory mapped so replaying large recordings does not copy them
+class CMappedFile
+{
+public:
+    CMappedFile(const char* path);
+    ~CMappedFile();
+    CMappedFile(CMappedFile const&) = delete;
+    CMappedFile& operator=(CMappedFile const&) = delete;
+
+    const uint8_t* Data() const { return m_pData; }
+    size_t Size() const { return m_size; }
+
+private:
+    const uint8_t* m_pData;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_hFile;
+    void* m_hMapping;
+#endif
+};
+
+struct AccessUnit
+{
+    const uint8_t* pData;       // Annex B, starting with a start code
+    size_t size;
+};
+
+// Splits an H.264 Annex B elementary stream into access units, by the rules of ITU-T H.264
+// section 7.4.1.2.3: an access unit delimiter, SEI or parameter set after a slice, or a slice with
+// first_mb_in_slice 0 after a slice, starts a new access unit
+std::vector<AccessUnit> SplitAccessUnits(const uint8_t* pData, size_t size);
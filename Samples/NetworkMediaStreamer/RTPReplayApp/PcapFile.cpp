@@ -0,0 +1,179 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <stdexcept>
+#include "PcapFile.h"
+
+constexpr uint32_t pcapMagic = 0xA1B2C3D4;
+constexpr uint32_t pcapMagicNs = 0xA1B23C4D;                    // nanosecond timestamps
+constexpr uint32_t linkTypeEthernet = 1;
+constexpr uint32_t linkTypeRaw = 101;                           // raw IPv4/IPv6
+constexpr uint32_t pcapSnapLength = 65535;
+constexpr size_t ipv4HeaderSize = 20;
+constexpr size_t udpHeaderSize = 8;
+constexpr size_t ethernetHeaderSize = 14;
+
+static void PutLE32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+static void PutBE16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v;
+}
+
+static uint32_t GetLE32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t GetBE16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+CPcapWriter::CPcapWriter(const char* path)
+    : m_file(path, std::ios::binary | std::ios::trunc)
+    , m_ipId(0)
+{
+    if (!m_file)
+    {
+        throw std::runtime_error(std::string("cannot create ") + path);
+    }
+    uint8_t header[24] = { 0 };
+    PutLE32(&header[0], pcapMagic);
+    header[4] = 2;                                              // version 2.4
+    header[6] = 4;
+    PutLE32(&header[16], pcapSnapLength);
+    PutLE32(&header[20], linkTypeRaw);
+    m_file.write((const char*)header, sizeof(header));
+}
+
+void CPcapWriter::WritePacket(uint64_t timeUs, uint16_t dstPort, const uint8_t* pData, size_t size)
+{
+    size_t packetSize = ipv4HeaderSize + udpHeaderSize + size;
+    uint8_t header[16 + ipv4HeaderSize + udpHeaderSize] = { 0 };
+    PutLE32(&header[0], (uint32_t)(timeUs / 1000000));
+    PutLE32(&header[4], (uint32_t)(timeUs % 1000000));
+    PutLE32(&header[8], (uint32_t)packetSize);
+    PutLE32(&header[12], (uint32_t)packetSize);
+
+    uint8_t* ip = &header[16];
+    ip[0] = 0x45;                                               // IPv4, 5 word header
+    PutBE16(&ip[2], (uint16_t)packetSize);
+    PutBE16(&ip[4], m_ipId++);
+    ip[6] = 0x40;                                               // don't fragment
+    ip[8] = 64;                                                 // TTL
+    ip[9] = 17;                                                 // UDP
+    ip[12] = 127; ip[15] = 1;                                   // 127.0.0.1 to 127.0.0.1
+    ip[16] = 127; ip[19] = 1;
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < ipv4HeaderSize; i += 2)
+    {
+        checksum += GetBE16(&ip[i]);
+    }
+    checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    checksum += checksum >> 16;
+    PutBE16(&ip[10], (uint16_t)~checksum);
+
+    uint8_t* udp = &ip[ipv4HeaderSize];
+    PutBE16(&udp[0], replaySourcePort + (dstPort - replayRtpPort));
+    PutBE16(&udp[2], dstPort);
+    PutBE16(&udp[4], (uint16_t)(udpHeaderSize + size));         // checksum 0: not computed
+
+    m_file.write((const char*)header, sizeof(header));
+    m_file.write((const char*)pData, size);
+}
+
+std::vector<std::vector<uint8_t>> ReadPcapUdpPayloads(const char* path, uint16_t dstPort)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint8_t header[24];
+    if (!file.read((char*)header, sizeof(header)))
+    {
+        throw std::runtime_error(std::string("cannot read ") + path);
+    }
+    uint32_t magic = GetLE32(header);
+    if ((magic != pcapMagic) && (magic != pcapMagicNs))
+    {
+        throw std::runtime_error(std::string(path) + " is not a little endian pcap file");
+    }
+    uint32_t linkType = GetLE32(&header[20]);
+    if ((linkType != linkTypeRaw) && (linkType != linkTypeEthernet))
+    {
+        throw std::runtime_error(std::string(path) + ": unsupported link type " + std::to_string(linkType));
+    }
+
+    std::vector<std::vector<uint8_t>> payloads;
+    std::vector<uint8_t> packet;
+    uint8_t record[16];
+    while (file.read((char*)record, sizeof(record)))
+    {
+        uint32_t size = GetLE32(&record[8]);
+        packet.resize(size);
+        if (!file.read((char*)packet.data(), size))
+        {
+            break;
+        }
+        const uint8_t* p = packet.data();
+        const uint8_t* pEnd = p + size;
+        if (linkType == linkTypeEthernet)
+        {
+            if ((size < ethernetHeaderSize) || (GetBE16(&p[12]) != 0x0800))
+            {
+                continue;
+            }
+            p += ethernetHeaderSize;
+        }
+        if (((pEnd - p) < (ptrdiff_t)ipv4HeaderSize) || ((p[0] >> 4) != 4) || (p[9] != 17))
+        {
+            continue;
+        }
+        p += (p[0] & 0x0F) * 4;
+        if (((pEnd - p) < (ptrdiff_t)udpHeaderSize) || (GetBE16(&p[2]) != dstPort))
+        {
+            continue;
+        }
+        size_t udpSize = GetBE16(&p[4]);
+        p += udpHeaderSize;
+        if ((udpSize < udpHeaderSize) || ((size_t)(pEnd - p) < (udpSize - udpHeaderSize)))
+        {
+            continue;
+        }
+        payloads.emplace_back(p, p + (udpSize - udpHeaderSize));
+    }
+    return payloads;
+}
+
+std::string CompareRtpPackets(std::vector<std::vector<uint8_t>> const& expected, std::vector<std::vector<uint8_t>> const& actual)
+{
+    constexpr size_t ssrcOffset = 8;
+    constexpr size_t ssrcSize = 4;
+    size_t count = (expected.size() < actual.size()) ? expected.size() : actual.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        auto& e = expected[i];
+        auto& a = actual[i];
+        if (e.size() != a.size())
+        {
+            return "packet " + std::to_string(i) + ": size " + std::to_string(a.size()) + ", expected " + std::to_string(e.size());
+        }
+        for (size_t b = 0; b < e.size(); b++)
+        {
+            if ((b >= ssrcOffset) && (b < ssrcOffset + ssrcSize))
+            {
+                continue;
+            }
+            if (e[b] != a[b])
+            {
+                return "packet " + std::to_string(i) + ": byte " + std::to_string(b) + " is " + std::to_string(a[b]) + ", expected " + std::to_string(e[b]);
+            }
+        }
+    }
+    if (expected.size() != actual.size())
+    {
+        return std::to_string(actual.size()) + " packets, expected " + std::to_string(expected.size());
+    }
+    return std::string();
+}
@@ -0,0 +1,34 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+constexpr uint16_t replayRtpPort = 5004;                        // RTCP on the next port, as RFC 3550 recommends
+constexpr uint16_t replaySourcePort = 6970;
+
+// Writes packets as UDP datagrams between two loopback ports, in a pcap file of raw IPv4 packets that
+// Wireshark decodes with "Decode As RTP"
+class CPcapWriter
+{
+public:
+    CPcapWriter(const char* path);
+    void WritePacket(uint64_t timeUs, uint16_t dstPort, const uint8_t* pData, size_t size);
+
+private:
+    std::ofstream m_file;
+    uint16_t m_ipId;
+};
+
+// Payloads of the UDP datagrams to dstPort in a pcap file, in capture order. Reads the raw IPv4 captures
+// of CPcapWriter as well as Ethernet captures of live sessions.
+std::vector<std::vector<uint8_t>> ReadPcapUdpPayloads(const char* path, uint16_t dstPort);
+
+// Compares RTP packets ignoring the SSRC, which a live session picks at random. Returns an empty string
+// when they match, else a description of the first difference.
+std::string CompareRtpPackets(std::vector<std::vector<uint8_t>> const& expected, std::vector<std::vector<uint8_t>> const& actual);
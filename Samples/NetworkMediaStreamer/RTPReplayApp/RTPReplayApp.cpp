@@ -0,0 +1,274 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+// Replays a recorded H.264 elementary stream through the packetizer core without a camera, a network or
+// Media Foundation: the RTP packets can be written to a pcap file and compared with a golden capture.
+// At max speed it doubles as a packetizer throughput benchmark, and with -arq as a test of the ARQ core over
+// a lossy loopback link. It builds on any platform, e.g.
+//   g++ -O2 -std=c++17 -I../RTPPacketizer/inc *.cpp -o RTPReplayApp
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "H264Packetizer.h"
+#include "ElementaryStream.h"
+#include "PcapFile.h"
+#include "ArqLoopback.h"
+
+constexpr uint32_t replaySsrc = 0x52504C59;                     // fixed so captures of two runs are identical
+
+// Adds the RTP header the stream sink would to the packets of the packetizer, and counts, captures, records
+// and sends them over the ARQ loopback
+class CReplayPacketSink : public IRtpPacketSink
+{
+public:
+    CReplayPacketSink(CPcapWriter* pPcap, bool bCapture, CArqLoopback* pArq)
+        : m_pPcap(pPcap)
+        , m_bCapture(bCapture)
+        , m_pArq(pArq)
+        , m_sequenceNumber(0)
+        , m_captureTimeUs(0)
+        , m_packets(0)
+        , m_bytes(0)
+    {
+    }
+
+    void OnPacket(uint8_t* pPacket, size_t size, uint32_t timestamp, bool bMarker) override
+    {
+        WriteRtpHeader(pPacket, h264payloadType, bMarker, m_sequenceNumber++, timestamp, replaySsrc);
+        m_packets++;
+        m_bytes += size;
+        if (m_bCapture)
+        {
+            m_captured.emplace_back(pPacket, pPacket + size);
+        }
+        if (m_pPcap)
+        {
+            m_pPcap->WritePacket(m_captureTimeUs, replayRtpPort, pPacket, size);
+        }
+        if (m_pArq)
+        {
+            m_pArq->Send(pPacket, size, (int64_t)m_captureTimeUs * 10);
+        }
+    }
+
+    void SetCaptureTime(uint64_t timeUs) { m_captureTimeUs = timeUs; }
+    uint64_t Packets() const { return m_packets; }
+    uint64_t Bytes() const { return m_bytes; }
+    std::vector<std::vector<uint8_t>> const& Captured() const { return m_captured; }
+
+private:
+    CPcapWriter* m_pPcap;
+    bool m_bCapture;
+    CArqLoopback* m_pArq;
+    uint16_t m_sequenceNumber;
+    uint64_t m_captureTimeUs;                                   // presentation time of the access unit being sent
+    uint64_t m_packets;
+    uint64_t m_bytes;
+    std::vector<std::vector<uint8_t>> m_captured;
+};
+
+struct ReplayOptions
+{
+    std::string input;
+    std::string pcap;
+    std::string golden;
+    double fps = 30;
+    uint32_t loops = 1;
+    bool bRealtime = false;
+    double arqLoss = -1;                                        // percent, negative without -arq
+    uint32_t arqLatencyMs = 120;
+};
+
+void PrintUsage()
+{
+    std::cout << "Usage: RTPReplayApp <stream.h264> [options]\n"
+        << "  -fps <n>          frame rate of the stream, for timestamps and pacing (default 30)\n"
+        << "  -realtime         pace access units at the frame rate instead of max speed\n"
+        << "  -loop <n>         replay the stream n times (default 1)\n"
+        << "  -pcap <file>      write the RTP packets to a pcap file\n"
+        << "  -golden <file>    compare the RTP packets with a golden pcap capture\n"
+        << "  -arq <loss %>     send the RTP packets over loopback UDP with ARQ, dropping loss % of the datagrams\n"
+        << "  -latency <ms>     latency window of the ARQ (default 120)\n";
+}
+
+bool ParseOptions(int argc, char* argv[], ReplayOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool bHasValue = (i + 1) < argc;
+        if ((arg == "-fps") && bHasValue)
+        {
+            options.fps = std::stod(argv[++i]);
+        }
+        else if ((arg == "-loop") && bHasValue)
+        {
+            options.loops = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if ((arg == "-pcap") && bHasValue)
+        {
+            options.pcap = argv[++i];
+        }
+        else if ((arg == "-golden") && bHasValue)
+        {
+            options.golden = argv[++i];
+        }
+        else if ((arg == "-arq") && bHasValue)
+        {
+            options.arqLoss = std::stod(argv[++i]);
+        }
+        else if ((arg == "-latency") && bHasValue)
+        {
+            options.arqLatencyMs = (uint32_t)std::stoul(argv[++i]);
+        }
+        else if (arg == "-realtime")
+        {
+            options.bRealtime = true;
+        }
+        else if ((arg[0] != '-') && options.input.empty())
+        {
+            options.input = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return !options.input.empty() && (options.fps > 0) && (options.loops > 0) && (options.arqLoss < 100);
+}
+
+// Time spent packetizing one access unit
+void PrintPacketizationTimes(std::vector<double>& timesUs)
+{
+    if (timesUs.empty())
+    {
+        return;
+    }
+    std::sort(timesUs.begin(), timesUs.end());
+    auto percentile = [&timesUs](double p) { return timesUs[(size_t)(p * (timesUs.size() - 1))]; };
+    std::cout << "Packetization time per access unit (us): p50 " << percentile(0.5) << " p99 " << percentile(0.99)
+        << " p999 " << percentile(0.999) << " max " << timesUs.back() << "\n";
+}
+
+// The ARQ has to repair 99% of the loss of the shaper, and the last packet has to be sent again within the
+// latency window and not past it
+bool CheckArq(CArqLoopback& arq, int64_t hnsLast, double lossRate)
+{
+    arq.Finish(hnsLast);
+    auto& stats = arq.Stats();
+    std::cout << "ARQ: " << stats.packets << " packets, " << stats.dropped << " datagrams dropped, " << stats.lost << " packets lost, "
+        << stats.recovered << " recovered, " << stats.unrecovered << " unrecovered, " << stats.undetected << " lost at the end, "
+        << stats.nacks << " NACKs, " << stats.retransmits << " retransmits\n";
+    double residualLoss = stats.packets ? (double)(stats.unrecovered + stats.undetected) / stats.packets : 0;
+    if (residualLoss > lossRate / 100)
+    {
+        std::cout << "ARQ residual loss " << std::setprecision(4) << (100 * residualLoss) << "% is over 1% of the loss\n";
+        return false;
+    }
+    auto latency = arq.Latency();
+    if ((arq.RetransmitLast(hnsLast + latency / 2) != 1) || (arq.RetransmitLast(hnsLast + latency + 1) != 0))
+    {
+        std::cout << "ARQ latency window: the last packet is not sent again within it, or is past it\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    int result = 0;
+    try
+    {
+        CMappedFile input(options.input.c_str());
+        auto accessUnits = SplitAccessUnits(input.Data(), input.Size());
+        if (accessUnits.empty())
+        {
+            throw std::runtime_error(options.input + " has no H.264 access units");
+        }
+
+        std::unique_ptr<CPcapWriter> pPcap;
+        if (!options.pcap.empty())
+        {
+            pPcap = std::make_unique<CPcapWriter>(options.pcap.c_str());
+        }
+        std::unique_ptr<CArqLoopback> pArq;
+        if (options.arqLoss >= 0)
+        {
+            pArq = std::make_unique<CArqLoopback>(options.arqLoss / 100, (int64_t)options.arqLatencyMs * 10000);
+        }
+        CH264Packetizer packetizer;
+        std::vector<uint8_t> packetBuffer(packetizer.MtuSize());
+        CReplayPacketSink sink(pPcap.get(), !options.golden.empty(), pArq.get());
+
+        int64_t hnsFrameDuration = (int64_t)(10000000 / options.fps);
+        uint64_t totalAccessUnits = (uint64_t)accessUnits.size() * options.loops;
+        uint64_t inputBytes = 0;
+        std::vector<double> timesUs;
+        timesUs.reserve((size_t)totalAccessUnits);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < totalAccessUnits; i++)
+        {
+            auto& au = accessUnits[i % accessUnits.size()];
+            int64_t hnsSampleTime = (int64_t)i * hnsFrameDuration;
+            if (options.bRealtime)
+            {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(hnsSampleTime * 100));
+            }
+            sink.SetCaptureTime(hnsSampleTime / 10);
+            auto auStart = std::chrono::steady_clock::now();
+            packetizer.Packetize(au.pData, au.size, HnsToRtpTime(hnsSampleTime, videoClockRate), packetBuffer.data(), sink);
+            timesUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - auStart).count());
+            inputBytes += au.size;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::fixed << std::setprecision(2)
+            << "Replayed " << totalAccessUnits << " access units (" << inputBytes << " bytes) in " << seconds << " s\n"
+            << "RTP packets: " << sink.Packets() << ", " << sink.Bytes() << " bytes\n";
+        if (seconds > 0)
+        {
+            std::cout << "Throughput: " << (totalAccessUnits / seconds) << " access units/s, "
+                << (sink.Packets() / seconds) << " packets/s, " << std::setprecision(3) << ((sink.Bytes() * 8) / seconds / 1e9) << " Gbit/s\n";
+        }
+        PrintPacketizationTimes(timesUs);
+
+        if (pArq && !CheckArq(*pArq, (int64_t)(totalAccessUnits - 1) * hnsFrameDuration, options.arqLoss / 100))
+        {
+            result = 1;
+        }
+
+        if (!options.golden.empty())
+        {
+            auto mismatch = CompareRtpPackets(ReadPcapUdpPayloads(options.golden.c_str(), replayRtpPort), sink.Captured());
+            if (mismatch.empty())
+            {
+                std::cout << "Matches golden capture " << options.golden << "\n";
+            }
+            else
+            {
+                std::cout << "Differs from golden capture " << options.golden << ": " << mismatch << "\n";
+                result = 1;
+            }
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        std::cout << "Error: " << ex.what() << "\n";
+        result = 3;
+    }
+    return result;
+}
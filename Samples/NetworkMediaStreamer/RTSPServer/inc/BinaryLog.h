@@ -0,0 +1,213 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Log messages of the server: id, logger type and format, each {} is replaced by the next argument
+#define RTSP_LOG_FORMATS(X) \
+    X(Text,                     OTHER,      "{}") \
+    X(ClientConnected,          OTHER,      "\nConnected to client with address: {}") \
+    X(InvalidClientSocket,      ERRORS,     "\nInvalid client socket returned by WSAAccept") \
+    X(SocketWrapperFailed,      ERRORS,     "\nFailed to Create Socket wrapper:{}") \
+    X(SessionStarting,          OTHER,      "\nStarting session:{}") \
+    X(SessionCompleted,         OTHER,      "\nSession completed:{}") \
+    X(SessionCreateFailed,      ERRORS,     "\nFailed to Create Session") \
+    X(TlsHandshake,             OTHER,      "\nTLS session {}; resumption hit rate: {}% ({}/{}); avg handshake CPU cycles full: {} resumed: {}; total CPU cycles saved: {}") \
+    X(MetricsExporterStarted,   OTHER,      "\nMetrics exporter listening on http://127.0.0.1:{}/metrics") \
+    X(HttpEgressStarted,        OTHER,      "\nHTTP egress listening on port {}, serving {} streams") \
+    X(ClientCertAuthenticated,  OTHER,      "\nClient Authenticated over TLS as user: {}") \
+    X(ClientNotAuthenticated,   OTHER,      "\nClient  not Authenticated over TLS ") \
+    X(RequestReceived,          RTSPMSGS,   "\nRequest:: {}") \
+    X(ResponseSent,             RTSPMSGS,   "{}:Response:{}") \
+    X(UnhandledRequest,         WARNINGS,   "\nUnhandled Request ignored : size ={}\nDump:{}") \
+    X(InterleavedStats,         OTHER,      "\nInterleaved tcp://{} : {} packets in {} writes, {} bytes, {} access units dropped, max backlog {} bytes") \
+    X(RecordsDropped,           WARNINGS,   "\n{} log records dropped, the log consumer could not keep up")
+
+enum class LogFormat : uint16_t
+{
+#define RTSP_LOG_FORMAT_ID(id, type, format) id,
+    RTSP_LOG_FORMATS(RTSP_LOG_FORMAT_ID)
+#undef RTSP_LOG_FORMAT_ID
+    Count
+};
+
+// Hex dumped by the consumer
+struct LogBytes
+{
+    const BYTE* pData;
+    size_t size;
+};
+
+// Ring of log records written by one thread and read by the consumer thread. The producer never
+// waits: a record that does not fit is dropped and counted.
+class CLogRing
+{
+public:
+    static constexpr size_t capacity = 256 * 1024;              // power of 2
+
+    CLogRing();
+    BYTE* Reserve(size_t size);
+    void Commit(size_t size);
+    size_t Used() const { return (size_t)(m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_relaxed)); }
+
+    template<typename F> void Drain(F&& onRecord);
+
+    std::atomic<uint64_t> m_dropped;
+
+private:
+    std::unique_ptr<BYTE[]> m_data;
+    alignas(64) std::atomic<uint64_t> m_head;                   // consumer position
+    alignas(64) std::atomic<uint64_t> m_tail;                   // producer position
+    uint64_t m_reserved;                                        // producer position of the reserved record
+};
+
+// Binary log path of the RTSP server. Log() copies the format id and the arguments into a ring of the
+// calling thread; a consumer thread formats the records and raises the log events, in the order
+// they were logged. When a logger type has no handler, Log() returns after one relaxed load.
+class CBinaryLogger
+{
+public:
+    static constexpr size_t maxArgSize = 16 * 1024;             // longer string arguments are truncated
+    static constexpr DWORD consumerIntervalMs = 20;
+
+    CBinaryLogger(winrt::event<winrt::LogHandler>* pLoggerEvents);
+    ~CBinaryLogger();
+
+    // called when a handler is added or removed
+    void SetEnabled(LoggerType type, bool bEnabled)
+    {
+        m_enabled[(int)type].store(bEnabled, std::memory_order_relaxed);
+    }
+
+    bool IsEnabled(LoggerType type) const
+    {
+        return m_enabled[(int)type].load(std::memory_order_relaxed);
+    }
+
+    static LoggerType TypeOf(LogFormat format);
+
+    template<typename... Args>
+    void Log(LogFormat format, HRESULT hr, Args const&... args)
+    {
+        if (!IsEnabled(TypeOf(format)))
+        {
+            return;
+        }
+        // records are 8 byte multiples so there is always room for the padding marker at the end of the ring
+        size_t size = (sizeof(RecordHeader) + (ArgSize(args) + ... + 0) + 7) & ~(size_t)7;
+        auto pRing = GetThreadRing();
+        BYTE* p = pRing->Reserve(size);
+        if (!p)
+        {
+            return;
+        }
+        RecordHeader header = { (uint32_t)size, (uint16_t)format, (uint16_t)sizeof...(args), hr, m_sequence.fetch_add(1, std::memory_order_relaxed) };
+        memcpy(p, &header, sizeof(header));
+        p += sizeof(header);
+        (WriteArg(p, args), ...);
+        pRing->Commit(size);
+        if (pRing->Used() > (CLogRing::capacity / 2))
+        {
+            SetEvent(m_wakeEvent.get());
+        }
+    }
+
+private:
+    enum class ArgType : uint32_t { Int, UInt, String, WString, Bytes };
+#pragma pack(push, 4)
+    struct RecordHeader
+    {
+        uint32_t size;
+        uint16_t format;
+        uint16_t argCount;
+        HRESULT hr;
+        uint64_t sequence;
+    };
+#pragma pack(pop)
+    static constexpr size_t argHeaderSize = 2 * sizeof(uint32_t);
+
+    struct Message
+    {
+        uint64_t sequence;
+        bool bValid;
+        LoggerType type;
+        HRESULT hr;
+        std::wstring text;
+    };
+
+    template<typename T>
+    static size_t ArgSize(T const&)
+    {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "unsupported log argument type");
+        return argHeaderSize + sizeof(uint64_t);
+    }
+    static size_t ArgSize(std::string const& s) { return argHeaderSize + __min(s.size(), maxArgSize); }
+    static size_t ArgSize(const char* s) { return argHeaderSize + __min(strlen(s), maxArgSize); }
+    static size_t ArgSize(winrt::hstring const& s) { return argHeaderSize + __min(s.size(), maxArgSize) * sizeof(wchar_t); }
+    static size_t ArgSize(LogBytes const& b) { return argHeaderSize + __min(b.size, maxArgSize); }
+
+    static void WriteArgHeader(BYTE*& p, ArgType type, size_t size)
+    {
+        uint32_t header[] = { (uint32_t)type, (uint32_t)size };
+        memcpy(p, header, sizeof(header));
+        p += sizeof(header);
+    }
+    static void WriteArgData(BYTE*& p, ArgType type, const void* pData, size_t size)
+    {
+        WriteArgHeader(p, type, size);
+        memcpy(p, pData, size);
+        p += size;
+    }
+    template<typename T>
+    static void WriteArg(BYTE*& p, T const& v)
+    {
+        uint64_t value = (uint64_t)v;
+        WriteArgData(p, (std::is_signed_v<T> ? ArgType::Int : ArgType::UInt), &value, sizeof(value));
+    }
+    static void WriteArg(BYTE*& p, std::string const& s) { WriteArgData(p, ArgType::String, s.data(), __min(s.size(), maxArgSize)); }
+    static void WriteArg(BYTE*& p, const char* s) { WriteArgData(p, ArgType::String, s, __min(strlen(s), maxArgSize)); }
+    static void WriteArg(BYTE*& p, winrt::hstring const& s) { WriteArgData(p, ArgType::WString, s.data(), __min(s.size(), maxArgSize) * sizeof(wchar_t)); }
+    static void WriteArg(BYTE*& p, LogBytes const& b) { WriteArgData(p, ArgType::Bytes, b.pData, __min(b.size, maxArgSize)); }
+
+    CLogRing* GetThreadRing();
+    void ConsumerLoop();
+    void DrainAll(bool bFinal);
+    static std::wstring FormatText(LogFormat format, std::vector<std::wstring> const& args);
+    static std::wstring FormatRecord(BYTE const* pRecord, RecordHeader const& header);
+
+    static std::atomic<uint64_t> s_nextLoggerId;
+    uint64_t m_id;
+    std::atomic<bool> m_enabled[(size_t)LoggerType::LOGGER_MAX];
+    std::atomic<uint64_t> m_sequence;
+    winrt::event<winrt::LogHandler>* m_pLoggerEvents;
+    std::mutex m_ringsLock;
+    std::map<DWORD, std::unique_ptr<CLogRing>> m_rings;         // by thread id, a ring outlives its thread
+    uint64_t m_droppedReported;
+    uint64_t m_nextSequence;                                    // of the next message to raise
+    std::vector<Message> m_heldMessages;                        // drained after a sequence number still missing
+    winrt::handle m_wakeEvent;
+    std::atomic<bool> m_bStop;
+    std::thread m_consumer;
+};
+
+template<typename F>
+void CLogRing::Drain(F&& onRecord)
+{
+    auto head = m_head.load(std::memory_order_relaxed);
+    auto tail = m_tail.load(std::memory_order_acquire);
+    while (head < tail)
+    {
+        auto pos = (size_t)(head & (capacity - 1));
+        uint32_t size;
+        memcpy(&size, &m_data[pos], sizeof(size));
+        if (size == 0)
+        {
+            // padding up to the end of the ring
+            head += capacity - pos;
+            continue;
+        }
+        onRecord(&m_data[pos]);
+        head += size;
+    }
+    m_head.store(head, std::memory_order_release);
+}
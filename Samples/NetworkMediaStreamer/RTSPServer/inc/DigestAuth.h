@@ -0,0 +1,748 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Portable pieces of HTTP/RTSP digest authentication (RFC 7616): MD5 and SHA-256 hashing,
+// a single pass Authorization header parser and the response computation.
+// This file has no Windows dependency so the auth path can be built and measured on any platform.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+enum class DigestAlgorithm
+{
+    MD5,
+    SHA256
+};
+
+class CMd5
+{
+public:
+    static constexpr size_t DigestSize = 16;
+
+    CMd5()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_state = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+        m_totalLen = 0;
+        m_blockLen = 0;
+    }
+
+    void Append(const void* pData, size_t len)
+    {
+        auto p = (const uint8_t*)pData;
+        m_totalLen += len;
+        while (len)
+        {
+            auto n = (len < (64 - m_blockLen)) ? len : (64 - m_blockLen);
+            memcpy(&m_block[m_blockLen], p, n);
+            m_blockLen += n;
+            p += n;
+            len -= n;
+            if (m_blockLen == 64)
+            {
+                Transform(m_block.data());
+                m_blockLen = 0;
+            }
+        }
+    }
+
+    std::array<uint8_t, DigestSize> GetValueAndReset()
+    {
+        uint64_t bitLen = m_totalLen * 8;
+        uint8_t pad = 0x80;
+        Append(&pad, 1);
+        pad = 0;
+        while (m_blockLen != 56)
+        {
+            Append(&pad, 1);
+        }
+        uint8_t lenBytes[8];
+        for (int i = 0; i < 8; i++)
+        {
+            lenBytes[i] = (uint8_t)(bitLen >> (8 * i));
+        }
+        Append(lenBytes, 8);
+
+        std::array<uint8_t, DigestSize> digest;
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                digest[i * 4 + j] = (uint8_t)(m_state[i] >> (8 * j));
+            }
+        }
+        Reset();
+        return digest;
+    }
+
+private:
+    static uint32_t Rotl(uint32_t x, int c)
+    {
+        return (x << c) | (x >> (32 - c));
+    }
+
+    void Transform(const uint8_t* pBlock)
+    {
+        static constexpr uint32_t K[64] =
+        {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+        static constexpr int R[64] =
+        {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+        };
+        uint32_t M[16];
+        for (int i = 0; i < 16; i++)
+        {
+            M[i] = (uint32_t)pBlock[i * 4] | ((uint32_t)pBlock[i * 4 + 1] << 8) | ((uint32_t)pBlock[i * 4 + 2] << 16) | ((uint32_t)pBlock[i * 4 + 3] << 24);
+        }
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t f;
+            int g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            f += a + K[i] + M[g];
+            a = d;
+            d = c;
+            c = b;
+            b += Rotl(f, R[i]);
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+    }
+
+    std::array<uint32_t, 4> m_state;
+    std::array<uint8_t, 64> m_block;
+    uint64_t m_totalLen;
+    size_t m_blockLen;
+};
+
+class CSha256
+{
+public:
+    static constexpr size_t DigestSize = 32;
+
+    CSha256()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_state = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        m_totalLen = 0;
+        m_blockLen = 0;
+    }
+
+    void Append(const void* pData, size_t len)
+    {
+        auto p = (const uint8_t*)pData;
+        m_totalLen += len;
+        while (len)
+        {
+            auto n = (len < (64 - m_blockLen)) ? len : (64 - m_blockLen);
+            memcpy(&m_block[m_blockLen], p, n);
+            m_blockLen += n;
+            p += n;
+            len -= n;
+            if (m_blockLen == 64)
+            {
+                Transform(m_block.data());
+                m_blockLen = 0;
+            }
+        }
+    }
+
+    std::array<uint8_t, DigestSize> GetValueAndReset()
+    {
+        uint64_t bitLen = m_totalLen * 8;
+        uint8_t pad = 0x80;
+        Append(&pad, 1);
+        pad = 0;
+        while (m_blockLen != 56)
+        {
+            Append(&pad, 1);
+        }
+        uint8_t lenBytes[8];
+        for (int i = 0; i < 8; i++)
+        {
+            lenBytes[i] = (uint8_t)(bitLen >> (56 - 8 * i));
+        }
+        Append(lenBytes, 8);
+
+        std::array<uint8_t, DigestSize> digest;
+        for (int i = 0; i < 8; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                digest[i * 4 + j] = (uint8_t)(m_state[i] >> (24 - 8 * j));
+            }
+        }
+        Reset();
+        return digest;
+    }
+
+private:
+    static uint32_t Rotr(uint32_t x, int c)
+    {
+        return (x >> c) | (x << (32 - c));
+    }
+
+    void Transform(const uint8_t* pBlock)
+    {
+        static constexpr uint32_t K[64] =
+        {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+        uint32_t W[64];
+        for (int i = 0; i < 16; i++)
+        {
+            W[i] = ((uint32_t)pBlock[i * 4] << 24) | ((uint32_t)pBlock[i * 4 + 1] << 16) | ((uint32_t)pBlock[i * 4 + 2] << 8) | (uint32_t)pBlock[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = Rotr(W[i - 15], 7) ^ Rotr(W[i - 15], 18) ^ (W[i - 15] >> 3);
+            uint32_t s1 = Rotr(W[i - 2], 17) ^ Rotr(W[i - 2], 19) ^ (W[i - 2] >> 10);
+            W[i] = W[i - 16] + s0 + W[i - 7] + s1;
+        }
+        uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t S1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + S1 + ch + K[i] + W[i];
+            uint32_t S0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = S0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+
+    std::array<uint32_t, 8> m_state;
+    std::array<uint8_t, 64> m_block;
+    uint64_t m_totalLen;
+    size_t m_blockLen;
+};
+
+inline std::string ToHexString(const uint8_t* pData, size_t len)
+{
+    static constexpr char hexDigits[] = "0123456789abcdef";
+    std::string hex(len * 2, '0');
+    for (size_t i = 0; i < len; i++)
+    {
+        hex[i * 2] = hexDigits[pData[i] >> 4];
+        hex[i * 2 + 1] = hexDigits[pData[i] & 0x0F];
+    }
+    return hex;
+}
+
+// Hashes the concatenation of the given parts (e.g. "user", ":", "realm", ":", "password")
+// without building the intermediate string and returns the lower case hex encoded digest.
+template <typename... Parts>
+std::string DigestHex(DigestAlgorithm algorithm, Parts const&... parts)
+{
+    if (algorithm == DigestAlgorithm::MD5)
+    {
+        CMd5 hash;
+        (hash.Append(std::string_view(parts).data(), std::string_view(parts).size()), ...);
+        auto digest = hash.GetValueAndReset();
+        return ToHexString(digest.data(), digest.size());
+    }
+    else
+    {
+        CSha256 hash;
+        (hash.Append(std::string_view(parts).data(), std::string_view(parts).size()), ...);
+        auto digest = hash.GetValueAndReset();
+        return ToHexString(digest.data(), digest.size());
+    }
+}
+
+// Parameters of an Authorization header. The views point into the parsed header string.
+struct AuthHeaderParams
+{
+    std::string_view scheme;
+    std::string_view credentials;   // base64 token of the Basic scheme
+    std::string_view username;
+    std::string_view realm;
+    std::string_view nonce;
+    std::string_view uri;
+    std::string_view response;
+    std::string_view algorithm;
+    std::string_view qop;
+    std::string_view nc;
+    std::string_view cnonce;
+    std::string_view opaque;
+    std::string_view stale;
+};
+
+// Single pass parser for the first line of an Authorization (or WWW-Authenticate) header
+// e.g. 'Authorization: Digest username="user", realm="BeyondTheWall", nonce="...", uri="rtsp://...", response="..."'
+inline bool ParseAuthHeader(std::string_view header, AuthHeaderParams& params)
+{
+    params = AuthHeaderParams();
+    auto isSpace = [](char c) { return (c == ' ') || (c == '\t'); };
+    auto isEol = [](char c) { return (c == '\r') || (c == '\n'); };
+    size_t pos = 0, len = header.size();
+
+    // skip the header name if present
+    auto colon = header.find(':');
+    auto firstSpace = header.find_first_of(" \t");
+    if ((colon != std::string_view::npos) && (colon < firstSpace))
+    {
+        pos = colon + 1;
+    }
+    while ((pos < len) && isSpace(header[pos])) pos++;
+    auto schemeStart = pos;
+    while ((pos < len) && !isSpace(header[pos]) && !isEol(header[pos])) pos++;
+    params.scheme = header.substr(schemeStart, pos - schemeStart);
+    if (params.scheme.empty())
+    {
+        return false;
+    }
+    if (params.scheme == "Basic")
+    {
+        while ((pos < len) && isSpace(header[pos])) pos++;
+        auto credStart = pos;
+        while ((pos < len) && (header[pos] != ',') && !isSpace(header[pos]) && !isEol(header[pos])) pos++;
+        params.credentials = header.substr(credStart, pos - credStart);
+        return true;
+    }
+
+    while (pos < len)
+    {
+        while ((pos < len) && (isSpace(header[pos]) || (header[pos] == ','))) pos++;
+        if ((pos >= len) || isEol(header[pos]))
+        {
+            break;
+        }
+        auto nameStart = pos;
+        while ((pos < len) && (header[pos] != '=') && (header[pos] != ',') && !isSpace(header[pos]) && !isEol(header[pos])) pos++;
+        auto name = header.substr(nameStart, pos - nameStart);
+        if ((pos >= len) || (header[pos] != '='))
+        {
+            // not a name=value pair, ignore it
+            continue;
+        }
+        pos++;
+        std::string_view value;
+        if ((pos < len) && (header[pos] == '\"'))
+        {
+            auto valueStart = ++pos;
+            while ((pos < len) && (header[pos] != '\"') && !isEol(header[pos]))
+            {
+                pos += ((header[pos] == '\\') && (pos + 1 < len)) ? 2 : 1;
+            }
+            value = header.substr(valueStart, pos - valueStart);
+            if ((pos < len) && (header[pos] == '\"')) pos++;
+        }
+        else
+        {
+            auto valueStart = pos;
+            while ((pos < len) && (header[pos] != ',') && !isSpace(header[pos]) && !isEol(header[pos])) pos++;
+            value = header.substr(valueStart, pos - valueStart);
+        }
+
+        switch (name.size() ? name[0] : 0)
+        {
+        case 'u': if (name == "username") params.username = value; else if (name == "uri") params.uri = value; break;
+        case 'r': if (name == "realm") params.realm = value; else if (name == "response") params.response = value; break;
+        case 'n': if (name == "nonce") params.nonce = value; else if (name == "nc") params.nc = value; break;
+        case 'a': if (name == "algorithm") params.algorithm = value; break;
+        case 'q': if (name == "qop") params.qop = value; break;
+        case 'c': if (name == "cnonce") params.cnonce = value; break;
+        case 'o': if (name == "opaque") params.opaque = value; break;
+        case 's': if (name == "stale") params.stale = value; break;
+        default: break;
+        }
+    }
+    return true;
+}
+
+// RFC 7616 section 3.4.1 response. qop may be empty for RFC 2069 style clients.
+inline std::string ComputeDigestResponse(
+    DigestAlgorithm algorithm,
+    std::string_view ha1Hex,
+    std::string_view nonce,
+    std::string_view nc,
+    std::string_view cnonce,
+    std::string_view qop,
+    std::string_view method,
+    std::string_view uri)
+{
+    auto ha2Hex = DigestHex(algorithm, method, ":", uri);
+    if (qop.empty())
+    {
+        return DigestHex(algorithm, ha1Hex, ":", nonce, ":", ha2Hex);
+    }
+    else
+    {
+        return DigestHex(algorithm, ha1Hex, ":", nonce, ":", nc, ":", cnonce, ":", qop, ":", ha2Hex);
+    }
+}
+
+// Compares in a time that only depends on the lengths, so a response or a MAC cannot be guessed byte by byte
+inline bool FixedTimeEquals(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    uint8_t diff = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        diff |= (uint8_t)(a[i] ^ b[i]);
+    }
+    return diff == 0;
+}
+
+inline std::string Base64Decode(std::string_view encoded)
+{
+    auto decodeChar = [](char c) -> int
+    {
+        if ((c >= 'A') && (c <= 'Z')) return c - 'A';
+        if ((c >= 'a') && (c <= 'z')) return c - 'a' + 26;
+        if ((c >= '0') && (c <= '9')) return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    };
+    std::string decoded;
+    decoded.reserve(encoded.size() * 3 / 4);
+    uint32_t acc = 0;
+    int bits = 0;
+    for (auto c : encoded)
+    {
+        auto v = decodeChar(c);
+        if (v < 0)
+        {
+            break;
+        }
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            decoded.push_back((char)((acc >> bits) & 0xFF));
+        }
+    }
+    return decoded;
+}
+
+inline std::array<uint8_t, CSha256::DigestSize> HmacSha256(std::string_view key, std::string_view data)
+{
+    constexpr size_t blockSize = 64;
+    uint8_t keyBlock[blockSize] = { 0 };
+    if (key.size() > blockSize)
+    {
+        CSha256 keyHash;
+        keyHash.Append(key.data(), key.size());
+        auto hashedKey = keyHash.GetValueAndReset();
+        memcpy(keyBlock, hashedKey.data(), hashedKey.size());
+    }
+    else
+    {
+        memcpy(keyBlock, key.data(), key.size());
+    }
+
+    uint8_t pad[blockSize];
+    CSha256 inner, outer;
+    for (size_t i = 0; i < blockSize; i++) pad[i] = keyBlock[i] ^ 0x36;
+    inner.Append(pad, blockSize);
+    inner.Append(data.data(), data.size());
+    auto innerDigest = inner.GetValueAndReset();
+    for (size_t i = 0; i < blockSize; i++) pad[i] = keyBlock[i] ^ 0x5c;
+    outer.Append(pad, blockSize);
+    outer.Append(innerDigest.data(), innerDigest.size());
+    return outer.GetValueAndReset();
+}
+
+enum class NonceStatus
+{
+    Valid,
+    Stale,      // correctly signed but older than the nonce lifetime
+    Invalid
+};
+
+constexpr size_t statelessNonceTimeChars = 16;      // hex encoded 64 bit timestamp
+constexpr size_t statelessNonceMacBytes = 16;       // truncated HMAC-SHA256
+
+// Stateless nonce: hex(timestamp) followed by HMAC(secret, timestamp:clientAddress) truncated to 128 bits.
+// Any server holding the same secret can validate the nonce without remembering that it issued it.
+inline std::string MakeStatelessNonce(std::string_view key, uint64_t timestamp, std::string_view clientAddress)
+{
+    uint8_t timeBytes[8];
+    for (int i = 0; i < 8; i++)
+    {
+        timeBytes[i] = (uint8_t)(timestamp >> (56 - 8 * i));
+    }
+    auto timeHex = ToHexString(timeBytes, sizeof(timeBytes));
+    auto mac = HmacSha256(key, timeHex + ":" + std::string(clientAddress));
+    return timeHex + ToHexString(mac.data(), statelessNonceMacBytes);
+}
+
+inline NonceStatus ValidateStatelessNonce(std::string_view key, std::string_view nonce, std::string_view clientAddress, uint64_t now, uint64_t lifetime)
+{
+    if (nonce.size() != statelessNonceTimeChars + statelessNonceMacBytes * 2)
+    {
+        return NonceStatus::Invalid;
+    }
+    uint64_t timestamp = 0;
+    for (size_t i = 0; i < statelessNonceTimeChars; i++)
+    {
+        auto c = nonce[i];
+        uint64_t v = ((c >= '0') && (c <= '9')) ? (c - '0') : ((c >= 'a') && (c <= 'f')) ? (c - 'a' + 10) : 16;
+        if (v > 15)
+        {
+            return NonceStatus::Invalid;
+        }
+        timestamp = (timestamp << 4) | v;
+    }
+    if (!FixedTimeEquals(MakeStatelessNonce(key, timestamp, clientAddress), nonce))
+    {
+        return NonceStatus::Invalid;
+    }
+    return ((timestamp > now) || ((now - timestamp) > lifetime)) ? NonceStatus::Stale : NonceStatus::Valid;
+}
+
+// Issued nonces with the last nonce count accepted for each, for the replay check. All the nonces have the same
+// lifetime, so a queue in issue order is also in expiry order and tracking, lookup and eviction are O(1) amortized;
+// the queues drop the entries of erased nonces as they reach their front. Nonces a response was verified with
+// are moved to a second queue: when the table is full a nonce never verified is evicted first, so a flood of
+// unauthenticated requests cannot push out the nonces of the clients that authenticated. A peer, when known,
+// has at most maxPerPeer nonces, the next one replaces its oldest.
+class CNonceTable
+{
+public:
+    // lifetime and the times given are in the same unit
+    CNonceTable(int64_t lifetime, size_t maxNonces, size_t maxPerPeer)
+        : m_lifetime(lifetime)
+        , m_maxNonces(maxNonces)
+        , m_maxPerPeer(maxPerPeer)
+        , m_nextId(0)
+    {
+    }
+
+    // Tracks a nonce issued at now to peer, empty if it is not known, with a nonce count of 0
+    void Track(std::string const& nonce, std::string const& peer, int64_t now)
+    {
+        Erase(nonce);
+        DropExpired(m_pending, now);
+        DropExpired(m_verified, now);
+        if (!peer.empty())
+        {
+            auto peerIt = m_peers.find(peer);
+            if ((peerIt != m_peers.end()) && (peerIt->second.count >= m_maxPerPeer))
+            {
+                EraseFront(peerIt->second.queue);
+            }
+        }
+        if (m_nonces.size() >= m_maxNonces)
+        {
+            if (!EraseFront(m_pending))
+            {
+                EraseFront(m_verified);
+            }
+        }
+
+        uint64_t id = m_nextId++;
+        m_nonces[nonce] = { now, 0, id, peer };
+        m_pending.push_back({ nonce, id, now });
+        if (!peer.empty())
+        {
+            auto& peerState = m_peers[peer];
+            while (!peerState.queue.empty() && !IsLive(peerState.queue.front(), peerState.queue))
+            {
+                peerState.queue.pop_front();
+            }
+            peerState.queue.push_back({ nonce, id, now });
+            peerState.count++;
+        }
+    }
+
+    // Last nonce count accepted for the nonce, false if it is not tracked or has expired, which drops it
+    bool Find(std::string const& nonce, int64_t now, uint32_t* pLastNonceCount)
+    {
+        auto it = m_nonces.find(nonce);
+        if (it == m_nonces.end())
+        {
+            return false;
+        }
+        if ((now - it->second.issueTime) > m_lifetime)
+        {
+            Erase(nonce);
+            return false;
+        }
+        *pLastNonceCount = it->second.lastNonceCount;
+        return true;
+    }
+
+    // Records the nonce count of a verified response, false if the nonce is not tracked or the count is not
+    // above the last one accepted
+    bool Accept(std::string const& nonce, uint32_t nonceCount)
+    {
+        auto it = m_nonces.find(nonce);
+        if ((it == m_nonces.end()) || (nonceCount <= it->second.lastNonceCount))
+        {
+            return false;
+        }
+        if (!it->second.lastNonceCount)
+        {
+            m_verified.push_back({ nonce, it->second.id, it->second.issueTime });
+        }
+        it->second.lastNonceCount = nonceCount;
+        return true;
+    }
+
+    size_t Size() const { return m_nonces.size(); }
+
+private:
+    struct NonceState
+    {
+        int64_t issueTime;
+        uint32_t lastNonceCount;                // 0 until a response is verified with the nonce
+        uint64_t id;                            // tells a nonce from an earlier one with the same value
+        std::string peer;
+    };
+
+    struct QueueEntry
+    {
+        std::string nonce;
+        uint64_t id;
+        int64_t issueTime;
+    };
+
+    struct PeerState
+    {
+        std::deque<QueueEntry> queue;
+        size_t count;                           // nonces of the peer in the table
+    };
+
+    bool IsLive(QueueEntry const& entry, std::deque<QueueEntry> const& queue) const
+    {
+        auto it = m_nonces.find(entry.nonce);
+        return (it != m_nonces.end()) && (it->second.id == entry.id)
+            && ((&queue != &m_pending) || !it->second.lastNonceCount);
+    }
+
+    // Erases the oldest nonce of the queue still in the table, false if there is none
+    bool EraseFront(std::deque<QueueEntry>& queue)
+    {
+        while (!queue.empty())
+        {
+            bool bLive = IsLive(queue.front(), queue);
+            auto nonce = std::move(queue.front().nonce);
+            queue.pop_front();
+            if (bLive)
+            {
+                Erase(nonce);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void DropExpired(std::deque<QueueEntry>& queue, int64_t now)
+    {
+        while (!queue.empty() && (!IsLive(queue.front(), queue) || ((now - queue.front().issueTime) > m_lifetime)))
+        {
+            if (IsLive(queue.front(), queue))
+            {
+                Erase(queue.front().nonce);
+            }
+            queue.pop_front();
+        }
+    }
+
+    void Erase(std::string const& nonce)
+    {
+        auto it = m_nonces.find(nonce);
+        if (it == m_nonces.end())
+        {
+            return;
+        }
+        if (!it->second.peer.empty())
+        {
+            auto peerIt = m_peers.find(it->second.peer);
+            if ((peerIt != m_peers.end()) && !--peerIt->second.count)
+            {
+                m_peers.erase(peerIt);
+            }
+        }
+        m_nonces.erase(it);
+    }
+
+    int64_t m_lifetime;
+    size_t m_maxNonces;
+    size_t m_maxPerPeer;
+    uint64_t m_nextId;
+    std::unordered_map<std::string, NonceState> m_nonces;
+    std::deque<QueueEntry> m_pending;           // issue order, of the nonces never verified
+    std::deque<QueueEntry> m_verified;          // verification order, of the others
+    std::unordered_map<std::string, PeerState> m_peers;
+};
@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr size_t hlsSegmentsKept = 6;
+constexpr size_t hlsSegmentsWithParts = 3;                      // last segments listing their parts in the playlist
+constexpr DWORD httpKeepAliveTimeoutMs = 30000;
+constexpr auto hlsBlockingTimeout = std::chrono::seconds(10);   // longest wait of a blocking request
+constexpr size_t httpMaxRequestSize = 8192;
+constexpr size_t httpMaxConnections = 32;                       // more are answered 503 and closed
+
+// Last segments of one stream for the HTTP egress, fed the CMAF parts of a stream sink through a "cmaf"
+// transport handler. The parts are the buffers of the stream sink, every viewer sends the same ones.
+class CCmafSegmentCache
+{
+public:
+    struct Part
+    {
+        winrt::Windows::Storage::Streams::IBuffer data;
+        double duration;                                        // in seconds
+        bool bIndependent;                                      // starts with an IDR
+    };
+    struct Segment
+    {
+        uint64_t msn;                                           // media sequence number
+        std::vector<Part> parts;
+        bool bComplete;
+        double duration;
+    };
+
+    // partTarget is the part duration of the stream sink, in seconds. A segment lasts at most
+    // targetDuration seconds, rounded up to a whole second
+    CCmafSegmentCache(double partTarget, double targetDuration);
+    void OnChunk(winrt::Windows::Storage::Streams::IBuffer const& buf);
+    void Close();
+
+    // LL-HLS blocking playlist reload: waits for part of segment msn, or for the whole segment if part is
+    // negative. False if the request is too far ahead to ever be answered; a timed out wait returns true and
+    // the playlist is sent as it is.
+    bool WaitForPlaylist(uint64_t msn, int64_t part);
+    std::string Playlist();
+    winrt::Windows::Storage::Streams::IBuffer InitSegment();
+    // Waits for a part that is not there yet, so a preload hint is answered as soon as the part exists.
+    // nullptr if the part will not come; bLast once the segment is complete and has no part after this one.
+    winrt::Windows::Storage::Streams::IBuffer WaitForPart(uint64_t msn, size_t part, bool& bLast);
+
+private:
+    static size_t FindBox(const BYTE* pData, size_t start, size_t end, const char* type);
+    static uint32_t ReadTimescale(const BYTE* pData, size_t size);
+    double FragmentDuration(const BYTE* pData, size_t size) const;
+    Segment* FindSegment(uint64_t msn);
+
+    std::mutex m_lock;
+    std::condition_variable m_updated;
+    winrt::Windows::Storage::Streams::IBuffer m_initSegment;
+    uint32_t m_timescale;                                       // of the track, from the init segment
+    std::deque<Segment> m_segments;
+    uint64_t m_nextMsn;
+    const double m_partTarget;
+    const int m_targetDuration;
+    bool m_bClosed;
+};
+
+// LL-HLS server over HTTP/1.1: GET /<stream>/index.m3u8 with the _HLS_msn and _HLS_part blocking reload
+// parameters, init.mp4, seg<msn>.m4s and part<msn>.<part>.m4s, where <stream> is the URL suffix of the
+// media sink. A segment still being produced is sent with chunked transfer encoding, a part at a time as
+// it comes. Each connection has a thread, kept alive between requests, up to httpMaxConnections of them.
+class CHttpEgressServer
+{
+public:
+    // Listens on the IPv4 address pAddress, on all the interfaces if it is null
+    CHttpEgressServer(LPCWSTR pAddress, uint16_t port, std::map<std::string, std::shared_ptr<CCmafSegmentCache>> const& caches);
+    ~CHttpEgressServer();
+
+private:
+    void ConnectionThread(SOCKET client);
+    bool HandleRequest(SOCKET client, std::string const& request);
+    bool SendResponse(SOCKET client, std::string const& status, std::string const& contentType, std::string const& body, bool bKeepAlive);
+    bool SendBuffers(SOCKET client, std::string const& contentType, std::vector<winrt::Windows::Storage::Streams::IBuffer> const& buffers, bool bKeepAlive);
+    bool SendSegment(SOCKET client, CCmafSegmentCache& cache, uint64_t msn, bool bChunked, bool bKeepAlive);
+    static bool Send(SOCKET client, const void* pData, size_t size);
+
+    SOCKET m_listenSocket;
+    winrt::handle m_acceptEvent;
+    winrt::handle m_callbackHandle;
+    std::map<std::string, std::shared_ptr<CCmafSegmentCache>> m_caches;
+    std::mutex m_lock;
+    std::condition_variable m_connectionEnded;
+    std::vector<SOCKET> m_connections;
+    bool m_bStopping;
+};
@@ -0,0 +1,160 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Coalescing and backlog core of the interleaved write path on plain byte buffers: interleaved RTP/RTCP frames
+// (RFC 2326 section 10.12) are gathered per access unit, encoded and sent together, and the bytes the transport
+// does not take are kept in a bounded backlog. It has no Windows dependency so it can be tested over loopback
+// on any platform; CInterleavedWriter is an adapter over it that adds the lock and the socket, with its TLS
+// encoding.
+
+#include <bitset>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr size_t INTERLEAVED_COALESCE_SIZE = 64 * 1024;         // plain bytes gathered before they are encoded and written
+constexpr size_t INTERLEAVED_MAX_BACKLOG = 1024 * 1024;         // unsent bytes after which new access units are refused
+constexpr size_t INTERLEAVED_HEADER_SIZE = 4;                   // '$', channel, 16 bit length
+constexpr size_t INTERLEAVED_MAX_PAYLOAD = 0xFFFF;
+
+struct InterleavedWriterStats
+{
+    uint64_t packets;
+    uint64_t writes;                                            // send() calls
+    uint64_t bytesWritten;
+    uint64_t accessUnitsRefused;                                // access units refused because the backlog was full
+    size_t maxBacklog;                                          // high water mark of unsent bytes
+};
+
+// The transport is given to each call as two functions:
+//   encode(pData, size, wire) appends the wire bytes of plain data to wire, e.g. TLS records of it
+//   send(pData, size) returns the bytes the transport took, 0 if it would block, negative on an error
+// Once send fails everything is discarded.
+class CInterleavedQueue
+{
+public:
+    CInterleavedQueue(size_t maxBacklog = INTERLEAVED_MAX_BACKLOG)
+        : m_maxBacklog(maxBacklog)
+        , m_bBroken(false)
+        , m_backlogOffset(0)
+        , m_stats()
+    {
+        m_pending.reserve(INTERLEAVED_COALESCE_SIZE + INTERLEAVED_MAX_PAYLOAD + INTERLEAVED_HEADER_SIZE);
+    }
+
+    // Queues one RTP or RTCP packet. Returns false without queuing it when a new access unit starts
+    // while the backlog is full; the caller should then drop the rest of that access unit.
+    template <typename EncodeFn, typename SendFn>
+    bool WritePacket(uint8_t channel, const uint8_t* pPacket, size_t size, bool bIsRtcp, bool bEndOfAccessUnit, EncodeFn&& encode, SendFn&& send)
+    {
+        if (m_bBroken || (size > INTERLEAVED_MAX_PAYLOAD))
+        {
+            return false;
+        }
+        if (!m_openAccessUnits.test(channel))
+        {
+            Drain(send);
+            if (Backlog() >= m_maxBacklog)
+            {
+                // RTCP is dropped as well, but it is not an access unit
+                m_stats.accessUnitsRefused += bIsRtcp ? 0 : 1;
+                return false;
+            }
+        }
+
+        uint8_t header[INTERLEAVED_HEADER_SIZE] = { '$', channel, (uint8_t)(size >> 8), (uint8_t)(size & 0xFF) };
+        m_pending.insert(m_pending.end(), header, header + INTERLEAVED_HEADER_SIZE);
+        m_pending.insert(m_pending.end(), pPacket, pPacket + size);
+        m_stats.packets++;
+
+        // access units of the tracks are tracked per channel and the data is written once none is open;
+        // RTCP sent between access units goes out at once, otherwise it rides along with them
+        if (!bIsRtcp)
+        {
+            m_openAccessUnits.set(channel, !bEndOfAccessUnit);
+        }
+        if (m_openAccessUnits.none() || (m_pending.size() >= INTERLEAVED_COALESCE_SIZE))
+        {
+            EncodePending(encode);
+            Drain(send);
+        }
+        return true;
+    }
+
+    // Sends a message, e.g. an RTSP response, after the data already queued
+    template <typename EncodeFn, typename SendFn>
+    void WriteMessage(const uint8_t* pMessage, size_t size, EncodeFn&& encode, SendFn&& send)
+    {
+        if (m_bBroken)
+        {
+            return;
+        }
+        // interleaved frames are self delimiting, so a message can go between two of them
+        m_pending.insert(m_pending.end(), pMessage, pMessage + size);
+        EncodePending(encode);
+        Drain(send);
+    }
+
+    // Sends as much of the backlog as the transport takes, called when it is writable again
+    template <typename SendFn>
+    void Drain(SendFn&& send)
+    {
+        while (!m_bBroken && (m_backlogOffset < m_backlog.size()))
+        {
+            auto remaining = m_backlog.size() - m_backlogOffset;
+            m_stats.maxBacklog = (remaining > m_stats.maxBacklog) ? remaining : m_stats.maxBacklog;
+            auto sent = send(m_backlog.data() + m_backlogOffset, (remaining < (size_t)INT_MAX) ? remaining : (size_t)INT_MAX);
+            if (sent < 0)
+            {
+                m_bBroken = true;
+                m_backlog.clear();
+                m_backlogOffset = 0;
+                m_pending.clear();
+            }
+            if (sent <= 0)
+            {
+                break;
+            }
+            m_stats.writes++;
+            m_stats.bytesWritten += (uint64_t)sent;
+            m_backlogOffset += (size_t)sent;
+        }
+
+        if (m_backlogOffset == m_backlog.size())
+        {
+            m_backlog.clear();
+            m_backlogOffset = 0;
+        }
+        else if (m_backlogOffset > (m_backlog.size() / 2))
+        {
+            m_backlog.erase(m_backlog.begin(), m_backlog.begin() + m_backlogOffset);
+            m_backlogOffset = 0;
+        }
+    }
+
+    size_t Backlog() const { return m_backlog.size() - m_backlogOffset; }
+    bool IsBroken() const { return m_bBroken; }
+    InterleavedWriterStats const& Stats() const { return m_stats; }
+
+private:
+    template <typename EncodeFn>
+    void EncodePending(EncodeFn&& encode)
+    {
+        if (!m_pending.empty())
+        {
+            encode(m_pending.data(), m_pending.size(), m_backlog);
+            m_pending.clear();
+        }
+    }
+
+    size_t m_maxBacklog;
+    std::bitset<256> m_openAccessUnits;                         // channels with an access unit in progress
+    bool m_bBroken;                                             // transport error, everything is discarded
+    std::vector<uint8_t> m_pending;                             // plain interleaved frames not yet encoded
+    std::vector<uint8_t> m_backlog;                             // wire bytes not yet taken by the transport
+    size_t m_backlogOffset;
+    InterleavedWriterStats m_stats;
+};
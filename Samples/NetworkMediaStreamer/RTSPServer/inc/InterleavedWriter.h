@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+#include "InterleavedQueue.h"
+
+// Write path of one RTSP connection.
+// Interleaved RTP/RTCP frames (RFC 2326 section 10.12) of an access unit are gathered and written with
+// one send(), or one TLS record per cbMaximumMessage bytes, when the packet with the RTP marker bit arrives.
+// The socket is non blocking once it is event selected, so bytes the socket does not take are kept in a
+// bounded backlog and sent before anything else. RTSP responses go through the same path to keep the
+// byte stream, and the TLS record sequence, ordered. The coalescing and the backlog are CInterleavedQueue,
+// this adds the lock and the socket.
+class CInterleavedWriter
+{
+public:
+    CInterleavedWriter(CSocketWrapper* pSocket, size_t maxBacklog = INTERLEAVED_MAX_BACKLOG);
+
+    // Queues one RTP or RTCP packet. Returns false without queuing it when a new access unit starts
+    // while the backlog is full; the caller should then drop the rest of that access unit.
+    bool WritePacket(BYTE channel, const BYTE* pPacket, size_t size, bool bIsRtcp, bool bEndOfAccessUnit);
+
+    // Sends an RTSP message after the data already queued.
+    void WriteMessage(const BYTE* pMessage, size_t size);
+
+    // Sends as much of the backlog as the socket takes, called when the socket is writable again.
+    void Drain();
+
+    InterleavedWriterStats GetStats();
+
+private:
+    void Encode(const BYTE* pData, size_t size, std::vector<BYTE>& wire);
+    int64_t Send(const BYTE* pData, size_t size);
+
+    std::mutex m_lock;
+    CSocketWrapper* m_pSocket;
+    CInterleavedQueue m_queue;
+};
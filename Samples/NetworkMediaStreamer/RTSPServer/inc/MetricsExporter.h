@@ -0,0 +1,28 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+typedef winrt::delegate<RTSPServerMetrics&, std::vector<RTSPSessionMetrics>&> MetricsSnapshotHandler;
+
+// Minimal HTTP endpoint on the loopback interface serving the server metrics:
+// GET /metrics in the Prometheus text format, GET /metrics.json as JSON.
+// Requests are answered one at a time on the wait callback, it is meant for a local scraper.
+class CMetricsExporter
+{
+public:
+    CMetricsExporter(uint16_t port, MetricsSnapshotHandler snapshot);
+    ~CMetricsExporter();
+
+    static std::string FormatPrometheus(RTSPServerMetrics const& server, std::vector<RTSPSessionMetrics> const& sessions);
+    static std::string FormatJson(RTSPServerMetrics const& server, std::vector<RTSPSessionMetrics> const& sessions);
+
+private:
+    void HandleConnection(SOCKET client);
+
+    SOCKET m_listenSocket;
+    winrt::handle m_acceptEvent;
+    winrt::handle m_callbackHandle;
+    MetricsSnapshotHandler m_snapshot;
+    std::mutex m_lock;
+};
@@ -4,7 +4,7 @@
 #pragma once
 #define DBGLEVEL 1
 
-class RTSPServer : public winrt::implements<RTSPServer, IRTSPServerControl>
+class RTSPServer : public winrt::implements<RTSPServer, IRTSPServerControl, IRTSPServerMetrics, IRTSPServerHttpEgress>
 {
 public:
     RTSPServer(ABI::RTSPSuffixSinkMap* streamers, uint16_t socketPort, IRTSPAuthProvider* pAuthProvider, PCCERT_CONTEXT* serverCerts, size_t uCertCount)
@@ -23,11 +23,17 @@ public:
             winrt::check_pointer(serverCerts[i]);
             m_serverCerts[i] = CertDuplicateCertificateContext(serverCerts[i]);
         }
+        if (m_bSecure)
+        {
+            m_spTlsCredential = std::make_shared<CTlsServerCredential>(m_serverCerts);
+        }
         m_spAuthProvider.copy_from(pAuthProvider);
     }
 
     virtual  ~RTSPServer()
     {
+        StopHttpEgress();
+        StopMetricsExporter();
         StopServer();
     }
 
@@ -39,6 +45,7 @@ public:
         winrt::LogHandler h;
         winrt::copy_from_abi(h, handler);
         auto token = m_loggerEvents[(int)type].add(h);
+        m_logger.SetEnabled(type, true);
         winrt::copy_to_abi(token, *pToken);
         return S_OK;
     }HRESULT_EXCEPTION_BOUNDARY_FUNC
@@ -48,6 +55,7 @@ public:
         winrt::event_token tk;
         winrt::copy_from_abi(tk, token);
         m_loggerEvents[(int)type].remove(tk);
+        m_logger.SetEnabled(type, bool(m_loggerEvents[(int)type]));
         return S_OK;
     }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
@@ -71,7 +79,19 @@ public:
     STDMETHODIMP StartServer() override;
     STDMETHODIMP StopServer() override;
 
+    // IRTSPServerMetrics
+    STDMETHODIMP GetServerMetrics(RTSPServerMetrics* pMetrics) override;
+    STDMETHODIMP GetSessionMetrics(RTSPSessionMetrics* pMetrics, UINT32 uMaxSessions, UINT32* puSessionCount) override;
+    STDMETHODIMP StartMetricsExporter(uint16_t port) override;
+    STDMETHODIMP StopMetricsExporter() override;
+
+    // IRTSPServerHttpEgress
+    STDMETHODIMP StartHttpEgress(LPCWSTR pAddress, uint16_t port, UINT32 uPartDurationMs, UINT32 uSegmentDurationMs) override;
+    STDMETHODIMP StopHttpEgress() override;
+
 private:
+    void LogTlsHandshakeStats(bool bResumed);
+    void GetMetricsSnapshot(RTSPServerMetrics& server, std::vector<RTSPSessionMetrics>& sessions);
 
     winrt::RTSPSuffixSinkMap m_streamers;
 
@@ -82,10 +102,18 @@ private:
     uint16_t m_socketPort;
     bool m_bSecure;
     winrt::com_array<PCCERT_CONTEXT> m_serverCerts;
+    std::shared_ptr<CTlsServerCredential> m_spTlsCredential;     // shared by all connections so TLS sessions can be resumed
     winrt::event<winrt::LogHandler> m_loggerEvents[(size_t)LoggerType::LOGGER_MAX];
+    CBinaryLogger m_logger{ m_loggerEvents };                   // raises m_loggerEvents, declared after them
     winrt::event<winrt::SessionStatusHandler> m_sessionStatusEvents;
     winrt::com_ptr<IMFPresentationClock> m_spClock;
     bool m_bIsShutdown;
     std::mutex m_apiGuard;
     winrt::com_ptr<IRTSPAuthProvider> m_spAuthProvider;
+    CServerCounters m_counters;
+    std::unique_ptr<CMetricsExporter> m_pMetricsExporter;
+    std::mutex m_exporterGuard;                                 // not m_apiGuard: the exporter callback takes that one
+    std::unique_ptr<CHttpEgressServer> m_pHttpEgress;
+    std::vector<std::pair<winrt::com_ptr<INetworkMediaStreamSink>, winrt::PacketHandler>> m_httpEgressHandlers;
+    std::mutex m_httpEgressGuard;
 };
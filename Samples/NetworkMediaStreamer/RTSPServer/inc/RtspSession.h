@@ -4,6 +4,7 @@
 #pragma once
 
 #define RTP_DEFAULT_PORT       54554
+#define RTP_FIRST_LOCAL_PORT   6970     // first port tried for the local RTP/RTCP port pair
 #define RTSP_BUFFER_SIZE       10000    // for incoming requests, and outgoing responses
 #define RTSP_PARAM_STRING_MAX  200
 
@@ -15,7 +16,25 @@ enum class RTSP_CMD
     DESCRIBE,
     SETUP,
     PLAY,
-    TEARDOWN
+    TEARDOWN,
+    INTERLEAVED                 // interleaved RTCP from the client
+};
+
+// Transport state of one stream sink of the media sink, set up with its own SETUP request
+struct RtspTrack
+{
+    winrt::com_ptr<IMFStreamSink> spStreamer;
+    bool     bSetup;
+    bool     bTcpTransport;
+    u_short  localRTPPort;
+    u_short  localRTCPPort;
+    u_short  clientRTPPort;
+    u_short  clientRTCPPort;
+    BYTE     rtpChannel;                                 // interleaved channel of RTP, RTCP uses rtpChannel + 1
+    uint32_t ssrc;
+    std::string dest;                                    // UDP destination while streaming
+    winrt::PacketHandler packetHandler;                  // interleaved TCP transport
+    std::unique_ptr<CStreamCounters> spCounters;         // packets of the clients that stopped streaming
 };
 
 class RTSPSession
@@ -25,11 +44,13 @@ public:
         CSocketWrapper* rtspClientSocket,
         winrt::Windows::Foundation::Collections::PropertySet streamers,
         IRTSPAuthProvider* pAuthProvider,
-        winrt::event<winrt::LogHandler>* m_pLoggers);
+        CBinaryLogger* pLogger,
+        CServerCounters* pServerCounters);
     virtual ~RTSPSession();
 
     virtual RTSP_CMD HandleRequest(char const* aRequest, unsigned aRequestSize);
     int GetStreamID();
+    void GetMetrics(RTSPSessionMetrics& metrics, RTSPStreamMetrics& streaming);
     SOCKET GetSocket()
     {
         return m_pRtspClient->GetSocket();
@@ -38,49 +59,66 @@ public:
     void BeginSession(winrt::delegate<RTSPSession*> completed);
 private:
     void Init();
-    void InitUDPTransport();
-    void InitTCPTransport();
+    void InitTracks(winrt::com_ptr<IMFMediaSink> spMediaSink);
+    void InitUDPTransport(u_short startPort, u_short& rtpPort, u_short& rtcpPort);
+    void InitTCPTransport(RtspTrack& track);
+    std::string GenerateSessionSDP(std::string const& dest);
+    std::string GetContentBase();
     RTSP_CMD ParseRequest(char const* aRequest, unsigned aRequestSize);
     char const* DateHeader();
-    std::string m_dest;
     // RTSP request command handlers
     void HandleCmdOPTIONS();
     void HandleCmdDESCRIBE();
     void HandleCmdSETUP();
     void HandleCmdPLAY();
     void HandleCmdTEARDOWN();
+    void HandleRequestError();
     void Handle_RtspPAUSE();
     void StopIfStreaming();
+    size_t HandleInterleavedData(BYTE const* pData, size_t size);
+    void HandleReceiverReport(BYTE const* pReport, size_t size);
+    bool GetClientStats(RtspTrack& track, RTSPStreamMetrics& m);
+    void LogLatencyStats();
     void SendToClient(std::string Response);
+    std::string GetAuthChallenge();
 
     uint32_t m_rtspSessionID;
     winrt::delegate<RTSPSession*> m_sessionCompleted;
     std::unique_ptr<CSocketWrapper> m_pRtspClient;
     std::string    m_rtspClientAddr;
     u_short  m_rtspPort;
-    u_short  m_localRTPPort;                           // client port for UDP based RTP transport
-    u_short  m_localRTCPPort;                          // client port for UDP based RTCP transport  
-
     u_short  m_clientRTPPort;                           // client port for UDP based RTP transport
     u_short  m_clientRTCPPort;                          // client port for UDP based RTCP transport  
     bool     m_bTcpTransport;                            // if Tcp based streaming was activated
     uint32_t m_ssrc;
+    uint32_t m_trackIndex;                               // trackID of the request URL
+    int      m_interleavedChannel;                       // interleaved RTP channel asked by the client, -1 if none
+    double   m_nptStart;                                 // Range of the PLAY request in seconds, 0 for live
+    double   m_scale;                                    // Scale of the PLAY request
     winrt::Windows::Foundation::Collections::PropertySet m_streamers;
-    winrt::com_ptr<IMFStreamSink> m_spCurrentStreamer;
+    winrt::com_ptr<IMFMediaSink> m_spCurrentSink;
+    std::vector<RtspTrack> m_tracks;
 
     // parameters of the last received RTSP request
     std::string           m_strCSeq;             // RTSP command sequence number
     std::string           m_urlHostPort;      // host:port part of the URL
     std::string           m_urlProto;
+    std::string           m_requestError;     // status of a malformed request, empty if it parsed
     std::string           m_curAuthSessionMsg;
+    MFTIME                m_curAuthSessionTime;  // when m_curAuthSessionMsg was issued
     winrt::com_ptr<IRTSPAuthProvider> m_spAuthProvider;
+    winrt::com_ptr<IRTSPAuthProviderStateless> m_spStatelessAuthProvider;
     winrt::handle m_rtspReadEvent;
     winrt::handle m_callBackHandle;
-    winrt::PacketHandler m_packetHandler;
-    bool m_bStreamingStarted, m_bTerminate, m_bAuthorizationReceived;
-    std::unique_ptr<BYTE[]> m_pTcpTxBuff;
+    bool m_bStreamingStarted, m_bTerminate, m_bAuthorizationReceived, m_bAuthNonceStale;
+    std::unique_ptr<CInterleavedWriter> m_pWriter;
     std::unique_ptr<BYTE[]> m_pTcpRxBuff;
+    size_t m_tcpRxPending;                               // bytes of an interleaved frame at the start of m_pTcpRxBuff
+    size_t m_tcpRxSkip;                                  // bytes still to come of a frame too large for m_pTcpRxBuff
     std::string m_urlSuffix;
     std::mutex m_readDelegateMutex;
-    winrt::event<winrt::LogHandler>* m_pLoggerEvents;
+    CBinaryLogger* m_pLogger;
+    CServerCounters* m_pServerCounters;
+    CRequestCounters m_requestCounters;
+    CPaddedCounter m_rttUs;
 };
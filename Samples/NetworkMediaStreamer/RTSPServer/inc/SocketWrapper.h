@@ -4,17 +4,59 @@
 #pragma once
 
 constexpr LPWSTR g_lpPackageName = (LPWSTR)UNISP_NAME;
+constexpr DWORD TLS_SESSION_LIFESPAN_MS = 10 * 60 * 1000;    // how long a client can resume its TLS session
 
 #define SEC_SUCCESS(Status) ((Status) >= 0)
 
+struct TlsHandshakeStats
+{
+    uint64_t fullHandshakes;
+    uint64_t resumedHandshakes;
+    uint64_t fullHandshakeCycles;                           // CPU cycles spent in AcceptSecurityContext
+    uint64_t resumedHandshakeCycles;
+};
+
+// Server TLS credential shared by all the connections accepted by one server.
+// Schannel keeps its server side session cache per credential handle, so a reconnecting client
+// can only resume its previous session (and skip the full handshake and certificate verification)
+// if every connection is accepted with the same handle. Cached sessions expire after the lifespan
+// given here; the cache size is bounded by Schannel's system wide limit.
+class CTlsServerCredential
+{
+public:
+    CTlsServerCredential(winrt::array_view<PCCERT_CONTEXT> aCertContext, DWORD dwSessionLifespanMs = TLS_SESSION_LIFESPAN_MS);
+    virtual ~CTlsServerCredential();
+
+    PCredHandle GetHandle()
+    {
+        return &m_hCred;
+    }
+
+    DWORD GetMaxTokenSize()
+    {
+        return m_cbMaxToken;
+    }
+
+    void RecordHandshake(bool bResumed, uint64_t cycles);
+    TlsHandshakeStats GetStats();
+
+private:
+    CredHandle m_hCred;
+    DWORD m_cbMaxToken;
+    std::atomic<uint64_t> m_fullHandshakes, m_resumedHandshakes;
+    std::atomic<uint64_t> m_fullHandshakeCycles, m_resumedHandshakeCycles;
+};
+
 class CSocketWrapper
 {
 public:
 
-    CSocketWrapper(SOCKET connectedSocket, winrt::array_view<PCCERT_CONTEXT> aCertContext = winrt::com_array<PCCERT_CONTEXT>());
+    CSocketWrapper(SOCKET connectedSocket, std::shared_ptr<CTlsServerCredential> spCredential = nullptr);
     virtual ~CSocketWrapper();
     int Recv(BYTE* buf, int sz);
     int Send(BYTE* buf, int sz);
+    void Encode(const BYTE* buf, size_t sz, std::vector<BYTE>& wire);
+    int SendEncoded(const BYTE* buf, int sz);
 
     SOCKET GetSocket()
     {
@@ -31,6 +73,11 @@ public:
         return m_bIsSecure;
     }
 
+    bool IsSessionResumed()
+    {
+        return m_bIsSessionResumed;
+    }
+
     std::wstring GetClientCertUserName()
     {
         return m_clientUserName;
@@ -44,17 +91,18 @@ private:
     bool m_bIsSecure;
     SOCKET m_socket;
     bool m_bIsAuthenticated;
+    bool m_bIsSessionResumed;
 
-    CredHandle m_hCred;
+    std::shared_ptr<CTlsServerCredential> m_spCredential;
     struct _SecHandle  m_hCtxt;
     SECURITY_STATUS m_securityStatus;
     std::unique_ptr<BYTE[]> m_pInBuf;
     std::unique_ptr<BYTE[]> m_pOutBuf;
     DWORD m_bufSz;
-    winrt::array_view<PCCERT_CONTEXT> m_aCertContext;
     SecPkgContext_StreamSizes m_secPkgContextStrmSizes;
     winrt::handle m_readEvent;
     std::condition_variable m_handshakeDone;
     winrt::handle m_callBackHandle;
     std::wstring m_clientUserName;
-};
\ No newline at end of file
+    uint64_t m_handshakeCycles;
+};
@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+constexpr size_t METRICS_CACHE_LINE_SIZE = 64;
+
+// Counter alone on its cache line. Counters are written from the wait callbacks of many sessions at
+// once and read by snapshots on yet another thread, padding keeps them from invalidating each other.
+struct alignas(METRICS_CACHE_LINE_SIZE) CPaddedCounter
+{
+    std::atomic<uint64_t> value;
+
+    CPaddedCounter() : value(0) {}
+    void Add(uint64_t v) { value.fetch_add(v, std::memory_order_relaxed); }
+    void Set(uint64_t v) { value.store(v, std::memory_order_relaxed); }
+    void SetMax(uint64_t v)
+    {
+        auto cur = value.load(std::memory_order_relaxed);
+        while ((v > cur) && !value.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+    }
+    uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+};
+
+inline void AddStreamMetrics(RTSPStreamMetrics& total, RTSPStreamMetrics const& m)
+{
+    total.bytesSent += m.bytesSent;
+    total.packetsSent += m.packetsSent;
+    total.packetsDropped += m.packetsDropped;
+    total.retransmits += m.retransmits;
+}
+
+inline void AddStreamMetrics(RTSPStreamMetrics& total, NetworkStreamClientStats const& stats)
+{
+    total.bytesSent += stats.bytesSent;
+    total.packetsSent += stats.packetsSent;
+    total.packetsDropped += stats.packetsDropped;
+    total.retransmits += stats.retransmits;
+}
+
+// Packets of clients that stopped streaming; the counters of streaming clients are kept by the stream sinks
+struct CStreamCounters
+{
+    CPaddedCounter bytesSent;
+    CPaddedCounter packetsSent;
+    CPaddedCounter packetsDropped;
+    CPaddedCounter retransmits;
+
+    void Add(RTSPStreamMetrics const& m)
+    {
+        bytesSent.Add(m.bytesSent);
+        packetsSent.Add(m.packetsSent);
+        packetsDropped.Add(m.packetsDropped);
+        retransmits.Add(m.retransmits);
+    }
+    void Snapshot(RTSPStreamMetrics& m) const
+    {
+        m.bytesSent = bytesSent.Get();
+        m.packetsSent = packetsSent.Get();
+        m.packetsDropped = packetsDropped.Get();
+        m.retransmits = retransmits.Get();
+    }
+};
+
+struct CRequestCounters
+{
+    CPaddedCounter requests;
+    CPaddedCounter authFailures;
+    CPaddedCounter requestLatencyTotalUs;
+    CPaddedCounter requestLatencyMaxUs;
+};
+
+// Totals of the server, every session adds to them as well as to its own counters
+struct CServerCounters
+{
+    CPaddedCounter sessionsStarted;
+    CRequestCounters requests;
+    CStreamCounters streams;
+};
@@ -8,6 +8,16 @@
 #include <windows.h>
 #include <iostream>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <vector>
+#include <bitset>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <condition_variable>
 
 #include <Security.h>
 #include <schnlsp.h>
@@ -19,6 +29,7 @@
 #include <windows.foundation.h>
 #include <windows.Storage.streams.h>
 #include <sstream>
+#include <iomanip>
 #include <winrt\base.h>
 #include <winrt\Windows.Foundation.h>
 #include <winrt\Windows.Foundation.Collections.h>
@@ -30,6 +41,12 @@
 #define HRESULT_EXCEPTION_BOUNDARY_FUNC catch(...) { auto hr = winrt::to_hresult(); return hr;}
 #include "NetworkMediaStreamer.h"
 #include "RTSPServerControl.h"
+#include "BinaryLog.h"
+#include "DigestAuth.h"
 #include "SocketWrapper.h"
+#include "InterleavedWriter.h"
+#include "StreamingMetrics.h"
+#include "MetricsExporter.h"
+#include "HttpEgress.h"
 #include "RtspSession.h"
 #include "RTSPServer.h"
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+struct LogFormatInfo
+{
+    LoggerType type;
+    const wchar_t* format;
+};
+
+static constexpr LogFormatInfo s_logFormats[] =
+{
+#define RTSP_LOG_FORMAT_INFO(id, type, format) { LoggerType::type, L##format },
+    RTSP_LOG_FORMATS(RTSP_LOG_FORMAT_INFO)
+#undef RTSP_LOG_FORMAT_INFO
+};
+static_assert(ARRAYSIZE(s_logFormats) == (size_t)LogFormat::Count, "a log format has no entry");
+
+std::atomic<uint64_t> CBinaryLogger::s_nextLoggerId(1);
+
+CLogRing::CLogRing()
+    : m_data(std::make_unique<BYTE[]>(capacity))
+    , m_dropped(0)
+    , m_head(0)
+    , m_tail(0)
+    , m_reserved(0)
+{
+}
+
+BYTE* CLogRing::Reserve(size_t size)
+{
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    auto pos = (size_t)(tail & (capacity - 1));
+    auto start = tail;
+    if (size > (capacity - pos))
+    {
+        // records do not wrap, skip the end of the ring
+        start += capacity - pos;
+    }
+    if ((start + size - m_head.load(std::memory_order_acquire)) > capacity)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (start != tail)
+    {
+        uint32_t padding = 0;
+        memcpy(&m_data[pos], &padding, sizeof(padding));
+    }
+    m_reserved = start;
+    return &m_data[(size_t)(start & (capacity - 1))];
+}
+
+void CLogRing::Commit(size_t size)
+{
+    m_tail.store(m_reserved + size, std::memory_order_release);
+}
+
+CBinaryLogger::CBinaryLogger(winrt::event<winrt::LogHandler>* pLoggerEvents)
+    : m_id(s_nextLoggerId.fetch_add(1))
+    , m_sequence(0)
+    , m_pLoggerEvents(pLoggerEvents)
+    , m_droppedReported(0)
+    , m_nextSequence(0)
+    , m_wakeEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr))
+    , m_bStop(false)
+{
+    winrt::check_bool(bool(m_wakeEvent));
+    for (auto& enabled : m_enabled)
+    {
+        enabled.store(false);
+    }
+    m_consumer = std::thread([this]() { ConsumerLoop(); });
+}
+
+CBinaryLogger::~CBinaryLogger()
+{
+    m_bStop = true;
+    SetEvent(m_wakeEvent.get());
+    m_consumer.join();
+}
+
+LoggerType CBinaryLogger::TypeOf(LogFormat format)
+{
+    return s_logFormats[(size_t)format].type;
+}
+
+// The ring of the calling thread, looked up once per thread and logger
+CLogRing* CBinaryLogger::GetThreadRing()
+{
+    thread_local uint64_t t_loggerId = 0;
+    thread_local CLogRing* t_pRing = nullptr;
+    if (t_loggerId != m_id)
+    {
+        auto lock = std::lock_guard(m_ringsLock);
+        auto& spRing = m_rings[GetCurrentThreadId()];
+        if (!spRing)
+        {
+            spRing = std::make_unique<CLogRing>();
+        }
+        t_pRing = spRing.get();
+        t_loggerId = m_id;
+    }
+    return t_pRing;
+}
+
+void CBinaryLogger::ConsumerLoop()
+{
+    while (!m_bStop)
+    {
+        WaitForSingleObject(m_wakeEvent.get(), consumerIntervalMs);
+        DrainAll(false);
+    }
+    DrainAll(true);
+}
+
+// Records of all the rings are formatted and raised by sequence number, so messages logged on different
+// threads keep their order. A thread takes its sequence number before it commits the record, so a drain can
+// miss a record that precedes ones it found in other rings: those are held until the missing one is drained,
+// the numbers have no gaps since a dropped record never takes one. The last drain raises everything.
+void CBinaryLogger::DrainAll(bool bFinal)
+{
+    std::vector<CLogRing*> rings;
+    {
+        auto lock = std::lock_guard(m_ringsLock);
+        for (auto& ring : m_rings)
+        {
+            rings.push_back(ring.second.get());
+        }
+    }
+
+    std::vector<Message> messages;
+    messages.swap(m_heldMessages);
+    uint64_t dropped = 0;
+    for (auto pRing : rings)
+    {
+        pRing->Drain([&messages](BYTE const* pRecord)
+            {
+                RecordHeader header;
+                memcpy(&header, pRecord, sizeof(header));
+                bool bValid = (header.format < (uint16_t)LogFormat::Count);
+                messages.push_back({ header.sequence, bValid, bValid ? TypeOf((LogFormat)header.format) : LoggerType::OTHER, header.hr,
+                    bValid ? FormatRecord(pRecord, header) : std::wstring() });
+            });
+        dropped += pRing->m_dropped.load(std::memory_order_relaxed);
+    }
+
+    std::sort(messages.begin(), messages.end(), [](Message const& a, Message const& b) { return a.sequence < b.sequence; });
+    size_t raised = 0;
+    for (; (raised < messages.size()) && (bFinal || (messages[raised].sequence == m_nextSequence)); raised++)
+    {
+        auto& message = messages[raised];
+        if (message.bValid)
+        {
+            m_pLoggerEvents[(int)message.type](message.hr, winrt::hstring(message.text));
+        }
+        m_nextSequence = message.sequence + 1;
+    }
+    m_heldMessages.assign(std::make_move_iterator(messages.begin() + raised), std::make_move_iterator(messages.end()));
+    if ((dropped > m_droppedReported) && IsEnabled(LoggerType::WARNINGS))
+    {
+        m_pLoggerEvents[(int)LoggerType::WARNINGS](S_OK, winrt::hstring(FormatText(LogFormat::RecordsDropped, { std::to_wstring(dropped - m_droppedReported) })));
+    }
+    m_droppedReported = dropped;
+}
+
+std::wstring CBinaryLogger::FormatText(LogFormat format, std::vector<std::wstring> const& args)
+{
+    std::wstring text;
+    const wchar_t* pFormat = s_logFormats[(size_t)format].format;
+    size_t arg = 0;
+    for (auto p = pFormat; *p; p++)
+    {
+        if ((p[0] == L'{') && (p[1] == L'}'))
+        {
+            if (arg < args.size())
+            {
+                text += args[arg++];
+            }
+            p++;
+        }
+        else
+        {
+            text += *p;
+        }
+    }
+    return text;
+}
+
+std::wstring CBinaryLogger::FormatRecord(BYTE const* pRecord, RecordHeader const& header)
+{
+    std::vector<std::wstring> args;
+    auto p = pRecord + sizeof(RecordHeader);
+    for (uint16_t i = 0; i < header.argCount; i++)
+    {
+        uint32_t argHeader[2];
+        memcpy(argHeader, p, sizeof(argHeader));
+        p += sizeof(argHeader);
+        auto size = argHeader[1];
+        switch ((ArgType)argHeader[0])
+        {
+        case ArgType::Int:
+        case ArgType::UInt:
+        {
+            uint64_t value;
+            memcpy(&value, p, sizeof(value));
+            args.push_back(((ArgType)argHeader[0] == ArgType::Int) ? std::to_wstring((int64_t)value) : std::to_wstring(value));
+            break;
+        }
+        case ArgType::String:
+            args.push_back(std::wstring(winrt::to_hstring(std::string_view((const char*)p, size))));
+            break;
+        case ArgType::WString:
+        {
+            std::wstring s(size / sizeof(wchar_t), L'\0');
+            memcpy(s.data(), p, size);
+            args.push_back(s);
+            break;
+        }
+        case ArgType::Bytes:
+        {
+            static const wchar_t digits[] = L"0123456789abcdef";
+            std::wstring dump;
+            dump.reserve(size * 5);
+            for (uint32_t b = 0; b < size; b++)
+            {
+                dump += L" 0x";
+                if (p[b] >= 0x10)
+                {
+                    dump += digits[p[b] >> 4];
+                }
+                dump += digits[p[b] & 0xF];
+            }
+            args.push_back(dump);
+            break;
+        }
+        }
+        p += size;
+    }
+    return FormatText((LogFormat)header.format, args);
+}
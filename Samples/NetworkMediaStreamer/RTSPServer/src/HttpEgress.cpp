@@ -0,0 +1,600 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+using winrt::Windows::Storage::Streams::IBuffer;
+
+namespace
+{
+    uint32_t Read32(const BYTE* p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    // value of a query parameter, empty if it is missing
+    std::string QueryParameter(std::string const& query, std::string const& name)
+    {
+        size_t pos = 0;
+        while (pos < query.size())
+        {
+            auto end = query.find('&', pos);
+            end = (end == std::string::npos) ? query.size() : end;
+            if ((query.compare(pos, name.size(), name) == 0) && (query[pos + name.size()] == '='))
+            {
+                return query.substr(pos + name.size() + 1, end - pos - name.size() - 1);
+            }
+            pos = end + 1;
+        }
+        return std::string();
+    }
+
+    // false unless the whole text is a number of the type
+    template<typename T>
+    bool ParseNumber(std::string const& text, T& value)
+    {
+        auto end = text.data() + text.size();
+        auto result = std::from_chars(text.data(), end, value);
+        return (result.ec == std::errc()) && (result.ptr == end) && !text.empty();
+    }
+}
+
+// The targets of a playlist must not change while it is served, they are fixed by the configured durations
+// rather than taken from the parts
+CCmafSegmentCache::CCmafSegmentCache(double partTarget, double targetDuration)
+    : m_initSegment(nullptr)
+    , m_timescale(90000)
+    , m_nextMsn(0)
+    , m_partTarget(partTarget)
+    , m_targetDuration(std::max(1, (int)std::ceil(targetDuration)))
+    , m_bClosed(false)
+{
+}
+
+// The stream sink sends the init segment, then parts; a part starting with an IDR begins with a styp box and
+// starts a segment. A part that would make its segment longer than the target duration starts one too, for
+// the GOPs longer than it. The parts before the first IDR are of a segment joined midway, they are dropped.
+void CCmafSegmentCache::OnChunk(IBuffer const& buf)
+{
+    auto pData = buf.data();
+    size_t size = buf.Length();
+    if (size < 8)
+    {
+        return;
+    }
+    {
+        auto lock = std::lock_guard(m_lock);
+        if (!memcmp(pData + 4, "ftyp", 4))
+        {
+            m_initSegment = buf;
+            m_timescale = ReadTimescale(pData, size);
+        }
+        else
+        {
+            bool bIndependent = !memcmp(pData + 4, "styp", 4);
+            auto duration = FragmentDuration(pData, size);
+            if (!bIndependent && m_segments.empty())
+            {
+                return;
+            }
+            if (bIndependent || (!m_segments.back().parts.empty() && (m_segments.back().duration + duration > m_targetDuration)))
+            {
+                if (!m_segments.empty())
+                {
+                    m_segments.back().bComplete = true;
+                }
+                m_segments.push_back({ m_nextMsn++, {}, false, 0 });
+                while (m_segments.size() > hlsSegmentsKept)
+                {
+                    m_segments.pop_front();
+                }
+            }
+            auto& segment = m_segments.back();
+            segment.parts.push_back({ buf, duration, bIndependent });
+            segment.duration += duration;
+        }
+    }
+    m_updated.notify_all();
+}
+
+// Ends the waits, the stream sink will not send more
+void CCmafSegmentCache::Close()
+{
+    {
+        auto lock = std::lock_guard(m_lock);
+        m_bClosed = true;
+    }
+    m_updated.notify_all();
+}
+
+size_t CCmafSegmentCache::FindBox(const BYTE* pData, size_t start, size_t end, const char* type)
+{
+    while (start + 8 <= end)
+    {
+        size_t boxSize = Read32(pData + start);
+        if ((boxSize < 8) || (boxSize > end - start))
+        {
+            break;
+        }
+        if (!memcmp(pData + start + 4, type, 4))
+        {
+            return start;
+        }
+        start += boxSize;
+    }
+    return std::string::npos;
+}
+
+// timescale of the mdhd of the first track, moov > trak > mdia > mdhd
+uint32_t CCmafSegmentCache::ReadTimescale(const BYTE* pData, size_t size)
+{
+    size_t start = 0, end = size;
+    for (auto type : { "moov", "trak", "mdia", "mdhd" })
+    {
+        start = FindBox(pData, start, end, type);
+        if (start == std::string::npos)
+        {
+            return 90000;
+        }
+        end = start + Read32(pData + start);
+        start += 8;
+    }
+    // version 0 has 32 bit times before the timescale, version 1 64 bit ones
+    size_t offset = start + ((pData[start] == 1) ? 20 : 12);
+    auto timescale = (offset + 4 <= end) ? Read32(pData + offset) : 0;
+    return timescale ? timescale : 90000;
+}
+
+// Sum of the sample durations of the trun of the part (moof > traf > trun). The stream sink writes them in
+// each sample, a part without them counts as 0.
+double CCmafSegmentCache::FragmentDuration(const BYTE* pData, size_t size) const
+{
+    size_t start = FindBox(pData, 0, size, "moof");
+    size_t end = size;
+    for (auto type : { "traf", "trun" })
+    {
+        if (start == std::string::npos)
+        {
+            return 0;
+        }
+        end = start + Read32(pData + start);
+        start = FindBox(pData, start + 8, end, type);
+    }
+    if ((start == std::string::npos) || (start + 16 > end))
+    {
+        return 0;
+    }
+    end = start + Read32(pData + start);
+    uint32_t flags = Read32(pData + start + 8) & 0xFFFFFF;
+    uint32_t count = Read32(pData + start + 12);
+    if (!(flags & 0x100))
+    {
+        return 0;
+    }
+    size_t pos = start + 16 + ((flags & 0x1) ? 4 : 0) + ((flags & 0x4) ? 4 : 0);
+    size_t stride = 4 * (size_t)(((flags >> 8) & 1) + ((flags >> 9) & 1) + ((flags >> 10) & 1) + ((flags >> 11) & 1));
+    uint64_t total = 0;
+    for (uint32_t i = 0; (i < count) && (pos + stride <= end); i++, pos += stride)
+    {
+        total += Read32(pData + pos);
+    }
+    return (double)total / m_timescale;
+}
+
+// m_lock is held
+CCmafSegmentCache::Segment* CCmafSegmentCache::FindSegment(uint64_t msn)
+{
+    if (m_segments.empty() || (msn < m_segments.front().msn) || (msn > m_segments.back().msn))
+    {
+        return nullptr;
+    }
+    return &m_segments[(size_t)(msn - m_segments.front().msn)];
+}
+
+bool CCmafSegmentCache::WaitForPlaylist(uint64_t msn, int64_t part)
+{
+    std::unique_lock lock(m_lock);
+    // the spec allows a request up to two segments past the last one
+    if (msn > m_nextMsn + 1)
+    {
+        return false;
+    }
+    m_updated.wait_for(lock, hlsBlockingTimeout, [&]
+        {
+            if (m_bClosed || (!m_segments.empty() && (m_segments.back().msn > msn)))
+            {
+                return true;
+            }
+            auto pSegment = FindSegment(msn);
+            return pSegment && (pSegment->bComplete || ((part >= 0) && ((size_t)part < pSegment->parts.size())));
+        });
+    return true;
+}
+
+std::string CCmafSegmentCache::Playlist()
+{
+    auto lock = std::lock_guard(m_lock);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(5);
+    out << "#EXTM3U\n#EXT-X-VERSION:9\n"
+        << "#EXT-X-TARGETDURATION:" << m_targetDuration << "\n"
+        << "#EXT-X-PART-INF:PART-TARGET=" << m_partTarget << "\n"
+        << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" << 3 * m_partTarget << "\n"
+        << "#EXT-X-MEDIA-SEQUENCE:" << (m_segments.empty() ? 0 : m_segments.front().msn) << "\n"
+        << "#EXT-X-MAP:URI=\"init.mp4\"\n";
+    for (size_t i = 0; i < m_segments.size(); i++)
+    {
+        auto& segment = m_segments[i];
+        if (i + hlsSegmentsWithParts >= m_segments.size())
+        {
+            for (size_t j = 0; j < segment.parts.size(); j++)
+            {
+                out << "#EXT-X-PART:DURATION=" << segment.parts[j].duration << ",URI=\"part" << segment.msn << "." << j << ".m4s\""
+                    << (segment.parts[j].bIndependent ? ",INDEPENDENT=YES\n" : "\n");
+            }
+        }
+        if (segment.bComplete)
+        {
+            out << "#EXTINF:" << segment.duration << ",\nseg" << segment.msn << ".m4s\n";
+        }
+    }
+    if (!m_segments.empty())
+    {
+        auto& last = m_segments.back();
+        out << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part" << last.msn << "." << last.parts.size() << ".m4s\"\n";
+    }
+    return out.str();
+}
+
+IBuffer CCmafSegmentCache::InitSegment()
+{
+    auto lock = std::lock_guard(m_lock);
+    return m_initSegment;
+}
+
+IBuffer CCmafSegmentCache::WaitForPart(uint64_t msn, size_t part, bool& bLast)
+{
+    std::unique_lock lock(m_lock);
+    IBuffer data = nullptr;
+    bLast = false;
+    m_updated.wait_for(lock, hlsBlockingTimeout, [&]
+        {
+            // the next segment is worth waiting for, it starts with the next part
+            if (m_bClosed || (msn > m_nextMsn))
+            {
+                return true;
+            }
+            auto pSegment = FindSegment(msn);
+            if (!pSegment)
+            {
+                return msn < m_nextMsn;
+            }
+            if (part < pSegment->parts.size())
+            {
+                data = pSegment->parts[part].data;
+                bLast = pSegment->bComplete && (part + 1 == pSegment->parts.size());
+                return true;
+            }
+            bLast = pSegment->bComplete;
+            return bLast;
+        });
+    return data;
+}
+
+CHttpEgressServer::CHttpEgressServer(LPCWSTR pAddress, uint16_t port, std::map<std::string, std::shared_ptr<CCmafSegmentCache>> const& caches)
+    : m_listenSocket(INVALID_SOCKET)
+    , m_acceptEvent(nullptr)
+    , m_callbackHandle(nullptr)
+    , m_caches(caches)
+    , m_bStopping(false)
+{
+    WSADATA WsaData;
+    winrt::check_win32(WSAStartup(0x202, &WsaData));
+    try
+    {
+        sockaddr_in addr = { 0 };
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (pAddress && (InetPtonW(AF_INET, pAddress, &addr.sin_addr) != 1))
+        {
+            winrt::check_win32(ERROR_INVALID_NETNAME);
+        }
+
+        m_listenSocket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr, 0, 0);
+        if ((m_listenSocket == INVALID_SOCKET)
+            || (bind(m_listenSocket, (sockaddr*)&addr, sizeof(addr)) != 0)
+            || (listen(m_listenSocket, SOMAXCONN) != 0))
+        {
+            winrt::check_win32(WSAGetLastError());
+        }
+        m_acceptEvent.attach(WSACreateEvent());
+        if (!m_acceptEvent || (WSAEventSelect(m_listenSocket, m_acceptEvent.get(), FD_ACCEPT) != 0))
+        {
+            winrt::check_win32(WSAGetLastError());
+        }
+        winrt::check_bool(RegisterWaitForSingleObject(m_callbackHandle.put(), m_acceptEvent.get(), [](PVOID arg, BOOLEAN)
+            {
+                auto pServer = (CHttpEgressServer*)arg;
+                WSAResetEvent(pServer->m_acceptEvent.get());
+                SOCKET client = accept(pServer->m_listenSocket, nullptr, nullptr);
+                if (client == INVALID_SOCKET)
+                {
+                    return;
+                }
+                auto lock = std::lock_guard(pServer->m_lock);
+                if (pServer->m_bStopping)
+                {
+                    closesocket(client);
+                    return;
+                }
+                if (pServer->m_connections.size() >= httpMaxConnections)
+                {
+                    // a thread each, so the viewers past the limit are turned away rather than queued
+                    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                    send(client, busy, sizeof(busy) - 1, 0);
+                    closesocket(client);
+                    return;
+                }
+                try
+                {
+                    std::thread(&CHttpEgressServer::ConnectionThread, pServer, client).detach();
+                    pServer->m_connections.push_back(client);
+                }
+                catch (...)
+                {
+                    closesocket(client);
+                }
+            }, this, INFINITE, WT_EXECUTEINWAITTHREAD));
+    }
+    catch (...)
+    {
+        if (m_listenSocket != INVALID_SOCKET)
+        {
+            closesocket(m_listenSocket);
+        }
+        WSACleanup();
+        throw;
+    }
+}
+
+// The connections end when their sockets are shut down and the blocking requests give up, then their
+// threads are done with the server
+CHttpEgressServer::~CHttpEgressServer()
+{
+    if (m_callbackHandle)
+    {
+        UnregisterWaitEx(m_callbackHandle.detach(), INVALID_HANDLE_VALUE);
+    }
+    closesocket(m_listenSocket);
+    for (auto& cache : m_caches)
+    {
+        cache.second->Close();
+    }
+    {
+        std::unique_lock lock(m_lock);
+        m_bStopping = true;
+        for (auto client : m_connections)
+        {
+            shutdown(client, SD_BOTH);
+        }
+        m_connectionEnded.wait(lock, [this] { return m_connections.empty(); });
+    }
+    WSACleanup();
+}
+
+void CHttpEgressServer::ConnectionThread(SOCKET client)
+{
+    // the accepted socket inherits the event selection, make it blocking with a timeout again
+    u_long nonBlocking = 0;
+    WSAEventSelect(client, nullptr, 0);
+    ioctlsocket(client, FIONBIO, &nonBlocking);
+    DWORD timeout = httpKeepAliveTimeoutMs;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    BOOL noDelay = TRUE;                                        // parts are small and late ones stall the players
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+    std::string pending;
+    char buf[2048];
+    bool bKeepAlive = true;
+    while (bKeepAlive)
+    {
+        auto end = pending.find("\r\n\r\n");
+        if (end == std::string::npos)
+        {
+            int received = (pending.size() < httpMaxRequestSize) ? recv(client, buf, sizeof(buf), 0) : 0;
+            if (received <= 0)
+            {
+                break;
+            }
+            pending.append(buf, received);
+            continue;
+        }
+        auto request = pending.substr(0, end + 4);
+        pending.erase(0, end + 4);
+        try
+        {
+            bKeepAlive = HandleRequest(client, request);
+        }
+        catch (...)
+        {
+            bKeepAlive = false;
+        }
+    }
+
+    // the last access to the server, it may be destroyed as soon as the lock is released
+    auto lock = std::lock_guard(m_lock);
+    m_connections.erase(std::find(m_connections.begin(), m_connections.end(), client));
+    closesocket(client);
+    m_connectionEnded.notify_all();
+}
+
+// Returns whether the connection is kept for another request
+bool CHttpEgressServer::HandleRequest(SOCKET client, std::string const& request)
+{
+    std::istringstream requestLine(request.substr(0, request.find("\r\n")));
+    std::string method, target, version;
+    requestLine >> method >> target >> version;
+    std::string headers = request;
+    std::transform(headers.begin(), headers.end(), headers.begin(), [](char c) { return (char)tolower(c); });
+    bool bHttp11 = (version == "HTTP/1.1");
+    bool bKeepAlive = bHttp11 ? (headers.find("\nconnection: close") == std::string::npos) : (headers.find("\nconnection: keep-alive") != std::string::npos);
+
+    if (method != "GET")
+    {
+        return SendResponse(client, "405 Method Not Allowed", "text/plain", "GET only\n", bKeepAlive);
+    }
+    auto queryPos = target.find('?');
+    auto path = target.substr(0, queryPos);
+    auto query = (queryPos == std::string::npos) ? std::string() : target.substr(queryPos + 1);
+    auto slash = path.rfind('/');
+    auto it = (slash == std::string::npos) ? m_caches.end() : m_caches.find(path.substr(0, slash));
+    if (it == m_caches.end())
+    {
+        return SendResponse(client, "404 Not Found", "text/plain", "not found\n", bKeepAlive);
+    }
+    auto& cache = *it->second;
+    auto file = path.substr(slash + 1);
+
+    unsigned long long msn = 0;
+    unsigned int part = 0;
+    if (file == "index.m3u8")
+    {
+        auto msnParam = QueryParameter(query, "_HLS_msn");
+        auto partParam = QueryParameter(query, "_HLS_part");
+        // _HLS_part is only valid with _HLS_msn
+        if ((!msnParam.empty() && !ParseNumber(msnParam, msn)) || (!partParam.empty() && (msnParam.empty() || !ParseNumber(partParam, part))))
+        {
+            return SendResponse(client, "400 Bad Request", "text/plain", "invalid _HLS_msn or _HLS_part\n", bKeepAlive);
+        }
+        // a plain request waits for the first part
+        if (!cache.WaitForPlaylist(msn, partParam.empty() ? (msnParam.empty() ? 0 : -1) : (int64_t)part))
+        {
+            return SendResponse(client, "400 Bad Request", "text/plain", "_HLS_msn too far ahead\n", bKeepAlive);
+        }
+        return SendResponse(client, "200 OK", "application/vnd.apple.mpegurl", cache.Playlist(), bKeepAlive);
+    }
+    else if (file == "init.mp4")
+    {
+        auto init = cache.InitSegment();
+        if (init)
+        {
+            return SendBuffers(client, "video/mp4", { init }, bKeepAlive);
+        }
+    }
+    else if (sscanf_s(file.c_str(), "part%llu.%u.m4s", &msn, &part) == 2)
+    {
+        bool bLast;
+        auto data = cache.WaitForPart(msn, part, bLast);
+        if (data)
+        {
+            return SendBuffers(client, "video/mp4", { data }, bKeepAlive);
+        }
+    }
+    else if (sscanf_s(file.c_str(), "seg%llu.m4s", &msn) == 1)
+    {
+        return SendSegment(client, cache, msn, bHttp11, bKeepAlive);
+    }
+    return SendResponse(client, "404 Not Found", "text/plain", "not found\n", bKeepAlive);
+}
+
+bool CHttpEgressServer::SendResponse(SOCKET client, std::string const& status, std::string const& contentType, std::string const& body, bool bKeepAlive)
+{
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+        + "Content-Type: " + contentType + "\r\n"
+        + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        + "Cache-Control: no-cache\r\n"
+        + "Access-Control-Allow-Origin: *\r\n"
+        + (bKeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n")
+        + body;
+    return Send(client, response.c_str(), response.size()) && bKeepAlive;
+}
+
+bool CHttpEgressServer::SendBuffers(SOCKET client, std::string const& contentType, std::vector<IBuffer> const& buffers, bool bKeepAlive)
+{
+    size_t size = 0;
+    for (auto& buf : buffers)
+    {
+        size += buf.Length();
+    }
+    std::string header = "HTTP/1.1 200 OK\r\nContent-Type: " + contentType + "\r\n"
+        + "Content-Length: " + std::to_string(size) + "\r\n"
+        + "Access-Control-Allow-Origin: *\r\n"
+        + (bKeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    if (!Send(client, header.c_str(), header.size()))
+    {
+        return false;
+    }
+    for (auto& buf : buffers)
+    {
+        if (!Send(client, buf.data(), buf.Length()))
+        {
+            return false;
+        }
+    }
+    return bKeepAlive;
+}
+
+// A segment still being produced goes out a part at a time as the parts come, with chunked transfer
+// encoding; HTTP/1.0 clients get it once it is complete
+bool CHttpEgressServer::SendSegment(SOCKET client, CCmafSegmentCache& cache, uint64_t msn, bool bChunked, bool bKeepAlive)
+{
+    std::vector<IBuffer> parts;
+    for (size_t part = 0; ; part++)
+    {
+        bool bLast = false;
+        auto data = cache.WaitForPart(msn, part, bLast);
+        if (!data && !bLast)
+        {
+            // once chunks went out the response can only be cut, so the client does not take it as whole
+            return (bChunked && part) ? false : SendResponse(client, "404 Not Found", "text/plain", "not found\n", bKeepAlive);
+        }
+        if (data && !bChunked)
+        {
+            parts.push_back(data);
+        }
+        else if (data)
+        {
+            if (!part)
+            {
+                std::string header = "HTTP/1.1 200 OK\r\nContent-Type: video/mp4\r\nTransfer-Encoding: chunked\r\n"
+                    "Access-Control-Allow-Origin: *\r\n";
+                header += bKeepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+                if (!Send(client, header.c_str(), header.size()))
+                {
+                    return false;
+                }
+            }
+            char chunkSize[16];
+            int length = sprintf_s(chunkSize, "%X\r\n", data.Length());
+            if (!Send(client, chunkSize, length) || !Send(client, data.data(), data.Length()) || !Send(client, "\r\n", 2))
+            {
+                return false;
+            }
+        }
+        if (bLast)
+        {
+            break;
+        }
+    }
+    if (!bChunked)
+    {
+        return SendBuffers(client, "video/mp4", parts, bKeepAlive);
+    }
+    return Send(client, "0\r\n\r\n", 5) && bKeepAlive;
+}
+
+bool CHttpEgressServer::Send(SOCKET client, const void* pData, size_t size)
+{
+    size_t sent = 0;
+    while (sent < size)
+    {
+        int res = send(client, (const char*)pData + sent, (int)(size - sent), 0);
+        if (res <= 0)
+        {
+            return false;
+        }
+        sent += res;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+CInterleavedWriter::CInterleavedWriter(CSocketWrapper* pSocket, size_t maxBacklog /*= INTERLEAVED_MAX_BACKLOG*/)
+    : m_pSocket(pSocket)
+    , m_queue(maxBacklog)
+{
+}
+
+bool CInterleavedWriter::WritePacket(BYTE channel, const BYTE* pPacket, size_t size, bool bIsRtcp, bool bEndOfAccessUnit)
+{
+    auto lock = std::lock_guard(m_lock);
+    return m_queue.WritePacket(channel, pPacket, size, bIsRtcp, bEndOfAccessUnit,
+        [this](const BYTE* pData, size_t size, std::vector<BYTE>& wire) { Encode(pData, size, wire); },
+        [this](const BYTE* pData, size_t size) { return Send(pData, size); });
+}
+
+void CInterleavedWriter::WriteMessage(const BYTE* pMessage, size_t size)
+{
+    auto lock = std::lock_guard(m_lock);
+    m_queue.WriteMessage(pMessage, size,
+        [this](const BYTE* pData, size_t size, std::vector<BYTE>& wire) { Encode(pData, size, wire); },
+        [this](const BYTE* pData, size_t size) { return Send(pData, size); });
+}
+
+void CInterleavedWriter::Drain()
+{
+    auto lock = std::lock_guard(m_lock);
+    m_queue.Drain([this](const BYTE* pData, size_t size) { return Send(pData, size); });
+}
+
+InterleavedWriterStats CInterleavedWriter::GetStats()
+{
+    auto lock = std::lock_guard(m_lock);
+    return m_queue.Stats();
+}
+
+void CInterleavedWriter::Encode(const BYTE* pData, size_t size, std::vector<BYTE>& wire)
+{
+    m_pSocket->Encode(pData, size, wire);
+}
+
+// WSAEWOULDBLOCK is 0, the queue then waits for FD_WRITE
+int64_t CInterleavedWriter::Send(const BYTE* pData, size_t size)
+{
+    auto sent = m_pSocket->SendEncoded(pData, (int)size);
+    if (sent == SOCKET_ERROR)
+    {
+        return (WSAGetLastError() == WSAEWOULDBLOCK) ? 0 : -1;
+    }
+    return sent;
+}
@@ -0,0 +1,243 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <pch.h>
+
+constexpr DWORD METRICS_RECV_TIMEOUT_MS = 1000;
+
+CMetricsExporter::CMetricsExporter(uint16_t port, MetricsSnapshotHandler snapshot)
+    : m_listenSocket(INVALID_SOCKET)
+    , m_acceptEvent(nullptr)
+    , m_callbackHandle(nullptr)
+    , m_snapshot(snapshot)
+{
+    WSADATA WsaData;
+    winrt::check_win32(WSAStartup(0x202, &WsaData));
+    try
+    {
+        sockaddr_in addr = { 0 };
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);          // local scrapers only
+        addr.sin_port = htons(port);
+
+        m_listenSocket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, nullptr, 0, 0);
+        if ((m_listenSocket == INVALID_SOCKET)
+            || (bind(m_listenSocket, (sockaddr*)&addr, sizeof(addr)) != 0)
+            || (listen(m_listenSocket, 5) != 0))
+        {
+            winrt::check_win32(WSAGetLastError());
+        }
+        m_acceptEvent.attach(WSACreateEvent());
+        if (!m_acceptEvent || (WSAEventSelect(m_listenSocket, m_acceptEvent.get(), FD_ACCEPT) != 0))
+        {
+            winrt::check_win32(WSAGetLastError());
+        }
+        winrt::check_bool(RegisterWaitForSingleObject(m_callbackHandle.put(), m_acceptEvent.get(), [](PVOID arg, BOOLEAN)
+            {
+                auto pExporter = (CMetricsExporter*)arg;
+                auto lock = std::lock_guard(pExporter->m_lock);
+                WSAResetEvent(pExporter->m_acceptEvent.get());
+                SOCKET client = accept(pExporter->m_listenSocket, nullptr, nullptr);
+                if (client != INVALID_SOCKET)
+                {
+                    pExporter->HandleConnection(client);
+                    closesocket(client);
+                }
+            }, this, INFINITE, WT_EXECUTEINWAITTHREAD));
+    }
+    catch (...)
+    {
+        if (m_listenSocket != INVALID_SOCKET)
+        {
+            closesocket(m_listenSocket);
+        }
+        WSACleanup();
+        throw;
+    }
+}
+
+CMetricsExporter::~CMetricsExporter()
+{
+    if (m_callbackHandle)
+    {
+        // wait for a request being answered
+        UnregisterWaitEx(m_callbackHandle.detach(), INVALID_HANDLE_VALUE);
+    }
+    closesocket(m_listenSocket);
+    WSACleanup();
+}
+
+void CMetricsExporter::HandleConnection(SOCKET client)
+{
+    // the accepted socket inherits the event selection, make it blocking with a timeout again
+    u_long nonBlocking = 0;
+    WSAEventSelect(client, nullptr, 0);
+    ioctlsocket(client, FIONBIO, &nonBlocking);
+    DWORD timeout = METRICS_RECV_TIMEOUT_MS;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    char request[1024];
+    int received = recv(client, request, sizeof(request) - 1, 0);
+    if (received <= 0)
+    {
+        return;
+    }
+    request[received] = 0;
+
+    std::string status = "200 OK";
+    std::string contentType;
+    std::string body;
+    std::string requestLine(request, strcspn(request, "\r\n"));
+    if ((requestLine.rfind("GET /metrics.json ", 0) == 0) || (requestLine.rfind("GET /metrics ", 0) == 0))
+    {
+        RTSPServerMetrics server;
+        std::vector<RTSPSessionMetrics> sessions;
+        m_snapshot(server, sessions);
+        if (requestLine.rfind("GET /metrics.json ", 0) == 0)
+        {
+            contentType = "application/json";
+            body = FormatJson(server, sessions);
+        }
+        else
+        {
+            contentType = "text/plain; version=0.0.4";
+            body = FormatPrometheus(server, sessions);
+        }
+    }
+    else
+    {
+        status = "404 Not Found";
+        contentType = "text/plain";
+        body = "not found\n";
+    }
+
+    std::string response = "HTTP/1.0 " + status + "\r\n"
+        + "Content-Type: " + contentType + "\r\n"
+        + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        + "Connection: close\r\n\r\n"
+        + body;
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        int res = send(client, response.c_str() + sent, (int)(response.size() - sent), 0);
+        if (res <= 0)
+        {
+            break;
+        }
+        sent += res;
+    }
+}
+
+// Every metric family is written as one group, as the text format requires
+std::string CMetricsExporter::FormatPrometheus(RTSPServerMetrics const& server, std::vector<RTSPSessionMetrics> const& sessions)
+{
+    std::ostringstream out;
+    auto family = [&out](const char* name, const char* type, const char* help)
+    {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    };
+    auto sessionLabels = [](RTSPSessionMetrics const& s)
+    {
+        return "session=\"" + std::to_string(s.sessionId) + "\",client=\"" + s.clientAddress + "\"";
+    };
+
+    struct { const char* name; const char* type; const char* help; uint64_t value; } serverFamilies[] =
+    {
+        { "rtsp_sessions_started_total", "counter", "RTSP sessions started", server.sessionsStarted },
+        { "rtsp_sessions_active", "gauge", "RTSP sessions connected", server.activeSessions },
+        { "rtsp_clients_active", "gauge", "RTSP sessions playing", server.activeClients },
+        { "rtsp_requests_total", "counter", "RTSP requests handled", server.requests },
+        { "rtsp_auth_failures_total", "counter", "RTSP requests with rejected credentials", server.authFailures },
+        { "rtsp_request_latency_microseconds_total", "counter", "Time spent handling RTSP requests", server.requestLatencyTotalUs },
+        { "rtsp_request_latency_microseconds_max", "gauge", "Longest RTSP request", server.requestLatencyMaxUs },
+        { "rtp_bytes_sent_total", "counter", "RTP bytes sent by all sessions", server.total.bytesSent },
+        { "rtp_packets_sent_total", "counter", "RTP packets sent by all sessions", server.total.packetsSent },
+        { "rtp_packets_dropped_total", "counter", "RTP packets dropped by all sessions", server.total.packetsDropped },
+        { "rtp_retransmits_total", "counter", "RTP packets retransmitted by all sessions", server.total.retransmits },
+    };
+    for (auto& f : serverFamilies)
+    {
+        family(f.name, f.type, f.help);
+        out << f.name << " " << f.value << "\n";
+    }
+
+    struct { const char* name; const char* type; const char* help; uint64_t RTSPSessionMetrics::* value; } sessionFamilies[] =
+    {
+        { "rtsp_session_requests_total", "counter", "RTSP requests of a session", &RTSPSessionMetrics::requests },
+        { "rtsp_session_auth_failures_total", "counter", "Rejected credentials of a session", &RTSPSessionMetrics::authFailures },
+        { "rtsp_session_rtt_microseconds", "gauge", "Round trip time from the receiver reports of a session", &RTSPSessionMetrics::rttUs },
+    };
+    for (auto& f : sessionFamilies)
+    {
+        family(f.name, f.type, f.help);
+        for (auto& s : sessions)
+        {
+            out << f.name << "{" << sessionLabels(s) << "} " << s.*f.value << "\n";
+        }
+    }
+
+    struct { const char* name; const char* help; uint64_t RTSPStreamMetrics::* value; } trackFamilies[] =
+    {
+        { "rtp_track_bytes_sent_total", "RTP bytes sent for a track of a session", &RTSPStreamMetrics::bytesSent },
+        { "rtp_track_packets_sent_total", "RTP packets sent for a track of a session", &RTSPStreamMetrics::packetsSent },
+        { "rtp_track_packets_dropped_total", "RTP packets dropped for a track of a session", &RTSPStreamMetrics::packetsDropped },
+        { "rtp_track_retransmits_total", "RTP packets retransmitted for a track of a session", &RTSPStreamMetrics::retransmits },
+    };
+    for (auto& f : trackFamilies)
+    {
+        family(f.name, "counter", f.help);
+        for (auto& s : sessions)
+        {
+            for (uint32_t i = 0; i < __min(s.trackCount, (uint32_t)RTSP_METRICS_MAX_TRACKS); i++)
+            {
+                out << f.name << "{" << sessionLabels(s) << ",track=\"" << i << "\"} " << s.tracks[i].*f.value << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+std::string CMetricsExporter::FormatJson(RTSPServerMetrics const& server, std::vector<RTSPSessionMetrics> const& sessions)
+{
+    std::ostringstream out;
+    auto streamMetrics = [&out](RTSPStreamMetrics const& m)
+    {
+        out << "{\"bytesSent\":" << m.bytesSent << ",\"packetsSent\":" << m.packetsSent
+            << ",\"packetsDropped\":" << m.packetsDropped << ",\"retransmits\":" << m.retransmits << "}";
+    };
+
+    out << "{\"sessionsStarted\":" << server.sessionsStarted
+        << ",\"activeSessions\":" << server.activeSessions
+        << ",\"activeClients\":" << server.activeClients
+        << ",\"requests\":" << server.requests
+        << ",\"authFailures\":" << server.authFailures
+        << ",\"requestLatencyTotalUs\":" << server.requestLatencyTotalUs
+        << ",\"requestLatencyMaxUs\":" << server.requestLatencyMaxUs
+        << ",\"total\":";
+    streamMetrics(server.total);
+    out << ",\"sessions\":[";
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        auto& s = sessions[i];
+        out << (i ? "," : "")
+            << "{\"sessionId\":" << s.sessionId
+            << ",\"client\":\"" << s.clientAddress << "\""
+            << ",\"playing\":" << (s.bPlaying ? "true" : "false")
+            << ",\"requests\":" << s.requests
+            << ",\"authFailures\":" << s.authFailures
+            << ",\"requestLatencyTotalUs\":" << s.requestLatencyTotalUs
+            << ",\"requestLatencyMaxUs\":" << s.requestLatencyMaxUs
+            << ",\"rttUs\":" << s.rttUs
+            << ",\"total\":";
+        streamMetrics(s.total);
+        out << ",\"tracks\":[";
+        for (uint32_t t = 0; t < __min(s.trackCount, (uint32_t)RTSP_METRICS_MAX_TRACKS); t++)
+        {
+            out << (t ? "," : "");
+            streamMetrics(s.tracks[t]);
+        }
+        out << "]}";
+    }
+    out << "]}\n";
+    return out.str();
+}
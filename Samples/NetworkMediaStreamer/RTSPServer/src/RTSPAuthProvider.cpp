@@ -9,28 +9,34 @@ using namespace winrt::Windows::Foundation::Collections;
 using namespace Cryptography::Core;
 using namespace Cryptography;
 
-class CAuthProvider : public winrt::implements<CAuthProvider, IRTSPAuthProvider, IRTSPAuthProviderCredStore>
+constexpr char g_authRealm[] = "BeyondTheWall";
+constexpr MFTIME NONCE_LIFETIME = 5ll * 60 * 10000000;      // 5 minutes in 100ns units
+constexpr size_t MAX_TRACKED_NONCES = 4096;
+constexpr size_t MAX_NONCES_PER_PEER = 16;                  // stateless nonces verified for one client address
+
+constexpr UINT32 DEFAULT_STATELESS_NONCE_LIFETIME = 5 * 60;   // seconds
+constexpr size_t DEFAULT_NONCE_KEY_SIZE = 32;
+
+// Tracks every issued nonce. CAuthProvider<IRTSPAuthProviderStateless> also issues stateless nonces, which the
+// RTSP server uses instead when the provider implements that interface.
+template <typename... StatelessInterface>
+class CAuthProvider : public winrt::implements<CAuthProvider<StatelessInterface...>, IRTSPAuthProvider, IRTSPAuthProviderCredStore, StatelessInterface...>
 {
 public:
 
     STDMETHODIMP GetNewAuthSessionMessage(HSTRING* pAuthSessionMessage) override try
     {
         winrt::check_pointer(pAuthSessionMessage);
-        std::string authString;
-        if ((m_authType == AuthType::Both) || (m_authType == AuthType::Basic))
-        {
-            authString = "WWW-Authenticate: Basic realm=\"BeyondTheWall\", charset=\"UTF-8\"\r\n";
-        }
+        auto now = MFGetSystemTime();
         auto buf = Cryptography::CryptographicBuffer::GenerateRandom(24);
-        *((uint64_t*)(buf.data() + 16)) = MFGetSystemTime();
-        auto nonce = Cryptography::CryptographicBuffer::EncodeToHexString(buf);
+        *((uint64_t*)(buf.data() + 16)) = now;
+        auto nonce = winrt::to_string(Cryptography::CryptographicBuffer::EncodeToHexString(buf));
         if ((m_authType == AuthType::Both) || (m_authType == AuthType::Digest))
         {
-            authString += "WWW-Authenticate: Digest realm=\"BeyondTheWall\", nonce=\"" + winrt::to_string(nonce) + "\", algorithm=SHA-256, charset=\"UTF-8\", stale=FALSE\r\n";
-            authString += "WWW-Authenticate: Digest realm=\"BeyondTheWall\", nonce=\"" + winrt::to_string(nonce) + "\", algorithm=MD5, charset=\"UTF-8\", stale=FALSE\r\n";
+            TrackNonce(nonce, now);
         }
 
-        *pAuthSessionMessage = reinterpret_cast<HSTRING> (winrt::detach_abi(winrt::to_hstring(authString)));
+        *pAuthSessionMessage = reinterpret_cast<HSTRING> (winrt::detach_abi(winrt::to_hstring(BuildChallenge(nonce, false))));
         return S_OK;
     }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
@@ -39,130 +45,112 @@ public:
         winrt::check_pointer(authResp);
         winrt::check_pointer(authSesMsg);
         winrt::check_pointer(mthd);
-        bool result = true;
+        bool result = false;
         auto authResponse = winrt::to_string(authResp);
         auto authSessionMessage = winrt::to_string(authSesMsg);
         auto method = winrt::to_string(mthd);
-        std::vector<std::string> paramsResponce = { "Authorization: ","realm=","nonce=", "username=", "response=", "algorithm=", "uri=" };
-        std::vector<std::string> paramsSent = { "realm=","nonce=" };
-        std::map<std::string, std::string> paramMapResponse, paramMap;
-        for (auto param : paramsResponce)
+        AuthHeaderParams response;
+
+        if (!ParseAuthHeader(authResponse, response))
         {
-            paramMapResponse[param] = GetValueForParam(authResponse, param);
+            winrt::check_win32(ERROR_INVALID_PASSWORD);
         }
-        for (auto param : paramsSent)
+
+        if (response.scheme == "Digest")
         {
-            paramMap[param] = GetValueForParam(authSessionMessage, param);
-            if (!((paramMapResponse[param].empty()) || (paramMap[param].empty())))
+            AuthHeaderParams sent;
+            auto digestPos = authSessionMessage.find("Digest");
+            if ((digestPos != std::string::npos) && ParseAuthHeader(std::string_view(authSessionMessage).substr(digestPos), sent))
             {
-                result &= (paramMapResponse[param] == paramMap[param]);
+                uint32_t nonceCount = 0;
+                result = (response.nonce == sent.nonce)
+                    && (response.realm == g_authRealm)
+                    && CheckNonce(response.nonce, response.nc, !response.qop.empty(), &nonceCount)
+                    && VerifyDigest(response, method)
+                    && AcceptNonceCount(response.nonce, nonceCount);
             }
         }
+        else if (response.scheme == "Basic")
+        {
+            result = VerifyBasic(response);
+        }
 
-        if (paramMapResponse["Authorization: "] == "Digest")
+        if (!result)
         {
-            CryptographicHash hash(nullptr);
-            if ((paramMapResponse["algorithm="] == "MD5") || (paramMapResponse["response="].size() < 64))
-            {
-                hash = m_hashMD5;
-            }
-            else
-            {
-                hash = m_hashSHA256;
-            }
-            auto username = paramMapResponse["username="];
-            std::string password;
-            auto vault = PasswordVault();
+            winrt::check_win32(ERROR_INVALID_PASSWORD);
+        }
+        return S_OK;
+    }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
-            PasswordCredential cred = nullptr;
-            if (!username.empty())
-            {
-                try
-                {
-                    cred = vault.Retrieve(m_resourceName, winrt::to_hstring(username));
-                }
-                catch (winrt::hresult_error const& ex) // not-so-elegant hack- vault.Retrieve throws if user is not found.
-                {
-                    (ex);
-                    cred = nullptr;
-                }
-            }
-            if (cred)
-            {
-                cred.RetrievePassword();
-                password = winrt::to_string(cred.Password());
-                auto A1 = username + ":" + paramMap["realm="] + ":" + password;
-                auto bufA1 = CryptographicBuffer::ConvertStringToBinary(winrt::to_hstring(A1), BinaryStringEncoding::Utf8);
-                hash.Append(bufA1);
-                auto HA1 = hash.GetValueAndReset();
-                auto A2 = method + ":" + paramMapResponse["uri="];
-                auto bufA2 = CryptographicBuffer::ConvertStringToBinary(winrt::to_hstring(A2), BinaryStringEncoding::Utf8);
-                hash.Append(bufA2);
-                auto HA2 = hash.GetValueAndReset();
-                auto nonce = paramMap["nonce="];
-                auto strKD = CryptographicBuffer::EncodeToHexString(HA1) + L":" + winrt::to_hstring(nonce) + L":" + CryptographicBuffer::EncodeToHexString(HA2);
-                auto bufKD = CryptographicBuffer::ConvertStringToBinary(strKD, BinaryStringEncoding::Utf8);
-                hash.Append(bufKD);
-
-                auto response = hash.GetValueAndReset();
-                paramMap["response="] = winrt::to_string(CryptographicBuffer::EncodeToHexString(response));
-                result &= (paramMapResponse["response="] == paramMap["response="]);
-            }
-            else
-            {
-                result = false;
-            }
+    // IRTSPAuthProviderStateless, only overrides when the provider implements it
+    STDMETHODIMP GetNewAuthSessionMessageForClient(LPCWSTR clientAddress, BOOL bStale, HSTRING* pAuthSessionMessage) try
+    {
+        winrt::check_pointer(clientAddress);
+        winrt::check_pointer(pAuthSessionMessage);
+        std::string nonce;
+        {
+            auto lock = std::lock_guard(m_cacheLock);
+            nonce = MakeStatelessNonce(m_nonceKey, GetWallClockSeconds(), winrt::to_string(clientAddress));
         }
-        else //Basic
+        *pAuthSessionMessage = reinterpret_cast<HSTRING> (winrt::detach_abi(winrt::to_hstring(BuildChallenge(nonce, bStale))));
+        return S_OK;
+    }HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+    // Returns SEC_E_CONTEXT_EXPIRED if the credentials are right but the nonce is stale,
+    // the caller should then challenge the client again with stale=TRUE.
+    STDMETHODIMP AuthorizeClient(LPCWSTR authResp, LPCWSTR clientAddress, LPCWSTR mthd) try
+    {
+        winrt::check_pointer(authResp);
+        winrt::check_pointer(clientAddress);
+        winrt::check_pointer(mthd);
+        bool result = false;
+        bool bStale = false;
+        auto authResponse = winrt::to_string(authResp);
+        auto method = winrt::to_string(mthd);
+        AuthHeaderParams response;
+
+        if (!ParseAuthHeader(authResponse, response))
         {
-            auto idx = authResponse.find("Basic");
-            if (idx != std::string::npos)
-            {
-                idx += 6;
-                paramMapResponse["response="] = authResponse.substr(idx, authResponse.find_first_of(" \n\r\t,", idx) - idx);
-            }
-            auto received = CryptographicBuffer::DecodeFromBase64String(winrt::to_hstring(paramMapResponse["response="]));
-            auto strReceveid = CryptographicBuffer::ConvertBinaryToString(BinaryStringEncoding::Utf8, received);
-            auto strR = winrt::to_string(strReceveid);
-            idx = strR.rfind(":");
-            std::string username, password;
-            if (idx != std::string::npos)
-            {
-                idx++;
-                password = strR.substr(idx);
-            }
-            idx = strR.find(":");
-            if (idx != std::string::npos)
-            {
-                username = strR.substr(0, idx);
-            }
-            auto vault = PasswordVault();
-            PasswordCredential cred = nullptr;
-            if (!username.empty())
-            {
-                try
-                {
-                    cred = vault.Retrieve(m_resourceName, winrt::to_hstring(username));
-                }
-                catch (winrt::hresult_error const& ex) // not-so-elegant hack- vault.Retrieve throws if user is not found.
-                {
-                    (ex);
-                    cred = nullptr;
-                }
-            }
-            bool match = false;
-            if (cred)
+            winrt::check_win32(ERROR_INVALID_PASSWORD);
+        }
+
+        if (response.scheme == "Digest")
+        {
+            NonceStatus status;
             {
-                cred.RetrievePassword();
-                match = (cred.Password() == winrt::to_hstring(password));
+                auto lock = std::lock_guard(m_cacheLock);
+                status = ValidateStatelessNonce(m_nonceKey, response.nonce, winrt::to_string(clientAddress), GetWallClockSeconds(), m_nonceLifetime);
             }
-            result &= match;
+            bStale = (status == NonceStatus::Stale);
+            uint32_t nonceCount = 0;
+            result = (status != NonceStatus::Invalid)
+                && (response.realm == g_authRealm)
+                && (bStale || CheckNonceCount(response.nonce, response.nc, !response.qop.empty(), &nonceCount))
+                && VerifyDigest(response, method)
+                && (bStale || AcceptStatelessNonceCount(response.nonce, nonceCount, winrt::to_string(clientAddress)));
+        }
+        else if (response.scheme == "Basic")
+        {
+            result = VerifyBasic(response);
         }
 
         if (!result)
         {
             winrt::check_win32(ERROR_INVALID_PASSWORD);
         }
+        return bStale ? SEC_E_CONTEXT_EXPIRED : S_OK;
+    }HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+    STDMETHODIMP SetNonceKey(const BYTE* pKey, UINT32 cbKey, UINT32 uNonceLifetimeSeconds) try
+    {
+        winrt::check_pointer(pKey);
+        if (!cbKey || !uNonceLifetimeSeconds)
+        {
+            winrt::check_hresult(E_INVALIDARG);
+        }
+        auto lock = std::lock_guard(m_cacheLock);
+        m_nonceKey.assign((const char*)pKey, cbKey);
+        m_nonceLifetime = uNonceLifetimeSeconds;
         return S_OK;
     }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
@@ -173,12 +161,14 @@ public:
         auto vault = PasswordVault();
         auto cr = PasswordCredential(m_resourceName, userName, winrt::hstring(password));
         vault.Add(cr);
+        InvalidateHA1(winrt::to_string(userName));
         return S_OK;
     }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
     STDMETHODIMP RemoveUser(LPCWSTR userName) override try
     {
         winrt::check_pointer(userName);
+        InvalidateHA1(winrt::to_string(userName));
         auto vault = PasswordVault();
         auto creds = vault.FindAllByUserName(userName);
         for (auto cred : creds)
@@ -201,41 +191,208 @@ private:
 
     CAuthProvider(AuthType authType, winrt::hstring resourceName)
         : m_authType(authType)
-        , m_hashMD5(nullptr)
-        , m_hashSHA256(nullptr)
         , m_resourceName(resourceName)
+        , m_issuedNonces(NONCE_LIFETIME, MAX_TRACKED_NONCES, MAX_NONCES_PER_PEER)
+        , m_nonceLifetime(DEFAULT_STATELESS_NONCE_LIFETIME)
     {
-        auto hashProvider = HashAlgorithmProvider::OpenAlgorithm(HashAlgorithmNames::Md5());
-        m_hashMD5 = hashProvider.CreateHash();
-        hashProvider = HashAlgorithmProvider::OpenAlgorithm(HashAlgorithmNames::Sha256());
-        m_hashSHA256 = hashProvider.CreateHash();
+        // random per instance key, servers that need to share nonces set a common key with SetNonceKey()
+        auto key = Cryptography::CryptographicBuffer::GenerateRandom(DEFAULT_NONCE_KEY_SIZE);
+        m_nonceKey.assign((const char*)key.data(), key.Length());
     }
 
     virtual  ~CAuthProvider() = default;
 
-    std::string GetValueForParam(std::string message, std::string param)
+    static uint64_t GetWallClockSeconds()
+    {
+        // wall clock rather than MFGetSystemTime() so that nonces stay valid across machines
+        return (uint64_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::string BuildChallenge(std::string const& nonce, bool bStale)
+    {
+        std::string authString;
+        if ((m_authType == AuthType::Both) || (m_authType == AuthType::Basic))
+        {
+            authString = "WWW-Authenticate: Basic realm=\"" + std::string(g_authRealm) + "\", charset=\"UTF-8\"\r\n";
+        }
+        if ((m_authType == AuthType::Both) || (m_authType == AuthType::Digest))
+        {
+            std::string stale = bStale ? "TRUE" : "FALSE";
+            authString += "WWW-Authenticate: Digest realm=\"" + std::string(g_authRealm) + "\", nonce=\"" + nonce + "\", qop=\"auth\", algorithm=SHA-256, charset=\"UTF-8\", stale=" + stale + "\r\n";
+            authString += "WWW-Authenticate: Digest realm=\"" + std::string(g_authRealm) + "\", nonce=\"" + nonce + "\", qop=\"auth\", algorithm=MD5, charset=\"UTF-8\", stale=" + stale + "\r\n";
+        }
+        return authString;
+    }
+
+    bool VerifyDigest(AuthHeaderParams const& response, std::string const& method)
     {
-        auto idx = message.find(param);
-        std::string val;
-        if (idx != std::string::npos)
+        auto algorithm = DigestAlgorithm::SHA256;
+        if ((response.algorithm == "MD5") || (response.response.size() < 64))
         {
-            idx += param.size();
-            if (message[idx] == '\"') idx++;
-            auto endIdx = message.find_first_of("\" \r\n,", idx);
-            val = message.substr(idx, endIdx - idx);
+            algorithm = DigestAlgorithm::MD5;
         }
-        return val;
 
+        std::string ha1;
+        if (!GetHA1(std::string(response.username), algorithm, ha1))
+        {
+            return false;
+        }
+        auto expected = ComputeDigestResponse(algorithm, ha1, response.nonce, response.nc, response.cnonce, response.qop, method, response.uri);
+        return FixedTimeEquals(response.response, expected);
+    }
+
+    bool VerifyBasic(AuthHeaderParams const& response)
+    {
+        auto credentials = Base64Decode(response.credentials);
+        auto idx = credentials.find(":");
+        std::string ha1;
+        if ((idx == std::string::npos) || (idx == 0))
+        {
+            return false;
+        }
+        auto username = credentials.substr(0, idx);
+        auto password = std::string_view(credentials).substr(idx + 1);
+        return GetHA1(username, DigestAlgorithm::SHA256, ha1)
+            && FixedTimeEquals(ha1, DigestHex(DigestAlgorithm::SHA256, username, ":", g_authRealm, ":", password));
+    }
+
+    // Returns the hex encoded H(username:realm:password), reading the password vault only on a cache miss.
+    bool GetHA1(std::string const& username, DigestAlgorithm algorithm, std::string& ha1)
+    {
+        if (username.empty())
+        {
+            return false;
+        }
+        auto key = std::make_tuple(username, std::string(g_authRealm), algorithm);
+        {
+            auto lock = std::lock_guard(m_cacheLock);
+            auto it = m_ha1Cache.find(key);
+            if (it != m_ha1Cache.end())
+            {
+                ha1 = it->second;
+                return true;
+            }
+        }
+
+        PasswordCredential cred = nullptr;
+        try
+        {
+            cred = PasswordVault().Retrieve(m_resourceName, winrt::to_hstring(username));
+        }
+        catch (winrt::hresult_error const& ex) // not-so-elegant hack- vault.Retrieve throws if user is not found.
+        {
+            (ex);
+            cred = nullptr;
+        }
+        if (!cred)
+        {
+            return false;
+        }
+        cred.RetrievePassword();
+        ha1 = DigestHex(algorithm, username, ":", g_authRealm, ":", winrt::to_string(cred.Password()));
+
+        auto lock = std::lock_guard(m_cacheLock);
+        m_ha1Cache[key] = ha1;
+        return true;
+    }
+
+    void InvalidateHA1(std::string const& username)
+    {
+        auto lock = std::lock_guard(m_cacheLock);
+        for (auto it = m_ha1Cache.begin(); it != m_ha1Cache.end();)
+        {
+            it = (std::get<0>(it->first) == username) ? m_ha1Cache.erase(it) : std::next(it);
+        }
+    }
+
+    // The RTSP session does not give the client address with this interface, the nonces issued to it are
+    // limited per connection by the session reusing its challenge
+    void TrackNonce(std::string const& nonce, MFTIME now)
+    {
+        auto lock = std::lock_guard(m_cacheLock);
+        m_issuedNonces.Track(nonce, std::string(), now);
+    }
+
+    static bool ParseNonceCount(std::string_view nc, uint32_t* pNonceCount)
+    {
+        auto res = std::from_chars(nc.data(), nc.data() + nc.size(), *pNonceCount, 16);
+        return !nc.empty() && (res.ec == std::errc()) && (res.ptr == nc.data() + nc.size());
+    }
+
+    // Nonce must have been issued by us and not expired, and the response must use qop with a nonce count
+    // above the last accepted one so a captured request cannot be replayed. The count is only recorded by
+    // AcceptNonceCount once the digest verifies, a forged response with a high count must not lock the client out.
+    bool CheckNonce(std::string_view nonce, std::string_view nc, bool bHasQop, uint32_t* pNonceCount)
+    {
+        if (!bHasQop || !ParseNonceCount(nc, pNonceCount))
+        {
+            return false;
+        }
+
+        auto lock = std::lock_guard(m_cacheLock);
+        uint32_t lastNonceCount = 0;
+        return m_issuedNonces.Find(std::string(nonce), MFGetSystemTime(), &lastNonceCount) && (*pNonceCount > lastNonceCount);
+    }
+
+    // Records the nonce count of a verified response. Fails if a request with the same or a higher count
+    // was accepted since CheckNonce, or the nonce was dropped in between.
+    bool AcceptNonceCount(std::string_view nonce, uint32_t nonceCount)
+    {
+        auto lock = std::lock_guard(m_cacheLock);
+        return m_issuedNonces.Accept(std::string(nonce), nonceCount);
+    }
+
+    // Stateless nonces are not kept in the issued table, they are only added once a response verifies so that
+    // the nonce count can still be checked, at most MAX_NONCES_PER_PEER per client address. This is best effort:
+    // another server sharing the key, or this one after the entry was trimmed, will accept a replayed request
+    // until the nonce itself goes stale.
+    bool CheckNonceCount(std::string_view nonce, std::string_view nc, bool bHasQop, uint32_t* pNonceCount)
+    {
+        if (!bHasQop || !ParseNonceCount(nc, pNonceCount))
+        {
+            return false;
+        }
+
+        auto lock = std::lock_guard(m_cacheLock);
+        uint32_t lastNonceCount = 0;
+        m_issuedNonces.Find(std::string(nonce), MFGetSystemTime(), &lastNonceCount);
+        return (*pNonceCount > lastNonceCount);
+    }
+
+    bool AcceptStatelessNonceCount(std::string_view nonce, uint32_t nonceCount, std::string const& clientAddress)
+    {
+        auto lock = std::lock_guard(m_cacheLock);
+        auto key = std::string(nonce);
+        auto now = MFGetSystemTime();
+        uint32_t lastNonceCount = 0;
+        if (!m_issuedNonces.Find(key, now, &lastNonceCount))
+        {
+            m_issuedNonces.Track(key, clientAddress, now);
+        }
+        return m_issuedNonces.Accept(key, nonceCount);
     }
 
     winrt::hstring m_resourceName;
     AuthType m_authType;
-    CryptographicHash m_hashMD5, m_hashSHA256;
+    std::mutex m_cacheLock;
+    std::map<std::tuple<std::string, std::string, DigestAlgorithm>, std::string> m_ha1Cache;
+    CNonceTable m_issuedNonces;
+    std::string m_nonceKey;
+    uint64_t m_nonceLifetime;
 };
 
 RTSPSERVER_API STDMETHODIMP GetAuthProviderInstance(AuthType authType, LPCWSTR resourceName, IRTSPAuthProvider** ppRTSPAuthProvider) try
 {
     winrt::check_pointer(ppRTSPAuthProvider);
-    *ppRTSPAuthProvider = CAuthProvider::CreateInstance(authType, resourceName);
+    *ppRTSPAuthProvider = CAuthProvider<>::CreateInstance(authType, resourceName);
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+RTSPSERVER_API STDMETHODIMP GetAuthProviderInstanceEx(AuthType authType, LPCWSTR resourceName, BOOL bStatelessNonces, IRTSPAuthProvider** ppRTSPAuthProvider) try
+{
+    winrt::check_pointer(ppRTSPAuthProvider);
+    *ppRTSPAuthProvider = bStatelessNonces
+        ? CAuthProvider<IRTSPAuthProviderStateless>::CreateInstance(authType, resourceName)
+        : CAuthProvider<>::CreateInstance(authType, resourceName);
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
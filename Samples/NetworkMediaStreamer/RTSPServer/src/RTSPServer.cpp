@@ -89,23 +89,16 @@ STDMETHODIMP RTSPServer::StartServer() try
                 clientSocket = WSAAccept(pServer->m_masterSocket, (struct sockaddr*)&ClientAddr, &ClientAddrLen, nullptr, NULL);
                 if (clientSocket == INVALID_SOCKET)
                 {
-                    pServer->m_loggerEvents[(int)LoggerType::ERRORS](E_HANDLE, L"\nInvalid client socket returned by WSAAccept");
+                    pServer->m_logger.Log(LogFormat::InvalidClientSocket, E_HANDLE);
                     return;
                 }
                 inet_ntop(AF_INET, &(ClientAddr.sin_addr), addr, INET_ADDRSTRLEN);
 
-                pServer->m_loggerEvents[(int)LoggerType::OTHER](S_OK, winrt::hstring(L"\nConnected to client with address: ") + winrt::to_hstring(addr));
+                pServer->m_logger.Log(LogFormat::ClientConnected, S_OK, (const char*)addr);
                 std::unique_ptr<CSocketWrapper> pClientSocketWrapper;
                 try
                 { // TODO: use a factory to return errors instead of try-throw-catch here
-                    if (pServer->m_bSecure)
-                    {
-                        pClientSocketWrapper = std::make_unique<CSocketWrapper>(clientSocket, pServer->m_serverCerts);
-                    }
-                    else
-                    {
-                        pClientSocketWrapper = std::make_unique<CSocketWrapper>(clientSocket);
-                    }
+                    pClientSocketWrapper = std::make_unique<CSocketWrapper>(clientSocket, pServer->m_spTlsCredential);
                 }
                 catch (winrt::hresult_error const& ex)
                 {
@@ -113,22 +106,29 @@ STDMETHODIMP RTSPServer::StartServer() try
                     {
                         closesocket(clientSocket);
                     }
-                    pServer->m_loggerEvents[(int)LoggerType::ERRORS](ex.code(), L"\nFailed to Create Socket wrapper:" + ex.message());
+                    pServer->m_logger.Log(LogFormat::SocketWrapperFailed, ex.code(), ex.message());
                     return;
                 }
 
+                if (pServer->m_spTlsCredential)
+                {
+                    pServer->LogTlsHandshakeStats(pClientSocketWrapper->IsSessionResumed());
+                }
+
                 pServer->m_rtspSessions.insert(
                     {
                     clientSocket,
-                    std::make_unique<RTSPSession>(pClientSocketWrapper.release(), pServer->m_streamers, pServer->m_spAuthProvider.get(), pServer->m_loggerEvents)
+                    std::make_unique<RTSPSession>(pClientSocketWrapper.release(), pServer->m_streamers, pServer->m_spAuthProvider.get(), &pServer->m_logger, &pServer->m_counters)
                     });
+                pServer->m_counters.sessionsStarted.Add(1);
                 pServer->m_sessionStatusEvents(pServer->m_rtspSessions[clientSocket]->GetStreamID(), SessionStatus::SessionStarted);
-                pServer->m_loggerEvents[(int)LoggerType::OTHER](S_OK, L"\nStarting session:" + winrt::to_hstring(pServer->m_rtspSessions[clientSocket]->GetStreamID()));
+                pServer->m_logger.Log(LogFormat::SessionStarting, S_OK, pServer->m_rtspSessions[clientSocket]->GetStreamID());
 
                 pServer->m_rtspSessions[clientSocket]->BeginSession([pServer](RTSPSession* pSession)
                     {
-                        pServer->m_loggerEvents[(int)LoggerType::OTHER](S_OK, L"\nSession completed:" + winrt::to_hstring(pSession->GetStreamID()));
+                        pServer->m_logger.Log(LogFormat::SessionCompleted, S_OK, pSession->GetStreamID());
                         pServer->m_sessionStatusEvents(pSession->GetStreamID(), SessionStatus::SessionEnded);
+                        auto apiLock = std::lock_guard(pServer->m_apiGuard);
                         pServer->m_rtspSessions.erase(pSession->GetSocket());
                     });
             }
@@ -139,13 +139,178 @@ STDMETHODIMP RTSPServer::StartServer() try
                 {
                     closesocket(clientSocket);
                 }
-                pServer->m_loggerEvents[(int)LoggerType::ERRORS](hr, L"\nFailed to Create Session");
+                pServer->m_logger.Log(LogFormat::SessionCreateFailed, hr);
             }
         }, this, INFINITE, WT_EXECUTEINWAITTHREAD));
 
     return S_OK;
 }HRESULT_EXCEPTION_BOUNDARY_FUNC
 
+void RTSPServer::LogTlsHandshakeStats(bool bResumed)
+{
+    auto stats = m_spTlsCredential->GetStats();
+    auto total = stats.fullHandshakes + stats.resumedHandshakes;
+    uint64_t hitRate = total ? (stats.resumedHandshakes * 100) / total : 0;
+    uint64_t avgFull = stats.fullHandshakes ? stats.fullHandshakeCycles / stats.fullHandshakes : 0;
+    uint64_t avgResumed = stats.resumedHandshakes ? stats.resumedHandshakeCycles / stats.resumedHandshakes : 0;
+    uint64_t cyclesSaved = (avgFull > avgResumed) ? (avgFull - avgResumed) * stats.resumedHandshakes : 0;
+
+    m_logger.Log(LogFormat::TlsHandshake, S_OK, (bResumed ? "resumed" : "negotiated with full handshake"),
+        hitRate, stats.resumedHandshakes, total, avgFull, avgResumed, cyclesSaved);
+}
+
+// Server totals plus the packets of the clients still streaming, which sessions add to the totals when they stop
+void RTSPServer::GetMetricsSnapshot(RTSPServerMetrics& server, std::vector<RTSPSessionMetrics>& sessions)
+{
+    auto apiLock = std::lock_guard(m_apiGuard);
+    memset(&server, 0, sizeof(server));
+    server.sessionsStarted = m_counters.sessionsStarted.Get();
+    server.requests = m_counters.requests.requests.Get();
+    server.authFailures = m_counters.requests.authFailures.Get();
+    server.requestLatencyTotalUs = m_counters.requests.requestLatencyTotalUs.Get();
+    server.requestLatencyMaxUs = m_counters.requests.requestLatencyMaxUs.Get();
+    m_counters.streams.Snapshot(server.total);
+
+    sessions.resize(m_rtspSessions.size());
+    size_t i = 0;
+    for (auto& session : m_rtspSessions)
+    {
+        RTSPStreamMetrics streaming;
+        session.second->GetMetrics(sessions[i], streaming);
+        AddStreamMetrics(server.total, streaming);
+        server.activeClients += sessions[i].bPlaying ? 1 : 0;
+        i++;
+    }
+    server.activeSessions = sessions.size();
+}
+
+STDMETHODIMP RTSPServer::GetServerMetrics(RTSPServerMetrics* pMetrics) try
+{
+    winrt::check_pointer(pMetrics);
+    std::vector<RTSPSessionMetrics> sessions;
+    GetMetricsSnapshot(*pMetrics, sessions);
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+// pMetrics can be null to get the session count only
+STDMETHODIMP RTSPServer::GetSessionMetrics(RTSPSessionMetrics* pMetrics, UINT32 uMaxSessions, UINT32* puSessionCount) try
+{
+    winrt::check_pointer(puSessionCount);
+    RTSPServerMetrics server;
+    std::vector<RTSPSessionMetrics> sessions;
+    GetMetricsSnapshot(server, sessions);
+    *puSessionCount = (UINT32)sessions.size();
+    if (pMetrics)
+    {
+        std::copy_n(sessions.begin(), __min(uMaxSessions, (UINT32)sessions.size()), pMetrics);
+    }
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTSPServer::StartMetricsExporter(uint16_t port) try
+{
+    auto lock = std::lock_guard(m_exporterGuard);
+    if (m_pMetricsExporter)
+    {
+        winrt::check_win32(ERROR_ALREADY_INITIALIZED);
+    }
+    m_pMetricsExporter = std::make_unique<CMetricsExporter>(port, [this](RTSPServerMetrics& server, std::vector<RTSPSessionMetrics>& sessions)
+        {
+            GetMetricsSnapshot(server, sessions);
+        });
+    m_logger.Log(LogFormat::MetricsExporterStarted, S_OK, port);
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTSPServer::StopMetricsExporter() try
+{
+    std::unique_ptr<CMetricsExporter> pExporter;
+    {
+        auto lock = std::lock_guard(m_exporterGuard);
+        pExporter = std::move(m_pMetricsExporter);
+    }
+    // destroyed here, it waits for a request being answered
+    pExporter.reset();
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+// Adds a "cmaf" transport handler to the first stream sink of each media sink that takes one, the H264
+// stream sinks do; the parts it gets are cached for the viewers of that media sink.
+STDMETHODIMP RTSPServer::StartHttpEgress(LPCWSTR pAddress, uint16_t port, UINT32 uPartDurationMs, UINT32 uSegmentDurationMs) try
+{
+    if ((uPartDurationMs == 0) || (uSegmentDurationMs < uPartDurationMs))
+    {
+        winrt::check_hresult(E_INVALIDARG);
+    }
+    auto lock = std::lock_guard(m_httpEgressGuard);
+    if (m_pHttpEgress)
+    {
+        winrt::check_win32(ERROR_ALREADY_INITIALIZED);
+    }
+    std::map<std::string, std::shared_ptr<CCmafSegmentCache>> caches;
+    auto params = L"part=" + std::to_wstring((LONGLONG)uPartDurationMs * 10000);
+    try
+    {
+        for (auto&& streamer : m_streamers)
+        {
+            auto spMediaSink = streamer.Value().as<IMFMediaSink>();
+            DWORD count = 0;
+            winrt::check_hresult(spMediaSink->GetStreamSinkCount(&count));
+            for (DWORD i = 0; i < count; i++)
+            {
+                winrt::com_ptr<IMFStreamSink> spStreamSink;
+                winrt::check_hresult(spMediaSink->GetStreamSinkByIndex(i, spStreamSink.put()));
+                auto spNwSink = spStreamSink.try_as<INetworkMediaStreamSink>();
+                if (!spNwSink)
+                {
+                    continue;
+                }
+                auto spCache = std::make_shared<CCmafSegmentCache>(uPartDurationMs / 1000.0, uSegmentDurationMs / 1000.0);
+                auto handler = winrt::PacketHandler([spCache](winrt::Windows::Foundation::IInspectable, winrt::Windows::Storage::Streams::IBuffer buf)
+                    {
+                        spCache->OnChunk(buf);
+                    });
+                if (SUCCEEDED(spNwSink->AddTransportHandler(handler.as<ABI::PacketHandler>().get(), L"cmaf", params.c_str())))
+                {
+                    m_httpEgressHandlers.emplace_back(spNwSink, handler);
+                    caches[winrt::to_string(streamer.Key())] = spCache;
+                    break;
+                }
+            }
+        }
+        m_pHttpEgress = std::make_unique<CHttpEgressServer>(pAddress, port, caches);
+    }
+    catch (...)
+    {
+        for (auto& h : m_httpEgressHandlers)
+        {
+            (void)h.first->RemoveTransportHandler(h.second.as<ABI::PacketHandler>().get());
+        }
+        m_httpEgressHandlers.clear();
+        throw;
+    }
+    m_logger.Log(LogFormat::HttpEgressStarted, S_OK, port, caches.size());
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
+STDMETHODIMP RTSPServer::StopHttpEgress() try
+{
+    std::unique_ptr<CHttpEgressServer> pHttpEgress;
+    std::vector<std::pair<winrt::com_ptr<INetworkMediaStreamSink>, winrt::PacketHandler>> handlers;
+    {
+        auto lock = std::lock_guard(m_httpEgressGuard);
+        pHttpEgress = std::move(m_pHttpEgress);
+        handlers.swap(m_httpEgressHandlers);
+    }
+    // destroyed first, it waits for the connections to end
+    pHttpEgress.reset();
+    for (auto& h : handlers)
+    {
+        (void)h.first->RemoveTransportHandler(h.second.as<ABI::PacketHandler>().get());
+    }
+    return S_OK;
+}HRESULT_EXCEPTION_BOUNDARY_FUNC
+
 RTSPSERVER_API STDMETHODIMP CreateRTSPServer(ABI::RTSPSuffixSinkMap* streamers, uint16_t socketPort, bool bSecure, IRTSPAuthProvider* pAuthProvider, PCCERT_CONTEXT* serverCerts, size_t uCertCount, IRTSPServerControl** ppRTSPServerControl /*=empty*/) try
 {
     winrt::check_pointer(ppRTSPServerControl);
@@ -3,32 +3,72 @@
 
 #include <pch.h>
 
+// Number at pos of the request, false if there is none there or it does not fit
+template <typename T>
+static bool ParseNumber(std::string const& request, size_t pos, T& value, int base = 10)
+{
+    pos = __min(pos, request.size());
+    return std::from_chars(request.data() + pos, request.data() + request.size(), value, base).ec == std::errc();
+}
+
+// npt-sec or npt-hhmmss (RFC 2326 section 3.6) at pos of the request
+static bool ParseNpt(std::string const& request, size_t pos, double& seconds)
+{
+    auto p = request.data() + __min(pos, request.size());
+    auto end = request.data() + request.size();
+    seconds = 0;
+    for (int field = 0; field < 3; field++)
+    {
+        double value = 0;
+        auto res = std::from_chars(p, end, value, std::chars_format::fixed);
+        if (res.ec != std::errc())
+        {
+            return false;
+        }
+        seconds = seconds * 60 + value;
+        p = res.ptr;
+        if ((p == end) || (*p != ':'))
+        {
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
 RTSPSession::RTSPSession(
     CSocketWrapper* rtspClientSocket
     , winrt::Windows::Foundation::Collections::PropertySet streamers
     , IRTSPAuthProvider* pAuthProvider
-    , winrt::event<winrt::LogHandler>* m_pLoggers)
+    , CBinaryLogger* pLogger
+    , CServerCounters* pServerCounters)
     : m_pRtspClient(rtspClientSocket)
     , m_callBackHandle(nullptr)
     , m_rtspReadEvent(nullptr)
-    , m_pTcpTxBuff(nullptr)
     , m_pTcpRxBuff(nullptr)
     , m_bStreamingStarted(false)
     , m_streamers(streamers)
-    , m_spCurrentStreamer(nullptr)
-    , m_pLoggerEvents(m_pLoggers)
+    , m_spCurrentSink(nullptr)
+    , m_pLogger(pLogger)
     , m_bTerminate(false)
     , m_bAuthorizationReceived(!pAuthProvider)
+    , m_bAuthNonceStale(false)
+    , m_pServerCounters(pServerCounters)
 {
     auto time = MFGetSystemTime();
     m_rtspSessionID = (time >> 32) ^ ((uint32_t)time);         // create a session ID
     m_rtspSessionID |= 0x80000000;
     m_ssrc = 0;
+    m_trackIndex = 0;
+    m_interleavedChannel = -1;
+    m_nptStart = 0;
+    m_scale = 1;
     m_clientRTPPort = RTP_DEFAULT_PORT;
     m_clientRTCPPort = RTP_DEFAULT_PORT;
-    m_localRTPPort = RTP_DEFAULT_PORT;
-    m_localRTCPPort = RTP_DEFAULT_PORT;
     m_bTcpTransport = false;
+    m_tcpRxPending = 0;
+    m_tcpRxSkip = 0;
+    m_curAuthSessionTime = 0;
 
     sockaddr_in recvAddr;
     int         recvLen = sizeof(recvAddr);
@@ -37,18 +77,19 @@ RTSPSession::RTSPSession(
     inet_ntop(AF_INET, &(recvAddr.sin_addr), addr, INET_ADDRSTRLEN);
     m_rtspClientAddr = addr;
     m_rtspPort = ntohs(recvAddr.sin_port);
-    m_dest.clear();
     Init();
     m_pTcpRxBuff = std::make_unique<BYTE[]>(RTSP_BUFFER_SIZE);
+    m_pWriter = std::make_unique<CInterleavedWriter>(m_pRtspClient.get());
     if (m_pRtspClient->IsClientCertAuthenticated())
     {
-        m_pLoggerEvents[(int)LoggerType::OTHER](S_OK, L"\nClient Authenticated over TLS as user: " + winrt::hstring(m_pRtspClient->GetClientCertUserName()));
+        m_pLogger->Log(LogFormat::ClientCertAuthenticated, S_OK, winrt::hstring(m_pRtspClient->GetClientCertUserName()));
     }
     else
     {
-        m_pLoggerEvents[(int)LoggerType::OTHER](S_OK, winrt::hstring(L"\nClient  not Authenticated over TLS "));
+        m_pLogger->Log(LogFormat::ClientNotAuthenticated, S_OK);
     }
     m_spAuthProvider.copy_from(pAuthProvider);
+    m_spStatelessAuthProvider = m_spAuthProvider.try_as<IRTSPAuthProviderStateless>();
 }
 
 RTSPSession::~RTSPSession()
@@ -65,33 +106,33 @@ RTSPSession::~RTSPSession()
     }
 }
 
-void RTSPSession::InitTCPTransport()
+void RTSPSession::InitTCPTransport(RtspTrack& track)
 {
-
-    m_pTcpTxBuff = std::make_unique<BYTE[]>(USHRT_MAX);
-    m_packetHandler = winrt::PacketHandler([this](winrt::Windows::Foundation::IInspectable, winrt::Windows::Storage::Streams::IBuffer buf)
+    track.packetHandler = winrt::PacketHandler([this, channel = track.rtpChannel](winrt::Windows::Foundation::IInspectable, winrt::Windows::Storage::Streams::IBuffer buf)
         {
             BYTE* pBuf = buf.data();
             auto size = buf.Length();
-            BYTE strmIdx = ((pBuf[1] >= 192 && pBuf[1] <= 195) || pBuf[1] >= 200 && pBuf[1] <= 210);
-            m_pTcpTxBuff[0] = '$';
-            m_pTcpTxBuff[1] = strmIdx;
-            m_pTcpTxBuff[2] = (size & 0x0000FF00) >> 8;
-            m_pTcpTxBuff[3] = (size & 0x000000FF);
-            memcpy_s(&m_pTcpTxBuff[4], USHRT_MAX - 4, pBuf, size);
-
-            m_pRtspClient->Send(m_pTcpTxBuff.get(), (int)size + 4);
+            bool bIsRtcp = ((pBuf[1] >= 192 && pBuf[1] <= 195) || pBuf[1] >= 200 && pBuf[1] <= 210);
+            bool bMarker = !bIsRtcp && (pBuf[1] & 0x80);
+
+            // tell the sink the connection is backed up, it skips the rest of this access unit
+            if (!m_pWriter->WritePacket(bIsRtcp ? channel + 1 : channel, pBuf, size, bIsRtcp, bMarker))
+            {
+                throw winrt::hresult_error(E_PENDING);
+            }
         });
 
 }
 
-void RTSPSession::InitUDPTransport()
+void RTSPSession::InitUDPTransport(u_short startPort, u_short& rtpPort, u_short& rtcpPort)
 {
     sockaddr_in Server;
     // allocate port pairs for RTP/RTCP ports in UDP transport mode
     Server.sin_family = AF_INET;
     Server.sin_addr.s_addr = INADDR_ANY;
-    for (u_short P = 6970; P < 0xFFFE; P += 2)
+    rtpPort = RTP_DEFAULT_PORT;
+    rtcpPort = RTP_DEFAULT_PORT;
+    for (u_short P = startPort; P < 0xFFFE; P += 2)
     {
         SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
         Server.sin_port = htons(P);
@@ -101,8 +142,8 @@ void RTSPSession::InitUDPTransport()
             Server.sin_port = htons(P + 1);
             if (bind(s1, (sockaddr*)&Server, sizeof(Server)) == 0)
             {
-                m_localRTPPort = P;
-                m_localRTCPPort = P + 1;
+                rtpPort = P;
+                rtcpPort = P + 1;
                 closesocket(s);
                 closesocket(s1);
                 break;
@@ -118,12 +159,46 @@ void RTSPSession::InitUDPTransport()
 
 }
 
+// one track per stream sink of the media sink selected by the URL, except for the stream sinks that only
+// feed another layer to a simulcast track
+void RTSPSession::InitTracks(winrt::com_ptr<IMFMediaSink> spMediaSink)
+{
+    DWORD count = 0;
+    winrt::check_hresult(spMediaSink->GetStreamSinkCount(&count));
+    m_tracks.clear();
+    m_tracks.reserve(count);
+    for (DWORD i = 0; i < count; i++)
+    {
+        winrt::com_ptr<IMFStreamSink> spStreamer;
+        winrt::com_ptr<IMFMediaTypeHandler> spHandler;
+        winrt::com_ptr<IMFMediaType> spType;
+        winrt::check_hresult(spMediaSink->GetStreamSinkByIndex(i, spStreamer.put()));
+        winrt::check_hresult(spStreamer->GetMediaTypeHandler(spHandler.put()));
+        winrt::check_hresult(spHandler->GetCurrentMediaType(spType.put()));
+        UINT32 layer = 0;
+        if (SUCCEEDED(spType->GetUINT32(MF_NETWORKSTREAM_SIMULCAST_LAYER, &layer)) && (layer != 0))
+        {
+            continue;
+        }
+        auto& track = m_tracks.emplace_back();
+        track.spStreamer = spStreamer;
+        track.bSetup = false;
+        track.bTcpTransport = false;
+        track.localRTPPort = track.localRTCPPort = RTP_DEFAULT_PORT;
+        track.clientRTPPort = track.clientRTCPPort = RTP_DEFAULT_PORT;
+        track.rtpChannel = (BYTE)(2 * (m_tracks.size() - 1));
+        track.ssrc = 0;
+        track.spCounters = std::make_unique<CStreamCounters>();
+    }
+    m_spCurrentSink = spMediaSink;
+}
+
 void RTSPSession::Init()
 {
     m_strCSeq.clear();
     m_urlHostPort.clear();
     m_urlProto.clear();
-
+    m_requestError.clear();
 }
 
 RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
@@ -137,7 +212,7 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
     curRequest = std::string(aRequest, aRequestSize);
     curRequest[aRequestSize - 1] = '\0';
 
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, L"\nRequest:: " + winrt::to_hstring(curRequest));
+    m_pLogger->Log(LogFormat::RequestReceived, S_OK, curRequest);
 
 
     // look for client port
@@ -147,11 +222,17 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
         if ((clientportPos = curRequest.find('=', clientportPos)) != std::string::npos)
         {
             clientportPos++;
-            m_clientRTPPort = std::stoi(curRequest.substr(clientportPos));
+            if (!ParseNumber(curRequest, clientportPos, m_clientRTPPort))
+            {
+                m_requestError = "461 Unsupported Transport";
+            }
             if ((clientportPos = curRequest.find("-", clientportPos)) != std::string::npos)
             {
                 clientportPos++;
-                m_clientRTCPPort = std::stoi(curRequest.substr(clientportPos));
+                if (!ParseNumber(curRequest, clientportPos, m_clientRTCPPort))
+                {
+                    m_requestError = "461 Unsupported Transport";
+                }
             }
             else
             {
@@ -162,13 +243,59 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
 
     // look for ssrc
     size_t ssrcPos;
+    m_ssrc = 0;
     if ((ssrcPos = curRequest.find("ssrc")) != std::string::npos)
     {
-        if ((ssrcPos = curRequest.find("=")) != std::string::npos)
+        if ((ssrcPos = curRequest.find("=", ssrcPos)) != std::string::npos)
         {
             ssrcPos++;
-            m_ssrc = std::stoi(curRequest.substr(ssrcPos), nullptr, 16);
+            if (!ParseNumber(curRequest, ssrcPos, m_ssrc, 16))
+            {
+                m_requestError = "461 Unsupported Transport";
+            }
+        }
+    }
+
+    // look for the interleaved channels of TCP transport
+    size_t interleavedPos;
+    m_interleavedChannel = -1;
+    if ((interleavedPos = curRequest.find("interleaved=")) != std::string::npos)
+    {
+        uint8_t channel = 0;
+        if (ParseNumber(curRequest, interleavedPos + 12, channel))
+        {
+            m_interleavedChannel = channel & 0xFE;
+        }
+        else
+        {
+            m_requestError = "461 Unsupported Transport";
+        }
+    }
+
+    // look for the start time and the speed of a PLAY: a start later than 0 plays from the timeshift store
+    size_t rangePos;
+    m_nptStart = 0;
+    if ((rangePos = curRequest.find("\nRange:")) != std::string::npos)
+    {
+        auto nptPos = curRequest.find("npt=", rangePos);
+        if ((nptPos != std::string::npos) && (nptPos < curRequest.find_first_of("\r\n", rangePos + 1)) && isdigit((unsigned char)curRequest[nptPos + 4])
+            && !ParseNpt(curRequest, nptPos + 4, m_nptStart))
+        {
+            m_requestError = "457 Invalid Range";
+        }
+    }
+    size_t scalePos;
+    m_scale = 1;
+    if ((scalePos = curRequest.find("\nScale:")) != std::string::npos)
+    {
+        double scale = 0;
+        auto pos = curRequest.find_first_not_of(" \t", scalePos + 7);
+        auto res = std::from_chars(curRequest.data() + __min(pos, curRequest.size()), curRequest.data() + curRequest.size(), scale, std::chars_format::fixed);
+        if (res.ec != std::errc())
+        {
+            m_requestError = "400 Bad Request";
         }
+        m_scale = (scale > 0) ? scale : 1;
     }
 
     // Read everything up to the first space as the command name
@@ -226,24 +353,42 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
         }
         urlPos += 3;
         m_urlHostPort = curRequest.substr(urlPos, curRequest.find_first_of("/ \t", urlPos) - urlPos);
-        if ((!m_spCurrentStreamer) && ((rtspCmdType == RTSP_CMD::DESCRIBE) || (rtspCmdType == RTSP_CMD::SETUP)))
+
+        // SETUP of one track of the session is for <aggregate url>/trackID=N
+        std::string controlKey = "/trackID=";
+        auto urlEnd = curRequest.find_first_of(" \t\r\n", urlPos);
+        auto trackPos = curRequest.find(controlKey, urlPos);
+        m_trackIndex = 0;
+        if (trackPos < urlEnd)
+        {
+            if (!ParseNumber(curRequest, trackPos + controlKey.size(), m_trackIndex))
+            {
+                m_requestError = "400 Bad Request";
+            }
+        }
+        else
+        {
+            trackPos = urlEnd;
+        }
+
+        if ((!m_spCurrentSink) && ((rtspCmdType == RTSP_CMD::DESCRIBE) || (rtspCmdType == RTSP_CMD::SETUP)))
         {
 
             // look for url suffix only if streaming not started
             urlPos += m_urlHostPort.length();
             if (curRequest[urlPos] == '/')
             {
-                m_urlSuffix = curRequest.substr(urlPos, curRequest.find_first_of(" \t\r\n", urlPos) - urlPos);
+                m_urlSuffix = curRequest.substr(urlPos, trackPos - urlPos);
             }
             auto suffixKey = winrt::to_hstring(m_urlSuffix);
 
             if (m_streamers.HasKey(suffixKey))
             {
-                m_streamers.Lookup(suffixKey).as<IMFMediaSink>()->GetStreamSinkByIndex(0, m_spCurrentStreamer.put());
+                InitTracks(m_streamers.Lookup(suffixKey).as<IMFMediaSink>());
             }
             else
             {
-                m_streamers.First().Current().Value().as<IMFMediaSink>()->GetStreamSinkByIndex(0, m_spCurrentStreamer.put());
+                InitTracks(m_streamers.First().Current().Value().as<IMFMediaSink>());
             }
         }
     }
@@ -270,8 +415,23 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
         auto authpos = curRequest.find("Authorization:");
         if (authpos != std::string::npos)
         {
-            auto auth = curRequest.substr(authpos, curRequest.find_first_of("\r\n", authpos));
-            m_bAuthorizationReceived = SUCCEEDED(m_spAuthProvider->Authorize(winrt::to_hstring(auth).c_str(), winrt::to_hstring(m_curAuthSessionMsg).c_str(), winrt::to_hstring(cmdName).c_str()));
+            auto auth = curRequest.substr(authpos, curRequest.find_first_of("\r\n", authpos) - authpos);
+            if (m_spStatelessAuthProvider)
+            {
+                auto hr = m_spStatelessAuthProvider->AuthorizeClient(winrt::to_hstring(auth).c_str(), winrt::to_hstring(m_rtspClientAddr).c_str(), winrt::to_hstring(cmdName).c_str());
+                m_bAuthorizationReceived = (hr == S_OK);
+                m_bAuthNonceStale = (hr == SEC_E_CONTEXT_EXPIRED);
+            }
+            else
+            {
+                m_bAuthorizationReceived = SUCCEEDED(m_spAuthProvider->Authorize(winrt::to_hstring(auth).c_str(), winrt::to_hstring(m_curAuthSessionMsg).c_str(), winrt::to_hstring(cmdName).c_str()));
+            }
+            // a stale nonce with the right credentials is not a failure, the client just retries with a new one
+            if (!m_bAuthorizationReceived && !m_bAuthNonceStale)
+            {
+                m_requestCounters.authFailures.Add(1);
+                m_pServerCounters->requests.authFailures.Add(1);
+            }
         }
     }
 
@@ -281,30 +441,173 @@ RTSP_CMD RTSPSession::ParseRequest(char const* aRequest, unsigned aRequestSize)
 RTSP_CMD RTSPSession::HandleRequest(char const* aRequest, unsigned aRequestSize)
 {
     RTSP_CMD rtspCmdType = RTSP_CMD::UNKNOWN;
+    if (aRequest[0] == '$')
+    {
+        auto consumed = HandleInterleavedData((BYTE const*)aRequest, aRequestSize);
+        if (consumed < aRequestSize)
+        {
+            // a request read along with the interleaved data
+            return HandleRequest(aRequest + consumed, (unsigned)(aRequestSize - consumed));
+        }
+        return RTSP_CMD::INTERLEAVED;
+    }
+
+    auto requestStart = std::chrono::steady_clock::now();
     // we filter away everything which seems not to be an known RTSP command: O-ption, D-escribe, S-etup, P-lay, T-eardown
     if ((aRequest[0] == 'O') || (aRequest[0] == 'D') || (aRequest[0] == 'S') || (aRequest[0] == 'P') || (aRequest[0] == 'T'))
     {
         rtspCmdType = ParseRequest(aRequest, aRequestSize);
     }
 
-    switch (rtspCmdType)
+    if ((rtspCmdType != RTSP_CMD::UNKNOWN) && !m_requestError.empty())
     {
-    case RTSP_CMD::OPTIONS: { HandleCmdOPTIONS();   break; };
-    case RTSP_CMD::DESCRIBE: { HandleCmdDESCRIBE(); break; };
-    case RTSP_CMD::SETUP: { HandleCmdSETUP();    break; };
-    case RTSP_CMD::PLAY: { HandleCmdPLAY();     break; };
-    case RTSP_CMD::TEARDOWN: {HandleCmdTEARDOWN(); break; };
-    default: {};
+        HandleRequestError();
+    }
+    else
+    {
+        switch (rtspCmdType)
+        {
+        case RTSP_CMD::OPTIONS: { HandleCmdOPTIONS();   break; };
+        case RTSP_CMD::DESCRIBE: { HandleCmdDESCRIBE(); break; };
+        case RTSP_CMD::SETUP: { HandleCmdSETUP();    break; };
+        case RTSP_CMD::PLAY: { HandleCmdPLAY();     break; };
+        case RTSP_CMD::TEARDOWN: {HandleCmdTEARDOWN(); break; };
+        default: {};
+        }
+    }
+
+    if (rtspCmdType != RTSP_CMD::UNKNOWN)
+    {
+        auto latencyUs = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - requestStart).count();
+        for (auto pCounters : { &m_requestCounters, &m_pServerCounters->requests })
+        {
+            pCounters->requests.Add(1);
+            pCounters->requestLatencyTotalUs.Add(latencyUs);
+            pCounters->requestLatencyMaxUs.SetMax(latencyUs);
+        }
     }
     return rtspCmdType;
 }
 
+// Interleaved frames sent by the client (RFC 2326 section 10.12), RTCP is on the odd channels.
+// Returns the bytes used. A frame cut short by the end of the read is moved to the start of the receive buffer
+// and completed by the next read, one too large for the buffer is skipped
+size_t RTSPSession::HandleInterleavedData(BYTE const* pData, size_t size)
+{
+    size_t offset = 0;
+    while ((offset < size) && (pData[offset] == '$'))
+    {
+        bool bHeader = ((size - offset) >= INTERLEAVED_HEADER_SIZE);
+        BYTE channel = bHeader ? pData[offset + 1] : 0;
+        size_t length = bHeader ? ((pData[offset + 2] << 8) | pData[offset + 3]) : 0;
+        size_t end = offset + INTERLEAVED_HEADER_SIZE + length;
+        if ((INTERLEAVED_HEADER_SIZE + length) > RTSP_BUFFER_SIZE)
+        {
+            m_tcpRxSkip = (end > size) ? (end - size) : 0;
+            offset = __min(end, size);
+            continue;
+        }
+        if (end > size)
+        {
+            m_tcpRxPending = size - offset;
+            memmove(m_pTcpRxBuff.get(), pData + offset, m_tcpRxPending);
+            return size;
+        }
+        if (channel & 1)
+        {
+            HandleReceiverReport(pData + offset + INTERLEAVED_HEADER_SIZE, length);
+        }
+        offset += INTERLEAVED_HEADER_SIZE + length;
+    }
+    return offset;
+}
+
+// Round trip time from the report blocks about our tracks (RFC 3550 section 6.4.1):
+// arrival time - LSR - DLSR, all in the middle 32 bits of the NTP time.
+void RTSPSession::HandleReceiverReport(BYTE const* pReport, size_t size)
+{
+    constexpr uint64_t ntpEpochAsFileTime = 94354848000000000;  // 1900-01-01 in 100ns units since 1601-01-01
+    constexpr size_t reportBlockSize = 24;
+    auto read32 = [](BYTE const* p) { return (uint32_t)((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]); };
+
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    uint64_t ntpTime = ((((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime) - ntpEpochAsFileTime;
+    uint32_t arrival = (uint32_t)(((ntpTime / 10000000) << 16) | ((((ntpTime % 10000000) << 16) / 10000000) & 0xFFFF));
+
+    // a compound packet, the report blocks follow the header of an RR or the sender info of an SR
+    size_t offset = 0;
+    while ((size - offset) >= 8)
+    {
+        auto pPacket = pReport + offset;
+        size_t length = ((size_t)((pPacket[2] << 8) | pPacket[3]) + 1) * 4;
+        if (length > (size - offset))
+        {
+            break;
+        }
+        size_t blockOffset = (pPacket[1] == 201) ? 8 : ((pPacket[1] == 200) ? 28 : length);
+        for (BYTE i = 0; (i < (pPacket[0] & 0x1F)) && ((blockOffset + reportBlockSize) <= length); i++, blockOffset += reportBlockSize)
+        {
+            auto pBlock = pPacket + blockOffset;
+            uint32_t ssrc = read32(pBlock), lsr = read32(pBlock + 16), dlsr = read32(pBlock + 20);
+            bool bOurs = std::any_of(m_tracks.begin(), m_tracks.end(), [ssrc](RtspTrack const& t) { return t.bSetup && (t.ssrc == ssrc); });
+            if (bOurs && lsr && ((arrival - lsr) > dlsr))
+            {
+                m_rttUs.Set(((uint64_t)(arrival - lsr - dlsr) * 1000000) >> 16);
+            }
+        }
+        offset += length;
+    }
+
+    // the stream sinks adapt to the loss and round trip time of their clients, each picks its own blocks
+    for (auto& track : m_tracks)
+    {
+        if (track.bSetup && track.bTcpTransport)
+        {
+            (void)track.spStreamer.as<INetworkMediaStreamSink>()->ProcessRtcpPacket(pReport, size);
+        }
+    }
+}
+
+// WWW-Authenticate headers for a 401 response. A stateless provider binds the nonce to the client address
+// so nothing needs to be remembered here; the nonce count replay check is best effort in that mode.
+// Otherwise the provider tracks every nonce it issues, so the session sends the same challenge again for a
+// minute rather than letting a client that keeps failing fill the provider's table.
+std::string RTSPSession::GetAuthChallenge()
+{
+    constexpr MFTIME challengeReuseTime = 60ll * 10000000;     // well within the provider's nonce lifetime
+
+    if (!m_spAuthProvider)
+    {
+        return std::string();
+    }
+    winrt::hstring curAuthSessionMsg;
+    HSTRING msg;
+    if (m_spStatelessAuthProvider)
+    {
+        winrt::check_hresult(m_spStatelessAuthProvider->GetNewAuthSessionMessageForClient(winrt::to_hstring(m_rtspClientAddr).c_str(), m_bAuthNonceStale, &msg));
+        winrt::attach_abi(curAuthSessionMsg, msg);
+        m_bAuthNonceStale = false;
+        return winrt::to_string(curAuthSessionMsg);
+    }
+    auto now = MFGetSystemTime();
+    if (!m_curAuthSessionMsg.empty() && ((now - m_curAuthSessionTime) < challengeReuseTime))
+    {
+        return m_curAuthSessionMsg;
+    }
+    winrt::check_hresult(m_spAuthProvider->GetNewAuthSessionMessage(&msg));
+    winrt::attach_abi(curAuthSessionMsg, msg);
+    m_curAuthSessionMsg = winrt::to_string(curAuthSessionMsg);
+    m_curAuthSessionTime = now;
+    return m_curAuthSessionMsg;
+}
+
 void RTSPSession::HandleCmdOPTIONS()
 {
     std::string Response = "RTSP/1.0 200 OK\r\nCSeq: " + m_strCSeq + "\r\n"
         + "Public: DESCRIBE, SETUP, TEARDOWN, PLAY, PAUSE\r\n\r\n";
 
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, winrt::to_hstring(__FUNCTION__) + L":Response:" + winrt::to_hstring(Response));
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
 
     SendToClient(Response);
 }
@@ -312,32 +615,24 @@ void RTSPSession::HandleCmdOPTIONS()
 void RTSPSession::HandleCmdDESCRIBE()
 {
     std::string   Response;
-    char   SDPBuf[1024];
     if (m_pRtspClient.get()->IsClientCertAuthenticated() || m_bAuthorizationReceived)
     {
-        InitUDPTransport();
-        std::string dest = m_rtspClientAddr + std::string(":") + std::to_string(m_localRTPPort);
-        m_spCurrentStreamer.as<INetworkMediaStreamSink>()->GenerateSDP((uint8_t*)SDPBuf, 1024, winrt::to_hstring(dest).c_str());
+        u_short localRTPPort, localRTCPPort;
+        InitUDPTransport(RTP_FIRST_LOCAL_PORT, localRTPPort, localRTCPPort);
+        std::string dest = m_rtspClientAddr + std::string(":") + std::to_string(localRTPPort);
+        auto sdp = GenerateSessionSDP(dest);
 
         Response = "RTSP/1.0 200 OK\r\nCSeq: " + m_strCSeq + "\r\n"
             + DateHeader() + "\r\n"
-            + "Content-Base: " + m_urlProto + "://" + m_urlHostPort + "\r\n"
-            + "Content-Length: " + std::to_string(strlen(SDPBuf)) + "\r\n\r\n"
-            + SDPBuf;
+            + "Content-Base: " + GetContentBase() + "\r\n"
+            + "Content-Length: " + std::to_string(sdp.size()) + "\r\n\r\n"
+            + sdp;
     }
     else
     {
         Response = "RTSP/1.0 401 Unauthorized\r\n"
             + std::string("CSeq: ") + m_strCSeq + "\r\n";
-        if (m_spAuthProvider)
-        {
-            winrt::hstring curAuthSessionMsg;
-            HSTRING msg;
-            winrt::check_hresult(m_spAuthProvider->GetNewAuthSessionMessage(&msg));
-            winrt::attach_abi(curAuthSessionMsg, msg);
-            m_curAuthSessionMsg = winrt::to_string(curAuthSessionMsg);
-            Response += m_curAuthSessionMsg;
-        }
+        Response += GetAuthChallenge();
         Response += std::string("Server: NightKing\r\n")
             + DateHeader() + "\r\n\r\n";
 
@@ -345,7 +640,7 @@ void RTSPSession::HandleCmdDESCRIBE()
     SendToClient(Response);
 
 #if (DBGLEVEL == 1)
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, winrt::to_hstring(__FUNCTION__) + L":Response:" + winrt::to_hstring(Response));
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
 #endif
 }
 
@@ -353,20 +648,50 @@ void RTSPSession::HandleCmdSETUP()
 {
     std::string Response;// [1024] ;
     std::string Transport;// [255] ;
-    if (m_pRtspClient.get()->IsClientCertAuthenticated() || m_bAuthorizationReceived)
+    if ((m_pRtspClient.get()->IsClientCertAuthenticated() || m_bAuthorizationReceived) && (m_trackIndex >= m_tracks.size()))
+    {
+        Response = "RTSP/1.0 404 Not Found\r\nCSeq: " + m_strCSeq + "\r\n"
+            + DateHeader() + "\r\n\r\n";
+    }
+    else if (m_pRtspClient.get()->IsClientCertAuthenticated() || m_bAuthorizationReceived)
     {
+        auto& track = m_tracks[m_trackIndex];
+        track.bSetup = true;
+        track.bTcpTransport = m_bTcpTransport;
+        // every track needs its own SSRC, derive one from the session ID unless the client asked for one
+        track.ssrc = m_ssrc ? m_ssrc : (m_rtspSessionID ^ (0x9E3779B9 * (m_trackIndex + 1)));
+        std::ostringstream ssrc;
+        ssrc << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << track.ssrc;
+
         // simulate SETUP server response
-        if (m_bTcpTransport)
+        if (track.bTcpTransport)
         {
-            InitTCPTransport();
-            Transport = "RTP/AVP/TCP;unicast;interleaved=0-1";
+            if (m_interleavedChannel >= 0)
+            {
+                track.rtpChannel = (BYTE)m_interleavedChannel;
+            }
+            InitTCPTransport(track);
+            Transport = "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(track.rtpChannel) + "-" + std::to_string(track.rtpChannel + 1)
+                + ";ssrc=" + ssrc.str();
         }
         else
         {
-            InitUDPTransport();
+            // keep clear of the ports picked for the other tracks
+            u_short startPort = RTP_FIRST_LOCAL_PORT;
+            for (auto& t : m_tracks)
+            {
+                if ((&t != &track) && t.bSetup && !t.bTcpTransport)
+                {
+                    startPort = __max(startPort, (u_short)(t.localRTCPPort + 1));
+                }
+            }
+            InitUDPTransport(startPort, track.localRTPPort, track.localRTCPPort);
+            track.clientRTPPort = m_clientRTPPort;
+            track.clientRTCPPort = m_clientRTCPPort;
             Transport = "RTP/AVP;unicast;destination=" + m_rtspClientAddr + ";source=127.0.0.1;client_port="
-                + std::to_string(m_clientRTPPort) + "-" + std::to_string(m_clientRTCPPort)
-                + ";server_port=" + std::to_string(m_localRTPPort) + "-" + std::to_string(m_localRTCPPort);
+                + std::to_string(track.clientRTPPort) + "-" + std::to_string(track.clientRTCPPort)
+                + ";server_port=" + std::to_string(track.localRTPPort) + "-" + std::to_string(track.localRTCPPort)
+                + ";ssrc=" + ssrc.str();
         }
         Response = "RTSP/1.0 200 OK\r\nCSeq: " + m_strCSeq + "\r\n"
             + DateHeader() + "\r\n"
@@ -377,23 +702,14 @@ void RTSPSession::HandleCmdSETUP()
     {
         Response = "RTSP/1.0 401 Unauthorized\r\n"
             + std::string("CSeq: ") + m_strCSeq + "\r\n";
-        if (m_spAuthProvider)
-        {
-            winrt::hstring curAuthSessionMsg;
-            HSTRING msg;
-            winrt::check_hresult(m_spAuthProvider->GetNewAuthSessionMessage(&msg));
-            winrt::attach_abi(curAuthSessionMsg, msg);
-            m_curAuthSessionMsg = winrt::to_string(curAuthSessionMsg);
-
-            Response += m_curAuthSessionMsg;
-        }
+        Response += GetAuthChallenge();
         Response += std::string("Server: NightKing\r\n")
             + DateHeader() + "\r\n\r\n";
     }
     SendToClient(Response);
 
 #if (DBGLEVEL == 1)
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, winrt::to_hstring(__FUNCTION__) + L":Response:" + winrt::to_hstring(Response));
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
 #endif
 }
 
@@ -401,76 +717,238 @@ void RTSPSession::StopIfStreaming()
 {
     if (m_bStreamingStarted)
     {
-        if (!m_dest.empty())
+        LogLatencyStats();
+        bool bInterleaved = false;
+        for (auto& track : m_tracks)
         {
-            m_spCurrentStreamer.as<INetworkMediaStreamSink>()->RemoveNetworkClient(winrt::to_hstring(m_dest).c_str());
-            m_dest.clear();
+            // the stream sink forgets the client, keep its packet counts
+            RTSPStreamMetrics m;
+            if (track.bSetup && GetClientStats(track, m))
+            {
+                track.spCounters->Add(m);
+                m_pServerCounters->streams.Add(m);
+            }
+            if (!track.dest.empty())
+            {
+                track.spStreamer.as<INetworkMediaStreamSink>()->RemoveNetworkClient(winrt::to_hstring(track.dest).c_str());
+                track.dest.clear();
+            }
+            else if (track.bSetup && track.packetHandler)
+            {
+                track.spStreamer.as<INetworkMediaStreamSink>()->RemoveTransportHandler(track.packetHandler.as<ABI::PacketHandler>().get());
+                bInterleaved = true;
+            }
         }
-        else if (m_packetHandler)
+
+        if (bInterleaved)
         {
-            m_spCurrentStreamer.as<INetworkMediaStreamSink>()->RemoveTransportHandler(m_packetHandler.as<ABI::PacketHandler>().get());
-            m_packetHandler = nullptr;
+            auto stats = m_pWriter->GetStats();
+            m_pLogger->Log(LogFormat::InterleavedStats, S_OK, m_rtspClientAddr, stats.packets, stats.writes, stats.bytesWritten,
+                stats.accessUnitsRefused, stats.maxBacklog);
         }
     }
     m_bStreamingStarted = false;
 }
 
+bool RTSPSession::GetClientStats(RtspTrack& track, RTSPStreamMetrics& m)
+{
+    NetworkStreamClientStats stats;
+    HRESULT hr;
+    memset(&m, 0, sizeof(m));
+    auto spStreamer = track.spStreamer.as<INetworkMediaStreamSink>();
+    if (!track.dest.empty())
+    {
+        hr = spStreamer->GetNetworkClientStats(winrt::to_hstring(track.dest).c_str(), &stats);
+    }
+    else if (track.bTcpTransport && track.packetHandler)
+    {
+        hr = spStreamer->GetTransportHandlerStats(track.packetHandler.as<ABI::PacketHandler>().get(), &stats);
+    }
+    else
+    {
+        return false;
+    }
+    if (SUCCEEDED(hr))
+    {
+        AddStreamMetrics(m, stats);
+    }
+    return SUCCEEDED(hr);
+}
+
+// Counters of the session and of each track. streaming gets the packets of the clients still streaming,
+// which the server has not added to its totals yet.
+void RTSPSession::GetMetrics(RTSPSessionMetrics& metrics, RTSPStreamMetrics& streaming)
+{
+    auto l = std::lock_guard(m_readDelegateMutex);
+    memset(&metrics, 0, sizeof(metrics));
+    memset(&streaming, 0, sizeof(streaming));
+    metrics.sessionId = m_rtspSessionID;
+    strncpy_s(metrics.clientAddress, m_rtspClientAddr.c_str(), _TRUNCATE);
+    metrics.bPlaying = m_bStreamingStarted;
+    metrics.requests = m_requestCounters.requests.Get();
+    metrics.authFailures = m_requestCounters.authFailures.Get();
+    metrics.requestLatencyTotalUs = m_requestCounters.requestLatencyTotalUs.Get();
+    metrics.requestLatencyMaxUs = m_requestCounters.requestLatencyMaxUs.Get();
+    metrics.rttUs = m_rttUs.Get();
+    metrics.trackCount = (uint32_t)__min(m_tracks.size(), (size_t)RTSP_METRICS_MAX_TRACKS);
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        RTSPStreamMetrics track, live;
+        m_tracks[i].spCounters->Snapshot(track);
+        if (m_bStreamingStarted && m_tracks[i].bSetup && GetClientStats(m_tracks[i], live))
+        {
+            AddStreamMetrics(track, live);
+            AddStreamMetrics(streaming, live);
+        }
+        if (i < RTSP_METRICS_MAX_TRACKS)
+        {
+            metrics.tracks[i] = track;
+        }
+        AddStreamMetrics(metrics.total, track);
+    }
+}
+
+// Latency percentiles of every streaming track, measured from the sample time
+void RTSPSession::LogLatencyStats()
+{
+    static const char* stageNames[] = { "arrival", "packetized", "first packet sent", "last packet sent" };
+    static_assert(ARRAYSIZE(stageNames) == (size_t)NetworkStreamLatencyStage::Count, "a latency stage has no name");
+    if (!m_pLogger->IsEnabled(LoggerType::OTHER))
+    {
+        return;
+    }
+    std::ostringstream logstring;
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        if (!m_tracks[i].bSetup)
+        {
+            continue;
+        }
+        logstring << "\nLatency trackID=" << i << " (us)";
+        auto spStreamer = m_tracks[i].spStreamer.as<INetworkMediaStreamSink>();
+        for (int stage = 0; stage < (int)NetworkStreamLatencyStage::Count; stage++)
+        {
+            NetworkStreamLatencyStats stats;
+            if (SUCCEEDED(spStreamer->GetLatencyStats((NetworkStreamLatencyStage)stage, &stats)) && stats.count)
+            {
+                logstring << "\n  " << stageNames[stage] << ": p50 " << stats.p50Us << " p99 " << stats.p99Us
+                    << " p999 " << stats.p999Us << " max " << stats.maxUs << " (" << stats.count << " samples)";
+            }
+        }
+        LONGLONG hnsOldest, hnsNewest;
+        uint64_t dropped;
+        auto spTimeshift = m_tracks[i].spStreamer.try_as<INetworkMediaStreamTimeshift>();
+        if (spTimeshift && SUCCEEDED(spTimeshift->GetTimeshiftRange(&hnsOldest, &hnsNewest, &dropped)))
+        {
+            logstring << "\n  timeshift: npt " << (hnsOldest / 10000000.0) << "-" << (hnsNewest / 10000000.0)
+                << " stored, " << dropped << " access units dropped";
+        }
+    }
+    if (logstring.tellp() > 0)
+    {
+        m_pLogger->Log(LogFormat::Text, S_OK, logstring.str());
+    }
+}
+
 void RTSPSession::HandleCmdPLAY()
 {
     std::string   Response;
     if (m_pRtspClient.get()->IsClientCertAuthenticated() || m_bAuthorizationReceived)
     {
+        std::string rtpInfo;
+        for (size_t i = 0; i < m_tracks.size(); i++)
+        {
+            if (m_tracks[i].bSetup)
+            {
+                rtpInfo += (rtpInfo.empty() ? "url=" : ",url=") + GetContentBase() + "trackID=" + std::to_string(i);
+            }
+        }
+        // a timeshift start is resolved to the IDR the players start from, which is the start the client is told.
+        // It is passed to the stream sinks in hns, those without a timeshift store stay live.
+        LONGLONG hnsTimeshiftStart = -1;
+        for (size_t i = 0; (m_nptStart > 0) && (i < m_tracks.size()) && (hnsTimeshiftStart < 0); i++)
+        {
+            auto spTimeshift = m_tracks[i].spStreamer.try_as<INetworkMediaStreamTimeshift>();
+            LONGLONG hnsStart;
+            if (m_tracks[i].bSetup && spTimeshift && SUCCEEDED(spTimeshift->GetTimeshiftStart((LONGLONG)(m_nptStart * 10000000), &hnsStart)))
+            {
+                hnsTimeshiftStart = __max(hnsStart, 0);
+            }
+        }
+        if ((m_nptStart > 0) && (hnsTimeshiftStart < 0))
+        {
+            // nothing stored to play from
+            m_requestError = "457 Invalid Range";
+            HandleRequestError();
+            return;
+        }
+
+        std::wstring timeshiftParam;
+        char range[64], scale[32];
+        sprintf_s(range, "npt=%.3f-", (hnsTimeshiftStart < 0) ? 0.0 : (hnsTimeshiftStart / 10000000.0));
+        sprintf_s(scale, "%.2f", m_scale);
+        if (hnsTimeshiftStart >= 0)
+        {
+            timeshiftParam = L"&npt=" + std::to_wstring(hnsTimeshiftStart) + L"&scale=" + std::to_wstring(m_scale);
+        }
         Response = "RTSP/1.0 200 OK\r\nCSeq: " + m_strCSeq + "\r\n"
             + DateHeader() + "\r\n"
-            + "Range: npt=0.000-\r\n"
+            + "Range: " + range + "\r\n"
+            + (((hnsTimeshiftStart >= 0) && (m_scale != 1)) ? ("Scale: " + std::string(scale) + "\r\n") : "")
             + "Session: " + std::to_string(m_rtspSessionID) + "\r\n"
-            + "RTP-Info: url=" + m_urlProto + "://" + m_urlHostPort + "\r\n\r\n";
+            + "RTP-Info: " + rtpInfo + "\r\n\r\n";
 
         SendToClient(Response);
         StopIfStreaming();
-        if (m_bTcpTransport)
-        {
-            winrt::hstring param = L"ssrc=" + winrt::to_hstring(m_ssrc);
-            m_spCurrentStreamer.as<INetworkMediaStreamSink>()->AddTransportHandler(m_packetHandler.as<ABI::PacketHandler>().get(), L"rtp", param.c_str());
-        }
-        else
+        std::string logstring = "\nAdding destination : ";
+        for (size_t i = 0; i < m_tracks.size(); i++)
         {
-            std::string dest = m_rtspClientAddr + std::string(":") + std::to_string(m_clientRTPPort);
-            m_dest = dest;
-            winrt::hstring param = L"ssrc=" + winrt::to_hstring(m_ssrc) + L"&localrtpport=" + winrt::to_hstring(m_localRTPPort);
-            m_spCurrentStreamer.as<INetworkMediaStreamSink>()->AddNetworkClient(winrt::to_hstring(dest).c_str(), L"rtp", param.c_str());
+            auto& track = m_tracks[i];
+            if (!track.bSetup)
+            {
+                continue;
+            }
+            if (track.bTcpTransport)
+            {
+                winrt::hstring param = L"ssrc=" + winrt::to_hstring(track.ssrc) + timeshiftParam;
+                track.spStreamer.as<INetworkMediaStreamSink>()->AddTransportHandler(track.packetHandler.as<ABI::PacketHandler>().get(), L"rtp", param.c_str());
+                logstring += "tcp://" + m_rtspClientAddr + "/" + std::to_string(track.rtpChannel) + " ";
+            }
+            else
+            {
+                track.dest = m_rtspClientAddr + std::string(":") + std::to_string(track.clientRTPPort);
+                winrt::hstring param = L"ssrc=" + winrt::to_hstring(track.ssrc) + L"&localrtpport=" + winrt::to_hstring(track.localRTPPort) + timeshiftParam;
+                track.spStreamer.as<INetworkMediaStreamSink>()->AddNetworkClient(winrt::to_hstring(track.dest).c_str(), L"rtp", param.c_str());
+                logstring += track.dest + " ";
+            }
         }
         m_bStreamingStarted = true;
 
-        std::string logstring = "\nAdding destination : ";
-        if (!m_dest.empty())
-            logstring += m_dest;
-        else
-            logstring += "tcp://" + m_rtspClientAddr;
-
-        m_pLoggerEvents[(int)LoggerType::OTHER](S_OK, winrt::to_hstring(logstring));
+        m_pLogger->Log(LogFormat::Text, S_OK, logstring);
     }
     else
     {
         Response = "RTSP/1.0 401 Unauthorized\r\n"
             + std::string("CSeq: ") + m_strCSeq + "\r\n";
 
-        if (m_spAuthProvider)
-        {
-            winrt::hstring curAuthSessionMsg;
-            HSTRING msg;
-            winrt::check_hresult(m_spAuthProvider->GetNewAuthSessionMessage(&msg));
-            winrt::attach_abi(curAuthSessionMsg, msg);
-            m_curAuthSessionMsg = winrt::to_string(curAuthSessionMsg);
-            Response += m_curAuthSessionMsg;
-        }
+        Response += GetAuthChallenge();
         Response += std::string("Server: NightKing\r\n")
             + DateHeader() + "\r\n\r\n";
 
         SendToClient(Response);
     }
 
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, winrt::to_hstring(__FUNCTION__) + L":Response:" + winrt::to_hstring(Response));
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
+}
+
+// A request the parser could not use, answered with the status it chose and otherwise ignored
+void RTSPSession::HandleRequestError()
+{
+    std::string Response = "RTSP/1.0 " + m_requestError + "\r\nCSeq: " + m_strCSeq + "\r\n"
+        + DateHeader() + "\r\n\r\n";
+    SendToClient(Response);
+
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
 }
 
 void RTSPSession::HandleCmdTEARDOWN()
@@ -490,13 +968,52 @@ void RTSPSession::Handle_RtspPAUSE()
         SendToClient(Response);
     StopIfStreaming();
 
-    m_pLoggerEvents[(int)LoggerType::RTSPMSGS](S_OK, winrt::to_hstring(__FUNCTION__) + L":Response:" + winrt::to_hstring(Response));
+    m_pLogger->Log(LogFormat::ResponseSent, S_OK, __FUNCTION__, Response);
+
+}
+
+// Session level lines of the first stream sink's SDP followed by the media section of every stream sink,
+// each with a control URL relative to the Content-Base
+std::string RTSPSession::GenerateSessionSDP(std::string const& dest)
+{
+    char SDPBuf[1024];
+    std::string sdp;
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        winrt::check_hresult(m_tracks[i].spStreamer.as<INetworkMediaStreamSink>()->GenerateSDP((uint8_t*)SDPBuf, sizeof(SDPBuf), winrt::to_hstring(dest).c_str()));
+        std::string trackSdp(SDPBuf);
+        auto mediaPos = trackSdp.find("m=");
+        if (mediaPos == std::string::npos)
+        {
+            continue;
+        }
+        if (sdp.empty())
+        {
+            sdp = trackSdp.substr(0, mediaPos) + "a=control:*\n";
+        }
+        // the window a PLAY Range can start in, open ended since the stream is live
+        LONGLONG hnsOldest, hnsNewest;
+        uint64_t dropped;
+        auto spTimeshift = m_tracks[i].spStreamer.try_as<INetworkMediaStreamTimeshift>();
+        if (spTimeshift && (sdp.find("a=range:") == std::string::npos) && SUCCEEDED(spTimeshift->GetTimeshiftRange(&hnsOldest, &hnsNewest, &dropped)))
+        {
+            char range[64];
+            sprintf_s(range, "a=range:npt=%.3f-\n", __max(hnsOldest, 0) / 10000000.0);
+            sdp.insert(sdp.find("a=control:*\n"), range);
+        }
+        sdp += trackSdp.substr(mediaPos) + "a=control:trackID=" + std::to_string(i) + "\n";
+    }
+    return sdp;
+}
 
+std::string RTSPSession::GetContentBase()
+{
+    return m_urlProto + "://" + m_urlHostPort + m_urlSuffix + (((!m_urlSuffix.empty()) && (m_urlSuffix.back() == '/')) ? "" : "/");
 }
 
 void RTSPSession::SendToClient(std::string Response)
 {
-    m_pRtspClient->Send((BYTE*)Response.c_str(), (int)Response.length());
+    m_pWriter->WriteMessage((BYTE*)Response.c_str(), Response.length());
 }
 
 char const* RTSPSession::DateHeader()
@@ -518,13 +1035,14 @@ void RTSPSession::BeginSession(winrt::delegate<RTSPSession*> completed)
 {
     m_sessionCompleted = completed;
     m_rtspReadEvent.attach(WSACreateEvent());      // create READ wait event for our RTSP client socket
-    WSAEventSelect(m_pRtspClient->GetSocket(), m_rtspReadEvent.get(), FD_READ | FD_CLOSE);   // select socket read event
+    WSAEventSelect(m_pRtspClient->GetSocket(), m_rtspReadEvent.get(), FD_READ | FD_WRITE | FD_CLOSE);   // select socket read/write events
     RegisterWaitForSingleObject(m_callBackHandle.put(), m_rtspReadEvent.get(), [](PVOID arg, BOOLEAN flag)
         {
             auto pSession = (RTSPSession*)arg;
             try
             {
-                WSAResetEvent(pSession->m_rtspReadEvent.get());
+                WSANETWORKEVENTS networkEvents = { 0 };
+                WSAEnumNetworkEvents(pSession->m_pRtspClient->GetSocket(), pSession->m_rtspReadEvent.get(), &networkEvents);
                 auto l = std::lock_guard(pSession->m_readDelegateMutex);
                 if (!pSession->m_callBackHandle)
                 {
@@ -532,22 +1050,34 @@ void RTSPSession::BeginSession(winrt::delegate<RTSPSession*> completed)
                     return;
                 }
 
+                if (networkEvents.lNetworkEvents & FD_WRITE)
+                {
+                    // socket buffer has room again, send what the writer kept back
+                    pSession->m_pWriter->Drain();
+                }
+                if (!(networkEvents.lNetworkEvents & (FD_READ | FD_CLOSE)))
+                {
+                    return;
+                }
+
+                // appended to the start of an interleaved frame kept from the last read
                 char* pRecvBuf = (char*)pSession->m_pTcpRxBuff.get();
+                size_t pending = pSession->m_tcpRxPending;
+                pSession->m_tcpRxPending = 0;
 
                 RTSP_CMD rtspCmd = RTSP_CMD::UNKNOWN;
-                int res = pSession->m_pRtspClient->Recv((BYTE*)pRecvBuf, RTSP_BUFFER_SIZE);
+                int res = pSession->m_pRtspClient->Recv((BYTE*)pRecvBuf + pending, (int)(RTSP_BUFFER_SIZE - pending));
                 if (res > 0)
                 {
-                    rtspCmd = pSession->HandleRequest(pRecvBuf, res);
+                    // the rest of a frame too large for the buffer
+                    size_t skip = __min(pSession->m_tcpRxSkip, pending + res);
+                    pSession->m_tcpRxSkip -= skip;
+                    pRecvBuf += skip;
+                    size_t size = pending + res - skip;
+                    rtspCmd = size ? pSession->HandleRequest(pRecvBuf, (unsigned)size) : RTSP_CMD::INTERLEAVED;
                     if (rtspCmd == RTSP_CMD::UNKNOWN)
                     {
-                        std::ostringstream logstring;
-                        logstring << "\nUnhandled Request ignored : size =" << res << "\nDump:";
-                        for (int i = 0; i < res; i++)
-                        {
-                            logstring << " 0x" << std::hex << ((uint32_t)(uint8_t)pRecvBuf[i]);
-                        }
-                        pSession->m_pLoggerEvents[(int)LoggerType::WARNINGS](S_OK, winrt::to_hstring(logstring.str()));
+                        pSession->m_pLogger->Log(LogFormat::UnhandledRequest, S_OK, (int)size, LogBytes{ (const BYTE*)pRecvBuf, size });
                     }
                 }
 
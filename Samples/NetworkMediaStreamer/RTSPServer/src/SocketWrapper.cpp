@@ -3,22 +3,88 @@
 
 #include <pch.h>
 
-CSocketWrapper::CSocketWrapper(SOCKET connectedSocket, winrt::array_view<PCCERT_CONTEXT> aCertContext /*= empty vector*/)
-    : m_bIsSecure(!aCertContext.empty())
+CTlsServerCredential::CTlsServerCredential(winrt::array_view<PCCERT_CONTEXT> aCertContext, DWORD dwSessionLifespanMs /*= TLS_SESSION_LIFESPAN_MS*/)
+    : m_hCred({ 0 })
+    , m_cbMaxToken(0)
+    , m_fullHandshakes(0)
+    , m_resumedHandshakes(0)
+    , m_fullHandshakeCycles(0)
+    , m_resumedHandshakeCycles(0)
+{
+    TimeStamp Lifetime;
+    PSecPkgInfo pPkgInfo = nullptr;
+    winrt::check_hresult(QuerySecurityPackageInfo((LPWSTR)g_lpPackageName, &pPkgInfo));
+    m_cbMaxToken = pPkgInfo->cbMaxToken;
+    FreeContextBuffer(pPkgInfo);
+
+    SCHANNEL_CRED credData;
+    ZeroMemory(&credData, sizeof(credData));
+    credData.dwVersion = SCHANNEL_CRED_VERSION;
+    credData.cCreds = (DWORD)aCertContext.size();
+    credData.paCred = aCertContext.data();
+    credData.dwCredFormat = SCH_CRED_FORMAT_CERT_HASH;
+    credData.dwSessionLifespan = dwSessionLifespanMs;
+
+    winrt::check_hresult(AcquireCredentialsHandle(
+        NULL,
+        g_lpPackageName,
+        SECPKG_CRED_INBOUND,
+        NULL,
+        &credData,
+        NULL,
+        NULL,
+        &m_hCred,
+        &Lifetime));
+}
+
+CTlsServerCredential::~CTlsServerCredential()
+{
+    FreeCredentialsHandle(&m_hCred);
+}
+
+void CTlsServerCredential::RecordHandshake(bool bResumed, uint64_t cycles)
+{
+    if (bResumed)
+    {
+        m_resumedHandshakes++;
+        m_resumedHandshakeCycles += cycles;
+    }
+    else
+    {
+        m_fullHandshakes++;
+        m_fullHandshakeCycles += cycles;
+    }
+}
+
+TlsHandshakeStats CTlsServerCredential::GetStats()
+{
+    return { m_fullHandshakes, m_resumedHandshakes, m_fullHandshakeCycles, m_resumedHandshakeCycles };
+}
+
+CSocketWrapper::CSocketWrapper(SOCKET connectedSocket, std::shared_ptr<CTlsServerCredential> spCredential /*= nullptr*/)
+    : m_bIsSecure(spCredential != nullptr)
     , m_socket(connectedSocket)
-    , m_hCred({ 0 })
+    , m_spCredential(spCredential)
     , m_hCtxt({ 0,0 })
-    , m_aCertContext(aCertContext)
     , m_secPkgContextStrmSizes({ 0 })
     , m_bufSz(0)
     , m_readEvent(WSA_INVALID_EVENT)
     , m_callBackHandle(nullptr)
     , m_bIsAuthenticated(false)
+    , m_bIsSessionResumed(false)
+    , m_handshakeCycles(0)
 {
     if (m_bIsSecure)
     {
         InitializeSecurity();
 
+        SecPkgContext_SessionInfo sessionInfo = { 0 };
+        if (SEC_SUCCESS(QueryContextAttributes(&m_hCtxt, SECPKG_ATTR_SESSION_INFO, &sessionInfo)))
+        {
+            m_bIsSessionResumed = (sessionInfo.dwFlags & SSL_SESSION_RECONNECT) != 0;
+        }
+        m_spCredential->RecordHandshake(m_bIsSessionResumed, m_handshakeCycles);
+
         winrt::check_hresult(QueryContextAttributes(
             &m_hCtxt,
             SECPKG_ATTR_STREAM_SIZES,
@@ -40,6 +106,10 @@ CSocketWrapper::CSocketWrapper(SOCKET connectedSocket, winrt::array_view<PCCERT_
 CSocketWrapper::~CSocketWrapper()
 {
     //TODO: need to handle secure socket shutdown message to client
+    if (m_hCtxt.dwLower || m_hCtxt.dwUpper)
+    {
+        DeleteSecurityContext(&m_hCtxt);
+    }
 }
 
 void CSocketWrapper::ReadDelegate(PVOID arg, BOOLEAN flag)
@@ -80,8 +150,10 @@ void CSocketWrapper::ReadDelegate(PVOID arg, BOOLEAN flag)
             InSecBuff[1].BufferType = SECBUFFER_EMPTY;
             InSecBuff[1].pvBuffer = nullptr;
             bool bFirstHandshake = !(pSock->m_hCtxt.dwLower || pSock->m_hCtxt.dwUpper);
+            ULONG64 cyclesStart = 0, cyclesEnd = 0;
+            QueryThreadCycleTime(GetCurrentThread(), &cyclesStart);
             pSock->m_securityStatus = AcceptSecurityContext(
-                &pSock->m_hCred,
+                pSock->m_spCredential->GetHandle(),
                 bFirstHandshake ? NULL : &pSock->m_hCtxt,
                 &InBuffDesc,
                 Attribs,
@@ -90,6 +162,8 @@ void CSocketWrapper::ReadDelegate(PVOID arg, BOOLEAN flag)
                 &OutBuffDesc,
                 &Attribs,
                 &tokenLifetime);
+            QueryThreadCycleTime(GetCurrentThread(), &cyclesEnd);
+            pSock->m_handshakeCycles += (cyclesEnd - cyclesStart);
 
             if (InSecBuff[1].BufferType == SECBUFFER_EXTRA)
             {
@@ -122,35 +196,11 @@ void CSocketWrapper::ReadDelegate(PVOID arg, BOOLEAN flag)
 
 void CSocketWrapper::InitializeSecurity()
 {
-    TimeStamp Lifetime;
-    PSecPkgInfo pPkgInfo = nullptr;
-    winrt::check_hresult(QuerySecurityPackageInfo((LPWSTR)g_lpPackageName, &pPkgInfo));
-
-    auto maxTokenSz = pPkgInfo->cbMaxToken;
-    m_bufSz = pPkgInfo->cbMaxToken;
-    m_pInBuf = std::make_unique<BYTE[]>(pPkgInfo->cbMaxToken);
-    m_pOutBuf = std::make_unique<BYTE[]>(pPkgInfo->cbMaxToken);
-    FreeContextBuffer(pPkgInfo);
+    m_bufSz = m_spCredential->GetMaxTokenSize();
+    m_pInBuf = std::make_unique<BYTE[]>(m_bufSz);
+    m_pOutBuf = std::make_unique<BYTE[]>(m_bufSz);
 
     // Perform Handshake
-    SCHANNEL_CRED credData;
-    ZeroMemory(&credData, sizeof(credData));
-    credData.dwVersion = SCHANNEL_CRED_VERSION;
-    credData.cCreds = (DWORD)m_aCertContext.size();
-    credData.paCred = m_aCertContext.data();
-    credData.dwCredFormat = SCH_CRED_FORMAT_CERT_HASH;
-
-    winrt::check_hresult(AcquireCredentialsHandle(
-        NULL,
-        g_lpPackageName,
-        SECPKG_CRED_INBOUND,
-        NULL,
-        &credData,
-        NULL,
-        NULL,
-        &m_hCred,
-        &Lifetime));
-
     m_readEvent.attach(WSACreateEvent());      // create READ wait event for our RTSP client socket
     if (!m_readEvent) // == WSA_INVALID_EVENT
     {
@@ -270,6 +320,66 @@ int CSocketWrapper::Send(BYTE* buf, int sz)
 
 }
 
+// Appends the bytes to put on the wire for buf: TLS records of at most cbMaximumMessage bytes each on a
+// secure socket, buf itself otherwise. Records are encrypted in place in the output vector.
+void CSocketWrapper::Encode(const BYTE* buf, size_t sz, std::vector<BYTE>& wire)
+{
+    if (!m_bIsSecure)
+    {
+        wire.insert(wire.end(), buf, buf + sz);
+        return;
+    }
+
+    while (sz > 0)
+    {
+        auto chunk = (ULONG)__min(sz, (size_t)m_secPkgContextStrmSizes.cbMaximumMessage);
+        auto offset = wire.size();
+        wire.resize(offset + m_secPkgContextStrmSizes.cbHeader + chunk + m_secPkgContextStrmSizes.cbTrailer);
+
+        SecBufferDesc BuffDesc;
+        SecBuffer SecBuff[4];
+
+        BuffDesc.ulVersion = SECBUFFER_VERSION;
+        BuffDesc.cBuffers = 4;
+        BuffDesc.pBuffers = SecBuff;
+
+        SecBuff[0].cbBuffer = m_secPkgContextStrmSizes.cbHeader;
+        SecBuff[0].BufferType = SECBUFFER_STREAM_HEADER;
+        SecBuff[0].pvBuffer = wire.data() + offset;
+
+        SecBuff[1].cbBuffer = chunk;
+        SecBuff[1].BufferType = SECBUFFER_DATA;
+        SecBuff[1].pvBuffer = (BYTE*)SecBuff[0].pvBuffer + SecBuff[0].cbBuffer;
+
+        SecBuff[2].cbBuffer = m_secPkgContextStrmSizes.cbTrailer;
+        SecBuff[2].BufferType = SECBUFFER_STREAM_TRAILER;
+        SecBuff[2].pvBuffer = (BYTE*)SecBuff[1].pvBuffer + SecBuff[1].cbBuffer;
+
+        SecBuff[3].cbBuffer = 0;
+        SecBuff[3].BufferType = SECBUFFER_EMPTY;
+        SecBuff[3].pvBuffer = nullptr;
+
+        memcpy_s(SecBuff[1].pvBuffer, chunk, buf, chunk);
+
+        winrt::check_win32(EncryptMessage(
+            &m_hCtxt,
+            0,
+            &BuffDesc,
+            0));
+
+        // the trailer can be shorter than the maximum
+        wire.resize(offset + SecBuff[0].cbBuffer + SecBuff[1].cbBuffer + SecBuff[2].cbBuffer);
+        buf += chunk;
+        sz -= chunk;
+    }
+}
+
+// Sends bytes produced by Encode(). Returns the number of bytes the socket took or SOCKET_ERROR.
+int CSocketWrapper::SendEncoded(const BYTE* buf, int sz)
+{
+    return send(m_socket, (const char*)buf, sz, 0);
+}
+
 bool CSocketWrapper::AuthenticateClient()
 {
     DWORD cbUserName = 0;
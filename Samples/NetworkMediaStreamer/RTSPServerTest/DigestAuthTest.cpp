@@ -0,0 +1,215 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "DigestAuth.h"
+#include "RTSPServerTest.h"
+
+namespace
+{
+    struct DigestVector
+    {
+        const char* name;
+        DigestAlgorithm algorithm;
+        const char* header;                                     // Authorization header sent by the client
+        const char* password;
+        const char* method;
+    };
+
+    // RFC 2617 section 3.5 and RFC 7616 section 3.9.1, all with qop=auth
+    const DigestVector digestVectors[] =
+    {
+        { "RFC 2617 MD5", DigestAlgorithm::MD5,
+            "Authorization: Digest username=\"Mufasa\", realm=\"testrealm@host.com\", nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", "
+            "uri=\"/dir/index.html\", qop=auth, nc=00000001, cnonce=\"0a4f113b\", response=\"6629fae49393a05397450978507c4ef1\", "
+            "opaque=\"5ccc069c403ebaf9f0171e9517f40e41\"",
+            "Circle Of Life", "GET" },
+        { "RFC 7616 MD5", DigestAlgorithm::MD5,
+            "Authorization: Digest username=\"Mufasa\", realm=\"http-auth@example.org\", uri=\"/dir/index.html\", algorithm=MD5, "
+            "nonce=\"7ypf/xlj9XXwfDPEoM4URrv/xwf94BcCAzFZH4GiTo0v\", nc=00000001, cnonce=\"f2/wE4q74E6zIJEtWaHKaf5wv/H5QzzpXusqGemxURZJ\", "
+            "qop=auth, response=\"8ca523f5e9506fed4657c9700eebdbec\", opaque=\"FQhe/qaU925kfnzjCev0ciny7QMkPqMAFRtzCUYo5tdS\"",
+            "Circle of Life", "GET" },
+        { "RFC 7616 SHA-256", DigestAlgorithm::SHA256,
+            "Authorization: Digest username=\"Mufasa\", realm=\"http-auth@example.org\", uri=\"/dir/index.html\", algorithm=SHA-256, "
+            "nonce=\"7ypf/xlj9XXwfDPEoM4URrv/xwf94BcCAzFZH4GiTo0v\", nc=00000001, cnonce=\"f2/wE4q74E6zIJEtWaHKaf5wv/H5QzzpXusqGemxURZJ\", "
+            "qop=auth, response=\"753927fa0e85d155564e2e272a28d1802ca10daf4496794697cf8db5856cb6c1\", "
+            "opaque=\"FQhe/qaU925kfnzjCev0ciny7QMkPqMAFRtzCUYo5tdS\"",
+            "Circle of Life", "GET" },
+    };
+
+    // What the auth provider does for a response: parse the header, then compute and compare the response
+    bool VerifyVector(DigestVector const& vector, std::string_view header)
+    {
+        AuthHeaderParams params;
+        if (!ParseAuthHeader(header, params) || (params.scheme != "Digest"))
+        {
+            return false;
+        }
+        auto ha1 = DigestHex(vector.algorithm, params.username, ":", params.realm, ":", vector.password);
+        auto expected = ComputeDigestResponse(vector.algorithm, ha1, params.nonce, params.nc, params.cnonce, params.qop, vector.method, params.uri);
+        return FixedTimeEquals(params.response, expected);
+    }
+
+    bool TestHashes()
+    {
+        struct HashVector
+        {
+            DigestAlgorithm algorithm;
+            std::string input;
+            const char* digest;
+        };
+        const HashVector hashVectors[] =
+        {
+            { DigestAlgorithm::MD5, "", "d41d8cd98f00b204e9800998ecf8427e" },
+            { DigestAlgorithm::MD5, "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a" },
+            { DigestAlgorithm::SHA256, "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+            { DigestAlgorithm::SHA256, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        };
+        bool bPassed = true;
+        for (auto const& vector : hashVectors)
+        {
+            auto digest = DigestHex(vector.algorithm, vector.input);
+            if (digest != vector.digest)
+            {
+                std::cout << "Hash of \"" << vector.input << "\" is " << digest << ", expected " << vector.digest << "\n";
+                bPassed = false;
+            }
+        }
+        // RFC 4231 test case 2
+        auto mac = HmacSha256("Jefe", "what do ya want for nothing?");
+        if (ToHexString(mac.data(), mac.size()) != "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843")
+        {
+            std::cout << "HMAC-SHA256 differs from RFC 4231 test case 2\n";
+            bPassed = false;
+        }
+        return bPassed;
+    }
+
+    bool TestResponses()
+    {
+        bool bPassed = true;
+        for (auto const& vector : digestVectors)
+        {
+            std::string header = vector.header;
+            if (!VerifyVector(vector, header))
+            {
+                std::cout << vector.name << ": the response does not verify\n";
+                bPassed = false;
+            }
+            // a response differing in its last digit, or cut short, must not verify
+            auto responsePos = header.find("response=\"") + 10;
+            auto tampered = header;
+            auto end = tampered.find('\"', responsePos) - 1;
+            tampered[end] = (tampered[end] == '0') ? '1' : '0';
+            auto truncated = header;
+            truncated.erase(end, 1);
+            if (VerifyVector(vector, tampered) || VerifyVector(vector, truncated))
+            {
+                std::cout << vector.name << ": a wrong response verifies\n";
+                bPassed = false;
+            }
+        }
+        return bPassed;
+    }
+
+    bool TestNonceTable()
+    {
+        bool bPassed = true;
+        auto check = [&bPassed](bool bCondition, const char* description)
+        {
+            if (!bCondition)
+            {
+                std::cout << "Nonce table: " << description << "\n";
+                bPassed = false;
+            }
+        };
+        uint32_t lastNonceCount = 0;
+
+        CNonceTable table(100, 8, 2);
+        table.Track("a", "", 0);
+        check(table.Find("a", 50, &lastNonceCount) && (lastNonceCount == 0), "a tracked nonce is not found");
+        check(table.Accept("a", 1) && !table.Accept("a", 1) && table.Accept("a", 3), "the nonce count is not checked");
+        check(table.Find("a", 100, &lastNonceCount) && (lastNonceCount == 3), "the last nonce count is not kept");
+        check(!table.Find("a", 101, &lastNonceCount) && (table.Size() == 0), "an expired nonce is found");
+        check(!table.Accept("b", 1), "a nonce never tracked is accepted");
+
+        // a flood of nonces never verified evicts the others of its kind, not the verified ones
+        table.Track("verified", "", 1000);
+        table.Accept("verified", 1);
+        for (int i = 0; i < 100; i++)
+        {
+            table.Track("flood" + std::to_string(i), "", 1000 + i / 10);
+        }
+        check(table.Size() == 8, "the table is not capped");
+        check(table.Find("verified", 1050, &lastNonceCount), "a verified nonce is evicted by unverified ones");
+        check(table.Find("flood99", 1050, &lastNonceCount) && !table.Find("flood91", 1050, &lastNonceCount), "the oldest nonce is not the one evicted");
+
+        // a peer only replaces its own nonces
+        CNonceTable peers(100, 8, 2);
+        peers.Track("other", "10.0.0.2", 0);
+        for (int i = 0; i < 10; i++)
+        {
+            peers.Track("peer" + std::to_string(i), "10.0.0.1", i);
+        }
+        check(peers.Size() == 3, "a peer has more nonces than its cap");
+        check(peers.Find("other", 10, &lastNonceCount) && peers.Find("peer9", 10, &lastNonceCount) && peers.Find("peer8", 10, &lastNonceCount),
+            "a peer evicts the nonces of another one");
+        return bPassed;
+    }
+
+    // Responses verified per second, the HA1 cached as the provider does, and nonces tracked per second with a
+    // full table
+    void MeasureThroughput()
+    {
+        constexpr int verifications = 100000;
+        for (auto const& vector : digestVectors)
+        {
+            AuthHeaderParams params;
+            ParseAuthHeader(vector.header, params);
+            auto ha1 = DigestHex(vector.algorithm, params.username, ":", params.realm, ":", vector.password);
+            std::string header = vector.header;
+            int verified = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < verifications; i++)
+            {
+                ParseAuthHeader(header, params);
+                auto expected = ComputeDigestResponse(vector.algorithm, ha1, params.nonce, params.nc, params.cnonce, params.qop, vector.method, params.uri);
+                verified += FixedTimeEquals(params.response, expected) ? 1 : 0;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << vector.name << ": " << (int64_t)(verified / seconds) << " responses verified/s\n";
+        }
+
+        constexpr int64_t lifetime = 5ll * 60 * 10000000;
+        constexpr int nonces = 1000000;
+        CNonceTable table(lifetime, 4096, 16);
+        std::vector<std::string> values(nonces);
+        for (int i = 0; i < nonces; i++)
+        {
+            values[i] = ToHexString((const uint8_t*)&i, sizeof(i)) + std::string(40, 'f');
+        }
+        uint32_t lastNonceCount = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nonces; i++)
+        {
+            table.Track(values[i], "", i);
+            table.Find(values[i], i, &lastNonceCount);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Nonce table: " << (int64_t)(nonces / seconds) << " nonces tracked and looked up/s, " << table.Size() << " tracked\n";
+    }
+}
+
+bool RunDigestAuthTests(bool bBenchmark)
+{
+    bool bPassed = TestHashes() && TestResponses() && TestNonceTable();
+    std::cout << "Digest auth: " << (bPassed ? "passed" : "FAILED") << "\n";
+    if (bPassed && bBenchmark)
+    {
+        MeasureThroughput();
+    }
+    return bPassed;
+}
@@ -0,0 +1,475 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "InterleavedQueue.h"
+#include "RTSPServerTest.h"
+
+namespace
+{
+#ifdef _WIN32
+    typedef SOCKET TestSocket;
+    const TestSocket invalidSocket = INVALID_SOCKET;
+    void CloseSocket(TestSocket s) { closesocket(s); }
+    bool WouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+    typedef int TestSocket;
+    const TestSocket invalidSocket = -1;
+    void CloseSocket(TestSocket s) { close(s); }
+    bool WouldBlock() { return (errno == EAGAIN) || (errno == EWOULDBLOCK); }
+#endif
+
+    constexpr size_t packetSize = 1400;                         // RTP packet, header included
+    constexpr size_t rtpHeaderSize = 12;
+    constexpr uint8_t rtpChannel = 0;
+    constexpr uint8_t rtcpChannel = 1;
+    constexpr uint32_t rtcpInterval = 30;                       // access units between two RTCP packets
+
+    // RTP packet of an access unit: the marker bit on its last packet, the access unit in the timestamp and
+    // the index of the packet in the payload, so the receiver can tell a complete access unit
+    void FillPacket(uint8_t* pPacket, size_t size, uint16_t sequenceNumber, uint32_t accessUnit, uint32_t index, bool bMarker)
+    {
+        memset(pPacket, 0, size);
+        pPacket[0] = 0x80;
+        pPacket[1] = (uint8_t)(96 | (bMarker ? 0x80 : 0));
+        pPacket[2] = (uint8_t)(sequenceNumber >> 8);
+        pPacket[3] = (uint8_t)sequenceNumber;
+        for (int i = 0; i < 4; i++)
+        {
+            pPacket[4 + i] = (uint8_t)(accessUnit >> (24 - 8 * i));
+            pPacket[rtpHeaderSize + i] = (uint8_t)(index >> (24 - 8 * i));
+        }
+    }
+
+    uint32_t ReadUint32(const uint8_t* p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    // Parses the interleaved byte stream as it comes and checks that every access unit on the RTP channel
+    // is complete and in order: the access units refused by the sender are skipped as a whole
+    class CInterleavedReceiver
+    {
+    public:
+        // False at the first frame that breaks the rules
+        bool Receive(const uint8_t* pData, size_t size)
+        {
+            m_buffer.insert(m_buffer.end(), pData, pData + size);
+            size_t offset = 0;
+            while ((m_buffer.size() - offset) >= INTERLEAVED_HEADER_SIZE)
+            {
+                const uint8_t* pFrame = m_buffer.data() + offset;
+                size_t length = ((size_t)pFrame[2] << 8) | pFrame[3];
+                if (pFrame[0] != '$')
+                {
+                    return Fail("a frame does not start with $");
+                }
+                if ((m_buffer.size() - offset) < (INTERLEAVED_HEADER_SIZE + length))
+                {
+                    break;
+                }
+                if (!OnFrame(pFrame[1], pFrame + INTERLEAVED_HEADER_SIZE, length))
+                {
+                    return false;
+                }
+                offset += INTERLEAVED_HEADER_SIZE + length;
+            }
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + offset);
+            return true;
+        }
+
+        bool IsIdle() const { return m_buffer.empty() && !m_bInAccessUnit; }
+        uint64_t AccessUnits() const { return m_accessUnits; }
+        uint64_t RtcpPackets() const { return m_rtcpPackets; }
+        const char* Error() const { return m_pError; }
+
+    private:
+        bool Fail(const char* pError)
+        {
+            m_pError = pError;
+            return false;
+        }
+
+        bool OnFrame(uint8_t channel, const uint8_t* pPacket, size_t size)
+        {
+            if (channel == rtcpChannel)
+            {
+                m_rtcpPackets++;
+                return true;
+            }
+            if ((channel != rtpChannel) || (size < rtpHeaderSize + 4))
+            {
+                return Fail("a frame has an unknown channel or is too short");
+            }
+            uint32_t accessUnit = ReadUint32(pPacket + 4);
+            uint32_t index = ReadUint32(pPacket + rtpHeaderSize);
+            if (m_bInAccessUnit ? ((accessUnit != m_accessUnit) || (index != m_nextIndex))
+                : ((index != 0) || (m_accessUnits && (accessUnit <= m_accessUnit))))
+            {
+                return Fail("an access unit is incomplete or out of order");
+            }
+            m_accessUnit = accessUnit;
+            m_nextIndex = index + 1;
+            m_bInAccessUnit = !(pPacket[1] & 0x80);
+            if (!m_bInAccessUnit)
+            {
+                m_accessUnits++;
+            }
+            return true;
+        }
+
+        std::vector<uint8_t> m_buffer;
+        bool m_bInAccessUnit = false;
+        uint32_t m_accessUnit = 0;
+        uint32_t m_nextIndex = 0;
+        uint64_t m_accessUnits = 0;
+        uint64_t m_rtcpPackets = 0;
+        const char* m_pError = nullptr;
+    };
+
+    // Plain interleaved frames, no TLS
+    auto plainEncode = [](const uint8_t* pData, size_t size, std::vector<uint8_t>& wire)
+    {
+        wire.insert(wire.end(), pData, pData + size);
+    };
+
+    // The queue against a transport taking at most capacity bytes per send, then blocking
+    bool TestQueue()
+    {
+        bool bPassed = true;
+        auto check = [&bPassed](bool bCondition, const char* description)
+        {
+            if (!bCondition)
+            {
+                std::cout << "Interleaved queue: " << description << "\n";
+                bPassed = false;
+            }
+        };
+        CInterleavedReceiver receiver;
+        int64_t capacity = INT64_MAX;
+        uint64_t sends = 0;
+        auto send = [&](const uint8_t* pData, size_t size) -> int64_t
+        {
+            sends++;
+            int64_t taken = (int64_t)size < capacity ? (int64_t)size : capacity;
+            if (taken < 0)
+            {
+                return -1;
+            }
+            capacity -= taken;
+            receiver.Receive(pData, (size_t)taken);
+            return taken;
+        };
+
+        std::vector<uint8_t> packet(packetSize);
+        uint16_t sequenceNumber = 0;
+        CInterleavedQueue queue(8 * packetSize);
+        auto writeAccessUnit = [&](uint32_t accessUnit, uint32_t packets, bool bRtcpInside)
+        {
+            bool bAccepted = true;
+            for (uint32_t i = 0; (i < packets) && bAccepted; i++)
+            {
+                FillPacket(packet.data(), packet.size(), sequenceNumber++, accessUnit, i, i == (packets - 1));
+                bAccepted = queue.WritePacket(rtpChannel, packet.data(), packet.size(), false, i == (packets - 1), plainEncode, send);
+                if (bRtcpInside && (i == 0))
+                {
+                    queue.WritePacket(rtcpChannel, packet.data(), 64, true, false, plainEncode, send);
+                }
+            }
+            return bAccepted;
+        };
+
+        // one send per access unit, RTCP inside it rides along
+        check(writeAccessUnit(1, 10, true) && (sends == 1) && (queue.Stats().packets == 11), "an access unit is not written with one send");
+        check((receiver.AccessUnits() == 1) && (receiver.RtcpPackets() == 1) && receiver.IsIdle(), "the frames of an access unit are not received");
+
+        // RTCP between access units goes out at once
+        queue.WritePacket(rtcpChannel, packet.data(), 64, true, false, plainEncode, send);
+        check((sends == 2) && (receiver.RtcpPackets() == 2), "RTCP between access units is held");
+
+        // a blocked transport fills the backlog; an open access unit is finished, the next one is refused
+        capacity = 0;
+        check(writeAccessUnit(2, 4, false), "an access unit is refused before the backlog is full");
+        check(writeAccessUnit(3, 6, false) && (queue.Backlog() >= 8 * packetSize), "an access unit is cut once the backlog fills up");
+        check(!writeAccessUnit(4, 2, false) && (queue.Stats().accessUnitsRefused == 1), "an access unit is not refused with a full backlog");
+
+        // the receiver gets everything queued once the transport takes it again, a byte at a time included
+        capacity = 100;
+        queue.Drain(send);
+        capacity = INT64_MAX;
+        queue.Drain(send);
+        check((queue.Backlog() == 0) && writeAccessUnit(5, 3, false), "the backlog is not drained");
+        check((receiver.AccessUnits() == 4) && receiver.IsIdle() && !receiver.Error(), "the access units around a refused one are not received whole");
+
+        // a transport error discards everything, and the next packets are refused
+        capacity = -1;
+        writeAccessUnit(6, 1, false);
+        check(queue.IsBroken() && (queue.Backlog() == 0) && !writeAccessUnit(7, 1, false), "a transport error does not discard the queue");
+        return bPassed;
+    }
+
+    // Connected TCP sockets on the loopback interface, the sending one non blocking
+    void OpenLoopbackPair(TestSocket& sender, TestSocket& receiver)
+    {
+        TestSocket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrSize = sizeof(addr);
+        if ((listener == invalidSocket) || (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0) || (listen(listener, 1) != 0)
+            || (getsockname(listener, (sockaddr*)&addr, &addrSize) != 0))
+        {
+            throw std::runtime_error("cannot listen on the loopback interface");
+        }
+        sender = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if ((sender == invalidSocket) || (connect(sender, (sockaddr*)&addr, sizeof(addr)) != 0))
+        {
+            CloseSocket(listener);
+            throw std::runtime_error("cannot connect on the loopback interface");
+        }
+        receiver = accept(listener, nullptr, nullptr);
+        CloseSocket(listener);
+        int noDelay = 1;
+        setsockopt(sender, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(sender, FIONBIO, &nonBlocking);
+#endif
+    }
+
+    int64_t SendNonBlocking(TestSocket s, const uint8_t* pData, size_t size, uint64_t& sends)
+    {
+        sends++;
+#ifdef _WIN32
+        int sent = send(s, (const char*)pData, (int)size, 0);
+#else
+        auto sent = send(s, pData, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+#endif
+        if (sent < 0)
+        {
+            return WouldBlock() ? 0 : -1;
+        }
+        return sent;
+    }
+
+    void WaitWritable(TestSocket s)
+    {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(s, &writable);
+        timeval timeout = { 1, 0 };
+        select((int)s + 1, nullptr, &writable, nullptr, &timeout);
+    }
+
+    struct LoopbackResult
+    {
+        uint64_t accessUnits;                                   // complete access units received
+        uint64_t refused;
+        uint64_t sends;
+        uint64_t packets;
+        uint64_t bytes;
+        double seconds;
+        const char* pError;
+    };
+
+    // Sends accessUnits access units of accessUnitSize bytes, plus RTCP, from a thread to a receiving one,
+    // which with bHoldReader only starts reading once they are all offered. With bCoalesce they go through the
+    // queue, which only waits for the socket between access units when bWait is set, otherwise each frame is
+    // one send as before it.
+    LoopbackResult RunLoopback(uint32_t accessUnits, size_t accessUnitSize, bool bCoalesce, bool bWait, size_t maxBacklog, bool bHoldReader)
+    {
+        TestSocket sender = invalidSocket, receiverSocket = invalidSocket;
+        OpenLoopbackPair(sender, receiverSocket);
+        LoopbackResult result = {};
+
+        CInterleavedReceiver receiver;
+        std::atomic<bool> bReading(!bHoldReader);
+        std::thread receiveThread([&]()
+            {
+                std::vector<uint8_t> buf(256 * 1024);
+                while (!bReading)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                for (;;)
+                {
+                    auto received = recv(receiverSocket, (char*)buf.data(), (int)buf.size(), 0);
+                    if ((received <= 0) || !receiver.Receive(buf.data(), (size_t)received))
+                    {
+                        break;
+                    }
+                }
+            });
+
+        uint64_t sends = 0;
+        bool bBroken = false;
+        auto send = [&](const uint8_t* pData, size_t size) { return SendNonBlocking(sender, pData, size, sends); };
+        auto sendAll = [&](const uint8_t* pData, size_t size)
+        {
+            while (size && !bBroken)
+            {
+                auto sent = send(pData, size);
+                bBroken = (sent < 0);
+                if (sent <= 0)
+                {
+                    WaitWritable(sender);
+                    continue;
+                }
+                pData += sent;
+                size -= (size_t)sent;
+            }
+        };
+
+        CInterleavedQueue queue(maxBacklog);
+        std::vector<uint8_t> packet(packetSize);
+        std::vector<uint8_t> frame(INTERLEAVED_HEADER_SIZE + packetSize);
+        uint32_t packetsPerAccessUnit = (uint32_t)((accessUnitSize + packetSize - 1) / packetSize);
+        uint16_t sequenceNumber = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t au = 0; (au < accessUnits) && !bBroken; au++)
+        {
+            if (bCoalesce && bWait)
+            {
+                while ((queue.Backlog() >= maxBacklog) && !queue.IsBroken())
+                {
+                    WaitWritable(sender);
+                    queue.Drain(send);
+                }
+            }
+            for (uint32_t i = 0; i < packetsPerAccessUnit; i++)
+            {
+                bool bMarker = (i == (packetsPerAccessUnit - 1));
+                FillPacket(packet.data(), packet.size(), sequenceNumber++, au, i, bMarker);
+                if (!bCoalesce)
+                {
+                    frame[0] = '$';
+                    frame[1] = rtpChannel;
+                    frame[2] = (uint8_t)(packetSize >> 8);
+                    frame[3] = (uint8_t)packetSize;
+                    memcpy(frame.data() + INTERLEAVED_HEADER_SIZE, packet.data(), packetSize);
+                    sendAll(frame.data(), frame.size());
+                }
+                else if (!queue.WritePacket(rtpChannel, packet.data(), packet.size(), false, bMarker, plainEncode, send))
+                {
+                    break;
+                }
+                result.packets++;
+                result.bytes += packetSize;
+            }
+            if (bCoalesce && !(au % rtcpInterval))
+            {
+                queue.WritePacket(rtcpChannel, packet.data(), 64, true, false, plainEncode, send);
+            }
+        }
+        bReading = true;
+        while (bCoalesce && queue.Backlog() && !queue.IsBroken())
+        {
+            WaitWritable(sender);
+            queue.Drain(send);
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef _WIN32
+        shutdown(sender, SD_SEND);
+#else
+        shutdown(sender, SHUT_WR);
+#endif
+        receiveThread.join();
+        CloseSocket(sender);
+        CloseSocket(receiverSocket);
+
+        result.accessUnits = receiver.AccessUnits();
+        result.refused = queue.Stats().accessUnitsRefused;
+        result.sends = sends;
+        result.pError = receiver.Error();
+        if (!result.pError && (bBroken || queue.IsBroken()))
+        {
+            result.pError = "the socket failed";
+        }
+        else if (!result.pError && !receiver.IsIdle())
+        {
+            result.pError = "the stream ends inside an access unit";
+        }
+        else if (!result.pError && (result.accessUnits + result.refused != accessUnits))
+        {
+            result.pError = "access units are missing";
+        }
+        return result;
+    }
+
+    // A reader that falls behind makes the queue refuse access units, and the ones it takes still arrive whole.
+    // The access units are more than the socket buffers hold, so some are refused.
+    bool TestBackpressure()
+    {
+        auto result = RunLoopback(2000, 60000, true, false, 256 * 1024, true);
+        if (result.pError || !result.refused)
+        {
+            std::cout << "Interleaved loopback backpressure: " << (result.pError ? result.pError : "no access unit was refused") << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void PrintLoopback(const char* pName, LoopbackResult const& result)
+    {
+        std::cout << std::fixed << std::setprecision(2) << "Interleaved loopback, " << pName << ": "
+            << ((result.bytes * 8) / result.seconds / 1e9) << " Gbit/s, " << (result.packets / result.seconds / 1e3) << "k packets/s, "
+            << ((double)result.sends / result.packets) << " sends/packet" << (result.pError ? ", FAILED: " : "") << (result.pError ? result.pError : "") << "\n";
+    }
+}
+
+bool RunInterleavedTests(bool bBenchmark)
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(0x202, &wsaData);
+#endif
+    bool bPassed = false;
+    try
+    {
+        bPassed = TestQueue() && TestBackpressure();
+        if (bPassed && bBenchmark)
+        {
+            // 1080p30 at 8 Mbit/s has access units of about 33 KB, and a 4K IDR is a few hundred KB
+            for (size_t accessUnitSize : { (size_t)33000, (size_t)300000 })
+            {
+                std::cout << "Access units of " << accessUnitSize << " bytes\n";
+                auto perPacket = RunLoopback(20000, accessUnitSize, false, true, INTERLEAVED_MAX_BACKLOG, false);
+                auto coalesced = RunLoopback(20000, accessUnitSize, true, true, INTERLEAVED_MAX_BACKLOG, false);
+                PrintLoopback("a send per frame", perPacket);
+                PrintLoopback("coalesced per access unit", coalesced);
+                bPassed = bPassed && !perPacket.pError && !coalesced.pError;
+            }
+        }
+    }
+    catch (std::exception const& ex)
+    {
+        std::cout << "Interleaved loopback: " << ex.what() << "\n";
+        bPassed = false;
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    std::cout << "Interleaved writer: " << (bPassed ? "passed" : "FAILED") << "\n";
+    return bPassed;
+}
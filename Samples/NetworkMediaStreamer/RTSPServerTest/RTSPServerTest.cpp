@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+// Tests and benchmarks of the portable cores of the RTSP server, the pieces that have no Windows dependency,
+// so they can be checked without a camera, Media Foundation or a client. It builds on any platform, e.g.
+//   g++ -O2 -std=c++17 -Wall -Wextra -pthread -I../RTSPServer/inc *.cpp -o RTSPServerTest
+
+#include <iostream>
+#include <string>
+#include "RTSPServerTest.h"
+
+int main(int argc, char* argv[])
+{
+    bool bBenchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-benchmark")
+        {
+            bBenchmark = true;
+        }
+        else
+        {
+            std::cout << "Usage: RTSPServerTest [-benchmark]\n";
+            return 2;
+        }
+    }
+
+    bool bPassed = RunDigestAuthTests(bBenchmark);
+    bPassed = RunInterleavedTests(bBenchmark) && bPassed;
+    return bPassed ? 0 : 1;
+}
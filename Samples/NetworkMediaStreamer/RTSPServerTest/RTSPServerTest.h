@@ -0,0 +1,8 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for more information
+
+#pragma once
+
+// Each returns false if a check fails, and with bBenchmark also logs its throughput
+bool RunDigestAuthTests(bool bBenchmark);
+bool RunInterleavedTests(bool bBenchmark);
@@ -0,0 +1,40 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Tests and benchmarks of the frame processing of the media source, the pieces that only depend on the C++
+// standard library, so they can be checked and measured without Windows, a camera or the TAEF tests of
+// VirtualCameraTest. It builds on any platform, e.g. from Samples/VirtualCamera
+//   g++ -O2 -std=c++17 -Wall -Wextra -pthread -mavx2 -IVirtualCameraMediaSource FrameProcessingTest/*.cpp
+//       VirtualCameraMediaSource/TestPattern.cpp VirtualCameraMediaSource/PixelConverter.cpp
+//       VirtualCameraMediaSource/RowParallelExecutor.cpp VirtualCameraMediaSource/ImageScaler.cpp -o FrameProcessingTest
+// GCC and Clang only build the SSE4.1 and AVX2 kernels of the converter for targets that have them: -msse4.1 and
+// -mavx2 check one set each.
+
+#include <cstdio>
+#include <string>
+#include "FrameProcessingTest.h"
+
+int main(int argc, char* argv[])
+{
+    bool bBenchmark = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "-benchmark")
+        {
+            bBenchmark = true;
+        }
+        else
+        {
+            std::printf("Usage: FrameProcessingTest [-benchmark]\n");
+            return 2;
+        }
+    }
+
+    bool bPassed = RunTestPatternTests(bBenchmark);
+    bPassed = RunPixelConverterTests(bBenchmark) && bPassed;
+    bPassed = RunRowParallelExecutorTests(bBenchmark) && bPassed;
+    bPassed = RunImageScalerTests(bBenchmark) && bPassed;
+    std::printf(bPassed ? "All checks passed\n" : "FAILED\n");
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#include <chrono>
+
+// Each returns false if a check fails, and with bBenchmark also logs its throughput
+bool RunTestPatternTests(bool bBenchmark);
+bool RunPixelConverterTests(bool bBenchmark);
+bool RunRowParallelExecutorTests(bool bBenchmark);
+bool RunImageScalerTests(bool bBenchmark);
+
+inline double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
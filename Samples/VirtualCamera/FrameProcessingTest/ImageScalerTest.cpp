@@ -0,0 +1,283 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "ImageScaler.h"
+#include "FrameProcessingTest.h"
+
+namespace
+{
+    const ScaleFilter allFilters[] = { ScaleFilter::Box, ScaleFilter::Bilinear, ScaleFilter::Lanczos2 };
+    const char* const filterNames[] = { "box", "bilinear", "Lanczos2" };
+    const char* const formatNames[] = { "NV12", "I420" };
+
+    double SmoothPattern(double x, double y)
+    {
+        // x and y in frame widths and heights: 10 horizontal and 7.5 vertical periods, far below the Nyquist frequency at 360p
+        const double pi = 3.14159265358979323846;
+        return 128.0 + 60.0 * std::sin(2 * pi * 10 * x) * std::cos(2 * pi * 7.5 * y);
+    }
+
+    void RenderSmoothPattern(uint32_t width, uint32_t height, std::vector<uint8_t>& frame)
+    {
+        frame.assign((size_t)width * height * 3 / 2, 128);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                frame[(size_t)y * width + x] = (uint8_t)std::lround(SmoothPattern((x + 0.5) / width, (y + 0.5) / height));
+            }
+        }
+    }
+
+    // Y plane against the pattern at the center of each destination pixel in the source
+    double Psnr(std::vector<uint8_t> const& frame, uint32_t width, uint32_t height, ScaleRect const& crop, uint32_t srcWidth, uint32_t srcHeight)
+    {
+        double scaleX = (double)crop.width / width;
+        double scaleY = (double)crop.height / height;
+        double sum = 0;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                double expected = SmoothPattern((crop.x + (x + 0.5) * scaleX) / srcWidth, (crop.y + (y + 0.5) * scaleY) / srcHeight);
+                double error = frame[(size_t)y * width + x] - expected;
+                sum += error * error;
+            }
+        }
+        double mse = std::max<double>(sum / ((double)width * height), 1e-10);
+        return 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+
+    // The SIMD kernels give the same bytes as the C++ ones, and so do the tiles scaled in any order with another workspace
+    bool TestSimdAndTiles()
+    {
+        // downscales, upscales, widths with and without a remainder for the C++ kernels, sources narrower than the SIMD taps
+        const uint32_t sizes[][4] = { { 1920, 1080, 640, 360 }, { 3840, 2160, 320, 180 }, { 640, 360, 1920, 1080 }, { 640, 480, 640, 360 },
+            { 64, 48, 30, 22 }, { 10, 6, 4, 2 }, { 2, 2, 6, 6 } };
+
+        std::mt19937 random(42);
+        bool bPassed = true;
+        for (auto& size : sizes)
+        {
+            uint32_t srcWidth = size[0], srcHeight = size[1], dstWidth = size[2], dstHeight = size[3];
+            int32_t srcStride = srcWidth + 16;
+            int32_t dstStride = dstWidth + 8;
+            std::vector<uint8_t> src((size_t)srcStride * srcHeight * 3 / 2);
+            for (auto& b : src)
+            {
+                b = (uint8_t)random();
+            }
+
+            // the whole frame and its center
+            const ScaleRect crops[] = { { 0, 0, 0, 0 }, { (srcWidth / 4) & ~1u, (srcHeight / 4) & ~1u, (srcWidth / 2) & ~1u, (srcHeight / 2) & ~1u } };
+            for (auto& crop : crops)
+            {
+                for (auto format : { ScaleFormat::NV12, ScaleFormat::I420 })
+                {
+                    for (auto filter : allFilters)
+                    {
+                        ImageScalerSettings settings = { format, srcWidth, srcHeight, crop, dstWidth, dstHeight, filter };
+                        ImageScaler simd, reference;
+                        if (!simd.Initialize(settings, true) || !reference.Initialize(settings, false))
+                        {
+                            if (crop.width == 0)
+                            {
+                                std::printf("ImageScaler: %ux%u to %ux%u does not initialize\n", srcWidth, srcHeight, dstWidth, dstHeight);
+                                bPassed = false;
+                            }
+                            continue;
+                        }
+
+                        std::vector<uint8_t> expected((size_t)dstStride * dstHeight * 3 / 2), actual(expected.size()), tiled(expected.size());
+                        reference.Scale(src.data(), srcStride, expected.data(), dstStride);
+                        simd.Scale(src.data(), srcStride, actual.data(), dstStride);
+
+                        // last tile first, with another workspace
+                        ImageScaler::Workspace workspace;
+                        for (uint32_t tile = simd.TileCount(); tile > 0; tile--)
+                        {
+                            simd.ScaleTiles(src.data(), srcStride, tiled.data(), dstStride, tile - 1, tile, &workspace);
+                        }
+
+                        auto mismatch = std::mismatch(actual.begin(), actual.end(), expected.begin());
+                        auto tileMismatch = std::mismatch(tiled.begin(), tiled.end(), expected.begin());
+                        if ((mismatch.first != actual.end()) || (tileMismatch.first != tiled.end()))
+                        {
+                            std::printf("ImageScaler: %ux%u (crop %ux%u) to %ux%u, %s, %s: byte %d of the SIMD output, %d of the tiles differ\n",
+                                srcWidth, srcHeight, crop.width, crop.height, dstWidth, dstHeight, formatNames[(int)format], filterNames[(int)filter],
+                                (int)(mismatch.first - actual.begin()), (int)(tileMismatch.first - tiled.begin()));
+                            bPassed = false;
+                        }
+                    }
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    // Without scaling every filter gives the source pixels back, chroma included, for the whole frame and for a crop
+    bool TestIdentity()
+    {
+        const uint32_t width = 640, height = 480;
+        const ScaleRect crops[] = { { 0, 0, width, height }, { 100, 60, 320, 240 } };
+        std::mt19937 random(7);
+        std::vector<uint8_t> src(width * height * 3 / 2);
+        for (auto& b : src)
+        {
+            b = (uint8_t)random();
+        }
+
+        bool bPassed = true;
+        for (auto& crop : crops)
+        {
+            for (auto filter : allFilters)
+            {
+                for (auto format : { ScaleFormat::NV12, ScaleFormat::I420 })
+                {
+                    for (bool bUseSimd : { false, true })
+                    {
+                        std::vector<uint8_t> dst(crop.width * crop.height * 3 / 2);
+                        ImageScaler scaler;
+                        if (!scaler.Initialize({ format, width, height, crop, crop.width, crop.height, filter }, bUseSimd))
+                        {
+                            std::printf("ImageScaler: the %ux%u crop does not initialize\n", crop.width, crop.height);
+                            return false;
+                        }
+                        scaler.Scale(src.data(), width, dst.data(), crop.width);
+
+                        // Y rows, then chroma rows: full width UV or half width U and V
+                        uint32_t chromaSize = (format == ScaleFormat::NV12) ? crop.width : crop.width / 2;
+                        uint32_t chromaStride = (format == ScaleFormat::NV12) ? width : width / 2;
+                        uint32_t chromaX = (format == ScaleFormat::NV12) ? crop.x : crop.x / 2;
+                        uint32_t chromaPlanes = (format == ScaleFormat::NV12) ? 1 : 2;
+                        bool bSame = true;
+                        for (uint32_t y = 0; y < crop.height; y++)
+                        {
+                            bSame &= std::equal(dst.begin() + y * crop.width, dst.begin() + (y + 1) * crop.width, src.begin() + (crop.y + y) * width + crop.x);
+                        }
+                        for (uint32_t plane = 0; plane < chromaPlanes; plane++)
+                        {
+                            auto dstPlane = dst.begin() + crop.width * crop.height + plane * chromaSize * crop.height / 2;
+                            auto srcPlane = src.begin() + width * height + plane * chromaStride * height / 2;
+                            for (uint32_t y = 0; y < crop.height / 2; y++)
+                            {
+                                bSame &= std::equal(dstPlane + y * chromaSize, dstPlane + (y + 1) * chromaSize, srcPlane + (crop.y / 2 + y) * chromaStride + chromaX);
+                            }
+                        }
+                        if (!bSame)
+                        {
+                            std::printf("ImageScaler: %s, %s%s: the %ux%u crop at 1x is not the source region\n",
+                                filterNames[(int)filter], formatNames[(int)format], bUseSimd ? "" : ", C++ kernels", crop.width, crop.height);
+                            bPassed = false;
+                        }
+                    }
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    // PSNR of the Y plane against the smooth pattern it was rendered from, a floor for each filter
+    bool TestQuality(bool bBenchmark)
+    {
+        const double minPsnr = 40.0;
+        // downscales, upscale and a 2x digital zoom of the center
+        const struct { uint32_t srcWidth, srcHeight; ScaleRect crop; uint32_t dstWidth, dstHeight; } cases[] =
+        {
+            { 1920, 1080, { 0, 0, 1920, 1080 }, 640, 360 },
+            { 1920, 1080, { 0, 0, 1920, 1080 }, 1280, 720 },
+            { 640, 360, { 0, 0, 640, 360 }, 1280, 720 },
+            { 1280, 720, { 320, 180, 640, 360 }, 1280, 720 },
+        };
+
+        bool bPassed = true;
+        for (auto filter : allFilters)
+        {
+            for (auto& c : cases)
+            {
+                std::vector<uint8_t> src, dst(c.dstWidth * c.dstHeight * 3 / 2);
+                RenderSmoothPattern(c.srcWidth, c.srcHeight, src);
+
+                ImageScaler scaler;
+                if (!scaler.Initialize({ ScaleFormat::NV12, c.srcWidth, c.srcHeight, c.crop, c.dstWidth, c.dstHeight, filter }))
+                {
+                    std::printf("ImageScaler: %ux%u to %ux%u does not initialize\n", c.srcWidth, c.srcHeight, c.dstWidth, c.dstHeight);
+                    return false;
+                }
+                scaler.Scale(src.data(), c.srcWidth, dst.data(), c.dstWidth);
+
+                double psnr = Psnr(dst, c.dstWidth, c.dstHeight, c.crop, c.srcWidth, c.srcHeight);
+                if (psnr < minPsnr)
+                {
+                    std::printf("ImageScaler: %s, %ux%u (crop %ux%u) to %ux%u: PSNR %.1f dB, expected %.1f dB or more\n",
+                        filterNames[(int)filter], c.srcWidth, c.srcHeight, c.crop.width, c.crop.height, c.dstWidth, c.dstHeight, psnr, minPsnr);
+                    bPassed = false;
+                }
+                else if (bBenchmark)
+                {
+                    std::printf("ImageScaler: %s, %ux%u (crop %ux%u) to %ux%u: PSNR %.1f dB\n",
+                        filterNames[(int)filter], c.srcWidth, c.srcHeight, c.crop.width, c.crop.height, c.dstWidth, c.dstHeight, psnr);
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    // Time per frame of the SIMD and C++ kernels, and of the SIMD kernels a tile at a time as a worker thread does
+    void Benchmark()
+    {
+        const uint32_t sizes[][4] = { { 1920, 1080, 640, 360 }, { 1920, 1080, 1280, 720 }, { 3840, 2160, 1920, 1080 }, { 1280, 720, 1920, 1080 } };
+        const uint32_t frames = 30;
+
+        for (auto& size : sizes)
+        {
+            uint32_t srcWidth = size[0], srcHeight = size[1], dstWidth = size[2], dstHeight = size[3];
+            std::vector<uint8_t> src, dst(dstWidth * dstHeight * 3 / 2);
+            RenderSmoothPattern(srcWidth, srcHeight, src);
+            for (auto filter : allFilters)
+            {
+                double msPerFrame[3] = {};
+                for (int run = 0; run < 3; run++)
+                {
+                    ImageScaler scaler;
+                    scaler.Initialize({ ScaleFormat::NV12, srcWidth, srcHeight, {}, dstWidth, dstHeight, filter }, run != 0);
+                    ImageScaler::Workspace workspace;
+                    auto start = std::chrono::steady_clock::now();
+                    for (uint32_t i = 0; i < frames; i++)
+                    {
+                        if (run < 2)
+                        {
+                            scaler.Scale(src.data(), srcWidth, dst.data(), dstWidth);
+                            continue;
+                        }
+                        for (uint32_t tile = 0; tile < scaler.TileCount(); tile++)
+                        {
+                            scaler.ScaleTiles(src.data(), srcWidth, dst.data(), dstWidth, tile, tile + 1, &workspace);
+                        }
+                    }
+                    msPerFrame[run] = SecondsSince(start) * 1000 / frames;
+                }
+                std::printf("ImageScaler: %s, %ux%u to %ux%u: %.2f ms per frame, %.2f ms with the C++ kernels, %.2f ms a tile at a time\n",
+                    filterNames[(int)filter], srcWidth, srcHeight, dstWidth, dstHeight, msPerFrame[1], msPerFrame[0], msPerFrame[2]);
+            }
+        }
+    }
+}
+
+bool RunImageScalerTests(bool bBenchmark)
+{
+    bool bPassed = TestSimdAndTiles();
+    bPassed = TestIdentity() && bPassed;
+    bPassed = TestQuality(bBenchmark) && bPassed;
+    if (bPassed && bBenchmark)
+    {
+        Benchmark();
+    }
+    return bPassed;
+}
@@ -0,0 +1,237 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "PixelConverter.h"
+#include "FrameProcessingTest.h"
+
+namespace
+{
+    const YUVFormat allFormats[] = { YUVFormat::NV12, YUVFormat::I420, YUVFormat::YUY2, YUVFormat::P010 };
+    const char* const formatNames[] = { "NV12", "I420", "YUY2", "P010" };
+    const YUVMatrix allMatrices[] = { YUVMatrix::BT601, YUVMatrix::BT709, YUVMatrix::BT2020 };
+    const char* const matrixNames[] = { "BT.601", "BT.709", "BT.2020" };
+    const YUVRange allRanges[] = { YUVRange::Limited, YUVRange::Full };
+    const char* const rangeNames[] = { "limited", "full" };
+
+    // The kernels the converter uses when asked for SIMD: MSVC picks them at run time, other compilers by the target flags
+    const char* SimdKernels()
+    {
+#if defined(_M_X64) || defined(_M_IX86)
+        return "SSE4.1 or AVX2, picked at run time";
+#elif defined(__AVX2__)
+        return "AVX2";
+#elif defined(__SSE4_1__)
+        return "SSE4.1";
+#elif defined(_M_ARM64) || defined(__ARM_NEON)
+        return "NEON";
+#else
+        return "none";
+#endif
+    }
+
+    size_t FrameSize(YUVFormat format, int32_t dstStride, uint32_t height)
+    {
+        return (size_t)dstStride * height * ((format == YUVFormat::YUY2) ? 2 : 3) / 2;
+    }
+
+    // Every format, matrix and range with SIMD gives the same bytes as the C++ kernels, and so do bands of rows.
+    // Strides are larger than the rows, and the bytes past them must stay untouched
+    bool TestBitExactness()
+    {
+        // widths with and without a remainder for the SIMD kernels
+        const uint32_t sizes[][2] = { { 2, 2 }, { 6, 4 }, { 18, 2 }, { 34, 6 }, { 638, 480 }, { 1920, 1080 } };
+
+        std::mt19937 random(42);
+        bool bPassed = true;
+        for (auto& size : sizes)
+        {
+            uint32_t width = size[0], height = size[1];
+            int32_t srcStride = width * 4 + 16;
+            std::vector<uint8_t> src((size_t)srcStride * height);
+            for (auto& b : src)
+            {
+                b = (uint8_t)random();
+            }
+
+            for (auto format : allFormats)
+            {
+                bool b16 = (format == YUVFormat::P010) || (format == YUVFormat::YUY2);
+                int32_t dstStride = (b16 ? width * 2 : width) + 8;
+                size_t cbDst = FrameSize(format, dstStride, height);
+
+                for (auto matrix : allMatrices)
+                {
+                    for (auto range : allRanges)
+                    {
+                        PixelConverter simd, reference;
+                        if (!simd.Initialize(matrix, range, true) || !reference.Initialize(matrix, range, false))
+                        {
+                            std::printf("PixelConverter: %s %s range does not initialize\n", matrixNames[(int)matrix], rangeNames[(int)range]);
+                            return false;
+                        }
+
+                        std::vector<uint8_t> simdOut(cbDst, 0xCD), referenceOut(cbDst, 0xCD), bandsOut(cbDst, 0xCD);
+                        bool bConverted = simd.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, simdOut.data(), cbDst, dstStride)
+                            && reference.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, referenceOut.data(), cbDst, dstStride);
+                        for (uint32_t row = 0; bConverted && (row < height); row += 4)
+                        {
+                            bConverted = simd.ConvertRowsFromRGB32(src.data(), src.size(), srcStride, width, height, format, bandsOut.data(), cbDst, dstStride,
+                                row, std::min(row + 4, height));
+                        }
+                        if (!bConverted)
+                        {
+                            std::printf("PixelConverter: %s %ux%u does not convert\n", formatNames[(int)format], width, height);
+                            return false;
+                        }
+
+                        for (auto* pOut : { &simdOut, &bandsOut })
+                        {
+                            auto mismatch = std::mismatch(pOut->begin(), pOut->end(), referenceOut.begin());
+                            if (mismatch.first != pOut->end())
+                            {
+                                std::printf("PixelConverter: %s %ux%u %s %s range%s: byte %d is %d, expected %d\n",
+                                    formatNames[(int)format], width, height, matrixNames[(int)matrix], rangeNames[(int)range],
+                                    (pOut == &bandsOut) ? " by bands" : "", (int)(mismatch.first - pOut->begin()), *mismatch.first, *mismatch.second);
+                                bPassed = false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    // Solid colors against the floating point definition of each matrix, within 1 of the rounding
+    bool TestReferenceColors()
+    {
+        const struct { YUVMatrix matrix; double kr; double kb; } matrices[] =
+        {
+            { YUVMatrix::BT601, 0.299, 0.114 },
+            { YUVMatrix::BT709, 0.2126, 0.0722 },
+            { YUVMatrix::BT2020, 0.2627, 0.0593 },
+        };
+        const uint8_t colors[][3] =
+        {
+            { 0, 0, 0 }, { 255, 255, 255 }, { 128, 128, 128 },
+            { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 },
+            { 255, 255, 0 }, { 0, 255, 255 }, { 255, 0, 255 }, { 12, 200, 97 },
+        };
+        const uint32_t width = 16, height = 2;
+
+        bool bPassed = true;
+        for (auto& m : matrices)
+        {
+            for (auto range : allRanges)
+            {
+                double yScale = (range == YUVRange::Full) ? 1.0 : 219.0 / 255.0;
+                double cScale = (range == YUVRange::Full) ? 1.0 : 224.0 / 255.0;
+                double yOffset = (range == YUVRange::Full) ? 0.0 : 16.0;
+                PixelConverter converter;
+                converter.Initialize(m.matrix, range);
+
+                for (auto& color : colors)
+                {
+                    uint8_t R = color[0], G = color[1], B = color[2];
+                    std::vector<uint8_t> src(width * height * 4), nv12(width * height * 3 / 2);
+                    for (size_t i = 0; i < src.size(); i += 4)
+                    {
+                        src[i] = B;
+                        src[i + 1] = G;
+                        src[i + 2] = R;
+                        src[i + 3] = 0xFF;
+                    }
+                    converter.ConvertFromRGB32(src.data(), src.size(), width * 4, width, height, YUVFormat::NV12, nv12.data(), nv12.size(), width);
+                    int Y = nv12[0], U = nv12[width * height], V = nv12[width * height + 1];
+
+                    double luma = m.kr * R + (1.0 - m.kr - m.kb) * G + m.kb * B;
+                    double expectedY = yOffset + yScale * luma;
+                    double expectedU = std::clamp(128.0 + cScale * (B - luma) / (2.0 * (1.0 - m.kb)), 0.0, 255.0);
+                    double expectedV = std::clamp(128.0 + cScale * (R - luma) / (2.0 * (1.0 - m.kr)), 0.0, 255.0);
+                    if ((std::abs(Y - expectedY) > 1.0) || (std::abs(U - expectedU) > 1.0) || (std::abs(V - expectedV) > 1.0))
+                    {
+                        std::printf("PixelConverter: RGB(%d, %d, %d) %s %s range: YUV(%d, %d, %d), expected (%.1f, %.1f, %.1f)\n",
+                            R, G, B, matrixNames[(int)m.matrix], rangeNames[(int)range], Y, U, V, expectedY, expectedU, expectedV);
+                        bPassed = false;
+                    }
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    void Benchmark()
+    {
+        const uint32_t sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        const uint32_t frames = 20;
+
+        std::printf("PixelConverter: SIMD kernels: %s\n", PixelConverter::IsSimdSupported() ? SimdKernels() : "none");
+        std::mt19937 random(42);
+        for (auto& size : sizes)
+        {
+            uint32_t width = size[0], height = size[1];
+            int32_t srcStride = width * 4;
+            std::vector<uint8_t> src((size_t)srcStride * height);
+            for (auto& b : src)
+            {
+                b = (uint8_t)random();
+            }
+
+            // memcpy of the RGB32 frame reads the same bytes and writes more, the bound of a converter limited by the memory
+            std::vector<uint8_t> copy(src.size());
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < frames; i++)
+            {
+                std::memcpy(copy.data(), src.data(), src.size());
+            }
+            double msCopy = SecondsSince(start) * 1000 / frames;
+
+            for (auto format : allFormats)
+            {
+                bool b16 = (format == YUVFormat::P010) || (format == YUVFormat::YUY2);
+                int32_t dstStride = b16 ? width * 2 : width;
+                size_t cbDst = FrameSize(format, dstStride, height);
+                std::vector<uint8_t> dst(cbDst);
+
+                double msPerFrame[2] = {};
+                for (int simd = 0; simd < 2; simd++)
+                {
+                    PixelConverter converter;
+                    converter.Initialize(YUVMatrix::BT709, YUVRange::Limited, simd != 0);
+                    start = std::chrono::steady_clock::now();
+                    for (uint32_t i = 0; i < frames; i++)
+                    {
+                        converter.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, dst.data(), cbDst, dstStride);
+                    }
+                    msPerFrame[simd] = SecondsSince(start) * 1000 / frames;
+                }
+
+                double gbPerFrame = (double)(src.size() + cbDst) / 1e9;
+                std::printf("PixelConverter: %s %ux%u: %.2f ms per frame (%.0f frames/s, %.1f GB/s), %.2f ms with the C++ kernels, %.2f ms for memcpy of the RGB32 frame\n",
+                    formatNames[(int)format], width, height, msPerFrame[1], 1000.0 / msPerFrame[1], gbPerFrame / (msPerFrame[1] / 1000.0), msPerFrame[0], msCopy);
+            }
+        }
+    }
+}
+
+bool RunPixelConverterTests(bool bBenchmark)
+{
+    if (!PixelConverter::IsSimdSupported())
+    {
+        std::printf("PixelConverter: no SIMD kernels in this build, the bit exactness check compares the C++ kernels with themselves\n");
+    }
+    bool bPassed = TestBitExactness();
+    bPassed = TestReferenceColors() && bPassed;
+    if (bPassed && bBenchmark)
+    {
+        Benchmark();
+    }
+    return bPassed;
+}
@@ -0,0 +1,150 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "PixelConverter.h"
+#include "RowParallelExecutor.h"
+#include "TestPattern.h"
+#include "FrameProcessingTest.h"
+
+namespace
+{
+    const uint32_t WIDTH = 3840;
+    const uint32_t HEIGHT = 2160;
+
+    // 1, 2, 4 and one thread per core, the count the media source uses
+    std::vector<uint32_t> ThreadCounts()
+    {
+        uint32_t cores = std::clamp<uint32_t>(std::thread::hardware_concurrency(), 1, RowParallelExecutor::MAX_THREADS);
+        std::vector<uint32_t> counts = { 1, 2, 4 };
+        if (std::find(counts.begin(), counts.end(), cores) == counts.end())
+        {
+            counts.push_back(cores);
+        }
+        return counts;
+    }
+
+    // Each band converts the rows it just rendered, while they are still in the cache, as SimpleFrameGenerator does
+    int32_t RenderAndConvert(RowParallelExecutor& executor, TestPattern const& pattern, PixelConverter const& converter,
+        uint64_t frameNumber, std::vector<uint8_t>& rgbFrame, std::vector<uint8_t>& nv12Frame)
+    {
+        return executor.Run(HEIGHT, RowParallelExecutor::BandRows(WIDTH * 4, 2), [&](uint32_t rowStart, uint32_t rowEnd)
+        {
+            pattern.RenderRows(frameNumber, 123456789, 0xFFFFFF, rgbFrame.data(), WIDTH * 4, rowStart, rowEnd);
+            bool bConverted = converter.ConvertRowsFromRGB32(rgbFrame.data(), rgbFrame.size(), WIDTH * 4, WIDTH, HEIGHT,
+                YUVFormat::NV12, nv12Frame.data(), nv12Frame.size(), WIDTH, rowStart, rowEnd);
+            return bConverted ? 0 : -1;
+        });
+    }
+
+    // Every row is in one band, and the failure of a band is returned
+    bool TestBands()
+    {
+        bool bPassed = true;
+        for (auto threads : ThreadCounts())
+        {
+            RowParallelExecutor executor;
+            if (!executor.Initialize(threads))
+            {
+                std::printf("RowParallelExecutor: %u threads do not start\n", threads);
+                return false;
+            }
+            for (uint32_t bandRows : { 0u, 1u, 2u, 7u, 1080u, 5000u })
+            {
+                std::vector<std::atomic<uint32_t>> visits(HEIGHT);
+                auto hr = executor.Run(HEIGHT, bandRows, [&](uint32_t rowStart, uint32_t rowEnd)
+                {
+                    for (uint32_t row = rowStart; row < rowEnd; row++)
+                    {
+                        visits[row]++;
+                    }
+                    return 0;
+                });
+                auto wrong = std::find_if(visits.begin(), visits.end(), [](std::atomic<uint32_t> const& v) { return v != 1; });
+                if ((hr != 0) || (wrong != visits.end()))
+                {
+                    std::printf("RowParallelExecutor: %u threads, bands of %u rows: result %d, row %d visited %u times\n",
+                        threads, bandRows, hr, (int)(wrong - visits.begin()), (wrong != visits.end()) ? (uint32_t)*wrong : 1);
+                    bPassed = false;
+                }
+            }
+            auto hr = executor.Run(HEIGHT, 16, [](uint32_t rowStart, uint32_t rowEnd) { return ((rowStart <= 1600) && (1600 < rowEnd)) ? -5 : 0; });
+            if (hr != -5)
+            {
+                std::printf("RowParallelExecutor: %u threads: a failed band returns %d, expected -5\n", threads, hr);
+                bPassed = false;
+            }
+        }
+        return bPassed;
+    }
+
+    // A 4K zone plate with overlays rendered and converted to NV12 by bands: the frame is the same whatever the
+    // number of threads, and with bBenchmark the time per frame is logged
+    bool TestScaling(bool bBenchmark)
+    {
+        const uint32_t frames = bBenchmark ? 20 : 2;
+
+        TestPattern pattern;
+        PixelConverter converter;
+        if (!pattern.Initialize({ TestPatternKind::ZonePlate, 8, 0, 0, TestPatternOverlay_All }, WIDTH, HEIGHT)
+            || !converter.Initialize(YUVMatrix::BT601, YUVRange::Limited))
+        {
+            std::printf("RowParallelExecutor: the pattern or the converter does not initialize\n");
+            return false;
+        }
+
+        std::vector<uint8_t> rgbFrame(WIDTH * HEIGHT * 4), nv12Frame(WIDTH * HEIGHT * 3 / 2), reference;
+        double msOneThread = 0;
+        bool bPassed = true;
+        for (auto threads : ThreadCounts())
+        {
+            RowParallelExecutor executor;
+            executor.Initialize(threads);
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < frames; i++)
+            {
+                if (RenderAndConvert(executor, pattern, converter, i, rgbFrame, nv12Frame) != 0)
+                {
+                    std::printf("RowParallelExecutor: %u threads: a band failed\n", threads);
+                    return false;
+                }
+            }
+            double msPerFrame = SecondsSince(start) * 1000 / frames;
+
+            if (threads == 1)
+            {
+                reference = nv12Frame;
+                msOneThread = msPerFrame;
+            }
+            else if (nv12Frame != reference)
+            {
+                std::printf("RowParallelExecutor: %u threads: the frame differs from the one of a single thread\n", threads);
+                bPassed = false;
+            }
+
+            if (bBenchmark)
+            {
+                double speedup = msOneThread / msPerFrame;
+                std::printf("RowParallelExecutor: %u threads, %ux%u: %.2f ms per frame, %.2fx speedup, %.0f%% scaling efficiency\n",
+                    threads, WIDTH, HEIGHT, msPerFrame, speedup, 100.0 * speedup / threads);
+            }
+        }
+        if (bBenchmark && (std::thread::hardware_concurrency() < 4))
+        {
+            std::printf("RowParallelExecutor: %u cores, no speedup is expected past that many threads\n", std::thread::hardware_concurrency());
+        }
+        return bPassed;
+    }
+}
+
+bool RunRowParallelExecutorTests(bool bBenchmark)
+{
+    bool bPassed = TestBands();
+    return TestScaling(bBenchmark) && bPassed;
+}
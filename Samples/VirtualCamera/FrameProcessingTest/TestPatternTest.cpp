@@ -0,0 +1,223 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "TestPattern.h"
+#include "FrameProcessingTest.h"
+
+namespace
+{
+    const TestPatternKind allKinds[] = { TestPatternKind::Ramp, TestPatternKind::Bars, TestPatternKind::ZonePlate, TestPatternKind::MovingBoxes, TestPatternKind::Noise };
+    const char* const kindNames[] = { "ramp", "bars", "zone plate", "moving boxes", "noise" };
+
+    bool Render(TestPatternSettings const& settings, uint32_t width, uint32_t height, bool bUseSimd, uint32_t bandRows, uint64_t frameNumber, std::vector<uint32_t>& frame)
+    {
+        TestPattern pattern;
+        if (!pattern.Initialize(settings, width, height, bUseSimd))
+        {
+            std::printf("TestPattern: %s %ux%u does not initialize\n", kindNames[(int)settings.kind], width, height);
+            return false;
+        }
+        frame.assign((size_t)width * height, 0xCDCDCDCD);
+        for (uint32_t row = 0; row < height; row += bandRows)
+        {
+            pattern.RenderRows(frameNumber, 123456789, 0xFFFFFF, (uint8_t*)frame.data(), width * 4, row, std::min(row + bandRows, height));
+        }
+        return true;
+    }
+
+    // Bands rendered with the SIMD kernels give the same frame as the whole frame in C++
+    bool TestBandsAndSimd()
+    {
+        // widths with and without a remainder for the C++ noise kernel
+        const uint32_t sizes[][2] = { { 6, 4 }, { 18, 2 }, { 638, 480 }, { 1920, 1080 } };
+        bool bPassed = true;
+        for (auto& size : sizes)
+        {
+            for (auto kind : allKinds)
+            {
+                TestPatternSettings settings = { kind, 3, -2, 42, TestPatternOverlay_All };
+                std::vector<uint32_t> reference, banded;
+                if (!Render(settings, size[0], size[1], false, size[1], 17, reference) || !Render(settings, size[0], size[1], true, 7, 17, banded))
+                {
+                    return false;
+                }
+                auto mismatch = std::mismatch(banded.begin(), banded.end(), reference.begin());
+                if (mismatch.first != banded.end())
+                {
+                    std::printf("TestPattern: %s %ux%u: pixel %d is 0x%06x, expected 0x%06x\n",
+                        kindNames[(int)kind], size[0], size[1], (int)(mismatch.first - banded.begin()), *mismatch.first, *mismatch.second);
+                    bPassed = false;
+                }
+            }
+        }
+        return bPassed;
+    }
+
+    bool TestContent()
+    {
+        const uint32_t width = 1280, height = 720;
+        std::vector<uint32_t> frame, other;
+        bool bPassed = true;
+
+        // middle of each 75% bar, then the 100% white of the bottom row
+        const uint32_t bars[] = { 0xBFBFBF, 0xBFBF00, 0x00BFBF, 0x00BF00, 0xBF00BF, 0xBF0000, 0x0000BF };
+        if (!Render({ TestPatternKind::Bars, 0, 0, 0, 0 }, width, height, true, height, 0, frame))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < sizeof(bars) / sizeof(bars[0]); i++)
+        {
+            uint32_t pixel = frame[(height / 3) * width + (2 * i + 1) * width / 14];
+            if (pixel != bars[i])
+            {
+                std::printf("TestPattern: bar %u is 0x%06x, expected 0x%06x\n", i, pixel, bars[i]);
+                bPassed = false;
+            }
+        }
+        if (frame[(height - 1) * width + width / 4] != 0xFFFFFF)
+        {
+            std::printf("TestPattern: bottom white is 0x%06x\n", frame[(height - 1) * width + width / 4]);
+            bPassed = false;
+        }
+
+        // the same seed gives the same noise, another seed or frame another one
+        TestPatternSettings settings = { TestPatternKind::Noise, 0, 0, 1234, 0 };
+        if (!Render(settings, width, height, true, height, 5, frame) || !Render(settings, width, height, true, height, 5, other))
+        {
+            return false;
+        }
+        bool bSame = (frame == other);
+        Render(settings, width, height, true, height, 6, other);
+        bool bOtherFrame = (frame != other);
+        settings.seed++;
+        Render(settings, width, height, true, height, 5, other);
+        bool bOtherSeed = (frame != other);
+        if (!bSame || !bOtherFrame || !bOtherSeed)
+        {
+            std::printf("TestPattern: noise is %s for the same seed and frame, %s for the next frame, %s for another seed\n",
+                bSame ? "equal" : "different", bOtherFrame ? "different" : "equal", bOtherSeed ? "different" : "equal");
+            bPassed = false;
+        }
+        return bPassed;
+    }
+
+    // The ramp rendered straight to YUV: BT.601 limited range luma, the same in NV12 and YUY2, by bands or not
+    bool TestRampYUV()
+    {
+        const uint32_t width = 640, height = 480;
+        const int64_t time = 50000000;  // 5 s, the ramp is scrolled by 5 rows
+        TestPattern ramp;
+        if (!ramp.Initialize({ TestPatternKind::Ramp, 0, 0, 0, 0 }, width, height))
+        {
+            std::printf("TestPattern: ramp %ux%u does not initialize\n", width, height);
+            return false;
+        }
+        std::vector<uint8_t> nv12(width * height * 3 / 2), banded(nv12.size()), yuy2(width * height * 2);
+        ramp.RenderRampRowsNV12(time, 0xFFFFFF, nv12.data(), width, 0, height);
+        for (uint32_t row = 0; row < height; row += 6)
+        {
+            ramp.RenderRampRowsNV12(time, 0xFFFFFF, banded.data(), width, row, std::min(row + 6, height));
+        }
+        ramp.RenderRampRowsYUY2(time, 0xFFFFFF, yuy2.data(), width * 2, 0, height);
+
+        bool bPassed = true;
+        // gray 100 + 5 on the 100th row: Y = (220 * 105 + 128) / 256 + 16
+        if ((nv12[100 * width] != 106) || (nv12[100 * width + width - 1] != 106))
+        {
+            std::printf("TestPattern: NV12 ramp Y of row 100 is %d, expected 106\n", nv12[100 * width]);
+            bPassed = false;
+        }
+        if (banded != nv12)
+        {
+            std::printf("TestPattern: NV12 ramp rendered by bands differs from the whole frame\n");
+            bPassed = false;
+        }
+        for (uint32_t i = 0; bPassed && (i < width * height); i++)
+        {
+            if (yuy2[i * 2] != nv12[i])
+            {
+                std::printf("TestPattern: YUY2 ramp Y of pixel %u is %d, NV12 %d\n", i, yuy2[i * 2], nv12[i]);
+                bPassed = false;
+            }
+        }
+        return bPassed;
+    }
+
+    void Benchmark()
+    {
+        const uint32_t sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        const uint32_t frames = 30;
+        const int64_t time = 50000000;
+
+        for (auto& size : sizes)
+        {
+            uint32_t width = size[0], height = size[1];
+            std::vector<uint8_t> frame((size_t)width * height * 4);
+
+            TestPattern ramp;
+            ramp.Initialize({ TestPatternKind::Ramp, 0, 0, 0, 0 }, width, height);
+            double framesPerSecond[3] = {};
+            for (uint32_t format = 0; format < 3; format++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < frames; i++)
+                {
+                    switch (format)
+                    {
+                    case 0:
+                        ramp.RenderRows(i, time, 0xFFFFFF, frame.data(), width * 4, 0, height);
+                        break;
+                    case 1:
+                        ramp.RenderRampRowsNV12(time, 0xFFFFFF, frame.data(), width, 0, height);
+                        break;
+                    default:
+                        ramp.RenderRampRowsYUY2(time, 0xFFFFFF, frame.data(), width * 2, 0, height);
+                        break;
+                    }
+                }
+                framesPerSecond[format] = frames / SecondsSince(start);
+            }
+            std::printf("TestPattern: ramp %ux%u: %.0f frames/s in RGB32, %.0f in NV12, %.0f in YUY2\n",
+                width, height, framesPerSecond[0], framesPerSecond[1], framesPerSecond[2]);
+
+            for (auto kind : allKinds)
+            {
+                if (kind == TestPatternKind::Ramp)
+                {
+                    continue;
+                }
+                double perSecond[2] = {};
+                for (int simd = 0; simd < 2; simd++)
+                {
+                    TestPattern pattern;
+                    pattern.Initialize({ kind, 4, 2, 42, 0 }, width, height, simd != 0);
+                    auto start = std::chrono::steady_clock::now();
+                    for (uint32_t i = 0; i < frames; i++)
+                    {
+                        pattern.RenderRows(i, time, 0xFFFFFF, frame.data(), width * 4, 0, height);
+                    }
+                    perSecond[simd] = frames / SecondsSince(start);
+                }
+                // only the noise has SIMD kernels, the other patterns show the run to run variation
+                std::printf("TestPattern: %s %ux%u: %.0f frames/s in RGB32, %.0f with the C++ kernels\n",
+                    kindNames[(int)kind], width, height, perSecond[1], perSecond[0]);
+            }
+        }
+    }
+}
+
+bool RunTestPatternTests(bool bBenchmark)
+{
+    bool bPassed = TestBandsAndSimd();
+    bPassed = TestContent() && bPassed;
+    bPassed = TestRampYUV() && bPassed;
+    if (bPassed && bBenchmark)
+    {
+        Benchmark();
+    }
+    return bPassed;
+}
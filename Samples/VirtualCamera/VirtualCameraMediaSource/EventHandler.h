@@ -39,6 +39,25 @@ namespace winrt::WindowsSample::implementation
         InvokeFn m_pInvokeFn;
         DWORD m_dwQueue;
     };
+
+    // Signals an event when a sample goes back to the allocator
+    struct CSampleReleaseNotify : winrt::implements<CSampleReleaseNotify, IMFVideoSampleAllocatorNotify>
+    {
+    public:
+        CSampleReleaseNotify(_In_ HANDLE hEvent)
+            : m_hEvent(hEvent)
+        {}
+
+        // IMFVideoSampleAllocatorNotify
+        IFACEMETHODIMP NotifyRelease() override
+        {
+            SetEvent(m_hEvent);
+            return S_OK;
+        }
+
+    private:
+        HANDLE m_hEvent;    // outlives the callback: the owner clears it before closing the event
+    };
 }
 
 #endif
@@ -0,0 +1,125 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Built without the precompiled header, see FrameClock.h
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+#include "FrameClock.h"
+
+namespace
+{
+    const uint64_t TICKS_PER_SECOND = 10000000;
+}
+
+bool FrameClock::Start(int64_t startTime, uint32_t numerator, uint32_t denominator, uint32_t maxLateFrames)
+{
+    if ((numerator == 0) || (denominator == 0))
+    {
+        return false;
+    }
+
+    // the remainder products below stay under numerator * period
+    uint64_t period = TICKS_PER_SECOND * denominator;
+    if (period > (uint64_t)std::numeric_limits<int64_t>::max() / numerator)
+    {
+        return false;
+    }
+
+    m_startTime = startTime;
+    m_numerator = numerator;
+    m_period = period;
+    m_maxLateFrames = maxLateFrames;
+    m_nextFrame = 0;
+    ResetStats();
+
+    return true;
+}
+
+int64_t FrameClock::FrameTime(uint64_t frameIndex) const
+{
+    if (m_numerator == 0)
+    {
+        return m_startTime;
+    }
+
+    // frameIndex * m_period / m_numerator rounded up, without overflowing the product
+    uint64_t whole = frameIndex / m_numerator;
+    uint64_t remainder = frameIndex % m_numerator;
+    return m_startTime + (int64_t)(whole * m_period + (remainder * m_period + m_numerator - 1) / m_numerator);
+}
+
+uint64_t FrameClock::FrameIndex(int64_t time) const
+{
+    if ((m_numerator == 0) || (time <= m_startTime))
+    {
+        return 0;
+    }
+
+    uint64_t elapsed = (uint64_t)(time - m_startTime);
+    uint64_t whole = elapsed / m_period;
+    uint64_t remainder = elapsed % m_period;
+    return whole * m_numerator + (remainder * m_numerator) / m_period;
+}
+
+uint64_t FrameClock::NextFrame(int64_t now)
+{
+    uint64_t currentFrame = FrameIndex(now);
+    if (currentFrame > m_nextFrame + m_maxLateFrames)
+    {
+        m_stats.framesSkipped += currentFrame - m_nextFrame;
+        m_nextFrame = currentFrame;
+    }
+
+    return m_nextFrame++;
+}
+
+bool FrameClock::IsTooLate(uint64_t frameIndex, int64_t now) const
+{
+    return FrameIndex(now) > frameIndex + m_maxLateFrames;
+}
+
+void FrameClock::RecordDelivery(uint64_t frameIndex, int64_t deliveryTime)
+{
+    int64_t frameTime = FrameTime(frameIndex);
+    int64_t lateness = deliveryTime - frameTime;
+    if (m_stats.framesDelivered == 0)
+    {
+        m_stats.maxLateness = lateness;
+    }
+    m_stats.maxLateness = std::max<int64_t>(m_stats.maxLateness, lateness);
+    m_sumLateness += lateness;
+
+    // only between consecutive deliveries, a skip is not jitter
+    if (m_bDelivered && (frameIndex > m_lastFrameIndex))
+    {
+        int64_t jitter = std::llabs((deliveryTime - m_lastDeliveryTime) - (frameTime - FrameTime(m_lastFrameIndex)));
+        m_stats.maxJitter = std::max<int64_t>(m_stats.maxJitter, jitter);
+        m_sumJitter += jitter;
+        m_jitterCount++;
+    }
+
+    m_stats.framesDelivered++;
+    m_bDelivered = true;
+    m_lastFrameIndex = frameIndex;
+    m_lastDeliveryTime = deliveryTime;
+}
+
+FrameClockStats FrameClock::Stats() const
+{
+    FrameClockStats stats = m_stats;
+    stats.meanLateness = (stats.framesDelivered > 0) ? m_sumLateness / (int64_t)stats.framesDelivered : 0;
+    stats.meanJitter = (m_jitterCount > 0) ? m_sumJitter / (int64_t)m_jitterCount : 0;
+    return stats;
+}
+
+void FrameClock::ResetStats()
+{
+    m_stats = {};
+    m_sumJitter = 0;
+    m_sumLateness = 0;
+    m_jitterCount = 0;
+    m_bDelivered = false;
+}
@@ -0,0 +1,72 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <cstdint>
+
+// Times are in 100ns, the MFGetSystemTime unit
+struct FrameClockStats
+{
+    uint64_t framesDelivered;
+    uint64_t framesSkipped;     // frame times given up to catch up with the clock
+    int64_t meanJitter;         // difference between the delivery interval and the frame interval
+    int64_t maxJitter;
+    int64_t meanLateness;       // delivery time - frame time, negative when delivered ahead
+    int64_t maxLateness;
+};
+
+/*:
+   Frame times of a stream at a fixed rate: frame n is due at start + n * denominator / numerator seconds, computed
+   exactly for each frame so no rounding error builds up (29.97 fps is not a whole number of 100ns).
+   Frames whose time has already passed by more than maxLateFrames frames are skipped rather than delivered late,
+   so the timestamps stay on the clock after a stall. The clock doesn't read the time itself: the caller passes it,
+   which keeps this file free of the precompiled header for the test tooling.
+*/
+class FrameClock
+{
+public:
+    FrameClock() = default;
+    ~FrameClock() {};
+
+    // False if the rate is 0 or too large a fraction to compute exactly
+    bool Start(int64_t startTime, uint32_t numerator, uint32_t denominator, uint32_t maxLateFrames = 2);
+
+    // Time of the frameIndex-th frame, rounded up to the next 100ns so FrameIndex(FrameTime(n)) is n
+    int64_t FrameTime(uint64_t frameIndex) const;
+    int64_t FrameDuration(uint64_t frameIndex) const { return FrameTime(frameIndex + 1) - FrameTime(frameIndex); }
+
+    // Index of the frame showing at time, 0 before the start
+    uint64_t FrameIndex(int64_t time) const;
+
+    // Index of the next frame to render, after the frames too late at time now
+    uint64_t NextFrame(int64_t now);
+
+    // A frame rendered ahead that is now too late to deliver; counted as skipped by Skip
+    bool IsTooLate(uint64_t frameIndex, int64_t now) const;
+    void Skip(uint64_t frameCount) { m_stats.framesSkipped += frameCount; }
+
+    void RecordDelivery(uint64_t frameIndex, int64_t deliveryTime);
+    FrameClockStats Stats() const;
+    void ResetStats();
+
+private:
+    int64_t m_startTime = 0;
+    uint64_t m_numerator = 0;
+    uint64_t m_period = 0;              // 10^7 * denominator: a frame lasts m_period / m_numerator
+    uint32_t m_maxLateFrames = 0;
+    uint64_t m_nextFrame = 0;
+
+    FrameClockStats m_stats = {};
+    int64_t m_sumJitter = 0;
+    int64_t m_sumLateness = 0;
+    uint64_t m_jitterCount = 0;
+    bool m_bDelivered = false;
+    uint64_t m_lastFrameIndex = 0;
+    int64_t m_lastDeliveryTime = 0;
+};
+
+#endif
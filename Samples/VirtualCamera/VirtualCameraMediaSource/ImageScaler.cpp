@@ -0,0 +1,570 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Built without the precompiled header, see ImageScaler.h
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define IMAGESCALER_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#define IMAGESCALER_NEON
+#include <arm64_neon.h>
+#elif defined(__ARM_NEON)
+#define IMAGESCALER_NEON
+#include <arm_neon.h>
+#endif
+
+#include "ImageScaler.h"
+
+namespace
+{
+    const int32_t WEIGHT_BITS = 14;
+    const int32_t ROW_BITS = 6;
+    const int32_t HORIZONTAL_SHIFT = WEIGHT_BITS - ROW_BITS;
+    const int32_t HORIZONTAL_ROUND = 1 << (HORIZONTAL_SHIFT - 1);
+    const int32_t VERTICAL_SHIFT = WEIGHT_BITS + ROW_BITS;
+    const int32_t VERTICAL_ROUND = 1 << (VERTICAL_SHIFT - 1);
+
+    // the SIMD horizontal kernels take taps a multiple of these, Y and interleaved UV
+    const uint32_t SIMD_TAPS_Y = 8;
+    const uint32_t SIMD_TAPS_UV = 4;
+
+    // filter tables kept for the next scalers, 4 per scaler
+    const size_t TABLE_CACHE_SIZE = 16;
+
+    const double PI = 3.14159265358979323846;
+
+    double Lanczos2(double x)
+    {
+        x = std::abs(x);
+        if (x < 1e-9)
+        {
+            return 1.0;
+        }
+        if (x >= 2.0)
+        {
+            return 0.0;
+        }
+        return 2.0 * std::sin(PI * x) * std::sin(PI * x / 2) / (PI * PI * x * x);
+    }
+
+    //////////////////////////////////////////////////
+    // C++ kernels, the reference for the SIMD ones. They start at x so the SIMD kernels can finish a row with them.
+
+    template<uint32_t channels>
+    void Horizontal_C(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t x, uint32_t dstWidth, int16_t* pDst)
+    {
+        for (; x < dstWidth; x++)
+        {
+            const uint8_t* p = pSrc + pStarts[x] * channels;
+            const int16_t* w = pWeights + x * taps;
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                int32_t sum = 0;
+                for (uint32_t t = 0; t < taps; t++)
+                {
+                    sum += p[t * channels + c] * w[t];
+                }
+                pDst[x * channels + c] = (int16_t)((sum + HORIZONTAL_ROUND) >> HORIZONTAL_SHIFT);
+            }
+        }
+    }
+
+    void Vertical_C(const int16_t* const* ppRows, const int16_t* pWeights, uint32_t taps, uint32_t x, uint32_t count, uint8_t* pDst)
+    {
+        for (; x < count; x++)
+        {
+            int32_t sum = 0;
+            for (uint32_t t = 0; t < taps; t++)
+            {
+                sum += ppRows[t][x] * pWeights[t];
+            }
+            pDst[x] = (uint8_t)std::min<int32_t>(std::max<int32_t>((sum + VERTICAL_ROUND) >> VERTICAL_SHIFT, 0), 255);
+        }
+    }
+
+    void HorizontalY_Ref(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        Horizontal_C<1>(pSrc, pStarts, pWeights, taps, 0, dstWidth, pDst);
+    }
+
+    void HorizontalUV_Ref(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        Horizontal_C<2>(pSrc, pStarts, pWeights, taps, 0, dstWidth, pDst);
+    }
+
+    void Vertical_Ref(const int16_t* const* ppRows, const int16_t* pWeights, uint32_t taps, uint32_t count, uint8_t* pDst)
+    {
+        Vertical_C(ppRows, pWeights, taps, 0, count, pDst);
+    }
+
+#if defined(IMAGESCALER_SSE2)
+    //////////////////////////////////////////////////
+    // SSE2 kernels
+
+    // 4 pixels at a time, 8 taps at a time
+    void HorizontalY_SSE2(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(HORIZONTAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 4 <= dstWidth; x += 4)
+        {
+            __m128i s[4];
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                const uint8_t* p = pSrc + pStarts[x + i];
+                const int16_t* w = pWeights + (x + i) * taps;
+                s[i] = _mm_setzero_si128();
+                for (uint32_t t = 0; t < taps; t += SIMD_TAPS_Y)
+                {
+                    __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + t)), zero);
+                    s[i] = _mm_add_epi32(s[i], _mm_madd_epi16(pixels, _mm_loadu_si128((const __m128i*)(w + t))));
+                }
+            }
+
+            // s[i] holds 4 partial sums of pixel x + i
+            __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(s[0], s[1]), _mm_unpackhi_epi32(s[0], s[1]));
+            __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(s[2], s[3]), _mm_unpackhi_epi32(s[2], s[3]));
+            __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), HORIZONTAL_SHIFT);
+            _mm_storel_epi64((__m128i*)(pDst + x), _mm_packs_epi32(sum, sum));
+        }
+        Horizontal_C<1>(pSrc, pStarts, pWeights, taps, x, dstWidth, pDst);
+    }
+
+    // 2 UV pairs at a time, 4 taps at a time
+    void HorizontalUV_SSE2(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(HORIZONTAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 2 <= dstWidth; x += 2)
+        {
+            __m128i s[2];
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                const uint8_t* p = pSrc + pStarts[x + i] * 2;
+                const int16_t* w = pWeights + (x + i) * taps;
+                s[i] = _mm_setzero_si128();
+                for (uint32_t t = 0; t < taps; t += SIMD_TAPS_UV)
+                {
+                    // U0 V0 U1 V1 U2 V2 U3 V3 to U0 U1 V0 V1 U2 U3 V2 V3, times w0 w1 w0 w1 w2 w3 w2 w3
+                    __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + t * 2)), zero);
+                    pixels = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+                    __m128i weights = _mm_loadl_epi64((const __m128i*)(w + t));
+                    s[i] = _mm_add_epi32(s[i], _mm_madd_epi16(pixels, _mm_unpacklo_epi32(weights, weights)));
+                }
+            }
+
+            // s[i] holds U01 V01 U23 V23 of pixel x + i
+            __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(s[0], s[1]), _mm_unpackhi_epi64(s[0], s[1]));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), HORIZONTAL_SHIFT);
+            _mm_storel_epi64((__m128i*)(pDst + x * 2), _mm_packs_epi32(sum, sum));
+        }
+        Horizontal_C<2>(pSrc, pStarts, pWeights, taps, x, dstWidth, pDst);
+    }
+
+    // 8 values at a time, 2 taps per multiply
+    void Vertical_SSE2(const int16_t* const* ppRows, const int16_t* pWeights, uint32_t taps, uint32_t count, uint8_t* pDst)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(VERTICAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8)
+        {
+            __m128i sumLo = round;
+            __m128i sumHi = round;
+            uint32_t t = 0;
+            for (; t + 2 <= taps; t += 2)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(ppRows[t] + x));
+                __m128i b = _mm_loadu_si128((const __m128i*)(ppRows[t + 1] + x));
+                __m128i w = _mm_set1_epi32((int)((uint16_t)pWeights[t] | ((uint32_t)(uint16_t)pWeights[t + 1] << 16)));
+                sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+            }
+            if (t < taps)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(ppRows[t] + x));
+                __m128i w = _mm_set1_epi32((int)(uint16_t)pWeights[t]);
+                sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), w));
+                sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), w));
+            }
+
+            // the saturations clamp to 0-255 like the C++ kernel
+            __m128i y = _mm_packs_epi32(_mm_srai_epi32(sumLo, VERTICAL_SHIFT), _mm_srai_epi32(sumHi, VERTICAL_SHIFT));
+            _mm_storel_epi64((__m128i*)(pDst + x), _mm_packus_epi16(y, y));
+        }
+        Vertical_C(ppRows, pWeights, taps, x, count, pDst);
+    }
+#elif defined(IMAGESCALER_NEON)
+    //////////////////////////////////////////////////
+    // NEON kernels
+
+    // 4 pixels at a time, 8 taps at a time
+    void HorizontalY_NEON(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        const int32x4_t round = vdupq_n_s32(HORIZONTAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 4 <= dstWidth; x += 4)
+        {
+            int32x4_t s[4];
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                const uint8_t* p = pSrc + pStarts[x + i];
+                const int16_t* w = pWeights + (x + i) * taps;
+                s[i] = vdupq_n_s32(0);
+                for (uint32_t t = 0; t < taps; t += SIMD_TAPS_Y)
+                {
+                    int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p + t)));
+                    int16x8_t weights = vld1q_s16(w + t);
+                    s[i] = vmlal_high_s16(vmlal_s16(s[i], vget_low_s16(pixels), vget_low_s16(weights)), pixels, weights);
+                }
+            }
+
+            int32x4_t sum = vpaddq_s32(vpaddq_s32(s[0], s[1]), vpaddq_s32(s[2], s[3]));
+            sum = vshrq_n_s32(vaddq_s32(sum, round), HORIZONTAL_SHIFT);
+            vst1_s16(pDst + x, vqmovn_s32(sum));
+        }
+        Horizontal_C<1>(pSrc, pStarts, pWeights, taps, x, dstWidth, pDst);
+    }
+
+    // 2 UV pairs at a time, 4 taps at a time
+    void HorizontalUV_NEON(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst)
+    {
+        const int32x4_t round = vdupq_n_s32(HORIZONTAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 2 <= dstWidth; x += 2)
+        {
+            int32x2_t s[2];
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                const uint8_t* p = pSrc + pStarts[x + i] * 2;
+                const int16_t* w = pWeights + (x + i) * taps;
+                int32x4_t products = vdupq_n_s32(0);
+                for (uint32_t t = 0; t < taps; t += SIMD_TAPS_UV)
+                {
+                    // U0 V0 U1 V1 U2 V2 U3 V3 times w0 w0 w1 w1 w2 w2 w3 w3
+                    int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p + t * 2)));
+                    int16x4_t w4 = vld1_s16(w + t);
+                    int16x8_t weights = vzip1q_s16(vcombine_s16(w4, w4), vcombine_s16(w4, w4));
+                    products = vmlal_high_s16(vmlal_s16(products, vget_low_s16(pixels), vget_low_s16(weights)), pixels, weights);
+                }
+                s[i] = vadd_s32(vget_low_s32(products), vget_high_s32(products));
+            }
+
+            int32x4_t sum = vshrq_n_s32(vaddq_s32(vcombine_s32(s[0], s[1]), round), HORIZONTAL_SHIFT);
+            vst1_s16(pDst + x * 2, vqmovn_s32(sum));
+        }
+        Horizontal_C<2>(pSrc, pStarts, pWeights, taps, x, dstWidth, pDst);
+    }
+
+    // 8 values at a time
+    void Vertical_NEON(const int16_t* const* ppRows, const int16_t* pWeights, uint32_t taps, uint32_t count, uint8_t* pDst)
+    {
+        const int32x4_t round = vdupq_n_s32(VERTICAL_ROUND);
+
+        uint32_t x = 0;
+        for (; x + 8 <= count; x += 8)
+        {
+            int32x4_t sumLo = round;
+            int32x4_t sumHi = round;
+            for (uint32_t t = 0; t < taps; t++)
+            {
+                int16x8_t a = vld1q_s16(ppRows[t] + x);
+                sumLo = vmlal_n_s16(sumLo, vget_low_s16(a), pWeights[t]);
+                sumHi = vmlal_high_n_s16(sumHi, a, pWeights[t]);
+            }
+
+            // the saturations clamp to 0-255 like the C++ kernel
+            int16x8_t y = vcombine_s16(vqmovn_s32(vshrq_n_s32(sumLo, VERTICAL_SHIFT)), vqmovn_s32(vshrq_n_s32(sumHi, VERTICAL_SHIFT)));
+            vst1_u8(pDst + x, vqmovun_s16(y));
+        }
+        Vertical_C(ppRows, pWeights, taps, x, count, pDst);
+    }
+#endif
+}
+
+bool ImageScaler::Initialize(ImageScalerSettings const& settingsIn, bool bUseSimd)
+{
+    ImageScalerSettings settings = _Normalize(settingsIn);
+    ScaleRect const& crop = settings.crop;
+
+    m_bInitialized = false;
+    if ((settings.srcWidth == 0) || (settings.srcHeight == 0) || (settings.dstWidth == 0) || (settings.dstHeight == 0)
+        || (settings.srcWidth & 1) || (settings.srcHeight & 1) || (settings.dstWidth & 1) || (settings.dstHeight & 1)
+        || (crop.x & 1) || (crop.y & 1) || (crop.width & 1) || (crop.height & 1)
+        || (crop.x + crop.width > settings.srcWidth) || (crop.y + crop.height > settings.srcHeight)
+        || ((settings.filter != ScaleFilter::Box) && (settings.filter != ScaleFilter::Bilinear) && (settings.filter != ScaleFilter::Lanczos2))
+        || ((settings.format != ScaleFormat::NV12) && (settings.format != ScaleFormat::I420)))
+    {
+        return false;
+    }
+    m_settings = settings;
+
+    m_pfnVertical = Vertical_Ref;
+#if defined(IMAGESCALER_SSE2)
+    m_pfnVertical = bUseSimd ? Vertical_SSE2 : Vertical_Ref;
+#elif defined(IMAGESCALER_NEON)
+    m_pfnVertical = bUseSimd ? Vertical_NEON : Vertical_Ref;
+#endif
+
+    ScaleRect chromaCrop = { crop.x / 2, crop.y / 2, crop.width / 2, crop.height / 2 };
+    _InitializePlane(&m_y, 1, settings.srcWidth, settings.srcHeight, crop, settings.dstWidth, settings.dstHeight, bUseSimd);
+    _InitializePlane(&m_chroma, (settings.format == ScaleFormat::NV12) ? 2 : 1, settings.srcWidth / 2, settings.srcHeight / 2, chromaCrop,
+        settings.dstWidth / 2, settings.dstHeight / 2, bUseSimd);
+
+    // a UV row has as many values as a Y row, a U or V row half
+    m_maxTaps = std::max<uint32_t>(m_y.vertical->taps, m_chroma.vertical->taps);
+    m_maxRowSize = settings.dstWidth;
+    m_bInitialized = true;
+
+    return true;
+}
+
+bool ImageScaler::IsInitialized(ImageScalerSettings const& settings) const
+{
+    return m_bInitialized && (m_settings == _Normalize(settings));
+}
+
+ScaleFilter ImageScaler::DefaultFilter(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight)
+{
+    return ((dstWidth * 2 <= srcWidth) || (dstHeight * 2 <= srcHeight)) ? ScaleFilter::Box : ScaleFilter::Bilinear;
+}
+
+void ImageScaler::Scale(const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride)
+{
+    ScaleTiles(pSrc, srcStride, pDst, dstStride, 0, TileCount(), &m_workspace);
+}
+
+void ImageScaler::ScaleTiles(const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride, uint32_t tileStart, uint32_t tileEnd, Workspace* pWorkspace) const
+{
+    uint32_t rowStart = tileStart * TILE_ROWS;
+    uint32_t rowEnd = std::min<uint32_t>(tileEnd * TILE_ROWS, m_settings.dstHeight);
+    if (!m_bInitialized || (rowStart >= rowEnd))
+    {
+        return;
+    }
+
+    if (pWorkspace->rows.size() < (size_t)m_maxTaps * m_maxRowSize)
+    {
+        pWorkspace->rows.resize((size_t)m_maxTaps * m_maxRowSize);
+    }
+    pWorkspace->rowIndex.resize(m_maxTaps);
+    pWorkspace->rowPointers.resize(m_maxTaps);
+
+    _ScalePlane(m_y, pSrc, srcStride, pDst, dstStride, rowStart, rowEnd, pWorkspace);
+
+    // TILE_ROWS and the height are even, a tile has half as many chroma rows
+    const uint8_t* pSrcChroma = pSrc + (int64_t)srcStride * m_settings.srcHeight;
+    uint8_t* pDstChroma = pDst + (int64_t)dstStride * m_settings.dstHeight;
+    if (m_settings.format == ScaleFormat::NV12)
+    {
+        _ScalePlane(m_chroma, pSrcChroma, srcStride, pDstChroma, dstStride, rowStart / 2, rowEnd / 2, pWorkspace);
+    }
+    else
+    {
+        _ScalePlane(m_chroma, pSrcChroma, srcStride / 2, pDstChroma, dstStride / 2, rowStart / 2, rowEnd / 2, pWorkspace);
+        _ScalePlane(m_chroma, pSrcChroma + (int64_t)(srcStride / 2) * (m_settings.srcHeight / 2), srcStride / 2,
+            pDstChroma + (int64_t)(dstStride / 2) * (m_settings.dstHeight / 2), dstStride / 2, rowStart / 2, rowEnd / 2, pWorkspace);
+    }
+}
+
+//////////////////////////////////////////////////
+// private
+
+void ImageScaler::_ComputeTable(TableKey const& key, FilterTable* pTable)
+{
+    const int32_t srcSize = (int32_t)key.srcSize;
+    const double scale = (double)key.length / key.dstSize;
+
+    // weights of the source pixels [first, first + size) of each destination pixel, edge pixels repeated
+    std::vector<int32_t> firsts(key.dstSize);
+    std::vector<std::vector<double>> weights(key.dstSize);
+    uint32_t taps = 1;
+    for (uint32_t i = 0; i < key.dstSize; i++)
+    {
+        if (key.filter == ScaleFilter::Box)
+        {
+            double left = key.offset + i * scale;
+            double right = std::min<double>(left + scale, srcSize);
+            int32_t first = (int32_t)std::floor(left);
+            int32_t last = std::min<int32_t>((int32_t)std::ceil(right), srcSize) - 1;
+            firsts[i] = first;
+            for (int32_t s = first; s <= last; s++)
+            {
+                weights[i].push_back((std::min<double>(right, s + 1) - std::max<double>(left, s)) / scale);
+            }
+        }
+        else if (key.filter == ScaleFilter::Bilinear)
+        {
+            double center = key.offset + (i + 0.5) * scale - 0.5;
+            int32_t s0 = (int32_t)std::floor(center);
+            double fraction = center - s0;
+            int32_t first = std::min<int32_t>(std::max<int32_t>(s0, 0), srcSize - 1);
+            int32_t second = std::min<int32_t>(std::max<int32_t>(s0 + 1, 0), srcSize - 1);
+            firsts[i] = first;
+            weights[i].push_back(1.0 - fraction);
+            if (second != first)
+            {
+                weights[i].push_back(fraction);
+            }
+            else
+            {
+                weights[i][0] = 1.0;
+            }
+        }
+        else
+        {
+            // the kernel covers 2 source pixels on each side, 2 destination pixels when downscaling
+            double center = key.offset + (i + 0.5) * scale - 0.5;
+            double stretch = std::max<double>(scale, 1.0);
+            int32_t s0 = (int32_t)std::floor(center - 2 * stretch) + 1;
+            int32_t s1 = (int32_t)std::ceil(center + 2 * stretch) - 1;
+            int32_t first = std::min<int32_t>(std::max<int32_t>(s0, 0), srcSize - 1);
+            int32_t last = std::min<int32_t>(std::max<int32_t>(s1, 0), srcSize - 1);
+            firsts[i] = first;
+            weights[i].assign(last - first + 1, 0.0);
+            double total = 0;
+            for (int32_t s = s0; s <= s1; s++)
+            {
+                double weight = Lanczos2((s - center) / stretch);
+                weights[i][std::min<int32_t>(std::max<int32_t>(s, 0), srcSize - 1) - first] += weight;
+                total += weight;
+            }
+            for (auto& weight : weights[i])
+            {
+                weight /= total;
+            }
+        }
+        taps = std::max<uint32_t>(taps, (uint32_t)weights[i].size());
+    }
+
+    uint32_t paddedTaps = (taps + key.tapMultiple - 1) / key.tapMultiple * key.tapMultiple;
+    if (paddedTaps <= key.srcSize)
+    {
+        taps = paddedTaps;
+    }
+
+    // the last pixels start early so every tap is in the source, their first weights are 0
+    pTable->taps = taps;
+    pTable->starts.assign(key.dstSize, 0);
+    pTable->weights.assign((size_t)key.dstSize * taps, 0);
+    for (uint32_t i = 0; i < key.dstSize; i++)
+    {
+        int32_t start = std::max<int32_t>(std::min<int32_t>(firsts[i], srcSize - (int32_t)taps), 0);
+        int16_t* pWeights = pTable->weights.data() + (size_t)i * taps + (firsts[i] - start);
+        pTable->starts[i] = start;
+
+        // 14 bit weights adding up to exactly 1, the rounding error goes to the largest one
+        int32_t sum = 0;
+        size_t largest = 0;
+        for (size_t t = 0; t < weights[i].size(); t++)
+        {
+            pWeights[t] = (int16_t)std::lround(weights[i][t] * (1 << WEIGHT_BITS));
+            sum += pWeights[t];
+            largest = (pWeights[t] > pWeights[largest]) ? t : largest;
+        }
+        pWeights[largest] = (int16_t)(pWeights[largest] + (1 << WEIGHT_BITS) - sum);
+    }
+}
+
+std::shared_ptr<const ImageScaler::FilterTable> ImageScaler::_GetTable(TableKey const& key)
+{
+    // most recently used first
+    static std::mutex s_cacheLock;
+    static std::vector<std::pair<TableKey, std::shared_ptr<const FilterTable>>> s_cache;
+
+    {
+        std::lock_guard<std::mutex> lock(s_cacheLock);
+        auto it = std::find_if(s_cache.begin(), s_cache.end(), [&key](auto const& entry) { return entry.first == key; });
+        if (it != s_cache.end())
+        {
+            std::rotate(s_cache.begin(), it, it + 1);
+            return s_cache.front().second;
+        }
+    }
+
+    auto spTable = std::make_shared<FilterTable>();
+    _ComputeTable(key, spTable.get());
+
+    std::lock_guard<std::mutex> lock(s_cacheLock);
+    s_cache.insert(s_cache.begin(), { key, spTable });
+    if (s_cache.size() > TABLE_CACHE_SIZE)
+    {
+        s_cache.pop_back();
+    }
+    return spTable;
+}
+
+ImageScalerSettings ImageScaler::_Normalize(ImageScalerSettings const& settings)
+{
+    ImageScalerSettings normalized = settings;
+    if ((settings.crop.width == 0) || (settings.crop.height == 0))
+    {
+        normalized.crop = { 0, 0, settings.srcWidth, settings.srcHeight };
+    }
+    return normalized;
+}
+
+void ImageScaler::_InitializePlane(Plane* pPlane, uint32_t channels, uint32_t srcWidth, uint32_t srcHeight, ScaleRect const& crop,
+    uint32_t dstWidth, uint32_t dstHeight, bool bUseSimd)
+{
+    const uint32_t simdTaps = (channels == 1) ? SIMD_TAPS_Y : SIMD_TAPS_UV;
+
+    pPlane->channels = channels;
+    pPlane->dstWidth = dstWidth;
+    pPlane->dstHeight = dstHeight;
+    pPlane->horizontal = _GetTable({ srcWidth, crop.x, crop.width, dstWidth, m_settings.filter, bUseSimd ? simdTaps : 1 });
+    pPlane->vertical = _GetTable({ srcHeight, crop.y, crop.height, dstHeight, m_settings.filter, 1 });
+
+    pPlane->pfnHorizontal = (channels == 1) ? HorizontalY_Ref : HorizontalUV_Ref;
+    if (bUseSimd && (pPlane->horizontal->taps % simdTaps == 0))
+    {
+#if defined(IMAGESCALER_SSE2)
+        pPlane->pfnHorizontal = (channels == 1) ? HorizontalY_SSE2 : HorizontalUV_SSE2;
+#elif defined(IMAGESCALER_NEON)
+        pPlane->pfnHorizontal = (channels == 1) ? HorizontalY_NEON : HorizontalUV_NEON;
+#endif
+    }
+}
+
+void ImageScaler::_ScalePlane(Plane const& plane, const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride,
+    uint32_t rowStart, uint32_t rowEnd, Workspace* pWorkspace) const
+{
+    FilterTable const& horizontal = *plane.horizontal;
+    FilterTable const& vertical = *plane.vertical;
+    const uint32_t taps = vertical.taps;
+    const uint32_t rowSize = plane.dstWidth * plane.channels;
+    std::fill(pWorkspace->rowIndex.begin(), pWorkspace->rowIndex.end(), -1);
+
+    for (uint32_t y = rowStart; y < rowEnd; y++)
+    {
+        // the rows of consecutive destination rows overlap, each source row is filtered horizontally once per tile
+        int32_t start = vertical.starts[y];
+        for (uint32_t t = 0; t < taps; t++)
+        {
+            int32_t row = start + (int32_t)t;
+            uint32_t slot = (uint32_t)row % taps;
+            int16_t* pRow = pWorkspace->rows.data() + (size_t)slot * rowSize;
+            if (pWorkspace->rowIndex[slot] != row)
+            {
+                plane.pfnHorizontal(pSrc + (int64_t)row * srcStride, horizontal.starts.data(), horizontal.weights.data(),
+                    horizontal.taps, plane.dstWidth, pRow);
+                pWorkspace->rowIndex[slot] = row;
+            }
+            pWorkspace->rowPointers[t] = pRow;
+        }
+        m_pfnVertical(pWorkspace->rowPointers.data(), vertical.weights.data() + (size_t)y * taps, taps, rowSize, pDst + (int64_t)y * dstStride);
+    }
+}
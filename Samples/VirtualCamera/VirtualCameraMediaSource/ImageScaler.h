@@ -0,0 +1,169 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+#ifndef IMAGE_SCALER_H
+#define IMAGE_SCALER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class ScaleFilter : uint32_t
+{
+    Box,        // average of the source pixels under the destination pixel
+    Bilinear,   // the 2x2 source pixels around the center of the destination pixel
+    Lanczos2,   // 2 lobe Lanczos, stretched over more source pixels when downscaling
+};
+
+enum class ScaleFormat : uint32_t
+{
+    NV12,       // Y plane, then interleaved UV plane at stride * height
+    I420,       // Y plane, then U and V planes of stride / 2 at stride * height and stride * height * 5 / 4
+};
+
+// Region of the source frame, even
+struct ScaleRect
+{
+    uint32_t x, y;
+    uint32_t width, height;
+
+    bool operator==(ScaleRect const& other) const
+    {
+        return (x == other.x) && (y == other.y) && (width == other.width) && (height == other.height);
+    }
+};
+
+struct ImageScalerSettings
+{
+    ScaleFormat format;
+    uint32_t srcWidth;
+    uint32_t srcHeight;
+    ScaleRect crop;         // source region scaled to the destination, the whole frame when its width or height is 0
+    uint32_t dstWidth;
+    uint32_t dstHeight;
+    ScaleFilter filter;
+
+    bool operator==(ImageScalerSettings const& other) const
+    {
+        return (format == other.format) && (srcWidth == other.srcWidth) && (srcHeight == other.srcHeight) && (crop == other.crop)
+            && (dstWidth == other.dstWidth) && (dstHeight == other.dstHeight) && (filter == other.filter);
+    }
+};
+
+/*:
+   NV12 and I420 frame scaler, of the whole frame or of a region of it (digital zoom). Each plane is filtered
+   horizontally a source row at a time into 16 bit rows with 6 more bits of precision, kept in a ring while the
+   destination rows that need them are filtered vertically, so every source row is read once per tile.
+   The filter weights of every destination column and row are computed by Initialize, and shared with the other
+   scalers of the same sizes through a small cache.
+   The destination is scaled in tiles of rows: ScaleTiles is const and any tile range gives the same rows as the
+   whole frame, so a frame can be split between threads with a workspace each.
+   Only depends on the C++ standard library, the SSE2 (x86, x64) and NEON (ARM64) kernels give the same output
+   as the C++ ones.
+   The media source only scales whole frames, for its derived streams: it does not implement the digital window
+   control (KSPROPERTY_CAMERACONTROL_EXTENDED_DIGITALWINDOW) nor report KSCAMERA_METADATA_DIGITALWINDOW, so the
+   crop is only used by the tests and by callers of the scaler.
+*/
+class ImageScaler
+{
+public:
+    // Ring of horizontally filtered rows, vertical taps of them
+    struct Workspace
+    {
+        std::vector<int16_t> rows;
+        std::vector<int32_t> rowIndex;      // source row held by each row of the ring, -1 for none
+        std::vector<const int16_t*> rowPointers;
+    };
+
+    ImageScaler() = default;
+    ~ImageScaler() {};
+
+    // False if a size or the crop is 0, odd or out of the source
+    bool Initialize(ImageScalerSettings const& settings, bool bUseSimd = true);
+    bool Initialize(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, ScaleFilter filter, bool bUseSimd = true)
+    {
+        return Initialize({ ScaleFormat::NV12, srcWidth, srcHeight, {}, dstWidth, dstHeight, filter }, bUseSimd);
+    }
+
+    // Box for downscales of 2x or more, where bilinear would skip source pixels, bilinear otherwise
+    static ScaleFilter DefaultFilter(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight);
+
+    bool IsInitialized(ImageScalerSettings const& settings) const;
+    bool IsInitialized(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, ScaleFilter filter) const
+    {
+        return IsInitialized({ ScaleFormat::NV12, srcWidth, srcHeight, {}, dstWidth, dstHeight, filter });
+    }
+    ImageScalerSettings const& Settings() const { return m_settings; }
+
+    // Top down frames of the settings' format
+    void Scale(const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride);
+
+    // Tiles [tileStart, tileEnd) of the destination, TILE_ROWS rows each. Calls at the same time need a workspace each
+    static const uint32_t TILE_ROWS = 64;
+    uint32_t TileCount() const { return (m_settings.dstHeight + TILE_ROWS - 1) / TILE_ROWS; }
+    void ScaleTiles(const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride, uint32_t tileStart, uint32_t tileEnd, Workspace* pWorkspace) const;
+
+    // Weights are 14 bit fixed point, the 16 bit rows are 6 bit fixed point
+    typedef void (*PFN_HORIZONTAL)(const uint8_t* pSrc, const int32_t* pStarts, const int16_t* pWeights, uint32_t taps, uint32_t dstWidth, int16_t* pDst);
+    typedef void (*PFN_VERTICAL)(const int16_t* const* ppRows, const int16_t* pWeights, uint32_t taps, uint32_t count, uint8_t* pDst);
+
+private:
+    // Destination pixel i is the sum of taps source pixels from starts[i], weighted by weights[i * taps...]
+    struct FilterTable
+    {
+        uint32_t taps;
+        std::vector<int32_t> starts;
+        std::vector<int16_t> weights;
+    };
+
+    // Source pixels [offset, offset + length) of srcSize scaled to dstSize
+    struct TableKey
+    {
+        uint32_t srcSize;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t dstSize;
+        ScaleFilter filter;
+        uint32_t tapMultiple;
+
+        bool operator==(TableKey const& other) const
+        {
+            return (srcSize == other.srcSize) && (offset == other.offset) && (length == other.length)
+                && (dstSize == other.dstSize) && (filter == other.filter) && (tapMultiple == other.tapMultiple);
+        }
+    };
+
+    struct Plane
+    {
+        std::shared_ptr<const FilterTable> horizontal;
+        std::shared_ptr<const FilterTable> vertical;
+        uint32_t channels;          // 2 for the interleaved UV plane
+        uint32_t dstWidth;
+        uint32_t dstHeight;
+        PFN_HORIZONTAL pfnHorizontal;
+    };
+
+    // tapMultiple pads the filter for the SIMD kernels, when the source has as many pixels
+    static void _ComputeTable(TableKey const& key, FilterTable* pTable);
+    static std::shared_ptr<const FilterTable> _GetTable(TableKey const& key);
+    static ImageScalerSettings _Normalize(ImageScalerSettings const& settings);
+    void _InitializePlane(Plane* pPlane, uint32_t channels, uint32_t srcWidth, uint32_t srcHeight, ScaleRect const& crop,
+        uint32_t dstWidth, uint32_t dstHeight, bool bUseSimd);
+    void _ScalePlane(Plane const& plane, const uint8_t* pSrc, int32_t srcStride, uint8_t* pDst, int32_t dstStride,
+        uint32_t rowStart, uint32_t rowEnd, Workspace* pWorkspace) const;
+
+    ImageScalerSettings m_settings = {};
+    bool m_bInitialized = false;
+
+    Plane m_y = {};
+    Plane m_chroma = {};            // UV for NV12, U and V for I420
+    PFN_VERTICAL m_pfnVertical = nullptr;
+    uint32_t m_maxTaps = 0;         // vertical taps of the planes
+    uint32_t m_maxRowSize = 0;      // values of a destination row of the planes
+
+    Workspace m_workspace;          // used by Scale
+};
+
+#endif
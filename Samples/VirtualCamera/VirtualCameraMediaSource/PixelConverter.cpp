@@ -0,0 +1,776 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Built without the precompiled header, see PixelConverter.h
+#include <cmath>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define PIXELCONVERTER_SSE41
+#define PIXELCONVERTER_AVX2                 // checked at run time
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define PIXELCONVERTER_SSE41
+#include <immintrin.h>
+#if defined(__AVX2__)
+#define PIXELCONVERTER_AVX2                 // other compilers only build it with -mavx2 or above
+#endif
+#elif defined(_M_ARM64)
+#define PIXELCONVERTER_NEON
+#include <arm64_neon.h>
+#elif defined(__ARM_NEON)
+#define PIXELCONVERTER_NEON
+#include <arm_neon.h>
+#endif
+
+#include "PixelConverter.h"
+
+namespace
+{
+    //////////////////////////////////////////////////
+    // C++ kernels, the reference for the SIMD ones. They start at column x so the SIMD kernels can finish a row with them.
+
+    inline int Clamp(int value, int maxValue)
+    {
+        return (value < 0) ? 0 : ((value > maxValue) ? maxValue : value);
+    }
+
+    inline int Luma(const YUVCoefficients& c, const uint8_t* pBGRX)
+    {
+        return Clamp((c.y[0] * pBGRX[0] + c.y[1] * pBGRX[1] + c.y[2] * pBGRX[2] + c.yBias) >> c.shift, c.maxValue);
+    }
+
+    // B, G and R are sums of 4 pixels (2x2, shift + 2) or 2 pixels (2x1, shift + 1)
+    inline int Chroma(const int16_t k[4], int32_t bias, int shift, int B, int G, int R)
+    {
+        return (k[0] * B + k[1] * G + k[2] * R + bias) >> shift;
+    }
+
+    void RowPair420_C(const YUVCoefficients& c, uint32_t x, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep)
+    {
+        for (; x < width; x += 2)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            pY0[x] = (uint8_t)Luma(c, p0);
+            pY0[x + 1] = (uint8_t)Luma(c, p0 + 4);
+            pY1[x] = (uint8_t)Luma(c, p1);
+            pY1[x + 1] = (uint8_t)Luma(c, p1 + 4);
+
+            int B = p0[0] + p0[4] + p1[0] + p1[4];
+            int G = p0[1] + p0[5] + p1[1] + p1[5];
+            int R = p0[2] + p0[6] + p1[2] + p1[6];
+            pU[(x / 2) * uvStep] = (uint8_t)Clamp(Chroma(c.u, c.uvBias2x2, c.shift + 2, B, G, R), c.maxValue);
+            pV[(x / 2) * uvStep] = (uint8_t)Clamp(Chroma(c.v, c.uvBias2x2, c.shift + 2, B, G, R), c.maxValue);
+        }
+    }
+
+    // 10 bit samples in the high bits of 16 bit words, as P010
+    void RowPair420_16_C(const YUVCoefficients& c, uint32_t x, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV)
+    {
+        for (; x < width; x += 2)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            pY0[x] = (uint16_t)(Luma(c, p0) << 6);
+            pY0[x + 1] = (uint16_t)(Luma(c, p0 + 4) << 6);
+            pY1[x] = (uint16_t)(Luma(c, p1) << 6);
+            pY1[x + 1] = (uint16_t)(Luma(c, p1 + 4) << 6);
+
+            int B = p0[0] + p0[4] + p1[0] + p1[4];
+            int G = p0[1] + p0[5] + p1[1] + p1[5];
+            int R = p0[2] + p0[6] + p1[2] + p1[6];
+            pUV[x] = (uint16_t)(Clamp(Chroma(c.u, c.uvBias2x2, c.shift + 2, B, G, R), c.maxValue) << 6);
+            pUV[x + 1] = (uint16_t)(Clamp(Chroma(c.v, c.uvBias2x2, c.shift + 2, B, G, R), c.maxValue) << 6);
+        }
+    }
+
+    void Row422_C(const YUVCoefficients& c, uint32_t x, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2)
+    {
+        for (; x < width; x += 2)
+        {
+            const uint8_t* p = pRGB + x * 4;
+            uint8_t* pOut = pYUY2 + x * 2;
+            int B = p[0] + p[4];
+            int G = p[1] + p[5];
+            int R = p[2] + p[6];
+            pOut[0] = (uint8_t)Luma(c, p);
+            pOut[1] = (uint8_t)Clamp(Chroma(c.u, c.uvBias2x1, c.shift + 1, B, G, R), c.maxValue);
+            pOut[2] = (uint8_t)Luma(c, p + 4);
+            pOut[3] = (uint8_t)Clamp(Chroma(c.v, c.uvBias2x1, c.shift + 1, B, G, R), c.maxValue);
+        }
+    }
+
+    void RowPair420_Ref(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep)
+    {
+        RowPair420_C(c, 0, pRGB0, pRGB1, width, pY0, pY1, pU, pV, uvStep);
+    }
+
+    void RowPair420_16_Ref(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV)
+    {
+        RowPair420_16_C(c, 0, pRGB0, pRGB1, width, pY0, pY1, pUV);
+    }
+
+    void Row422_Ref(const YUVCoefficients& c, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2)
+    {
+        Row422_C(c, 0, pRGB, width, pYUY2);
+    }
+
+#if defined(PIXELCONVERTER_SSE41)
+    //////////////////////////////////////////////////
+    // SSE4.1 kernels, 8 pixels at a time
+
+    // 4 BGRX pixels to 4 luma values
+    inline __m128i Luma4_SSE41(__m128i bgrx, __m128i ky, __m128i bias, __m128i shift)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = _mm_hadd_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi8(bgrx, zero), ky),
+            _mm_madd_epi16(_mm_unpackhi_epi8(bgrx, zero), ky));
+        return _mm_sra_epi32(_mm_add_epi32(sum, bias), shift);
+    }
+
+    // 8 BGRX pixels to 8 luma values, 16 bits each
+    inline __m128i Luma8_SSE41(const YUVCoefficients& c, const uint8_t* p)
+    {
+        const __m128i ky = _mm_set_epi16(0, c.y[2], c.y[1], c.y[0], 0, c.y[2], c.y[1], c.y[0]);
+        const __m128i bias = _mm_set1_epi32(c.yBias);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift);
+        return _mm_packs_epi32(
+            Luma4_SSE41(_mm_loadu_si128((const __m128i*)p), ky, bias, shift),
+            Luma4_SSE41(_mm_loadu_si128((const __m128i*)(p + 16)), ky, bias, shift));
+    }
+
+    // Sums of the pixel pairs of 4 BGRX pixels (as 16 bit B, G, R, X) given as 2 pixels per register
+    inline __m128i PairSums_SSE41(__m128i p01, __m128i p23)
+    {
+        return _mm_unpacklo_epi64(_mm_add_epi16(p01, _mm_srli_si128(p01, 8)), _mm_add_epi16(p23, _mm_srli_si128(p23, 8)));
+    }
+
+    // Chroma of 4 pixel sums (2 per register) with the coefficients k
+    inline __m128i Chroma4_SSE41(__m128i s01, __m128i s23, __m128i k, __m128i bias, __m128i shift)
+    {
+        __m128i sum = _mm_hadd_epi32(_mm_madd_epi16(s01, k), _mm_madd_epi16(s23, k));
+        return _mm_sra_epi32(_mm_add_epi32(sum, bias), shift);
+    }
+
+    // 2x2 chroma of 8 pixels of 2 rows: U in the low 4 values, V in the high 4
+    inline void Chroma2x2_SSE41(const YUVCoefficients& c, const uint8_t* p0, const uint8_t* p1, __m128i* pU, __m128i* pV)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ku = _mm_set_epi16(0, c.u[2], c.u[1], c.u[0], 0, c.u[2], c.u[1], c.u[0]);
+        const __m128i kv = _mm_set_epi16(0, c.v[2], c.v[1], c.v[0], 0, c.v[2], c.v[1], c.v[0]);
+        const __m128i bias = _mm_set1_epi32(c.uvBias2x2);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift + 2);
+
+        __m128i a0 = _mm_loadu_si128((const __m128i*)p0);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(p0 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)p1);
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p1 + 16));
+
+        // vertical sums, 2 pixels per register
+        __m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        __m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        __m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+        // then horizontal: the 4 2x2 sums
+        __m128i s0123 = PairSums_SSE41(v01, v23);
+        __m128i s4567 = PairSums_SSE41(v45, v67);
+
+        *pU = Chroma4_SSE41(s0123, s4567, ku, bias, shift);
+        *pV = Chroma4_SSE41(s0123, s4567, kv, bias, shift);
+    }
+
+    void RowPair420_SSE41(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep)
+    {
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            __m128i y0 = Luma8_SSE41(c, p0);
+            __m128i y1 = Luma8_SSE41(c, p1);
+            _mm_storel_epi64((__m128i*)(pY0 + x), _mm_packus_epi16(y0, y0));
+            _mm_storel_epi64((__m128i*)(pY1 + x), _mm_packus_epi16(y1, y1));
+
+            __m128i u, v;
+            Chroma2x2_SSE41(c, p0, p1, &u, &v);
+            if (uvStep == 2)
+            {
+                // NV12, U V U V...
+                __m128i uv = _mm_packs_epi32(_mm_unpacklo_epi32(u, v), _mm_unpackhi_epi32(u, v));
+                _mm_storel_epi64((__m128i*)(pU + x), _mm_packus_epi16(uv, uv));
+            }
+            else
+            {
+                __m128i uv = _mm_packs_epi32(u, v);
+                uv = _mm_packus_epi16(uv, uv);
+                *(uint32_t*)(pU + x / 2) = (uint32_t)_mm_cvtsi128_si32(uv);
+                *(uint32_t*)(pV + x / 2) = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+            }
+        }
+        RowPair420_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pU, pV, uvStep);
+    }
+
+    void RowPair420_16_SSE41(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV)
+    {
+        const __m128i maxValue = _mm_set1_epi16((short)c.maxValue);
+        const __m128i zero = _mm_setzero_si128();
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            // the luma values are 16 bit signed, clamp them to 0..maxValue
+            __m128i y0 = _mm_min_epi16(_mm_max_epi16(Luma8_SSE41(c, p0), zero), maxValue);
+            __m128i y1 = _mm_min_epi16(_mm_max_epi16(Luma8_SSE41(c, p1), zero), maxValue);
+            _mm_storeu_si128((__m128i*)(pY0 + x), _mm_slli_epi16(y0, 6));
+            _mm_storeu_si128((__m128i*)(pY1 + x), _mm_slli_epi16(y1, 6));
+
+            __m128i u, v;
+            Chroma2x2_SSE41(c, p0, p1, &u, &v);
+            __m128i uv = _mm_packus_epi32(_mm_unpacklo_epi32(u, v), _mm_unpackhi_epi32(u, v));
+            uv = _mm_min_epu16(uv, maxValue);
+            _mm_storeu_si128((__m128i*)(pUV + x), _mm_slli_epi16(uv, 6));
+        }
+        RowPair420_16_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pUV);
+    }
+
+    void Row422_SSE41(const YUVCoefficients& c, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ku = _mm_set_epi16(0, c.u[2], c.u[1], c.u[0], 0, c.u[2], c.u[1], c.u[0]);
+        const __m128i kv = _mm_set_epi16(0, c.v[2], c.v[1], c.v[0], 0, c.v[2], c.v[1], c.v[0]);
+        const __m128i bias = _mm_set1_epi32(c.uvBias2x1);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift + 1);
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            const uint8_t* p = pRGB + x * 4;
+            __m128i y = Luma8_SSE41(c, p);
+
+            __m128i a0 = _mm_loadu_si128((const __m128i*)p);
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(p + 16));
+            __m128i s0123 = PairSums_SSE41(_mm_unpacklo_epi8(a0, zero), _mm_unpackhi_epi8(a0, zero));
+            __m128i s4567 = PairSums_SSE41(_mm_unpacklo_epi8(a1, zero), _mm_unpackhi_epi8(a1, zero));
+            __m128i u = Chroma4_SSE41(s0123, s4567, ku, bias, shift);
+            __m128i v = Chroma4_SSE41(s0123, s4567, kv, bias, shift);
+            __m128i uv = _mm_packs_epi32(_mm_unpacklo_epi32(u, v), _mm_unpackhi_epi32(u, v));
+
+            // Y0 U Y1 V
+            __m128i yuyv = _mm_packus_epi16(_mm_unpacklo_epi16(y, uv), _mm_unpackhi_epi16(y, uv));
+            _mm_storeu_si128((__m128i*)(pYUY2 + x * 2), yuyv);
+        }
+        Row422_C(c, x, pRGB, width, pYUY2);
+    }
+#endif
+
+#if defined(PIXELCONVERTER_AVX2)
+    //////////////////////////////////////////////////
+    // AVX2 kernels, 16 pixels at a time: the SSE4.1 ones on both 128 bit lanes, then the lanes put back in order.
+    // The converter is bound by the arithmetic rather than the memory with SSE4.1 (see PixelConverterTest.TestThroughput)
+
+    // 4 BGRX pixels of each lane to 4 luma values
+    inline __m256i Luma4_AVX2(__m256i bgrx, __m256i ky, __m256i bias, __m128i shift)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i sum = _mm256_hadd_epi32(
+            _mm256_madd_epi16(_mm256_unpacklo_epi8(bgrx, zero), ky),
+            _mm256_madd_epi16(_mm256_unpackhi_epi8(bgrx, zero), ky));
+        return _mm256_sra_epi32(_mm256_add_epi32(sum, bias), shift);
+    }
+
+    // 16 BGRX pixels to 16 luma values, 16 bits each, in order
+    inline __m256i Luma16_AVX2(const YUVCoefficients& c, const uint8_t* p)
+    {
+        const __m256i ky = _mm256_setr_epi16(c.y[0], c.y[1], c.y[2], 0, c.y[0], c.y[1], c.y[2], 0, c.y[0], c.y[1], c.y[2], 0, c.y[0], c.y[1], c.y[2], 0);
+        const __m256i bias = _mm256_set1_epi32(c.yBias);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift);
+        // pixels 0-3 8-11 | 4-7 12-15
+        __m256i y = _mm256_packs_epi32(
+            Luma4_AVX2(_mm256_loadu_si256((const __m256i*)p), ky, bias, shift),
+            Luma4_AVX2(_mm256_loadu_si256((const __m256i*)(p + 32)), ky, bias, shift));
+        return _mm256_permute4x64_epi64(y, _MM_SHUFFLE(3, 1, 2, 0));
+    }
+
+    // Sums of the pixel pairs, 2 pixels per lane of each register
+    inline __m256i PairSums_AVX2(__m256i p01, __m256i p23)
+    {
+        return _mm256_unpacklo_epi64(_mm256_add_epi16(p01, _mm256_srli_si256(p01, 8)), _mm256_add_epi16(p23, _mm256_srli_si256(p23, 8)));
+    }
+
+    // Chroma of the sums of pixels 0-7 and 8-15, in order
+    inline __m256i Chroma8_AVX2(__m256i s0123, __m256i s4567, __m256i k, __m256i bias, __m128i shift)
+    {
+        // sums 0 1 4 5 | 2 3 6 7
+        __m256i sum = _mm256_hadd_epi32(_mm256_madd_epi16(s0123, k), _mm256_madd_epi16(s4567, k));
+        sum = _mm256_sra_epi32(_mm256_add_epi32(sum, bias), shift);
+        return _mm256_permutevar8x32_epi32(sum, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+    }
+
+    // Interleaved U V of 8 chroma pairs, 16 bits each: pairs 0-3 | 4-7
+    inline __m256i Interleave_AVX2(__m256i u, __m256i v)
+    {
+        return _mm256_packs_epi32(_mm256_unpacklo_epi32(u, v), _mm256_unpackhi_epi32(u, v));
+    }
+
+    // 2x2 chroma of 16 pixels of 2 rows, in order
+    inline void Chroma2x2_AVX2(const YUVCoefficients& c, const uint8_t* p0, const uint8_t* p1, __m256i* pU, __m256i* pV)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ku = _mm256_setr_epi16(c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0);
+        const __m256i kv = _mm256_setr_epi16(c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0);
+        const __m256i bias = _mm256_set1_epi32(c.uvBias2x2);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift + 2);
+
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)p0);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(p0 + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)p1);
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(p1 + 32));
+
+        // vertical sums, pixels 0 1 | 4 5 and 2 3 | 6 7 of each register
+        __m256i va = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+        __m256i vb = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+        __m256i vc = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+        __m256i vd = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+
+        // then horizontal: the 2x2 sums 0 1 | 2 3 and 4 5 | 6 7
+        __m256i s0123 = PairSums_AVX2(va, vb);
+        __m256i s4567 = PairSums_AVX2(vc, vd);
+
+        *pU = Chroma8_AVX2(s0123, s4567, ku, bias, shift);
+        *pV = Chroma8_AVX2(s0123, s4567, kv, bias, shift);
+    }
+
+    void RowPair420_AVX2(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep)
+    {
+        uint32_t x = 0;
+        for (; x + 16 <= width; x += 16)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            // 8 bit values 0-7 8-15 | 0-7 8-15 after the pack, the low 64 bits of each lane
+            __m256i y0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(Luma16_AVX2(c, p0), _mm256_setzero_si256()), _MM_SHUFFLE(3, 1, 2, 0));
+            __m256i y1 = _mm256_permute4x64_epi64(_mm256_packus_epi16(Luma16_AVX2(c, p1), _mm256_setzero_si256()), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)(pY0 + x), _mm256_castsi256_si128(y0));
+            _mm_storeu_si128((__m128i*)(pY1 + x), _mm256_castsi256_si128(y1));
+
+            __m256i u, v;
+            Chroma2x2_AVX2(c, p0, p1, &u, &v);
+            if (uvStep == 2)
+            {
+                // NV12, U V U V...
+                __m256i uv = _mm256_packus_epi16(Interleave_AVX2(u, v), _mm256_setzero_si256());
+                uv = _mm256_permute4x64_epi64(uv, _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128((__m128i*)(pU + x), _mm256_castsi256_si128(uv));
+            }
+            else
+            {
+                // U 0-3 V 0-3 | U 4-7 V 4-7, then U 0-7 V 0-7
+                __m256i uv = _mm256_permute4x64_epi64(_mm256_packs_epi32(u, v), _MM_SHUFFLE(3, 1, 2, 0));
+                uv = _mm256_packus_epi16(uv, uv);
+                _mm_storel_epi64((__m128i*)(pU + x / 2), _mm256_castsi256_si128(uv));
+                _mm_storel_epi64((__m128i*)(pV + x / 2), _mm256_extracti128_si256(uv, 1));
+            }
+        }
+        RowPair420_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pU, pV, uvStep);
+    }
+
+    void RowPair420_16_AVX2(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV)
+    {
+        const __m256i maxValue = _mm256_set1_epi16((short)c.maxValue);
+        const __m256i zero = _mm256_setzero_si256();
+        uint32_t x = 0;
+        for (; x + 16 <= width; x += 16)
+        {
+            const uint8_t* p0 = pRGB0 + x * 4;
+            const uint8_t* p1 = pRGB1 + x * 4;
+            __m256i y0 = _mm256_min_epi16(_mm256_max_epi16(Luma16_AVX2(c, p0), zero), maxValue);
+            __m256i y1 = _mm256_min_epi16(_mm256_max_epi16(Luma16_AVX2(c, p1), zero), maxValue);
+            _mm256_storeu_si256((__m256i*)(pY0 + x), _mm256_slli_epi16(y0, 6));
+            _mm256_storeu_si256((__m256i*)(pY1 + x), _mm256_slli_epi16(y1, 6));
+
+            __m256i u, v;
+            Chroma2x2_AVX2(c, p0, p1, &u, &v);
+            __m256i uv = _mm256_packus_epi32(_mm256_unpacklo_epi32(u, v), _mm256_unpackhi_epi32(u, v));
+            uv = _mm256_min_epu16(uv, maxValue);
+            _mm256_storeu_si256((__m256i*)(pUV + x), _mm256_slli_epi16(uv, 6));
+        }
+        RowPair420_16_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pUV);
+    }
+
+    void Row422_AVX2(const YUVCoefficients& c, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ku = _mm256_setr_epi16(c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0, c.u[0], c.u[1], c.u[2], 0);
+        const __m256i kv = _mm256_setr_epi16(c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0, c.v[0], c.v[1], c.v[2], 0);
+        const __m256i bias = _mm256_set1_epi32(c.uvBias2x1);
+        const __m128i shift = _mm_cvtsi32_si128(c.shift + 1);
+        uint32_t x = 0;
+        for (; x + 16 <= width; x += 16)
+        {
+            const uint8_t* p = pRGB + x * 4;
+            __m256i y = Luma16_AVX2(c, p);
+
+            __m256i a0 = _mm256_loadu_si256((const __m256i*)p);
+            __m256i a1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+            __m256i s0123 = PairSums_AVX2(_mm256_unpacklo_epi8(a0, zero), _mm256_unpackhi_epi8(a0, zero));
+            __m256i s4567 = PairSums_AVX2(_mm256_unpacklo_epi8(a1, zero), _mm256_unpackhi_epi8(a1, zero));
+            __m256i uv = Interleave_AVX2(Chroma8_AVX2(s0123, s4567, ku, bias, shift), Chroma8_AVX2(s0123, s4567, kv, bias, shift));
+
+            // Y0 U Y1 V, pixels 0-7 | 8-15
+            __m256i yuyv = _mm256_packus_epi16(_mm256_unpacklo_epi16(y, uv), _mm256_unpackhi_epi16(y, uv));
+            _mm256_storeu_si256((__m256i*)(pYUY2 + x * 2), yuyv);
+        }
+        Row422_C(c, x, pRGB, width, pYUY2);
+    }
+
+    bool IsAvx2Supported()
+    {
+#if defined(_MSC_VER)
+        static const bool bAVX2 = []()
+        {
+            int cpuInfo[4] = {};
+            __cpuid(cpuInfo, 1);
+            // ECX bit 27: OSXSAVE, the OS saves the YMM registers (XCR0 bits 1 and 2)
+            if (((cpuInfo[2] & (1 << 27)) == 0) || ((_xgetbv(0) & 0x6) != 0x6))
+            {
+                return false;
+            }
+            __cpuidex(cpuInfo, 7, 0);
+            return (cpuInfo[1] & (1 << 5)) != 0;    // EBX bit 5: AVX2
+        }();
+        return bAVX2;
+#else
+        return true;
+#endif
+    }
+#endif
+
+#if defined(PIXELCONVERTER_NEON)
+    //////////////////////////////////////////////////
+    // NEON kernels, 8 pixels at a time
+
+    // 8 luma values, 16 bits each, of the deinterleaved B, G, R bytes
+    inline int16x8_t Luma8_NEON(const YUVCoefficients& c, uint8x8x4_t bgrx)
+    {
+        int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(bgrx.val[0]));
+        int16x8_t g = vreinterpretq_s16_u16(vmovl_u8(bgrx.val[1]));
+        int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(bgrx.val[2]));
+        int32x4_t bias = vdupq_n_s32(c.yBias);
+        int32x4_t shift = vdupq_n_s32(-c.shift);
+
+        int32x4_t lo = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(bias, vget_low_s16(b), c.y[0]), vget_low_s16(g), c.y[1]), vget_low_s16(r), c.y[2]);
+        int32x4_t hi = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(bias, vget_high_s16(b), c.y[0]), vget_high_s16(g), c.y[1]), vget_high_s16(r), c.y[2]);
+        return vcombine_s16(vqmovn_s32(vshlq_s32(lo, shift)), vqmovn_s32(vshlq_s32(hi, shift)));
+    }
+
+    inline int32x4_t Chroma4_NEON(const int16_t k[4], int32x4_t b, int32x4_t g, int32x4_t r, int32x4_t bias, int32x4_t shift)
+    {
+        return vshlq_s32(vmlaq_n_s32(vmlaq_n_s32(vmlaq_n_s32(bias, b, k[0]), g, k[1]), r, k[2]), shift);
+    }
+
+    // U V U V... of 4 chroma pairs
+    inline int16x8_t Interleave_NEON(int32x4_t u, int32x4_t v)
+    {
+        int16x4x2_t uv = vzip_s16(vqmovn_s32(u), vqmovn_s32(v));
+        return vcombine_s16(uv.val[0], uv.val[1]);
+    }
+
+    void RowPair420_NEON_Chroma(const YUVCoefficients& c, uint8x8x4_t a, uint8x8x4_t b, int32x4_t* pU, int32x4_t* pV)
+    {
+        // vertical then horizontal sums: the 4 2x2 sums
+        int32x4_t sb = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(a.val[0], b.val[0])));
+        int32x4_t sg = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(a.val[1], b.val[1])));
+        int32x4_t sr = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(a.val[2], b.val[2])));
+        int32x4_t bias = vdupq_n_s32(c.uvBias2x2);
+        int32x4_t shift = vdupq_n_s32(-(c.shift + 2));
+        *pU = Chroma4_NEON(c.u, sb, sg, sr, bias, shift);
+        *pV = Chroma4_NEON(c.v, sb, sg, sr, bias, shift);
+    }
+
+    void RowPair420_NEON(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep)
+    {
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            uint8x8x4_t a = vld4_u8(pRGB0 + x * 4);
+            uint8x8x4_t b = vld4_u8(pRGB1 + x * 4);
+            vst1_u8(pY0 + x, vqmovun_s16(Luma8_NEON(c, a)));
+            vst1_u8(pY1 + x, vqmovun_s16(Luma8_NEON(c, b)));
+
+            int32x4_t u, v;
+            RowPair420_NEON_Chroma(c, a, b, &u, &v);
+            if (uvStep == 2)
+            {
+                vst1_u8(pU + x, vqmovun_s16(Interleave_NEON(u, v)));
+            }
+            else
+            {
+                uint8x8_t uv = vqmovun_s16(vcombine_s16(vqmovn_s32(u), vqmovn_s32(v)));
+                vst1_lane_u32((uint32_t*)(pU + x / 2), vreinterpret_u32_u8(uv), 0);
+                vst1_lane_u32((uint32_t*)(pV + x / 2), vreinterpret_u32_u8(uv), 1);
+            }
+        }
+        RowPair420_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pU, pV, uvStep);
+    }
+
+    void RowPair420_16_NEON(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV)
+    {
+        const uint16x8_t maxValue = vdupq_n_u16((uint16_t)c.maxValue);
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            uint8x8x4_t a = vld4_u8(pRGB0 + x * 4);
+            uint8x8x4_t b = vld4_u8(pRGB1 + x * 4);
+            uint16x8_t y0 = vminq_u16(vreinterpretq_u16_s16(vmaxq_s16(Luma8_NEON(c, a), vdupq_n_s16(0))), maxValue);
+            uint16x8_t y1 = vminq_u16(vreinterpretq_u16_s16(vmaxq_s16(Luma8_NEON(c, b), vdupq_n_s16(0))), maxValue);
+            vst1q_u16(pY0 + x, vshlq_n_u16(y0, 6));
+            vst1q_u16(pY1 + x, vshlq_n_u16(y1, 6));
+
+            int32x4_t u, v;
+            RowPair420_NEON_Chroma(c, a, b, &u, &v);
+            uint16x8_t uv = vminq_u16(vreinterpretq_u16_s16(vmaxq_s16(Interleave_NEON(u, v), vdupq_n_s16(0))), maxValue);
+            vst1q_u16(pUV + x, vshlq_n_u16(uv, 6));
+        }
+        RowPair420_16_C(c, x, pRGB0, pRGB1, width, pY0, pY1, pUV);
+    }
+
+    void Row422_NEON(const YUVCoefficients& c, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2)
+    {
+        const int32x4_t bias = vdupq_n_s32(c.uvBias2x1);
+        const int32x4_t shift = vdupq_n_s32(-(c.shift + 1));
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            uint8x8x4_t a = vld4_u8(pRGB + x * 4);
+            uint8x8_t y = vqmovun_s16(Luma8_NEON(c, a));
+
+            int32x4_t sb = vreinterpretq_s32_u32(vmovl_u16(vpaddl_u8(a.val[0])));
+            int32x4_t sg = vreinterpretq_s32_u32(vmovl_u16(vpaddl_u8(a.val[1])));
+            int32x4_t sr = vreinterpretq_s32_u32(vmovl_u16(vpaddl_u8(a.val[2])));
+            uint8x8_t uv = vqmovun_s16(Interleave_NEON(Chroma4_NEON(c.u, sb, sg, sr, bias, shift), Chroma4_NEON(c.v, sb, sg, sr, bias, shift)));
+
+            // Y0 U Y1 V
+            uint8x8x2_t yuyv = vzip_u8(y, uv);
+            vst1_u8(pYUY2 + x * 2, yuyv.val[0]);
+            vst1_u8(pYUY2 + x * 2 + 8, yuyv.val[1]);
+        }
+        Row422_C(c, x, pRGB, width, pYUY2);
+    }
+#endif
+}
+
+bool PixelConverter::Initialize(YUVMatrix matrix, YUVRange range, bool bUseSimd)
+{
+    if ((matrix != YUVMatrix::BT601 && matrix != YUVMatrix::BT709 && matrix != YUVMatrix::BT2020)
+        || (range != YUVRange::Limited && range != YUVRange::Full))
+    {
+        return false;
+    }
+
+    _ComputeCoefficients(matrix, range, 8, &m_coefficients8);
+    _ComputeCoefficients(matrix, range, 10, &m_coefficients10);
+
+    m_pfnRowPair420 = RowPair420_Ref;
+    m_pfnRowPair420_16 = RowPair420_16_Ref;
+    m_pfnRow422 = Row422_Ref;
+    if (bUseSimd && IsSimdSupported())
+    {
+#if defined(PIXELCONVERTER_SSE41)
+        m_pfnRowPair420 = RowPair420_SSE41;
+        m_pfnRowPair420_16 = RowPair420_16_SSE41;
+        m_pfnRow422 = Row422_SSE41;
+#if defined(PIXELCONVERTER_AVX2)
+        if (IsAvx2Supported())
+        {
+            m_pfnRowPair420 = RowPair420_AVX2;
+            m_pfnRowPair420_16 = RowPair420_16_AVX2;
+            m_pfnRow422 = Row422_AVX2;
+        }
+#endif
+#elif defined(PIXELCONVERTER_NEON)
+        m_pfnRowPair420 = RowPair420_NEON;
+        m_pfnRowPair420_16 = RowPair420_16_NEON;
+        m_pfnRow422 = Row422_NEON;
+#endif
+    }
+
+    return true;
+}
+
+bool PixelConverter::IsSimdSupported()
+{
+#if defined(PIXELCONVERTER_SSE41) && defined(_MSC_VER)
+    static const bool bSSE41 = []()
+    {
+        int cpuInfo[4] = {};
+        __cpuid(cpuInfo, 1);
+        return (cpuInfo[2] & (1 << 19)) != 0;   // ECX bit 19: SSE4.1
+    }();
+    return bSSE41;
+#elif defined(PIXELCONVERTER_SSE41)
+    return true;                                // only built with -msse4.1 or above by other compilers
+#elif defined(PIXELCONVERTER_NEON)
+    return true;                                // part of ARMv8
+#else
+    return false;
+#endif
+}
+
+bool PixelConverter::ConvertFromRGB32(
+    const uint8_t* pSrc,
+    size_t cbSrc,
+    int32_t srcStride,
+    uint32_t width,
+    uint32_t height,
+    YUVFormat format,
+    uint8_t* pDst,
+    size_t cbDst,
+    int32_t dstStride) const
+{
+    return ConvertRowsFromRGB32(pSrc, cbSrc, srcStride, width, height, format, pDst, cbDst, dstStride, 0, height);
+}
+
+bool PixelConverter::ConvertRowsFromRGB32(
+    const uint8_t* pSrc,
+    size_t cbSrc,
+    int32_t srcStride,
+    uint32_t width,
+    uint32_t height,
+    YUVFormat format,
+    uint8_t* pDst,
+    size_t cbDst,
+    int32_t dstStride,
+    uint32_t rowStart,
+    uint32_t rowEnd) const
+{
+    if ((m_pfnRowPair420 == nullptr) || (pSrc == nullptr) || (pDst == nullptr)
+        || (rowStart > rowEnd) || (rowEnd > height)
+        || (width == 0) || (height == 0) || (width & 1) || (height & 1)
+        || (srcStride < (int32_t)(width * 4)) || (dstStride <= 0)
+        || (cbSrc < (uint64_t)srcStride * height))
+    {
+        return false;
+    }
+
+    uint64_t planeSize = (uint64_t)dstStride * height;
+    switch (format)
+    {
+    case YUVFormat::NV12:
+    case YUVFormat::I420:
+    {
+        if ((dstStride < (int32_t)width) || (rowStart & 1) || (rowEnd & 1) || (cbDst < planeSize + planeSize / 2))
+        {
+            return false;
+        }
+
+        bool bNV12 = (format == YUVFormat::NV12);
+        // I420 chroma planes have half the stride of the luma plane
+        int32_t chromaStride = bNV12 ? dstStride : dstStride / 2;
+        uint8_t* pU = pDst + planeSize;
+        uint8_t* pV = bNV12 ? pU + 1 : pU + (uint64_t)chromaStride * (height / 2);
+        for (uint32_t r = rowStart; r < rowEnd; r += 2)
+        {
+            m_pfnRowPair420(m_coefficients8,
+                pSrc + (uint64_t)r * srcStride, pSrc + (uint64_t)(r + 1) * srcStride, width,
+                pDst + (uint64_t)r * dstStride, pDst + (uint64_t)(r + 1) * dstStride,
+                pU + (uint64_t)(r / 2) * chromaStride, pV + (uint64_t)(r / 2) * chromaStride, bNV12 ? 2 : 1);
+        }
+        return true;
+    }
+    case YUVFormat::P010:
+    {
+        if ((dstStride < (int32_t)(width * 2)) || (dstStride & 1) || (rowStart & 1) || (rowEnd & 1) || (cbDst < planeSize + planeSize / 2))
+        {
+            return false;
+        }
+
+        uint8_t* pUV = pDst + planeSize;
+        for (uint32_t r = rowStart; r < rowEnd; r += 2)
+        {
+            m_pfnRowPair420_16(m_coefficients10,
+                pSrc + (uint64_t)r * srcStride, pSrc + (uint64_t)(r + 1) * srcStride, width,
+                (uint16_t*)(pDst + (uint64_t)r * dstStride), (uint16_t*)(pDst + (uint64_t)(r + 1) * dstStride),
+                (uint16_t*)(pUV + (uint64_t)(r / 2) * dstStride));
+        }
+        return true;
+    }
+    case YUVFormat::YUY2:
+    {
+        if ((dstStride < (int32_t)(width * 2)) || (cbDst < planeSize))
+        {
+            return false;
+        }
+
+        for (uint32_t r = rowStart; r < rowEnd; r++)
+        {
+            m_pfnRow422(m_coefficients8, pSrc + (uint64_t)r * srcStride, width, pDst + (uint64_t)r * dstStride);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+//////////////////////////////////////////////////
+// private
+
+/*:
+   Y  = yOffset + yRange * (Kr * R + Kg * G + Kb * B) / 255
+   Cb = cOffset + cRange * (B - Y') / (2 * (1 - Kb)) / 255
+   Cr = cOffset + cRange * (R - Y') / (2 * (1 - Kr)) / 255
+   in fixed point with 22 - bitDepth fractional bits, so every coefficient fits 16 bits.
+   The green coefficients are derived from the rounded red and blue ones so that gray has no chroma
+   and white is exactly the top of the range.
+*/
+void PixelConverter::_ComputeCoefficients(YUVMatrix matrix, YUVRange range, uint32_t bitDepth, YUVCoefficients* pCoefficients)
+{
+    double kr = 0.299, kb = 0.114;
+    if (matrix == YUVMatrix::BT709)
+    {
+        kr = 0.2126;
+        kb = 0.0722;
+    }
+    else if (matrix == YUVMatrix::BT2020)
+    {
+        kr = 0.2627;
+        kb = 0.0593;
+    }
+
+    int32_t shift = 22 - (int32_t)bitDepth;
+    int32_t maxValue = (1 << bitDepth) - 1;
+    int32_t yOffset = 0, cOffset = 1 << (bitDepth - 1);
+    double yRange = maxValue, cRange = maxValue;
+    if (range == YUVRange::Limited)
+    {
+        yOffset = 16 << (bitDepth - 8);
+        yRange = 219 << (bitDepth - 8);
+        cRange = 224 << (bitDepth - 8);
+    }
+
+    double one = (double)(1 << shift);
+    double yScale = yRange / 255.0 * one;
+    double cScale = cRange / 255.0 * one;
+
+    YUVCoefficients& c = *pCoefficients;
+    c = {};
+    c.y[0] = (int16_t)std::lround(kb * yScale);
+    c.y[2] = (int16_t)std::lround(kr * yScale);
+    c.y[1] = (int16_t)(std::lround(yScale) - c.y[0] - c.y[2]);
+    c.u[0] = (int16_t)std::lround(0.5 * cScale);
+    c.u[2] = (int16_t)std::lround(-kr / (2.0 * (1.0 - kb)) * cScale);
+    c.u[1] = (int16_t)(-c.u[0] - c.u[2]);
+    c.v[2] = (int16_t)std::lround(0.5 * cScale);
+    c.v[0] = (int16_t)std::lround(-kb / (2.0 * (1.0 - kr)) * cScale);
+    c.v[1] = (int16_t)(-c.v[0] - c.v[2]);
+    c.yBias = (yOffset << shift) + (1 << (shift - 1));
+    c.uvBias2x2 = (cOffset << (shift + 2)) + (1 << (shift + 1));
+    c.uvBias2x1 = (cOffset << (shift + 1)) + (1 << shift);
+    c.shift = shift;
+    c.maxValue = maxValue;
+}
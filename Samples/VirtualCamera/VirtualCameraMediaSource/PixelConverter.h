@@ -0,0 +1,107 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+#ifndef PIXEL_CONVERTER_H
+#define PIXEL_CONVERTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class YUVMatrix
+{
+    BT601,
+    BT709,
+    BT2020
+};
+
+enum class YUVRange
+{
+    Limited,    // 16-235 luma, 16-240 chroma (64-940 and 64-960 for 10 bits)
+    Full        // 0-255 (0-1023)
+};
+
+enum class YUVFormat : uint32_t
+{
+    NV12,       // Y plane, then interleaved UV plane at stride * height
+    I420,       // Y plane, then U and V planes of stride / 2 at stride * height and stride * height * 5 / 4
+    YUY2,       // Y0 U Y1 V
+    P010        // NV12 layout, 10 bit samples in the high bits of 16 bit words
+};
+
+// Fixed point RGB to YUV coefficients for one bit depth, in the B, G, R, X order of the RGB32 bytes
+struct YUVCoefficients
+{
+    int16_t y[4];
+    int16_t u[4];
+    int16_t v[4];
+    int32_t yBias;              // offset and rounding of a luma sample
+    int32_t uvBias2x2;          // offset and rounding of a chroma sample from the sum of 4 pixels
+    int32_t uvBias2x1;          // from the sum of 2 pixels
+    int32_t shift;
+    int32_t maxValue;
+};
+
+/*:
+   RGB32 (B, G, R, X bytes, as MFVideoFormat_RGB32 and MFVideoFormat_ARGB32) to YUV converter.
+   NV12, I420 and P010 chroma is the average of each 2x2 block of pixels, YUY2 chroma the average of each
+   pair of pixels. The SSE4.1 and AVX2 (x86, x64) and NEON (ARM64) kernels give the same output as the C++ ones.
+   Only depends on the C++ standard library, the media type lookup is SimpleFrameGenerator's; this file doesn't
+   use the precompiled header so the test tooling can build it as well.
+*/
+class PixelConverter
+{
+public:
+    PixelConverter() = default;
+    ~PixelConverter() {};
+
+    // False if the matrix or the range is not one of the enums
+    bool Initialize(YUVMatrix matrix, YUVRange range, bool bUseSimd = true);
+
+    static bool IsSimdSupported();
+
+    // Top down frames; width and height must be even. False if a size, a stride or a buffer is too small,
+    // or the converter is not initialized
+    bool ConvertFromRGB32(
+        const uint8_t* pSrc,
+        size_t cbSrc,
+        int32_t srcStride,
+        uint32_t width,
+        uint32_t height,
+        YUVFormat format,
+        uint8_t* pDst,
+        size_t cbDst,
+        int32_t dstStride) const;
+
+    // Same as ConvertFromRGB32 for rows [rowStart, rowEnd) of the frame only, to split a frame between threads:
+    // the converter is only read, one can serve all of them.
+    // rowStart and rowEnd must be even for NV12, I420 and P010
+    bool ConvertRowsFromRGB32(
+        const uint8_t* pSrc,
+        size_t cbSrc,
+        int32_t srcStride,
+        uint32_t width,
+        uint32_t height,
+        YUVFormat format,
+        uint8_t* pDst,
+        size_t cbDst,
+        int32_t dstStride,
+        uint32_t rowStart,
+        uint32_t rowEnd) const;
+
+    typedef void (*PFN_ROWPAIR420)(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint8_t* pY0, uint8_t* pY1, uint8_t* pU, uint8_t* pV, uint32_t uvStep);
+    typedef void (*PFN_ROWPAIR420_16)(const YUVCoefficients& c, const uint8_t* pRGB0, const uint8_t* pRGB1, uint32_t width, uint16_t* pY0, uint16_t* pY1, uint16_t* pUV);
+    typedef void (*PFN_ROW422)(const YUVCoefficients& c, const uint8_t* pRGB, uint32_t width, uint8_t* pYUY2);
+
+private:
+    static void _ComputeCoefficients(YUVMatrix matrix, YUVRange range, uint32_t bitDepth, YUVCoefficients* pCoefficients);
+
+    YUVCoefficients m_coefficients8 = {};
+    YUVCoefficients m_coefficients10 = {};
+    PFN_ROWPAIR420 m_pfnRowPair420 = nullptr;
+    PFN_ROWPAIR420_16 m_pfnRowPair420_16 = nullptr;
+    PFN_ROW422 m_pfnRow422 = nullptr;
+};
+
+#endif
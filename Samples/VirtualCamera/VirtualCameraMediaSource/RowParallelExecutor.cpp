@@ -0,0 +1,154 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Built without the precompiled header, see RowParallelExecutor.h
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <algorithm>
+
+#include "RowParallelExecutor.h"
+
+RowParallelExecutor::~RowParallelExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStopping = true;
+    }
+    m_workReady.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+bool RowParallelExecutor::Initialize(uint32_t threadCount)
+{
+    if (!m_threads.empty())
+    {
+        return false;
+    }
+
+    if (threadCount == 0)
+    {
+#ifdef _WIN32
+        threadCount = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+#else
+        threadCount = std::thread::hardware_concurrency();
+#endif
+    }
+    threadCount = std::clamp<uint32_t>(threadCount, 1, MAX_THREADS);
+
+    try
+    {
+        // the calling thread is the first one
+        for (uint32_t i = 1; i < threadCount; i++)
+        {
+            m_threads.emplace_back(&RowParallelExecutor::_WorkerThread, this, i);
+#ifdef _WIN32
+            // A preferred core rather than a hard affinity mask: the workers of the frame server still spread over
+            // the cores, but when a core is busy with the application or the encoder the scheduler can run the worker
+            // elsewhere instead of stalling the frame until the core is free. The camera process does not own the
+            // machine, and a pinned worker would hold the whole frame back behind the slowest core.
+            SetThreadIdealProcessor(m_threads.back().native_handle(), i);
+#endif
+        }
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+int32_t RowParallelExecutor::Run(uint32_t rows, uint32_t bandRows, BandFunction const& band)
+{
+    bandRows = std::max<uint32_t>(bandRows, 1);
+
+    // not worth waking the workers for a single band
+    if (m_threads.empty() || rows <= bandRows)
+    {
+        return band(0, rows);
+    }
+
+    std::lock_guard<std::mutex> runLock(m_runLock);
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pBand = &band;
+        m_rows = rows;
+        m_bandRows = bandRows;
+        m_nextBand = 0;
+        m_hr = 0;
+        m_busyWorkers = (uint32_t)m_threads.size();
+        m_generation++;
+    }
+    m_workReady.notify_all();
+
+    _RunBands();
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_workDone.wait(lock, [this]() { return m_busyWorkers == 0; });
+    m_pBand = nullptr;
+
+    return m_hr;
+}
+
+uint32_t RowParallelExecutor::BandRows(uint32_t bytesPerRow, uint32_t rowAlignment)
+{
+    rowAlignment = std::max<uint32_t>(rowAlignment, 1);
+    uint32_t rows = BAND_BYTES / std::max<uint32_t>(bytesPerRow, 1);
+    rows -= rows % rowAlignment;
+    return std::max<uint32_t>(rows, rowAlignment);
+}
+
+//////////////////////////////////////////////////
+// private
+
+void RowParallelExecutor::_WorkerThread(uint32_t /*index*/)
+{
+    uint64_t generation = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_workReady.wait(lock, [&]() { return m_bStopping || (m_generation != generation); });
+            if (m_bStopping)
+            {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        _RunBands();
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (--m_busyWorkers == 0)
+        {
+            m_workDone.notify_one();
+        }
+    }
+}
+
+// Takes bands until there are none left
+void RowParallelExecutor::_RunBands()
+{
+    for (;;)
+    {
+        uint32_t rowStart = m_nextBand++ * m_bandRows;
+        if (rowStart >= m_rows)
+        {
+            return;
+        }
+        int32_t hr = (*m_pBand)(rowStart, std::min<uint32_t>(rowStart + m_bandRows, m_rows));
+        if (hr < 0)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_hr >= 0)
+            {
+                m_hr = hr;
+            }
+        }
+    }
+}
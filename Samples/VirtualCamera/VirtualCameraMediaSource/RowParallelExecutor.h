@@ -0,0 +1,67 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+#ifndef ROW_PARALLEL_EXECUTOR_H
+#define ROW_PARALLEL_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*:
+   Fork-join executor splitting the rows of a frame in horizontal bands.
+   The worker threads are created once and wait between frames; the calling thread works on the bands as well.
+   Only depends on the C++ standard library, and on Windows for the ideal processor of the workers, so the test
+   tooling can build it as well; this file doesn't use the precompiled header.
+*/
+class RowParallelExecutor
+{
+public:
+    // Returns an HRESULT, negative for a failure
+    typedef std::function<int32_t(uint32_t rowStart, uint32_t rowEnd)> BandFunction;
+
+    RowParallelExecutor() = default;
+    ~RowParallelExecutor();
+
+    // threadCount 0: one thread per core, up to MAX_THREADS. False if it was already initialized or a thread cannot be created
+    bool Initialize(uint32_t threadCount = 0);
+
+    // Calls band() for each band of bandRows rows of [0, rows) and returns once all are done, with the first failure if any.
+    // bandRows should be a multiple of the row alignment of the frame (2 for 4:2:0 formats), 0 is taken as 1
+    int32_t Run(uint32_t rows, uint32_t bandRows, BandFunction const& band);
+
+    uint32_t ThreadCount() const { return (uint32_t)m_threads.size() + 1; }
+
+    // Rows per band so a band of output fits in the cache of a core, a multiple of rowAlignment
+    static uint32_t BandRows(uint32_t bytesPerRow, uint32_t rowAlignment);
+
+    static constexpr uint32_t MAX_THREADS = 8;
+    static constexpr uint32_t BAND_BYTES = 128 * 1024;
+
+private:
+    void _WorkerThread(uint32_t index);
+    void _RunBands();
+
+    std::mutex m_runLock;                       // one frame at a time
+    std::mutex m_lock;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    std::vector<std::thread> m_threads;
+
+    const BandFunction* m_pBand = nullptr;
+    uint32_t m_rows = 0;
+    uint32_t m_bandRows = 0;
+    std::atomic<uint32_t> m_nextBand = 0;
+    uint64_t m_generation = 0;                  // incremented for each frame
+    uint32_t m_busyWorkers = 0;
+    int32_t m_hr = 0;
+    bool m_bStopping = false;
+};
+
+#endif
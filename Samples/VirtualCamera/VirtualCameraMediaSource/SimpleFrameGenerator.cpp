@@ -2,24 +2,46 @@
 // Copyright (C) Microsoft Corporation. All rights reserved.
 //
 #include "pch.h"
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
 
 HRESULT SimpleFrameGenerator::Initialize(_In_ IMFMediaType* pMediaType)
 {
     RETURN_HR_IF_NULL(E_INVALIDARG, pMediaType);
 
     RETURN_IF_FAILED(pMediaType->GetGUID(MF_MT_SUBTYPE, &m_subType));
-    if (m_subType != MFVideoFormat_RGB32 && m_subType != MFVideoFormat_NV12)
+    if (m_subType != MFVideoFormat_RGB32 && m_subType != MFVideoFormat_NV12 && m_subType != MFVideoFormat_YUY2)
     {
         RETURN_HR_MSG(MF_E_UNSUPPORTED_FORMAT, "Unsupported format: %s", winrt::to_hstring(m_subType).data());
     }
+    m_yuvFormat = (m_subType == MFVideoFormat_YUY2) ? YUVFormat::YUY2 : YUVFormat::NV12;
     MFGetAttributeSize(pMediaType, MF_MT_FRAME_SIZE, &m_width, &m_height);
+    RETURN_HR_IF(MF_E_INVALIDMEDIATYPE, !m_pattern.Initialize(m_patternSettings, m_width, m_height));
+
+    YUVMatrix matrix = YUVMatrix::BT601;
+    YUVRange range = YUVRange::Limited;
+    RETURN_IF_FAILED(GetColorSpace(pMediaType, &matrix, &range));
+    RETURN_HR_IF(MF_E_INVALIDMEDIATYPE, !m_converter.Initialize(matrix, range));
+    m_bRampInYUV = (matrix == YUVMatrix::BT601) && (range == YUVRange::Limited);
+    m_frameNumber = 0;
+    m_bCacheValid = false;
+    InvalidateBuffers();
+
+    // the workers are kept across media type changes
+    if (m_spExecutor == nullptr)
+    {
+        m_spExecutor = wil::make_unique_nothrow<RowParallelExecutor>();
+        RETURN_IF_NULL_ALLOC_MSG(m_spExecutor, "Fail to create RowParallelExecutor");
+        RETURN_HR_IF(E_OUTOFMEMORY, !m_spExecutor->Initialize());
+    }
 
     return S_OK;
 }
 
 /*:
    Writes to a buffer representing a 2D image.
-   Writes a different constant to each line based on row number and current time.
+   Writes a different constant to each line based on row number and current time, or the pattern set with SetPattern.
    Assumes top down image, no negative stride and pBuf points to the begnning of the buffer of length len.
    Param:
    pBuf - pointer to beginning of buffer
@@ -30,33 +52,120 @@ HRESULT SimpleFrameGenerator::CreateFrame(
     _Inout_updates_bytes_(len) BYTE* pBuf,
     _In_ DWORD len,
     _In_ LONG pitch,
-    _In_ ULONG rgbMask)
+    _In_ ULONG rgbMask,
+    _In_ bool bPersistentBuffer)
 {
-    if (m_subType == MFVideoFormat_RGB32)
-    {
-        DEBUG_MSG(L"RGB32 frames %s\n", winrt::to_hstring(MFVideoFormat_RGB32).data());
+    return CreateFrame(pBuf, len, pitch, rgbMask, bPersistentBuffer, MFGetSystemTime(), m_frameNumber);
+}
 
-        RETURN_IF_FAILED(_CreateRGB32Frame(pBuf, len, pitch, m_width, m_height, rgbMask));
+HRESULT SimpleFrameGenerator::CreateFrame(
+    _Inout_updates_bytes_(len) BYTE* pBuf,
+    _In_ DWORD len,
+    _In_ LONG pitch,
+    _In_ ULONG rgbMask,
+    _In_ bool bPersistentBuffer,
+    _In_ LONGLONG time,
+    _In_ UINT64 frameNumber)
+{
+    RETURN_HR_IF_NULL(E_INVALIDARG, pBuf);
+    RETURN_HR_IF(E_NOT_VALID_STATE, (m_width == 0) || (m_height == 0));
+
+    // the ramp only changes once a second, the bars never do
+    m_frameNumber = frameNumber + 1;
+    LONGLONG timeBucket = 0;
+    if (TestPattern::IsAnimated(m_patternSettings))
+    {
+        timeBucket = (LONGLONG)frameNumber;
     }
-    else if(m_subType == MFVideoFormat_NV12)
+    else if (m_patternSettings.kind == TestPatternKind::Ramp)
     {
-        DEBUG_MSG(L"NV12 frames %s \n", winrt::to_hstring(MFVideoFormat_NV12).data());
+        timeBucket = time / (MFTIME)10000000;
+    }
+    FrameKey key = { m_subType, m_width, m_height, pitch, rgbMask, m_patternSettings, timeBucket };
+    DWORD frameSize = _FrameSize(pitch);
 
-        DWORD frameBuffLen = m_width * m_height * 4;
-        wil::unique_cotaskmem_ptr<BYTE[]> spBuff = wil::make_unique_cotaskmem_nothrow<BYTE[]>(frameBuffLen);
-        RETURN_IF_NULL_ALLOC(spBuff.get());
+    if (bPersistentBuffer && _BufferHolds(pBuf, len, key))
+    {
+        return S_OK;
+    }
 
-        RETURN_IF_FAILED(_CreateRGB32Frame(spBuff.get(), frameBuffLen, m_width * 4, m_width, m_height, rgbMask));
-        RETURN_IF_FAILED(RGB32ToNV12Frame(spBuff.get(), frameBuffLen, m_width * 4, m_width, m_height, pBuf, len, pitch));
+    if (m_bCacheValid && (m_cachedKey == key) && (len >= frameSize))
+    {
+        _StreamCopy(pBuf, m_spCache.get(), frameSize);
     }
     else
     {
-        return MF_E_UNSUPPORTED_FORMAT;
+        if ((m_patternSettings.kind != TestPatternKind::Ramp) || (m_patternSettings.overlay != 0)
+            || ((m_subType != MFVideoFormat_RGB32) && !m_bRampInYUV))
+        {
+            RETURN_IF_FAILED(_CreatePatternFrame(pBuf, len, pitch, rgbMask, frameNumber, time));
+        }
+        else if (m_subType == MFVideoFormat_RGB32)
+        {
+            DEBUG_MSG(L"RGB32 frames %s\n", winrt::to_hstring(MFVideoFormat_RGB32).data());
+
+            RETURN_IF_FAILED(_CreateRGB32Frame(pBuf, len, pitch, m_width, m_height, rgbMask, time));
+        }
+        else if(m_subType == MFVideoFormat_NV12)
+        {
+            DEBUG_MSG(L"NV12 frames %s \n", winrt::to_hstring(MFVideoFormat_NV12).data());
+
+            RETURN_IF_FAILED(_CreateNV12Frame(pBuf, len, pitch, m_width, m_height, rgbMask, time));
+        }
+        else if (m_subType == MFVideoFormat_YUY2)
+        {
+            DEBUG_MSG(L"YUY2 frames %s \n", winrt::to_hstring(MFVideoFormat_YUY2).data());
+
+            RETURN_IF_FAILED(_CreateYUY2Frame(pBuf, len, pitch, m_width, m_height, rgbMask, time));
+        }
+        else
+        {
+            return MF_E_UNSUPPORTED_FORMAT;
+        }
+
+        // keep the frame for the rest of the second, the frame is still good if this fails
+        m_bCacheValid = false;
+        if (m_cbCache < frameSize)
+        {
+            m_spCache = wil::make_unique_cotaskmem_nothrow<BYTE[]>(frameSize);
+            m_cbCache = m_spCache ? frameSize : 0;
+        }
+        if (m_spCache)
+        {
+            memcpy(m_spCache.get(), pBuf, frameSize);
+            m_cachedKey = key;
+            m_bCacheValid = true;
+        }
+    }
+
+    if (bPersistentBuffer)
+    {
+        _SetBufferContent(pBuf, len, key);
+    }
+
+    return S_OK;
+}
+
+HRESULT SimpleFrameGenerator::SetPattern(_In_ TestPatternSettings const& settings)
+{
+    RETURN_HR_IF(E_INVALIDARG, settings.kind >= TestPatternKind::End);
+    m_patternSettings = settings;
+    if ((m_width != 0) && (m_height != 0))
+    {
+        RETURN_HR_IF(E_INVALIDARG, !m_pattern.Initialize(m_patternSettings, m_width, m_height));
     }
 
     return S_OK;
 }
 
+void SimpleFrameGenerator::InvalidateBuffers()
+{
+    for (auto& content : m_bufferContents)
+    {
+        content.pBuffer = nullptr;
+    }
+}
+
 //////////////////////////////////////////////////
 // private
 
@@ -66,7 +175,8 @@ HRESULT SimpleFrameGenerator::_CreateRGB32Frame(
     _In_ LONG pitch,
     _In_ DWORD width,
     _In_ DWORD height,
-    _In_ ULONG rgbMask )
+    _In_ ULONG rgbMask,
+    _In_ LONGLONG time)
 {
     RETURN_HR_IF_NULL(E_INVALIDARG, pBuf);
     if (len < (abs(pitch) * height ))
@@ -74,26 +184,226 @@ HRESULT SimpleFrameGenerator::_CreateRGB32Frame(
         return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
     }
 
-    LONGLONG curSysTimeInS = MFGetSystemTime() / (MFTIME)10000000;
-    int offset = curSysTimeInS % height;
 
-    for (unsigned int r = 0; r < height; r++)
+    // only called for the ramp, which is then the pattern
+    return _RunBands(m_spExecutor.get(), height, RowParallelExecutor::BandRows(width * 4, 1), [&](UINT32 rowStart, UINT32 rowEnd)
     {
-        uint32_t* p = (uint32_t*)(pBuf + (r * pitch));
-        for (unsigned int c = 0; c < width; c++)
+        m_pattern.RenderRows(0, time, rgbMask, pBuf, pitch, rowStart, rowEnd);
+        return S_OK;
+    });
+}
+
+/*:
+   NV12: a row of Y then, after height rows, a row of interleaved U and V for each pair of rows.
+   The chroma of a pair of rows is the average of the chroma of both rows, see TestPattern::RenderRampRowsNV12.
+*/
+HRESULT SimpleFrameGenerator::_CreateNV12Frame(
+    _Inout_updates_bytes_(len) BYTE* pBuf,
+    _In_ DWORD len,
+    _In_ LONG pitch,
+    _In_ DWORD width,
+    _In_ DWORD height,
+    _In_ ULONG rgbMask,
+    _In_ LONGLONG time)
+{
+    RETURN_HR_IF_NULL(E_INVALIDARG, pBuf);
+    RETURN_HR_IF(E_INVALIDARG, pitch < (LONG)width);
+    if (len < ((DWORD)pitch * height + (DWORD)pitch * ((height + 1) / 2)))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    // bands of whole row pairs, each band writes its own part of the UV plane
+    return _RunBands(m_spExecutor.get(), height, RowParallelExecutor::BandRows(width + width / 2, 2), [&](UINT32 rowStart, UINT32 rowEnd)
+    {
+        m_pattern.RenderRampRowsNV12(time, rgbMask, pBuf, pitch, rowStart, rowEnd);
+        return S_OK;
+    });
+}
+
+/*:
+   YUY2: Y0 U Y1 V for each pair of pixels, chroma for every row.
+*/
+HRESULT SimpleFrameGenerator::_CreateYUY2Frame(
+    _Inout_updates_bytes_(len) BYTE* pBuf,
+    _In_ DWORD len,
+    _In_ LONG pitch,
+    _In_ DWORD width,
+    _In_ DWORD height,
+    _In_ ULONG rgbMask,
+    _In_ LONGLONG time)
+{
+    RETURN_HR_IF_NULL(E_INVALIDARG, pBuf);
+    RETURN_HR_IF(E_INVALIDARG, pitch < (LONG)(width * 2));
+    if (len < ((DWORD)pitch * height))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+
+    return _RunBands(m_spExecutor.get(), height, RowParallelExecutor::BandRows(width * 2, 1), [&](UINT32 rowStart, UINT32 rowEnd)
+    {
+        m_pattern.RenderRampRowsYUY2(time, rgbMask, pBuf, pitch, rowStart, rowEnd);
+        return S_OK;
+    });
+}
+
+HRESULT SimpleFrameGenerator::_CreatePatternFrame(
+    _Inout_updates_bytes_(len) BYTE* pBuf,
+    _In_ DWORD len,
+    _In_ LONG pitch,
+    _In_ ULONG rgbMask,
+    _In_ UINT64 frameNumber,
+    _In_ LONGLONG time)
+{
+    RETURN_HR_IF_NULL(E_INVALIDARG, pBuf);
+
+    if (m_subType == MFVideoFormat_RGB32)
+    {
+        RETURN_HR_IF(E_INVALIDARG, pitch < (LONG)(m_width * 4));
+        if (len < (DWORD)pitch * m_height)
         {
-            BYTE gray = (BYTE)(r + offset);
-            *p = ((uint32_t)gray << 16 | (uint32_t)gray << 8 | (uint32_t)gray) & rgbMask;
-            p++;
+            return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
         }
+
+        return _RunBands(m_spExecutor.get(), m_height, RowParallelExecutor::BandRows(m_width * 4, 1), [&](UINT32 rowStart, UINT32 rowEnd)
+        {
+            m_pattern.RenderRows(frameNumber, time, rgbMask, pBuf, pitch, rowStart, rowEnd);
+            return S_OK;
+        });
     }
 
-    return S_OK;
+    LONG rgbStride = (LONG)(m_width * 4);
+    DWORD cbRGBFrame = (DWORD)rgbStride * m_height;
+    if (m_cbRGBFrame < cbRGBFrame)
+    {
+        m_spRGBFrame = wil::make_unique_cotaskmem_nothrow<BYTE[]>(cbRGBFrame);
+        m_cbRGBFrame = m_spRGBFrame ? cbRGBFrame : 0;
+        RETURN_IF_NULL_ALLOC(m_spRGBFrame);
+    }
+
+    RETURN_HR_IF(E_INVALIDARG, pitch < (LONG)(m_width * ((m_yuvFormat == YUVFormat::YUY2) ? 2 : 1)));
+    if (len < _FrameSize(pitch))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    // each band converts the rows it just rendered, while they are still in the cache
+    BYTE* pRGBFrame = m_spRGBFrame.get();
+    return _RunBands(m_spExecutor.get(), m_height, RowParallelExecutor::BandRows(m_width * 4, 2), [&](UINT32 rowStart, UINT32 rowEnd)
+    {
+        m_pattern.RenderRows(frameNumber, time, rgbMask, pRGBFrame, rgbStride, rowStart, rowEnd);
+        RETURN_HR_IF(E_INVALIDARG, !m_converter.ConvertRowsFromRGB32(pRGBFrame, cbRGBFrame, rgbStride, m_width, m_height, m_yuvFormat, pBuf, len, pitch, rowStart, rowEnd));
+        return S_OK;
+    });
+}
+
+// Size of a frame of the current format in a buffer of this pitch
+DWORD SimpleFrameGenerator::_FrameSize(LONG pitch) const
+{
+    DWORD planeSize = (DWORD)pitch * m_height;
+    return (m_subType == MFVideoFormat_NV12) ? planeSize + (DWORD)pitch * ((m_height + 1) / 2) : planeSize;
+}
+
+bool SimpleFrameGenerator::_BufferHolds(const BYTE* pBuf, DWORD len, FrameKey const& key) const
+{
+    for (auto& content : m_bufferContents)
+    {
+        if ((content.pBuffer == pBuf) && (content.len == len))
+        {
+            return content.key == key;
+        }
+    }
+    return false;
+}
+
+void SimpleFrameGenerator::_SetBufferContent(const BYTE* pBuf, DWORD len, FrameKey const& key)
+{
+    BufferContent* pEntry = nullptr;
+    for (auto& content : m_bufferContents)
+    {
+        if ((content.pBuffer == pBuf) || (content.pBuffer == nullptr))
+        {
+            pEntry = &content;
+            break;
+        }
+    }
+    if (pEntry == nullptr)
+    {
+        // more buffers than entries, forget the oldest one
+        pEntry = &m_bufferContents[m_nextBufferContent];
+        m_nextBufferContent = (m_nextBufferContent + 1) % ARRAYSIZE(m_bufferContents);
+    }
+    pEntry->pBuffer = pBuf;
+    pEntry->len = len;
+    pEntry->key = key;
+}
+
+// Copy with non temporal stores: the sample goes to another process, there is no point in keeping it in the cache
+void SimpleFrameGenerator::_StreamCopy(_Out_writes_bytes_(size) BYTE* pDst, _In_reads_bytes_(size) const BYTE* pSrc, DWORD size)
+{
+#if defined(_M_X64) || defined(_M_IX86)
+    DWORD head = (DWORD)((16 - ((uintptr_t)pDst & 15)) & 15);
+    if (size >= head + 64)
+    {
+        memcpy(pDst, pSrc, head);
+        DWORD i = head;
+        for (; i + 64 <= size; i += 64)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(pSrc + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(pSrc + i + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(pSrc + i + 32));
+            __m128i d = _mm_loadu_si128((const __m128i*)(pSrc + i + 48));
+            _mm_stream_si128((__m128i*)(pDst + i), a);
+            _mm_stream_si128((__m128i*)(pDst + i + 16), b);
+            _mm_stream_si128((__m128i*)(pDst + i + 32), c);
+            _mm_stream_si128((__m128i*)(pDst + i + 48), d);
+        }
+        _mm_sfence();
+        memcpy(pDst + i, pSrc + i, size - i);
+        return;
+    }
+#endif
+    memcpy(pDst, pSrc, size);
+}
+
+// Runs band on the executor, or on this thread without one
+HRESULT SimpleFrameGenerator::_RunBands(_In_opt_ RowParallelExecutor* pExecutor, UINT32 rows, UINT32 bandRows, RowParallelExecutor::BandFunction const& band)
+{
+    if (pExecutor == nullptr)
+    {
+        return band(0, rows);
+    }
+    return pExecutor->Run(rows, bandRows, band);
 }
 
 //////////////////////////////////////////////////
 // pixelFormatConverter
 
+HRESULT SimpleFrameGenerator::GetColorSpace(_In_ IMFMediaType* pMediaType, _Out_ YUVMatrix* pMatrix, _Out_ YUVRange* pRange)
+{
+    RETURN_HR_IF_NULL(E_INVALIDARG, pMediaType);
+    RETURN_HR_IF_NULL(E_POINTER, pMatrix);
+    RETURN_HR_IF_NULL(E_POINTER, pRange);
+
+    switch (MFGetAttributeUINT32(pMediaType, MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT601))
+    {
+    case MFVideoTransferMatrix_BT709:
+        *pMatrix = YUVMatrix::BT709;
+        break;
+    case MFVideoTransferMatrix_BT2020_10:
+    case MFVideoTransferMatrix_BT2020_12:
+        *pMatrix = YUVMatrix::BT2020;
+        break;
+    default:
+        *pMatrix = YUVMatrix::BT601;
+        break;
+    }
+    *pRange = (MFGetAttributeUINT32(pMediaType, MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_16_235) == MFNominalRange_0_255) ? YUVRange::Full : YUVRange::Limited;
+
+    return S_OK;
+}
+
 void SimpleFrameGenerator::RGB24ToYUY2(int R, int G, int B, BYTE* pY, BYTE* pU, BYTE* pV)
 {
     *pY = ((66 * R + 129 * G + 25 * B + 128) >> 8) + 16;
@@ -117,34 +427,15 @@ void SimpleFrameGenerator::RGB32ToNV12(BYTE RGB1[8], BYTE RGB2[8], BYTE* pY1, BY
 //////////////////////////////////////////////////
 // FrameFormatConverter
 
-HRESULT SimpleFrameGenerator::RGB32ToNV12Frame(_Inout_updates_bytes_(len) BYTE* pbBuff, ULONG cbBuff, long stride, UINT width, UINT height, BYTE* pbBuffOut, ULONG cbBuffOut, long strideOut)
+HRESULT SimpleFrameGenerator::RGB32ToNV12Frame(_Inout_updates_bytes_(len) BYTE* pbBuff, ULONG cbBuff, long stride, UINT width, UINT height, BYTE* pbBuffOut, ULONG cbBuffOut, long strideOut, _In_opt_ RowParallelExecutor* pExecutor)
 {
-    do
+    PixelConverter converter;
+    RETURN_HR_IF(E_UNEXPECTED, !converter.Initialize(YUVMatrix::BT601, YUVRange::Limited));
+    RETURN_IF_FAILED(_RunBands(pExecutor, height, RowParallelExecutor::BandRows(width * 4, 2), [&](UINT32 rowStart, UINT32 rowEnd)
     {
-        RETURN_HR_IF(E_UNEXPECTED, width * 4 * height > cbBuff);
-        RETURN_HR_IF(E_UNEXPECTED, width * 1.5 * height > cbBuffOut);
-        RETURN_HR_IF_NULL(E_INVALIDARG, pbBuff);
-
-        RETURN_HR_IF_NULL(E_INVALIDARG, pbBuffOut);
-        for (DWORD h = 0; h < height - 1; h += 2)
-        {
-            BYTE* pRGB1 = h * stride + pbBuff;
-            BYTE* pRGB2 = (h + 1) * stride + pbBuff;
-            BYTE* pY1 = h * strideOut + pbBuffOut;
-            BYTE* pY2 = (h + 1) * strideOut + pbBuffOut;
-            BYTE* pUV = (h / 2 + height) * strideOut + pbBuffOut;
-
-            for (DWORD w = 0; w < width; w += 2)
-            {
-                RGB32ToNV12(pRGB1, pRGB2, pY1, pY2, pUV);
-                pRGB1 += 8;
-                pRGB2 += 8;
-                pY1 += 2;
-                pY2 += 2;
-                pUV += 2;
-            }
-        }
-    } while (FALSE);
+        RETURN_HR_IF(E_INVALIDARG, !converter.ConvertRowsFromRGB32(pbBuff, cbBuff, stride, width, height, YUVFormat::NV12, pbBuffOut, cbBuffOut, strideOut, rowStart, rowEnd));
+        return S_OK;
+    }));
 
     return S_OK;
 }
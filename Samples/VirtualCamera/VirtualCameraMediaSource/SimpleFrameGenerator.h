@@ -18,27 +18,131 @@ public:
         _Inout_updates_bytes_(len) BYTE* pBuf,
         _In_ DWORD len,
         _In_ LONG pitch,
-        _In_ ULONG rgbMask);
+        _In_ ULONG rgbMask,
+        _In_ bool bPersistentBuffer = false);
+
+    // Frame frameNumber of the stream, shown at time (in 100ns): animations move with the frame number, the ramp
+    // and the timestamp overlay follow the time. The overload above uses the next frame number and the current time.
+    // bPersistentBuffer: only this generator writes into pBuf, which is left untouched as long as it is not written again
+    // here, so a frame it already holds is skipped. Opt-in, InvalidateBuffers once that stops being true
+    HRESULT CreateFrame(
+        _Inout_updates_bytes_(len) BYTE* pBuf,
+        _In_ DWORD len,
+        _In_ LONG pitch,
+        _In_ ULONG rgbMask,
+        _In_ bool bPersistentBuffer,
+        _In_ LONGLONG time,
+        _In_ UINT64 frameNumber);
+
+    // Pattern of the next frames, the frame counter restarts with Initialize only
+    HRESULT SetPattern(_In_ TestPatternSettings const& settings);
+
+    // The sample buffers were written by someone else, the next frames are written whatever the buffers held
+    void InvalidateBuffers();
 
     // pixel format converter
     static void RGB24ToYUY2(int R, int G, int B, BYTE* pY, BYTE* pU, BYTE* pV);
     static void RGB24ToY(int R, int G, int B, BYTE* pY);
     static void RGB32ToNV12(BYTE RGB1[8], BYTE RGB2[8], BYTE* pY1, BYTE* pY2, BYTE* pUV);
 
-    static HRESULT RGB32ToNV12Frame(_Inout_updates_bytes_(len) BYTE* pbBuff, ULONG cbBuff, long stride, UINT width, UINT height, BYTE* pbBuffOut, ULONG cbBuffOut, long strideOut);
+    // Matrix and range of a YUV media type, BT.601 limited range when the media type does not say
+    static HRESULT GetColorSpace(_In_ IMFMediaType* pMediaType, _Out_ YUVMatrix* pMatrix, _Out_ YUVRange* pRange);
+
+    // pExecutor splits the conversion between its threads
+    static HRESULT RGB32ToNV12Frame(_Inout_updates_bytes_(len) BYTE* pbBuff, ULONG cbBuff, long stride, UINT width, UINT height, BYTE* pbBuffOut, ULONG cbBuffOut, long strideOut, _In_opt_ RowParallelExecutor* pExecutor = nullptr);
 
 private: 
+    // What a frame looks like: frames with the same key are identical
+    struct FrameKey
+    {
+        GUID subType;
+        UINT32 width;
+        UINT32 height;
+        LONG pitch;
+        ULONG rgbMask;
+        TestPatternSettings pattern;
+        LONGLONG timeBucket;       // frame number of animated patterns, second of the ramp
+
+        bool operator==(FrameKey const& other) const
+        {
+            return (subType == other.subType) && (width == other.width) && (height == other.height)
+                && (pitch == other.pitch) && (rgbMask == other.rgbMask) && (pattern == other.pattern) && (timeBucket == other.timeBucket);
+        }
+    };
+
+    // Frame last written to a sample buffer
+    struct BufferContent
+    {
+        const BYTE* pBuffer;
+        DWORD len;
+        FrameKey key;
+    };
+
     HRESULT _CreateRGB32Frame(
         _Inout_updates_bytes_(len) BYTE* pBuf,
         _In_ DWORD len,
         _In_ LONG pitch,
         _In_ DWORD width,
         _In_ DWORD height,
-        _In_ ULONG rgbMask);
+        _In_ ULONG rgbMask,
+        _In_ LONGLONG time);
+
+    // Render the ramp straight into the target format with TestPattern, no intermediate RGB32 frame
+    HRESULT _CreateNV12Frame(
+        _Inout_updates_bytes_(len) BYTE* pBuf,
+        _In_ DWORD len,
+        _In_ LONG pitch,
+        _In_ DWORD width,
+        _In_ DWORD height,
+        _In_ ULONG rgbMask,
+        _In_ LONGLONG time);
+
+    HRESULT _CreateYUY2Frame(
+        _Inout_updates_bytes_(len) BYTE* pBuf,
+        _In_ DWORD len,
+        _In_ LONG pitch,
+        _In_ DWORD width,
+        _In_ DWORD height,
+        _In_ ULONG rgbMask,
+        _In_ LONGLONG time);
+
+    // Any pattern other than the plain ramp: rendered in RGB32 then converted a band at a time
+    HRESULT _CreatePatternFrame(
+        _Inout_updates_bytes_(len) BYTE* pBuf,
+        _In_ DWORD len,
+        _In_ LONG pitch,
+        _In_ ULONG rgbMask,
+        _In_ UINT64 frameNumber,
+        _In_ LONGLONG time);
+
+    DWORD _FrameSize(LONG pitch) const;
+    bool _BufferHolds(const BYTE* pBuf, DWORD len, FrameKey const& key) const;
+    void _SetBufferContent(const BYTE* pBuf, DWORD len, FrameKey const& key);
+    static void _StreamCopy(_Out_writes_bytes_(size) BYTE* pDst, _In_reads_bytes_(size) const BYTE* pSrc, DWORD size);
+    static HRESULT _RunBands(_In_opt_ RowParallelExecutor* pExecutor, UINT32 rows, UINT32 bandRows, RowParallelExecutor::BandFunction const& band);
 
     UINT32 m_width = 0;
     UINT32 m_height = 0;
     GUID m_subType = GUID_NULL;
+    YUVFormat m_yuvFormat = YUVFormat::NV12;            // m_subType when it is NV12 or YUY2
+    bool m_bRampInYUV = false;                          // the ramp is rendered straight in YUV, BT.601 limited range only
+    wistd::unique_ptr<RowParallelExecutor> m_spExecutor;
+
+    TestPatternSettings m_patternSettings = {};
+    TestPattern m_pattern;
+    PixelConverter m_converter;
+    wil::unique_cotaskmem_ptr<BYTE[]> m_spRGBFrame;     // pattern frame before the conversion to NV12 or YUY2
+    DWORD m_cbRGBFrame = 0;
+    UINT64 m_frameNumber = 0;
+
+    // last frame rendered, copied to the next samples until the key changes
+    wil::unique_cotaskmem_ptr<BYTE[]> m_spCache;
+    DWORD m_cbCache = 0;
+    FrameKey m_cachedKey = {};
+    bool m_bCacheValid = false;
+
+    BufferContent m_bufferContents[16] = {};   // more than the samples of the allocator
+    UINT32 m_nextBufferContent = 0;
 
 };
 
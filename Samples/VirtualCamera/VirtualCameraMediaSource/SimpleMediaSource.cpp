@@ -29,13 +29,14 @@ namespace winrt::WindowsSample::implementation
 
         wil::unique_cotaskmem_array_ptr<wil::com_ptr_nothrow<IMFStreamDescriptor>> streamDescriptorList = wilEx::make_unique_cotaskmem_array<wil::com_ptr_nothrow<IMFStreamDescriptor>>(NUM_STREAMS);
 
-        // This example showcase one stream (i.e. NUM_STREAMS == 1),
-        // it can be extended to multiple streams by changing NUM_STREAMS
+        // This example showcase a capture stream and a preview stream derived from it, as a camera with a
+        // capture pin and a preview pin: the frame is rendered once, in the capture stream media type, and
+        // scaled to the preview stream media type. Each stream has its own allocator.
         for (unsigned int i = 0; i < NUM_STREAMS; i++)
         {
             auto ptr = winrt::make_self<SimpleMediaStream>();
             m_streamList[i] = ptr.detach();
-            RETURN_IF_FAILED(m_streamList[i]->Initialize(this, i, MFSampleAllocatorUsage_UsesProvidedAllocator));
+            RETURN_IF_FAILED(m_streamList[i]->Initialize(this, i, MFSampleAllocatorUsage_UsesProvidedAllocator, m_spAttributes.get(), (i > 0) ? m_streamList[0].get() : nullptr));
 
             RETURN_IF_FAILED(m_streamList[i]->GetStreamDescriptor(&streamDescriptorList[i]));
         }
@@ -441,6 +442,14 @@ namespace winrt::WindowsSample::implementation
                 *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_COLORMODE_S);
                 break;
 
+            case KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN:
+                *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S);
+                break;
+
+            case KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK:
+                *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S);
+                break;
+
             default:
                 return HRESULT_FROM_WIN32(ERROR_SET_NOT_FOUND);
                 break;
@@ -490,6 +499,92 @@ namespace winrt::WindowsSample::implementation
             }
                 break;
 
+            case KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN:
+            {
+                if (ulDataLength < sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S))
+                {
+                    *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S);
+                    return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+                }
+
+                PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S pPayload = (PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S)pPropertyData;
+
+                // Set operation 
+                if (0 != (pProperty->Flags & (KSPROPERTY_TYPE_SET)))
+                {
+                    DEBUG_MSG(L"Set filter level KSProperty");
+                    RETURN_HR_IF(E_INVALIDARG, pPayload->Pattern >= KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_END);
+                    RETURN_HR_IF(E_INVALIDARG, (pPayload->Overlay & ~(uint32_t)TestPatternOverlay_All) != 0);
+
+                    TestPatternSettings settings = { (TestPatternKind)pPayload->Pattern, pPayload->MotionX, pPayload->MotionY, pPayload->Seed, pPayload->Overlay };
+                    *pBytesReturned = 0;
+                    for (size_t i = 0; i < m_streamList.size(); i++)
+                    {
+                        RETURN_IF_FAILED(m_streamList[i]->SetPattern(settings));
+                    }
+                }
+                // Get operation
+                else if (0 != (pProperty->Flags & (KSPROPERTY_TYPE_GET)))
+                {
+                    DEBUG_MSG(L"Get filter level KSProperty");
+                    TestPatternSettings settings = m_streamList[0]->GetPattern();
+                    pPayload->Pattern = (uint32_t)settings.kind;
+                    pPayload->MotionX = settings.motionX;
+                    pPayload->MotionY = settings.motionY;
+                    pPayload->Seed = settings.seed;
+                    pPayload->Overlay = settings.overlay;
+                    *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S);
+                }
+                else
+                {
+                    return E_INVALIDARG;
+                }
+            }
+                break;
+
+            case KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK:
+            {
+                if (ulDataLength < sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S))
+                {
+                    *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S);
+                    return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+                }
+
+                PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S pPayload = (PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S)pPropertyData;
+
+                // Set operation 
+                if (0 != (pProperty->Flags & (KSPROPERTY_TYPE_SET)))
+                {
+                    DEBUG_MSG(L"Set filter level KSProperty");
+                    RETURN_HR_IF(E_INVALIDARG, pPayload->Pacing > 1);
+                    *pBytesReturned = 0;
+                    for (size_t i = 0; i < m_streamList.size(); i++)
+                    {
+                        m_streamList[i]->SetPacing(pPayload->Pacing != 0);
+                    }
+                }
+                // Get operation
+                else if (0 != (pProperty->Flags & (KSPROPERTY_TYPE_GET)))
+                {
+                    DEBUG_MSG(L"Get filter level KSProperty");
+                    FrameClockStats stats = m_streamList[0]->GetFrameClockStats();
+                    pPayload->Pacing = m_streamList[0]->GetPacing() ? 1 : 0;
+                    pPayload->Reserved = 0;
+                    pPayload->FramesDelivered = stats.framesDelivered;
+                    pPayload->FramesSkipped = stats.framesSkipped;
+                    pPayload->MeanJitter = stats.meanJitter;
+                    pPayload->MaxJitter = stats.maxJitter;
+                    pPayload->MeanLateness = stats.meanLateness;
+                    pPayload->MaxLateness = stats.maxLateness;
+                    *pBytesReturned = sizeof(KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S);
+                }
+                else
+                {
+                    return E_INVALIDARG;
+                }
+            }
+                break;
+
             default:
                 break;
             }
@@ -608,22 +703,25 @@ namespace winrt::WindowsSample::implementation
         // Create an empty profile collection...
         RETURN_IF_FAILED(MFCreateSensorProfileCollection(&profileCollection));
 
-        // In this example since we have just one stream, we only have one
-        // pin to add:  Pin = STREAM_ID.
+        // In this example we have two pins to add: the capture pin
+        // Pin = STREAM_ID and the preview pin Pin = PREVIEW_STREAM_ID.
 
         // Legacy profile is mandatory.  This is to ensure non-profile
         // aware applications can still function, but with degraded
         // feature sets.
         const DWORD STREAM_ID = 0;
+        const DWORD PREVIEW_STREAM_ID = 1;
         RETURN_IF_FAILED(MFCreateSensorProfile(KSCAMERAPROFILE_Legacy, 0 /*ProfileIndex*/, nullptr,
             &profile));
         RETURN_IF_FAILED(profile->AddProfileFilter(STREAM_ID, L"((RES==;FRT<=30,1;SUT==))"));
+        RETURN_IF_FAILED(profile->AddProfileFilter(PREVIEW_STREAM_ID, L"((RES==;FRT<=30,1;SUT==))"));
         RETURN_IF_FAILED(profileCollection->AddProfile(profile.get()));
 
-        // High Frame Rate profile will only allow >=60fps.
+        // High Frame Rate profile will only allow >=60fps, the preview stays at 30fps.
         RETURN_IF_FAILED(MFCreateSensorProfile(KSCAMERAPROFILE_HighFrameRate, 0 /*ProfileIndex*/, nullptr,
             &profile));
         RETURN_IF_FAILED(profile->AddProfileFilter(STREAM_ID, L"((RES==;FRT>=60,1;SUT==))"));
+        RETURN_IF_FAILED(profile->AddProfileFilter(PREVIEW_STREAM_ID, L"((RES==;FRT<=30,1;SUT==))"));
         RETURN_IF_FAILED(profileCollection->AddProfile(profile.get()));
 
 
@@ -91,7 +91,8 @@ namespace winrt::WindowsSample::implementation
         wil::com_ptr_nothrow<IMFAttributes> m_spAttributes;
         wil::unique_cotaskmem_array_ptr<wil::com_ptr_nothrow<SimpleMediaStream>> m_streamList;
 
-        const DWORD NUM_STREAMS = 1;
+        // Stream 0 renders the frames, the next streams are derived from it
+        const DWORD NUM_STREAMS = 2;
         bool m_initalized = false;
     };
 }
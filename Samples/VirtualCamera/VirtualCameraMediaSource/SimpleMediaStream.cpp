@@ -6,16 +6,36 @@
 
 #define NUM_IMAGE_ROWS 480
 #define NUM_IMAGE_COLS 640
-#define BYTES_PER_PIXEL 4
-#define IMAGE_BUFFER_SIZE_BYTES (NUM_IMAGE_ROWS * NUM_IMAGE_COLS * BYTES_PER_PIXEL)
-#define IMAGE_ROW_SIZE_BYTES (NUM_IMAGE_COLS * BYTES_PER_PIXEL)
+#define MAX_ALLOCATOR_SAMPLES 10
+#define MIN_ALLOCATOR_SAMPLES 4
+#define ALLOCATOR_BUDGET_BYTES (128 * 1024 * 1024)
+#define DEFAULT_RING_DEPTH 2
+#define MAX_RING_DEPTH 8
+#define DOWNSTREAM_SAMPLES 2
 
 namespace winrt::WindowsSample::implementation
 {
+    // Media types without a VCAM_MEDIATYPE_LADDER activation attribute
+    static const VCAM_MEDIATYPE_LADDER_ENTRY DEFAULT_MEDIATYPE_LADDER[] =
+    {
+        { NUM_IMAGE_COLS, NUM_IMAGE_ROWS, 30, 1, MFVideoFormat_NV12 },
+        { NUM_IMAGE_COLS, NUM_IMAGE_ROWS, 30, 1, MFVideoFormat_RGB32 },
+        { NUM_IMAGE_COLS, NUM_IMAGE_ROWS, 30, 1, MFVideoFormat_YUY2 },
+    };
+
+    // Media types of the derived streams, scaled from the frames of the primary stream
+    static const VCAM_MEDIATYPE_LADDER_ENTRY DERIVED_MEDIATYPE_LADDER[] =
+    {
+        { 640, 360, 30, 1, MFVideoFormat_NV12 },
+        { 320, 180, 30, 1, MFVideoFormat_NV12 },
+    };
+
     HRESULT SimpleMediaStream::Initialize(
             _In_ SimpleMediaSource* pSource,
             _In_ DWORD dwStreamId,
-            _In_ MFSampleAllocatorUsage allocatorUsage
+            _In_ MFSampleAllocatorUsage allocatorUsage,
+            _In_opt_ IMFAttributes* pSourceAttributes,
+            _In_opt_ SimpleMediaStream* pPrimaryStream
         )
     {
         winrt::slim_lock_guard lock(m_Lock);
@@ -28,37 +48,38 @@ namespace winrt::WindowsSample::implementation
 
         m_dwStreamId = dwStreamId;
         m_allocatorUsage = allocatorUsage;
+        m_bDerived = (pPrimaryStream != nullptr);
 
-        const uint32_t NUM_MEDIATYPES = 2;
-        wil::unique_cotaskmem_array_ptr<wil::com_ptr_nothrow<IMFMediaType>> mediaTypeList = wilEx::make_unique_cotaskmem_array<wil::com_ptr_nothrow<IMFMediaType>>(NUM_MEDIATYPES);
+        m_ringDepth = DEFAULT_RING_DEPTH;
+        if (pSourceAttributes != nullptr)
+        {
+            m_ringDepth = MFGetAttributeUINT32(pSourceAttributes, VCAM_SAMPLE_RING_DEPTH, DEFAULT_RING_DEPTH);
+            RETURN_HR_IF_MSG(E_INVALIDARG, (m_ringDepth == 0) || (m_ringDepth > MAX_RING_DEPTH), "Invalid sample ring depth: %d", m_ringDepth);
+            m_bReuseSampleContent = MFGetAttributeUINT32(pSourceAttributes, VCAM_REUSE_SAMPLE_CONTENT, FALSE) != FALSE;
+        }
 
-        // Initialize media type and set the video output media type.
-        wil::com_ptr_nothrow<IMFMediaType> spMediaType;
-        RETURN_IF_FAILED(MFCreateMediaType(&spMediaType));
-        spMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
-        spMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
-        spMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
-        spMediaType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
-        MFSetAttributeSize(spMediaType.get(), MF_MT_FRAME_SIZE, NUM_IMAGE_COLS, NUM_IMAGE_ROWS);
-        MFSetAttributeRatio(spMediaType.get(), MF_MT_FRAME_RATE, 30, 1);
-        // frame size * pixle bit size * framerate
-        uint32_t bitrate = (uint32_t)(NUM_IMAGE_COLS * 1.5 * NUM_IMAGE_ROWS * 8* 30);
-        spMediaType->SetUINT32(MF_MT_AVG_BITRATE, bitrate);
-        MFSetAttributeRatio(spMediaType.get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
-        mediaTypeList[0] = spMediaType.detach();
+        const VCAM_MEDIATYPE_LADDER_ENTRY* pLadder = DEFAULT_MEDIATYPE_LADDER;
+        uint32_t mediaTypeCount = ARRAYSIZE(DEFAULT_MEDIATYPE_LADDER);
+        wil::unique_cotaskmem_ptr<UINT8> spLadderBlob;
+        UINT32 cbLadderBlob = 0;
+        if (m_bDerived)
+        {
+            pLadder = DERIVED_MEDIATYPE_LADDER;
+            mediaTypeCount = ARRAYSIZE(DERIVED_MEDIATYPE_LADDER);
+        }
+        else if ((pSourceAttributes != nullptr) && SUCCEEDED(pSourceAttributes->GetAllocatedBlob(VCAM_MEDIATYPE_LADDER, wil::out_param(spLadderBlob), &cbLadderBlob)))
+        {
+            RETURN_HR_IF_MSG(E_INVALIDARG, (cbLadderBlob == 0) || (cbLadderBlob % sizeof(VCAM_MEDIATYPE_LADDER_ENTRY) != 0), "Invalid media type ladder size: %d", cbLadderBlob);
+            pLadder = (const VCAM_MEDIATYPE_LADDER_ENTRY*)spLadderBlob.get();
+            mediaTypeCount = cbLadderBlob / sizeof(VCAM_MEDIATYPE_LADDER_ENTRY);
+        }
 
-        RETURN_IF_FAILED(MFCreateMediaType(&spMediaType));
-        spMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
-        spMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_RGB32);
-        spMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
-        spMediaType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
-        MFSetAttributeSize(spMediaType.get(), MF_MT_FRAME_SIZE, NUM_IMAGE_COLS, NUM_IMAGE_ROWS);
-        MFSetAttributeRatio(spMediaType.get(), MF_MT_FRAME_RATE, 30, 1);
-        // frame size * pixle bit size * framerate
-        bitrate = (uint32_t)(NUM_IMAGE_COLS * NUM_IMAGE_ROWS * 4 * 8* 30);
-        spMediaType->SetUINT32(MF_MT_AVG_BITRATE, bitrate);
-        MFSetAttributeRatio(spMediaType.get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
-        mediaTypeList[1] = spMediaType.detach();
+        wil::unique_cotaskmem_array_ptr<wil::com_ptr_nothrow<IMFMediaType>> mediaTypeList = wilEx::make_unique_cotaskmem_array<wil::com_ptr_nothrow<IMFMediaType>>(mediaTypeCount);
+        RETURN_IF_NULL_ALLOC(mediaTypeList.get());
+        for (uint32_t i = 0; i < mediaTypeCount; i++)
+        {
+            RETURN_IF_FAILED(_CreateMediaType(pLadder[i], &mediaTypeList[i]));
+        }
 
         RETURN_IF_FAILED(MFCreateAttributes(&m_spAttributes, 10));
         RETURN_IF_FAILED(_SetStreamAttributes(m_spAttributes.get()));
@@ -66,12 +87,17 @@ namespace winrt::WindowsSample::implementation
         RETURN_IF_FAILED(MFCreateEventQueue(&m_spEventQueue));
 
         // Initialize stream descriptors
-        RETURN_IF_FAILED(MFCreateStreamDescriptor(m_dwStreamId /*StreamId*/, NUM_MEDIATYPES /*MT count*/, mediaTypeList.get(), &m_spStreamDesc));
+        RETURN_IF_FAILED(MFCreateStreamDescriptor(m_dwStreamId /*StreamId*/, mediaTypeCount /*MT count*/, mediaTypeList.get(), &m_spStreamDesc));
 
         RETURN_IF_FAILED(m_spStreamDesc->GetMediaTypeHandler(&spTypeHandler));
         RETURN_IF_FAILED(spTypeHandler->SetCurrentMediaType(mediaTypeList[0]));
         RETURN_IF_FAILED(_SetStreamDescriptorAttributes(m_spStreamDesc.get()));
 
+        if (m_bDerived)
+        {
+            RETURN_IF_FAILED(pPrimaryStream->_AddDerivedStream(this));
+        }
+
         return S_OK;
     }
 
@@ -185,13 +211,6 @@ namespace winrt::WindowsSample::implementation
         )
     {
         winrt::slim_lock_guard lock(m_Lock);
-        wil::com_ptr_nothrow<IMFSample> sample;
-        wil::com_ptr_nothrow<IMFMediaBuffer> outputBuffer;
-        LONG pitch = 0;
-        BYTE* bufferStart = nullptr; // not used
-        DWORD bufferLength = 0;
-        BYTE* pbuf = nullptr;
-        wil::com_ptr_nothrow<IMF2DBuffer2> buffer2D;
 
         RETURN_IF_FAILED(_CheckShutdownRequiresLock());
 
@@ -200,30 +219,17 @@ namespace winrt::WindowsSample::implementation
             RETURN_HR_MSG(MF_E_INVALIDREQUEST, "Stream is not in running state, state:%d, selected: %d", m_streamState, m_bSelected);
         }
 
-        RETURN_IF_FAILED(m_spSampleAllocator->AllocateSample(&sample));
-        RETURN_IF_FAILED(sample->GetBufferByIndex(0, &outputBuffer));
-        RETURN_IF_FAILED(outputBuffer->QueryInterface(IID_PPV_ARGS(&buffer2D)));
-        RETURN_IF_FAILED(buffer2D->Lock2DSize(MF2DBuffer_LockFlags_Write,
-            &pbuf,
-            &pitch,
-            &bufferStart,
-            &bufferLength));
-        
-
-        RETURN_IF_FAILED(m_spFrameGenerator->CreateFrame(pbuf, bufferLength, pitch, m_rgbMask));
-        //RETURN_IF_FAILED(WriteSampleData(pbuf, bufferLength, pitch, NUM_IMAGE_COLS, NUM_IMAGE_ROWS));
-        RETURN_IF_FAILED(buffer2D->Unlock2D());
-
-        RETURN_IF_FAILED(sample->SetSampleTime(MFGetSystemTime()));
-        RETURN_IF_FAILED(sample->SetSampleDuration(333333));
-        if (pToken != nullptr)
+        // The producer thread renders the frames ahead: a ready frame goes out now unless pacing holds it until its
+        // frame time, the producer serves the request otherwise
         {
-            RETURN_IF_FAILED(sample->SetUnknown(MFSampleExtension_Token, pToken));
+            std::lock_guard<std::mutex> frameLock(m_frameLock);
+            try
+            {
+                m_pendingRequests.emplace_back(pToken);
+            } CATCH_RETURN();
+            (void)_DeliverFrames();
         }
-        RETURN_IF_FAILED(m_spEventQueue->QueueEventParamUnk(MEMediaSample,
-            GUID_NULL,
-            S_OK,
-            sample.get()));
+        m_producerWake.SetEvent();
 
         return S_OK;
     }
@@ -247,6 +253,7 @@ namespace winrt::WindowsSample::implementation
             {
                 return MF_E_INVALID_STATE_TRANSITION;
             }
+            _StopProducer();
             m_streamState = MF_STREAM_STATE_PAUSED;
             break;
 
@@ -283,6 +290,11 @@ namespace winrt::WindowsSample::implementation
 
     //////////////////////////////////////////////////////////////////////////////////////////
     // Public methods
+    SimpleMediaStream::~SimpleMediaStream()
+    {
+        _StopProducer();
+    }
+
     HRESULT SimpleMediaStream::Start(_In_ IMFMediaType* pMediaType)
     {
         // Set stream seleted state to true, and update current mediatype.
@@ -318,6 +330,9 @@ namespace winrt::WindowsSample::implementation
     {
         winrt::slim_lock_guard lock(m_Lock);
 
+        // the producer uses the event queue
+        _StopProducer();
+
         m_bIsShutdown = true;
         m_parent.reset();
 
@@ -347,9 +362,50 @@ namespace winrt::WindowsSample::implementation
         m_spSampleAllocator.reset();
         m_spSampleAllocator = pAllocator;
 
+        // the new allocator has other buffers, maybe at the addresses of the old ones
+        if (m_spFrameGenerator != nullptr)
+        {
+            m_spFrameGenerator->InvalidateBuffers();
+        }
+
+        return S_OK;
+    }
+
+    void SimpleMediaStream::SetRGBMask(uint32_t rgbMask)
+    {
+        winrt::slim_lock_guard lock(m_Lock);
+        std::lock_guard<std::mutex> frameLock(m_frameLock);
+        m_rgbMask = rgbMask;
+    }
+
+    HRESULT SimpleMediaStream::SetPattern(TestPatternSettings const& settings)
+    {
+        winrt::slim_lock_guard lock(m_Lock);
+        RETURN_HR_IF(E_INVALIDARG, settings.kind >= TestPatternKind::End);
+
+        // the producer thread owns the generator while streaming and applies the pattern to the next frame,
+        // StartInternal applies it otherwise
+        std::lock_guard<std::mutex> frameLock(m_frameLock);
+        m_pattern = settings;
+        m_bPatternChanged = true;
+
         return S_OK;
     }
 
+    void SimpleMediaStream::SetPacing(bool bPacing)
+    {
+        winrt::slim_lock_guard lock(m_Lock);
+        {
+            std::lock_guard<std::mutex> frameLock(m_frameLock);
+            m_bPacing = bPacing;
+            m_frameClock.ResetStats();
+        }
+        if (m_producerWake)
+        {
+            m_producerWake.SetEvent();
+        }
+    }
+
     
     //////////////////////////////////////////////////////////////////////////////////////////
     // Private methods
@@ -375,7 +431,7 @@ namespace winrt::WindowsSample::implementation
     {
         RETURN_HR_IF_NULL(E_INVALIDARG, pAttributeStore);
 
-        RETURN_IF_FAILED(pAttributeStore->SetGUID(MF_DEVICESTREAM_STREAM_CATEGORY, PINNAME_VIDEO_CAPTURE));
+        RETURN_IF_FAILED(pAttributeStore->SetGUID(MF_DEVICESTREAM_STREAM_CATEGORY, m_bDerived ? PINNAME_VIDEO_PREVIEW : PINNAME_VIDEO_CAPTURE));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_STREAM_ID, m_dwStreamId));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_FRAMESERVER_SHARED, 1));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_ATTRIBUTE_FRAMESOURCE_TYPES, MFFrameSourceTypes::MFFrameSourceTypes_Color));
@@ -389,7 +445,7 @@ namespace winrt::WindowsSample::implementation
     {
         RETURN_HR_IF_NULL(E_INVALIDARG, pAttributeStore);
 
-        RETURN_IF_FAILED(pAttributeStore->SetGUID(MF_DEVICESTREAM_STREAM_CATEGORY, PINNAME_VIDEO_CAPTURE));
+        RETURN_IF_FAILED(pAttributeStore->SetGUID(MF_DEVICESTREAM_STREAM_CATEGORY, m_bDerived ? PINNAME_VIDEO_PREVIEW : PINNAME_VIDEO_CAPTURE));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_STREAM_ID, m_dwStreamId));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_FRAMESERVER_SHARED, 1));
         RETURN_IF_FAILED(pAttributeStore->SetUINT32(MF_DEVICESTREAM_ATTRIBUTE_FRAMESOURCE_TYPES, MFFrameSourceTypes::MFFrameSourceTypes_Color));
@@ -397,6 +453,60 @@ namespace winrt::WindowsSample::implementation
         return S_OK;
     }
 
+    HRESULT SimpleMediaStream::_CreateMediaType(
+            _In_ VCAM_MEDIATYPE_LADDER_ENTRY const& entry,
+            _COM_Outptr_ IMFMediaType** ppMediaType
+        )
+    {
+        RETURN_HR_IF_NULL(E_POINTER, ppMediaType);
+        *ppMediaType = nullptr;
+
+        UINT32 bitsPerPixel = 0;
+        if (entry.SubType == MFVideoFormat_NV12)
+        {
+            bitsPerPixel = 12;
+        }
+        else if (entry.SubType == MFVideoFormat_YUY2)
+        {
+            bitsPerPixel = 16;
+        }
+        else if (entry.SubType == MFVideoFormat_RGB32)
+        {
+            bitsPerPixel = 32;
+        }
+        else
+        {
+            RETURN_HR_MSG(MF_E_UNSUPPORTED_FORMAT, "Unsupported format: %s", winrt::to_hstring(entry.SubType).data());
+        }
+        // the 4:2:0 and 4:2:2 chroma and the frame generator need even sizes
+        RETURN_HR_IF_MSG(E_INVALIDARG, (entry.Width == 0) || (entry.Height == 0) || (entry.Width & 1) || (entry.Height & 1), "Invalid frame size: %dx%d", entry.Width, entry.Height);
+        RETURN_HR_IF_MSG(E_INVALIDARG, (entry.FrameRateNumerator == 0) || (entry.FrameRateDenominator == 0), "Invalid frame rate: %d/%d", entry.FrameRateNumerator, entry.FrameRateDenominator);
+
+        UINT32 sampleSize = 0;
+        LONG stride = 0;
+        RETURN_IF_FAILED(MFCalculateImageSize(entry.SubType, entry.Width, entry.Height, &sampleSize));
+        RETURN_IF_FAILED(MFGetStrideForBitmapInfoHeader(entry.SubType.Data1, entry.Width, &stride));
+
+        wil::com_ptr_nothrow<IMFMediaType> spMediaType;
+        RETURN_IF_FAILED(MFCreateMediaType(&spMediaType));
+        RETURN_IF_FAILED(spMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+        RETURN_IF_FAILED(spMediaType->SetGUID(MF_MT_SUBTYPE, entry.SubType));
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));
+        RETURN_IF_FAILED(MFSetAttributeSize(spMediaType.get(), MF_MT_FRAME_SIZE, entry.Width, entry.Height));
+        RETURN_IF_FAILED(MFSetAttributeRatio(spMediaType.get(), MF_MT_FRAME_RATE, entry.FrameRateNumerator, entry.FrameRateDenominator));
+        // frame size * pixel bit size * framerate, 4K RGB32 at 60 fps does not fit
+        UINT64 bitrate = ((UINT64)entry.Width * entry.Height * bitsPerPixel * entry.FrameRateNumerator) / entry.FrameRateDenominator;
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_AVG_BITRATE, (UINT32)std::min<UINT64>(bitrate, UINT32_MAX)));
+        RETURN_IF_FAILED(MFSetAttributeRatio(spMediaType.get(), MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_DEFAULT_STRIDE, (UINT32)stride));
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_FIXED_SIZE_SAMPLES, TRUE));
+        RETURN_IF_FAILED(spMediaType->SetUINT32(MF_MT_SAMPLE_SIZE, sampleSize));
+
+        *ppMediaType = spMediaType.detach();
+        return S_OK;
+    }
+
     _Requires_lock_held_(m_Lock)
     HRESULT SimpleMediaStream::StartInternal(bool bSendEvent, IMFMediaType* pNewMediaType)
     {
@@ -414,6 +524,9 @@ namespace winrt::WindowsSample::implementation
 
         if ((m_streamState != MF_STREAM_STATE_RUNNING) || !bMatch)
         {
+            // the producer uses the allocator and the frame generator
+            _StopProducer();
+
             // Create the allocator if one doesn't exist
             if (m_allocatorUsage == MFSampleAllocatorUsage_UsesProvidedAllocator)
             {
@@ -429,14 +542,31 @@ namespace winrt::WindowsSample::implementation
             RETURN_IF_FAILED(m_spMediaType->GetGUID(MF_MT_SUBTYPE, &subType));
             MFGetAttributeSize(m_spMediaType.get(), MF_MT_FRAME_SIZE, &width, &height);
 
-            DEBUG_MSG(L"Initialize sample allocator for mediatype: %s, %dx%d ", winrt::to_hstring(subType).data(), width, height);
-            RETURN_IF_FAILED(m_spSampleAllocator->InitializeSampleAllocator(10, m_spMediaType.get()));
+            UINT32 frameRateNumerator = 30, frameRateDenominator = 1;
+            (void)MFGetAttributeRatio(m_spMediaType.get(), MF_MT_FRAME_RATE, &frameRateNumerator, &frameRateDenominator);
+
+            // fewer samples for the large frames, 10 4K RGB32 samples would take 330MB;
+            // but always the sample ring and the samples downstream
+            UINT32 sampleSize = 0;
+            RETURN_IF_FAILED(MFCalculateImageSize(subType, width, height, &sampleSize));
+            DWORD sampleCount = std::min<DWORD>(MAX_ALLOCATOR_SAMPLES, ALLOCATOR_BUDGET_BYTES / std::max<UINT32>(sampleSize, 1));
+            sampleCount = std::max<DWORD>(sampleCount, std::max<DWORD>(MIN_ALLOCATOR_SAMPLES, m_ringDepth + DOWNSTREAM_SAMPLES));
+
+            DEBUG_MSG(L"Initialize sample allocator for mediatype: %s, %dx%d, %d samples ", winrt::to_hstring(subType).data(), width, height, sampleCount);
+            RETURN_IF_FAILED(m_spSampleAllocator->InitializeSampleAllocator(sampleCount, m_spMediaType.get()));
             if (m_spFrameGenerator == nullptr)
             {
                 m_spFrameGenerator = wil::make_unique_nothrow<SimpleFrameGenerator>();
                 RETURN_IF_NULL_ALLOC_MSG(m_spFrameGenerator, "Fail to create SimpleFrameGenerator");
             }
+            // the samples of a reinitialized allocator hold nothing the frame generator knows of
+            m_spFrameGenerator->InvalidateBuffers();
+            RETURN_IF_FAILED(m_spFrameGenerator->SetPattern(m_pattern));
             RETURN_IF_FAILED(m_spFrameGenerator->Initialize(m_spMediaType.get()));
+
+            // the derived streams scale the NV12 frames, they render their own frames otherwise
+            m_bFeeding = !m_derivedStreams.empty() && (subType == MFVideoFormat_NV12);
+            RETURN_IF_FAILED(_StartProducer(width, height, frameRateNumerator, frameRateDenominator));
         }
 
         if (bSendEvent)
@@ -457,7 +587,8 @@ namespace winrt::WindowsSample::implementation
         // Set stream state
         m_streamState = MF_STREAM_STATE_STOPPED;
 
-        // NOTE: if implementation has sampleRequestQueue or sampleQueue, it must flush the queue on stopped.
+        // Flushes the pending requests and the frames rendered ahead
+        _StopProducer();
         if (bSendEvent)
         {
             // Post MEStreamStopped event to signal stream has stopped
@@ -466,4 +597,474 @@ namespace winrt::WindowsSample::implementation
 
         return S_OK;
     }
+
+    _Requires_lock_held_(m_Lock)
+    HRESULT SimpleMediaStream::_StartProducer(UINT32 width, UINT32 height, UINT32 frameRateNumerator, UINT32 frameRateDenominator)
+    {
+        if (!m_producerWake)
+        {
+            RETURN_IF_FAILED(m_producerWake.create());
+        }
+        if (!m_frameTimer)
+        {
+            // a plain timer before Windows 10 1803, only as precise as the system timer resolution
+            m_frameTimer.reset(CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+            if (!m_frameTimer)
+            {
+                m_frameTimer.reset(CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS));
+            }
+            RETURN_LAST_ERROR_IF(!m_frameTimer);
+        }
+
+        LONGLONG clockStart = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_frameLock);
+
+            // a fed stream keeps the clock of the primary stream
+            clockStart = m_bFed ? m_feedClockStart : MFGetSystemTime();
+            RETURN_HR_IF_MSG(E_INVALIDARG, !m_frameClock.Start(clockStart, frameRateNumerator, frameRateDenominator), "Invalid frame rate: %d/%d", frameRateNumerator, frameRateDenominator);
+            try
+            {
+                m_ring.resize(m_ringDepth);
+            } CATCH_RETURN();
+            m_ringHead = 0;
+            m_ringCount = 0;
+            m_nextFedFrame = 0;
+            m_width = width;
+            m_height = height;
+            m_frameRateNumerator = frameRateNumerator;
+            m_frameRateDenominator = frameRateDenominator;
+            m_bStopProducer = false;
+            m_bProducing = true;
+        }
+
+        // the producer waits for a sample to come back rather than polling the allocator, when the allocator can tell
+        m_spAllocatorCallback = m_spSampleAllocator.try_query<IMFVideoSampleAllocatorCallback>();
+        if (m_spAllocatorCallback != nullptr)
+        {
+            auto spNotify = winrt::make_self<CSampleReleaseNotify>(m_producerWake.get());
+            if (FAILED(m_spAllocatorCallback->SetCallback(spNotify.get())))
+            {
+                m_spAllocatorCallback.reset();
+            }
+        }
+
+        if (m_bFeeding)
+        {
+            _StartFeeds(clockStart);
+        }
+
+        try
+        {
+            m_producerThread = std::thread(&SimpleMediaStream::_ProducerThread, this);
+        } CATCH_RETURN();
+
+        return S_OK;
+    }
+
+    void SimpleMediaStream::_StopProducer()
+    {
+        if (m_producerThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_frameLock);
+                m_bStopProducer = true;
+            }
+            m_producerWake.SetEvent();
+            m_producerThread.join();
+        }
+
+        // the derived streams render their own frames until the next start
+        if (m_bFeeding)
+        {
+            _StopFeeds();
+            m_bFeeding = false;
+        }
+
+        if (m_spAllocatorCallback != nullptr)
+        {
+            (void)m_spAllocatorCallback->SetCallback(nullptr);
+            m_spAllocatorCallback.reset();
+        }
+
+        // the requests are dropped and the samples go back to the allocator
+        std::lock_guard<std::mutex> lock(m_frameLock);
+        m_bProducing = false;
+        if ((m_ringCount > 0) || !m_pendingRequests.empty())
+        {
+            DEBUG_MSG(L"Flush %d frames and %d requests", m_ringCount, (UINT32)m_pendingRequests.size());
+        }
+        while (m_ringCount > 0)
+        {
+            _PopFrame();
+        }
+        m_pendingRequests.clear();
+
+        FrameClockStats stats = m_frameClock.Stats();
+        if (stats.framesDelivered > 0)
+        {
+            DEBUG_MSG(L"Frames delivered: %I64u, skipped: %I64u, jitter mean/max: %I64d/%I64d, lateness mean/max: %I64d/%I64d (100ns)",
+                stats.framesDelivered, stats.framesSkipped, stats.meanJitter, stats.maxJitter, stats.meanLateness, stats.maxLateness);
+        }
+    }
+
+    void SimpleMediaStream::_ProducerThread()
+    {
+        std::unique_lock<std::mutex> lock(m_frameLock);
+        while (!m_bStopProducer)
+        {
+            LONGLONG nextDeliveryTime = _DeliverFrames();
+            DWORD waitMs = INFINITE;
+
+            // keep the ring full, the primary stream fills it while the stream is fed
+            if (!m_bFed && (m_ringCount < m_ringDepth))
+            {
+                lock.unlock();
+                wil::com_ptr_nothrow<IMFSample> spSample;
+                HRESULT hr = m_spSampleAllocator->AllocateSample(&spSample);
+                lock.lock();
+
+                if (SUCCEEDED(hr))
+                {
+                    UINT64 frameIndex = m_frameClock.NextFrame(MFGetSystemTime());
+                    LONGLONG frameTime = m_frameClock.FrameTime(frameIndex);
+                    ULONG rgbMask = m_rgbMask;
+                    bool bPatternChanged = std::exchange(m_bPatternChanged, false);
+                    bool bFedSamples = std::exchange(m_bFedSamples, false);
+                    TestPatternSettings pattern = m_pattern;
+                    lock.unlock();
+
+                    if (bPatternChanged)
+                    {
+                        hr = m_spFrameGenerator->SetPattern(pattern);
+                    }
+                    if (bFedSamples)
+                    {
+                        m_spFrameGenerator->InvalidateBuffers();
+                    }
+                    if (SUCCEEDED(hr))
+                    {
+                        hr = _RenderFrame(spSample.get(), frameIndex, frameTime, rgbMask);
+                    }
+                    lock.lock();
+
+                    if (SUCCEEDED(hr))
+                    {
+                        // a stream fed in the meantime has a new clock, the frame is dropped and its sample goes
+                        // back to the allocator
+                        if (!m_bFed)
+                        {
+                            m_ring[(m_ringHead + m_ringCount) % m_ringDepth] = { std::move(spSample), frameIndex };
+                            m_ringCount++;
+                        }
+                        continue;
+                    }
+                }
+
+                if (hr != MF_E_SAMPLEALLOCATOR_EMPTY)
+                {
+                    LOG_HR_MSG(hr, "Fail to render frame");
+                    (void)m_spEventQueue->QueueEventParamVar(MEError, GUID_NULL, hr, nullptr);
+                    break;
+                }
+
+                // every sample is downstream: wait for the allocator callback, or poll if the allocator has none
+                if (m_spAllocatorCallback == nullptr)
+                {
+                    waitMs = std::max<DWORD>(1, (DWORD)(m_frameClock.FrameDuration(0) / 40000));
+                }
+            }
+
+            HANDLE handles[] = { m_producerWake.get(), m_frameTimer.get() };
+            DWORD handleCount = 1;
+            if (nextDeliveryTime != 0)
+            {
+                LONGLONG delay = std::max<LONGLONG>(nextDeliveryTime - MFGetSystemTime(), 1);
+                LARGE_INTEGER dueTime;
+                dueTime.QuadPart = -delay;
+                if (SetWaitableTimer(m_frameTimer.get(), &dueTime, 0, nullptr, nullptr, FALSE))
+                {
+                    handleCount = 2;
+                }
+                else
+                {
+                    waitMs = std::min<DWORD>(waitMs, (DWORD)((delay + 9999) / 10000));
+                }
+            }
+
+            lock.unlock();
+            (void)WaitForMultipleObjects(handleCount, handles, FALSE, waitMs);
+            lock.lock();
+        }
+    }
+
+    HRESULT SimpleMediaStream::_RenderFrame(
+            _In_ IMFSample* pSample,
+            UINT64 frameIndex,
+            LONGLONG frameTime,
+            ULONG rgbMask
+        )
+    {
+        wil::com_ptr_nothrow<IMFMediaBuffer> outputBuffer;
+        LONG pitch = 0;
+        BYTE* bufferStart = nullptr; // not used
+        DWORD bufferLength = 0;
+        BYTE* pbuf = nullptr;
+        wil::com_ptr_nothrow<IMF2DBuffer2> buffer2D;
+
+        RETURN_IF_FAILED(pSample->GetBufferByIndex(0, &outputBuffer));
+        RETURN_IF_FAILED(outputBuffer->QueryInterface(IID_PPV_ARGS(&buffer2D)));
+        RETURN_IF_FAILED(buffer2D->Lock2DSize(MF2DBuffer_LockFlags_Write,
+            &pbuf,
+            &pitch,
+            &bufferStart,
+            &bufferLength));
+
+        // a system memory buffer keeps its content between samples, a frame it already holds is not written again when
+        // VCAM_REUSE_SAMPLE_CONTENT says nothing downstream writes into it, and the allocator is ours so no other stream
+        // does; a D3D buffer goes through a staging copy and is always written
+        bool bPersistentBuffer = m_bReuseSampleContent && (m_allocatorUsage != MFSampleAllocatorUsage_UsesProvidedAllocator)
+            && !outputBuffer.try_query<IMFDXGIBuffer>();
+        HRESULT hr = m_spFrameGenerator->CreateFrame(pbuf, bufferLength, pitch, rgbMask, bPersistentBuffer, frameTime, frameIndex);
+
+        // the derived streams scale the frame while it is locked, a stream that fails misses the frame
+        if (SUCCEEDED(hr) && m_bFeeding)
+        {
+            for (auto& spStream : m_derivedStreams)
+            {
+                LOG_IF_FAILED(spStream->_FeedFrame(pbuf, pitch, m_width, m_height, frameTime));
+            }
+        }
+        RETURN_IF_FAILED(buffer2D->Unlock2D());
+        RETURN_IF_FAILED(hr);
+
+        return S_OK;
+    }
+
+    // Delivers the rendered frames to the pending requests, in order. Frames too late for the clock are dropped.
+    // When pacing, returns the frame time of the next frame to deliver if it is not due yet, 0 otherwise
+    _Requires_lock_held_(m_frameLock)
+    LONGLONG SimpleMediaStream::_DeliverFrames()
+    {
+        while (!m_pendingRequests.empty() && (m_ringCount > 0))
+        {
+            LONGLONG now = MFGetSystemTime();
+            RenderedFrame& frame = m_ring[m_ringHead];
+            if (m_frameClock.IsTooLate(frame.frameIndex, now))
+            {
+                m_frameClock.Skip(1);
+                _PopFrame();
+                continue;
+            }
+
+            LONGLONG frameTime = m_frameClock.FrameTime(frame.frameIndex);
+            if (m_bPacing && (frameTime > now))
+            {
+                return frameTime;
+            }
+
+            HRESULT hr = frame.spSample->SetSampleTime(frameTime);
+            if (SUCCEEDED(hr))
+            {
+                hr = frame.spSample->SetSampleDuration(m_frameClock.FrameDuration(frame.frameIndex));
+            }
+            if (SUCCEEDED(hr) && (m_pendingRequests.front() != nullptr))
+            {
+                hr = frame.spSample->SetUnknown(MFSampleExtension_Token, m_pendingRequests.front().get());
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = m_spEventQueue->QueueEventParamUnk(MEMediaSample, GUID_NULL, S_OK, frame.spSample.get());
+            }
+            LOG_IF_FAILED(hr);
+
+            m_frameClock.RecordDelivery(frame.frameIndex, now);
+            _PopFrame();
+            m_pendingRequests.pop_front();
+        }
+
+        return 0;
+    }
+
+    _Requires_lock_held_(m_frameLock)
+    void SimpleMediaStream::_PopFrame()
+    {
+        // the sample goes back to the allocator now, not when the slot is reused
+        m_ring[m_ringHead].spSample.reset();
+        m_ringHead = (m_ringHead + 1) % m_ringDepth;
+        m_ringCount--;
+    }
+
+    HRESULT SimpleMediaStream::_AddDerivedStream(_In_ SimpleMediaStream* pStream)
+    {
+        winrt::slim_lock_guard lock(m_Lock);
+        RETURN_HR_IF_NULL(E_INVALIDARG, pStream);
+
+        try
+        {
+            m_derivedStreams.emplace_back(pStream);
+        } CATCH_RETURN();
+
+        return S_OK;
+    }
+
+    void SimpleMediaStream::_StartFeeds(LONGLONG clockStart)
+    {
+        for (auto& spStream : m_derivedStreams)
+        {
+            spStream->_StartFeed(clockStart);
+        }
+    }
+
+    void SimpleMediaStream::_StopFeeds()
+    {
+        for (auto& spStream : m_derivedStreams)
+        {
+            spStream->_StopFeed();
+        }
+    }
+
+    void SimpleMediaStream::_StartFeed(LONGLONG clockStart)
+    {
+        std::lock_guard<std::mutex> lock(m_frameLock);
+        m_bFed = true;
+        m_feedClockStart = clockStart;
+        m_nextFedFrame = 0;
+
+        // the frames rendered on this stream's clock are dropped
+        if (m_bProducing)
+        {
+            (void)m_frameClock.Start(clockStart, m_frameRateNumerator, m_frameRateDenominator);
+            while (m_ringCount > 0)
+            {
+                _PopFrame();
+            }
+        }
+    }
+
+    void SimpleMediaStream::_StopFeed()
+    {
+        std::lock_guard<std::mutex> lock(m_frameLock);
+        m_bFed = false;
+
+        // back to a clock of its own from now, the fed frames are dropped
+        if (m_bProducing)
+        {
+            (void)m_frameClock.Start(MFGetSystemTime(), m_frameRateNumerator, m_frameRateDenominator);
+            while (m_ringCount > 0)
+            {
+                _PopFrame();
+            }
+            m_producerWake.SetEvent();
+        }
+    }
+
+    // Called on the producer thread of the primary stream, with the frame it has just rendered
+    HRESULT SimpleMediaStream::_FeedFrame(
+            _In_ const BYTE* pSrc,
+            LONG srcPitch,
+            UINT32 srcWidth,
+            UINT32 srcHeight,
+            LONGLONG frameTime
+        )
+    {
+        wil::com_ptr_nothrow<IMFVideoSampleAllocator> spAllocator;
+        UINT64 frameIndex = 0;
+        UINT32 width = 0, height = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_frameLock);
+            if (!m_bFed || !m_bProducing || m_bStopProducer || (m_ringCount == m_ringDepth))
+            {
+                return S_OK;
+            }
+
+            // the first frame at or after each frame time of this stream, stamped with it: the same time
+            // as the primary frame when the frame rates are multiples
+            frameIndex = m_frameClock.FrameIndex(frameTime);
+            if (frameIndex < m_nextFedFrame)
+            {
+                return S_OK;
+            }
+            m_nextFedFrame = frameIndex + 1;
+
+            // the allocator doesn't change while producing
+            spAllocator = m_spSampleAllocator;
+            width = m_width;
+            height = m_height;
+        }
+
+        wil::com_ptr_nothrow<IMFSample> spSample;
+        HRESULT hr = spAllocator->AllocateSample(&spSample);
+        if (hr == MF_E_SAMPLEALLOCATOR_EMPTY)
+        {
+            // every sample is downstream, this stream misses the frame
+            return S_OK;
+        }
+        RETURN_IF_FAILED(hr);
+        RETURN_IF_FAILED(_ScaleFrame(spSample.get(), pSrc, srcPitch, srcWidth, srcHeight, width, height));
+
+        std::lock_guard<std::mutex> lock(m_frameLock);
+        m_bFedSamples = true;
+
+        // the stream may have restarted with another media type in the meantime
+        if (m_bFed && m_bProducing && !m_bStopProducer && (m_ringCount < m_ringDepth) && (m_width == width) && (m_height == height))
+        {
+            m_ring[(m_ringHead + m_ringCount) % m_ringDepth] = { std::move(spSample), frameIndex };
+            m_ringCount++;
+            m_producerWake.SetEvent();
+        }
+
+        return S_OK;
+    }
+
+    HRESULT SimpleMediaStream::_ScaleFrame(
+            _In_ IMFSample* pSample,
+            _In_ const BYTE* pSrc,
+            LONG srcPitch,
+            UINT32 srcWidth,
+            UINT32 srcHeight,
+            UINT32 width,
+            UINT32 height
+        )
+    {
+        ScaleFilter filter = ImageScaler::DefaultFilter(srcWidth, srcHeight, width, height);
+        if (!m_scaler.IsInitialized(srcWidth, srcHeight, width, height, filter))
+        {
+            bool bInitialized = false;
+            try
+            {
+                bInitialized = m_scaler.Initialize(srcWidth, srcHeight, width, height, filter);
+            } CATCH_RETURN();
+            RETURN_HR_IF_MSG(E_INVALIDARG, !bInitialized, "Invalid scale: %dx%d to %dx%d", srcWidth, srcHeight, width, height);
+        }
+
+        wil::com_ptr_nothrow<IMFMediaBuffer> outputBuffer;
+        LONG pitch = 0;
+        BYTE* bufferStart = nullptr; // not used
+        DWORD bufferLength = 0;
+        BYTE* pbuf = nullptr;
+        wil::com_ptr_nothrow<IMF2DBuffer2> buffer2D;
+
+        RETURN_IF_FAILED(pSample->GetBufferByIndex(0, &outputBuffer));
+        RETURN_IF_FAILED(outputBuffer->QueryInterface(IID_PPV_ARGS(&buffer2D)));
+        RETURN_IF_FAILED(buffer2D->Lock2DSize(MF2DBuffer_LockFlags_Write,
+            &pbuf,
+            &pitch,
+            &bufferStart,
+            &bufferLength));
+
+        HRESULT hr = S_OK;
+        if ((pitch < (LONG)width) || (bufferLength < (UINT64)pitch * height * 3 / 2))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+        }
+        else
+        {
+            m_scaler.Scale(pSrc, srcPitch, pbuf, pitch);
+        }
+        RETURN_IF_FAILED(buffer2D->Unlock2D());
+        RETURN_IF_FAILED(hr);
+
+        return S_OK;
+    }
 }
@@ -15,6 +15,8 @@ namespace winrt::WindowsSample::implementation
         friend struct SimpleMediaSource;
 
     public:
+        ~SimpleMediaStream();
+
         // IMFMediaEventGenerator
         IFACEMETHODIMP BeginGetEvent(IMFAsyncCallback* pCallback, IUnknown* punkState) override;
         IFACEMETHODIMP EndGetEvent(IMFAsyncResult* pResult, IMFMediaEvent** ppEvent) override;
@@ -31,7 +33,8 @@ namespace winrt::WindowsSample::implementation
         IFACEMETHODIMP GetStreamState(_Out_ MF_STREAM_STATE* pState) override;
 
         // Non-interface methods.
-        HRESULT Initialize(_In_ SimpleMediaSource* pSource, _In_ DWORD streamId, _In_ MFSampleAllocatorUsage allocatorUsage);
+        // A stream with a primary stream is derived from it: its frames are scaled from the ones the primary stream renders
+        HRESULT Initialize(_In_ SimpleMediaSource* pSource, _In_ DWORD streamId, _In_ MFSampleAllocatorUsage allocatorUsage, _In_opt_ IMFAttributes* pSourceAttributes, _In_opt_ SimpleMediaStream* pPrimaryStream = nullptr);
         HRESULT Start(_In_ IMFMediaType* pMediaType);
         HRESULT Stop(_In_ bool fSendEvent);
         HRESULT Shutdown();
@@ -41,17 +44,49 @@ namespace winrt::WindowsSample::implementation
         DWORD Id() const { return m_dwStreamId; }
         MFSampleAllocatorUsage SampleAlloactorUsage() const { return m_allocatorUsage; }
 
-        void SetRGBMask(uint32_t rgbMask) { winrt::slim_lock_guard lock(m_Lock);  m_rgbMask = rgbMask; }
+        void SetRGBMask(uint32_t rgbMask);
         uint32_t GetRGBMask() { winrt::slim_lock_guard lock(m_Lock);  return m_rgbMask; }
+        HRESULT SetPattern(TestPatternSettings const& settings);
+        TestPatternSettings GetPattern() { winrt::slim_lock_guard lock(m_Lock);  return m_pattern; }
+        void SetPacing(bool bPacing);
+        bool GetPacing() { std::lock_guard<std::mutex> lock(m_frameLock);  return m_bPacing; }
+        FrameClockStats GetFrameClockStats() { std::lock_guard<std::mutex> lock(m_frameLock);  return m_frameClock.Stats(); }
 
     private:
         _Requires_lock_held_(m_Lock) HRESULT _CheckShutdownRequiresLock();
         _Requires_lock_held_(m_Lock) HRESULT _SetStreamAttributes(IMFAttributes* pAttributeStore);
         _Requires_lock_held_(m_Lock) HRESULT _SetStreamDescriptorAttributes(IMFAttributes* pAttributeStore);
+        static HRESULT _CreateMediaType(_In_ VCAM_MEDIATYPE_LADDER_ENTRY const& entry, _COM_Outptr_ IMFMediaType** ppMediaType);
 
         _Requires_lock_held_(m_Lock) HRESULT StartInternal(bool bSendEvent, IMFMediaType* pNewMediaType);
         _Requires_lock_held_(m_Lock) HRESULT StopInternal(bool bSendEvent);
 
+        // The producer thread keeps a ring of samples rendered ahead of the requests, and delivers them at their frame time when pacing
+        _Requires_lock_held_(m_Lock) HRESULT _StartProducer(UINT32 width, UINT32 height, UINT32 frameRateNumerator, UINT32 frameRateDenominator);
+        void _StopProducer();
+        void _ProducerThread();
+        HRESULT _RenderFrame(_In_ IMFSample* pSample, UINT64 frameIndex, LONGLONG frameTime, ULONG rgbMask);
+        HRESULT _ScaleFrame(_In_ IMFSample* pSample, _In_ const BYTE* pSrc, LONG srcPitch, UINT32 srcWidth, UINT32 srcHeight, UINT32 width, UINT32 height);
+        _Requires_lock_held_(m_frameLock) LONGLONG _DeliverFrames();
+        _Requires_lock_held_(m_frameLock) void _PopFrame();
+
+        // Primary stream: the derived streams take each frame it renders while it streams NV12
+        HRESULT _AddDerivedStream(_In_ SimpleMediaStream* pStream);
+        void _StartFeeds(LONGLONG clockStart);
+        void _StopFeeds();
+
+        // Derived stream, called by the primary stream. Its clock starts with the primary's: at the same frame rate
+        // frame n of both streams has the same timestamp, at a lower rate the frames in between are dropped
+        void _StartFeed(LONGLONG clockStart);
+        void _StopFeed();
+        HRESULT _FeedFrame(_In_ const BYTE* pSrc, LONG srcPitch, UINT32 srcWidth, UINT32 srcHeight, LONGLONG frameTime);
+
+        struct RenderedFrame
+        {
+            wil::com_ptr_nothrow<IMFSample> spSample;
+            UINT64 frameIndex;
+        };
+
         winrt::slim_mutex  m_Lock;
 
         wil::com_ptr_nothrow<IMFMediaSource> m_parent;
@@ -66,9 +101,45 @@ namespace winrt::WindowsSample::implementation
         bool m_bSelected = false;
         MF_STREAM_STATE m_streamState = MF_STREAM_STATE_STOPPED;
         uint32_t m_rgbMask = KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_COLORMODE_BLUE;
+        TestPatternSettings m_pattern = {};
+
+        // Frames rendered ahead and requests waiting for a frame, shared with the producer thread.
+        // m_rgbMask and m_pattern are written under both locks so the producer can read them under m_frameLock
+        std::mutex m_frameLock;
+        std::vector<RenderedFrame> m_ring;      // m_ringDepth slots, m_ringCount frames from m_ringHead
+        UINT32 m_ringDepth = 0;
+        UINT32 m_ringHead = 0;
+        UINT32 m_ringCount = 0;
+        std::deque<wil::com_ptr_nothrow<IUnknown>> m_pendingRequests;
+        FrameClock m_frameClock;
+        bool m_bPacing = true;
+        bool m_bPatternChanged = false;
+        bool m_bStopProducer = false;
+        std::thread m_producerThread;
+        wil::unique_event_nothrow m_producerWake;
+        wil::unique_handle m_frameTimer;
+        wil::com_ptr_nothrow<IMFVideoSampleAllocatorCallback> m_spAllocatorCallback;
+        bool m_bProducing = false;
+        UINT32 m_width = 0;
+        UINT32 m_height = 0;
+        UINT32 m_frameRateNumerator = 0;
+        UINT32 m_frameRateDenominator = 0;
+
+        // Derived streams of the primary stream, fed by its producer thread while m_bFeeding
+        std::vector<wil::com_ptr_nothrow<SimpleMediaStream>> m_derivedStreams;
+        bool m_bFeeding = false;
+
+        // Derived stream, under m_frameLock: while fed the producer thread only delivers
+        bool m_bFed = false;
+        bool m_bFedSamples = false;             // samples written by the feed, unknown to the frame generator
+        LONGLONG m_feedClockStart = 0;
+        UINT64 m_nextFedFrame = 0;
+        ImageScaler m_scaler;                   // used by the primary's producer thread only
 
         DWORD m_dwStreamId = 0;
         MFSampleAllocatorUsage m_allocatorUsage;
+        bool m_bDerived = false;
+        bool m_bReuseSampleContent = false;     // VCAM_REUSE_SAMPLE_CONTENT
     };
 }
 
@@ -0,0 +1,453 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+// Built without the precompiled header, see TestPattern.h
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TESTPATTERN_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#define TESTPATTERN_NEON
+#include <arm64_neon.h>
+#elif defined(__ARM_NEON)
+#define TESTPATTERN_NEON
+#include <arm_neon.h>
+#endif
+
+#include "TestPattern.h"
+
+namespace
+{
+    const uint32_t NOISE_INDEX_STEP = 0x9E3779B9;
+    const uint32_t NOISE_FRAME_STEP = 0x85EBCA6B;
+
+    // 75% bars, then the reverse blue bars and the -I, white, +Q, black, pluge row
+    const uint32_t BARS[7] = { 0xBFBFBF, 0xBFBF00, 0x00BFBF, 0x00BF00, 0xBF00BF, 0xBF0000, 0x0000BF };
+    const uint32_t REVERSE_BARS[7] = { 0x0000BF, 0x000000, 0xBF00BF, 0x000000, 0x00BFBF, 0x000000, 0xBFBFBF };
+    const uint32_t MINUS_I = 0x00214C;
+    const uint32_t PLUS_Q = 0x32006A;
+    const uint32_t WHITE = 0xFFFFFF;
+    const uint32_t BLACK = 0x000000;
+    const uint32_t PLUGE[3] = { 0x000000, 0x0A0A0A, 0x141414 };   // black, +4% and +8%
+
+    const uint32_t BOX_COLORS[][2] = { { 0xE03030, 0x701818 }, { 0x30E030, 0x187018 }, { 0x3030E0, 0x181870 }, { 0xE0E030, 0x707018 } };
+    const uint32_t BOX_CHECKER = 16;
+
+    // 5x7 font, a byte a row, bit 4 is the left column
+    const uint8_t GLYPHS[][7] =
+    {
+        { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },   // 0
+        { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },   // 1
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },   // 2
+        { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },   // 3
+        { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },   // 4
+        { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },   // 5
+        { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },   // 6
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },   // 7
+        { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },   // 8
+        { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },   // 9
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },   // :
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },   // .
+    };
+    const uint32_t GLYPH_CELL_WIDTH = 6;
+    const uint32_t GLYPH_CELL_HEIGHT = 9;
+    const uint32_t OVERLAY_CHARS = 12;                  // HH:MM:SS.mmm, the frame counter has 10 digits
+
+    // 8 bit cosine of a 10 bit phase
+    const uint8_t* CosineTable()
+    {
+        static const struct Table
+        {
+            uint8_t values[1024];
+            Table()
+            {
+                for (int i = 0; i < 1024; i++)
+                {
+                    values[i] = (uint8_t)std::lround(127.5 + 127.5 * std::cos(i * 3.14159265358979323846 / 512));
+                }
+            }
+        } table;
+        return table.values;
+    }
+
+    inline int64_t Wrap(int64_t value, int64_t size)
+    {
+        value %= size;
+        return (value < 0) ? value + size : value;
+    }
+
+    //////////////////////////////////////////////////
+    // Noise: a hash of the pixel index, only shifts, adds and xors so every SIMD flavor has the instructions
+
+    inline uint32_t Mix(uint32_t x)
+    {
+        x ^= x >> 16;
+        x += x << 3;
+        x ^= x >> 11;
+        x += x << 15;
+        x ^= x >> 13;
+        x += x << 7;
+        x ^= x >> 16;
+        return x;
+    }
+
+    void NoiseRow_C(uint32_t key, uint32_t index, uint32_t width, uint32_t* pDst)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            pDst[x] = Mix(key ^ ((index + x) * NOISE_INDEX_STEP)) & 0xFFFFFF;
+        }
+    }
+
+#if defined(TESTPATTERN_SSE2)
+    void NoiseRow_SSE2(uint32_t key, uint32_t index, uint32_t width, uint32_t* pDst)
+    {
+        const __m128i vKey = _mm_set1_epi32((int)key);
+        const __m128i vStep = _mm_set1_epi32((int)(4 * NOISE_INDEX_STEP));
+        const __m128i vMask = _mm_set1_epi32(0xFFFFFF);
+        __m128i vIndex = _mm_setr_epi32((int)(index * NOISE_INDEX_STEP), (int)((index + 1) * NOISE_INDEX_STEP),
+            (int)((index + 2) * NOISE_INDEX_STEP), (int)((index + 3) * NOISE_INDEX_STEP));
+
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_xor_si128(vKey, vIndex);
+            v = _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+            v = _mm_add_epi32(v, _mm_slli_epi32(v, 3));
+            v = _mm_xor_si128(v, _mm_srli_epi32(v, 11));
+            v = _mm_add_epi32(v, _mm_slli_epi32(v, 15));
+            v = _mm_xor_si128(v, _mm_srli_epi32(v, 13));
+            v = _mm_add_epi32(v, _mm_slli_epi32(v, 7));
+            v = _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+            _mm_storeu_si128((__m128i*)(pDst + x), _mm_and_si128(v, vMask));
+            vIndex = _mm_add_epi32(vIndex, vStep);
+        }
+        NoiseRow_C(key, index + x, width - x, pDst + x);
+    }
+#elif defined(TESTPATTERN_NEON)
+    void NoiseRow_NEON(uint32_t key, uint32_t index, uint32_t width, uint32_t* pDst)
+    {
+        const uint32x4_t vKey = vdupq_n_u32(key);
+        const uint32x4_t vStep = vdupq_n_u32(4 * NOISE_INDEX_STEP);
+        const uint32x4_t vMask = vdupq_n_u32(0xFFFFFF);
+        const uint32_t start[4] = { index * NOISE_INDEX_STEP, (index + 1) * NOISE_INDEX_STEP, (index + 2) * NOISE_INDEX_STEP, (index + 3) * NOISE_INDEX_STEP };
+        uint32x4_t vIndex = vld1q_u32(start);
+
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            uint32x4_t v = veorq_u32(vKey, vIndex);
+            v = veorq_u32(v, vshrq_n_u32(v, 16));
+            v = vaddq_u32(v, vshlq_n_u32(v, 3));
+            v = veorq_u32(v, vshrq_n_u32(v, 11));
+            v = vaddq_u32(v, vshlq_n_u32(v, 15));
+            v = veorq_u32(v, vshrq_n_u32(v, 13));
+            v = vaddq_u32(v, vshlq_n_u32(v, 7));
+            v = veorq_u32(v, vshrq_n_u32(v, 16));
+            vst1q_u32(pDst + x, vandq_u32(v, vMask));
+            vIndex = vaddq_u32(vIndex, vStep);
+        }
+        NoiseRow_C(key, index + x, width - x, pDst + x);
+    }
+#endif
+}
+
+bool TestPattern::Initialize(TestPatternSettings const& settings, uint32_t width, uint32_t height, bool bUseSimd)
+{
+    if ((width == 0) || (height == 0) || (settings.kind >= TestPatternKind::End))
+    {
+        return false;
+    }
+    m_settings = settings;
+    m_width = width;
+    m_height = height;
+
+    m_pfnNoiseRow = NoiseRow_C;
+#if defined(TESTPATTERN_SSE2)
+    m_pfnNoiseRow = bUseSimd ? NoiseRow_SSE2 : NoiseRow_C;
+#elif defined(TESTPATTERN_NEON)
+    m_pfnNoiseRow = bUseSimd ? NoiseRow_NEON : NoiseRow_C;
+#endif
+
+    // half a cycle per pixel at the left and right edges
+    m_zonePlateScale = ((uint64_t)1 << 31) / width;
+
+    m_background.resize(width);
+    for (uint32_t x = 0; x < width; x++)
+    {
+        uint32_t level = 32 + (x * 160) / width;
+        m_background[x] = (level << 16) | (level << 8) | level;
+    }
+
+    m_boxWidth = std::max<uint32_t>(width / 8, 1);
+    m_boxHeight = std::max<uint32_t>(height / 6, 1);
+    m_boxes.clear();
+    for (int32_t i = 0; i < 4; i++)
+    {
+        Box box = {};
+        box.x = (int32_t)(((2 * i + 1) * width) / 8) - (int32_t)m_boxWidth / 2;
+        box.y = (int32_t)(((i + 1) * height) / 5) - (int32_t)m_boxHeight / 2;
+        box.vx = settings.motionX * (i + 1);
+        box.vy = settings.motionY * (i + 1) * ((i & 1) ? -1 : 1);
+        box.color[0] = BOX_COLORS[i][0];
+        box.color[1] = BOX_COLORS[i][1];
+        m_boxes.push_back(box);
+    }
+
+    m_glyphScale = std::max<uint32_t>(height / 270, 1);
+    return true;
+}
+
+bool TestPattern::IsAnimated(TestPatternSettings const& settings)
+{
+    switch (settings.kind)
+    {
+    case TestPatternKind::Noise:
+        return true;
+    case TestPatternKind::MovingBoxes:
+        return (settings.overlay != 0) || (settings.motionX != 0) || (settings.motionY != 0);
+    case TestPatternKind::ZonePlate:
+        return (settings.overlay != 0) || (settings.motionX != 0);
+    default:
+        return settings.overlay != 0;
+    }
+}
+
+void TestPattern::RenderRows(
+    uint64_t frameNumber,
+    int64_t time,
+    uint32_t rgbMask,
+    uint8_t* pDst,
+    int32_t stride,
+    uint32_t rowStart,
+    uint32_t rowEnd) const
+{
+    uint32_t noiseKey = Mix(m_settings.seed ^ Mix((uint32_t)frameNumber * NOISE_FRAME_STEP));
+
+    for (uint32_t r = rowStart; (r < rowEnd) && (r < m_height); r++)
+    {
+        uint32_t* pRow = (uint32_t*)(pDst + (int64_t)r * stride);
+        switch (m_settings.kind)
+        {
+        case TestPatternKind::Ramp:
+            _RenderRamp(r, time, rgbMask, pRow);
+            break;
+        case TestPatternKind::Bars:
+            _RenderBars(r, pRow);
+            break;
+        case TestPatternKind::ZonePlate:
+            _RenderZonePlate(r, frameNumber, pRow);
+            break;
+        case TestPatternKind::MovingBoxes:
+            _RenderMovingBoxes(r, frameNumber, pRow);
+            break;
+        case TestPatternKind::Noise:
+            m_pfnNoiseRow(noiseKey, r * m_width, m_width, pRow);
+            break;
+        default:
+            break;
+        }
+
+        if (m_settings.overlay != 0)
+        {
+            _RenderOverlay(r, frameNumber, time, pRow);
+        }
+    }
+}
+
+void TestPattern::RenderRampRowsNV12(int64_t time, uint32_t rgbMask, uint8_t* pDst, int32_t stride, uint32_t rowStart, uint32_t rowEnd) const
+{
+    uint8_t* pUVPlane = pDst + (int64_t)stride * m_height;
+    for (uint32_t r = rowStart; (r < rowEnd) && (r < m_height); r += 2)
+    {
+        uint8_t y1, y2, u1, v1, u2, v2;
+        _RampYUV(r, time, rgbMask, &y1, &u1, &v1);
+        _RampYUV((r + 1 < m_height) ? r + 1 : r, time, rgbMask, &y2, &u2, &v2);
+
+        memset(pDst + (int64_t)r * stride, y1, m_width);
+        if (r + 1 < m_height)
+        {
+            memset(pDst + (int64_t)(r + 1) * stride, y2, m_width);
+        }
+
+        uint16_t uv = (uint16_t)(((v1 + v2 + 1) >> 1) << 8 | ((u1 + u2 + 1) >> 1));
+        std::fill_n((uint16_t*)(pUVPlane + (int64_t)(r / 2) * stride), m_width / 2, uv);
+    }
+}
+
+void TestPattern::RenderRampRowsYUY2(int64_t time, uint32_t rgbMask, uint8_t* pDst, int32_t stride, uint32_t rowStart, uint32_t rowEnd) const
+{
+    for (uint32_t r = rowStart; (r < rowEnd) && (r < m_height); r++)
+    {
+        uint8_t y, u, v;
+        _RampYUV(r, time, rgbMask, &y, &u, &v);
+
+        uint32_t yuyv = (uint32_t)v << 24 | (uint32_t)y << 16 | (uint32_t)u << 8 | y;
+        std::fill_n((uint32_t*)(pDst + (int64_t)r * stride), m_width / 2, yuyv);
+    }
+}
+
+//////////////////////////////////////////////////
+// private
+
+// Same as the ramp of SimpleFrameGenerator
+void TestPattern::_RenderRamp(uint32_t row, int64_t time, uint32_t rgbMask, uint32_t* pRow) const
+{
+    uint8_t gray = (uint8_t)(row + (uint32_t)((time / 10000000) % m_height));
+    _Fill(pRow, 0, m_width, ((uint32_t)gray << 16 | (uint32_t)gray << 8 | (uint32_t)gray) & rgbMask);
+}
+
+// Color of a ramp row in BT.601 limited range, as SimpleFrameGenerator::RGB24ToYUY2
+void TestPattern::_RampYUV(uint32_t row, int64_t time, uint32_t rgbMask, uint8_t* pY, uint8_t* pU, uint8_t* pV) const
+{
+    uint8_t gray = (uint8_t)(row + (uint32_t)((time / 10000000) % m_height));
+    uint32_t pixel = ((uint32_t)gray << 16 | (uint32_t)gray << 8 | (uint32_t)gray) & rgbMask;
+    int R = (pixel >> 16) & 0xFF, G = (pixel >> 8) & 0xFF, B = pixel & 0xFF;
+    *pY = (uint8_t)(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16);
+    *pU = (uint8_t)(((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128);
+    *pV = (uint8_t)(((112 * R - 94 * G - 18 * B + 128) >> 8) + 128);
+}
+
+void TestPattern::_RenderBars(uint32_t row, uint32_t* pRow) const
+{
+    uint32_t w = m_width;
+    if (row < (m_height * 2) / 3)
+    {
+        for (uint32_t i = 0; i < 7; i++)
+        {
+            _Fill(pRow, (i * w) / 7, ((i + 1) * w) / 7, BARS[i]);
+        }
+    }
+    else if (row < (m_height * 3) / 4)
+    {
+        for (uint32_t i = 0; i < 7; i++)
+        {
+            _Fill(pRow, (i * w) / 7, ((i + 1) * w) / 7, REVERSE_BARS[i]);
+        }
+    }
+    else
+    {
+        _Fill(pRow, 0, (5 * w) / 28, MINUS_I);
+        _Fill(pRow, (5 * w) / 28, (10 * w) / 28, WHITE);
+        _Fill(pRow, (10 * w) / 28, (15 * w) / 28, PLUS_Q);
+        _Fill(pRow, (15 * w) / 28, (5 * w) / 7, BLACK);
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            _Fill(pRow, (15 * w + i * w) / 21, (15 * w + (i + 1) * w) / 21, PLUGE[i]);
+        }
+        _Fill(pRow, (6 * w) / 7, w, BLACK);
+    }
+}
+
+void TestPattern::_RenderZonePlate(uint32_t row, uint64_t frameNumber, uint32_t* pRow) const
+{
+    const uint8_t* pCosine = CosineTable();
+    int64_t dy = (int64_t)row - m_height / 2;
+    int64_t dx = -(int64_t)(m_width / 2);
+    uint64_t r2 = (uint64_t)(dx * dx + dy * dy);
+    uint32_t phaseOffset = (uint32_t)(frameNumber * (uint64_t)(int64_t)m_settings.motionX * 256);
+
+    for (uint32_t x = 0; x < m_width; x++)
+    {
+        uint32_t phase = (uint32_t)((r2 * m_zonePlateScale) >> 16) + phaseOffset;
+        uint32_t gray = pCosine[(phase >> 6) & 1023];
+        pRow[x] = (gray << 16) | (gray << 8) | gray;
+        // (dx + 1)^2 = dx^2 + 2dx + 1
+        r2 += (uint64_t)(2 * dx + 1);
+        dx++;
+    }
+}
+
+void TestPattern::_RenderMovingBoxes(uint32_t row, uint64_t frameNumber, uint32_t* pRow) const
+{
+    std::copy(m_background.begin(), m_background.end(), pRow);
+
+    for (auto& box : m_boxes)
+    {
+        // the boxes wrap around the edges
+        int64_t y = Wrap(box.y + (int64_t)(frameNumber % m_height) * box.vy, m_height);
+        uint32_t boxRow = (uint32_t)Wrap((int64_t)row - y, m_height);
+        if (boxRow >= m_boxHeight)
+        {
+            continue;
+        }
+
+        uint32_t x = (uint32_t)Wrap(box.x + (int64_t)(frameNumber % m_width) * box.vx, m_width);
+        for (uint32_t cell = 0; cell < m_boxWidth; cell += BOX_CHECKER)
+        {
+            uint32_t pixel = box.color[((cell / BOX_CHECKER) + (boxRow / BOX_CHECKER)) & 1];
+            uint32_t start = (x + cell) % m_width;
+            uint32_t length = std::min<uint32_t>(BOX_CHECKER, m_boxWidth - cell);
+            uint32_t end = std::min<uint32_t>(start + length, m_width);
+            _Fill(pRow, start, end, pixel);
+            _Fill(pRow, 0, length - (end - start), pixel);
+        }
+    }
+}
+
+/*:
+   Frame counter then time (HH:MM:SS.mmm) in white on black, in the top left corner.
+*/
+void TestPattern::_RenderOverlay(uint32_t row, uint64_t frameNumber, int64_t time, uint32_t* pRow) const
+{
+    char lines[2][OVERLAY_CHARS + 1] = {};
+    uint32_t lineCount = 0;
+    if (m_settings.overlay & TestPatternOverlay_FrameCounter)
+    {
+        snprintf(lines[lineCount++], OVERLAY_CHARS + 1, "%010llu", (unsigned long long)(frameNumber % 10000000000ull));
+    }
+    if (m_settings.overlay & TestPatternOverlay_Timestamp)
+    {
+        uint64_t ms = (uint64_t)((time < 0) ? 0 : time) / 10000;
+        snprintf(lines[lineCount++], OVERLAY_CHARS + 1, "%02u:%02u:%02u.%03u",
+            (unsigned)((ms / 3600000) % 24), (unsigned)((ms / 60000) % 60), (unsigned)((ms / 1000) % 60), (unsigned)(ms % 1000));
+    }
+
+    uint32_t s = m_glyphScale;
+    uint32_t left = 2 * s;
+    uint32_t top = 2 * s;
+    uint32_t boxWidth = (OVERLAY_CHARS * GLYPH_CELL_WIDTH + 1) * s;
+    uint32_t boxHeight = (lineCount * GLYPH_CELL_HEIGHT) * s;
+    if ((lineCount == 0) || (row < top) || (row >= top + boxHeight) || (left >= m_width))
+    {
+        return;
+    }
+
+    _Fill(pRow, left, std::min<uint32_t>(left + boxWidth, m_width), BLACK);
+
+    uint32_t dotRow = (row - top) / s;
+    uint32_t line = dotRow / GLYPH_CELL_HEIGHT;
+    uint32_t glyphRow = (dotRow % GLYPH_CELL_HEIGHT) - 1;   // a dot above and below the glyphs
+    if (glyphRow >= 7)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; lines[line][i] != 0; i++)
+    {
+        char c = lines[line][i];
+        uint32_t glyph = (c == ':') ? 10 : ((c == '.') ? 11 : (uint32_t)(c - '0'));
+        uint8_t bits = GLYPHS[glyph][glyphRow];
+        for (uint32_t b = 0; b < 5; b++)
+        {
+            if (bits & (0x10 >> b))
+            {
+                uint32_t start = left + (1 + i * GLYPH_CELL_WIDTH + b) * s;
+                _Fill(pRow, std::min<uint32_t>(start, m_width), std::min<uint32_t>(start + s, m_width), WHITE);
+            }
+        }
+    }
+}
+
+void TestPattern::_Fill(uint32_t* pRow, uint32_t start, uint32_t end, uint32_t pixel) const
+{
+    if (start < end)
+    {
+        std::fill(pRow + start, pRow + end, pixel);
+    }
+}
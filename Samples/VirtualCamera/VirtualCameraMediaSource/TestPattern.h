@@ -0,0 +1,111 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+#ifndef TEST_PATTERN_H
+#define TEST_PATTERN_H
+
+#include <cstdint>
+#include <vector>
+
+// Same values as KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_*
+enum class TestPatternKind : uint32_t
+{
+    Ramp = 0,           // scrolling gray ramp, colored by the RGB mask
+    Bars = 1,           // SMPTE color bars
+    ZonePlate = 2,      // circular zone plate, up to the Nyquist frequency at the edges
+    MovingBoxes = 3,    // textured boxes moving over a gradient
+    Noise = 4,          // seeded pseudo random noise, the worst case for an encoder
+    End
+};
+
+// Same values as KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_OVERLAY_*
+enum TestPatternOverlay : uint32_t
+{
+    TestPatternOverlay_FrameCounter = 0x1,
+    TestPatternOverlay_Timestamp = 0x2,
+    TestPatternOverlay_All = 0x3
+};
+
+struct TestPatternSettings
+{
+    TestPatternKind kind;
+    int32_t motionX;    // MovingBoxes: pixels per frame of the first box, the next ones are 2x, 3x... faster
+    int32_t motionY;    // ZonePlate: motionX is the phase advance per frame in 1/256 of a cycle
+    uint32_t seed;      // Noise
+    uint32_t overlay;   // TestPatternOverlay flags
+
+    bool operator==(TestPatternSettings const& other) const
+    {
+        return (kind == other.kind) && (motionX == other.motionX) && (motionY == other.motionY)
+            && (seed == other.seed) && (overlay == other.overlay);
+    }
+};
+
+/*:
+   Renders the test patterns in RGB32 (B, G, R, X bytes, X is 0), a band of rows at a time so a frame can be split
+   between threads: RenderRows is const and any band gives the same rows as the whole frame.
+   Only depends on the C++ standard library, the noise has SSE2 (x86, x64) and NEON (ARM64) kernels which give
+   the same output as the C++ one.
+*/
+class TestPattern
+{
+public:
+    TestPattern() = default;
+    ~TestPattern() {};
+
+    bool Initialize(TestPatternSettings const& settings, uint32_t width, uint32_t height, bool bUseSimd = true);
+
+    // False if the frames only depend on the time in seconds (Ramp) or never change
+    static bool IsAnimated(TestPatternSettings const& settings);
+
+    // Rows [rowStart, rowEnd) of frame frameNumber, shown at time (in 100ns) when the timestamp overlay is on.
+    // pDst points to the first row of the frame
+    void RenderRows(
+        uint64_t frameNumber,
+        int64_t time,
+        uint32_t rgbMask,
+        uint8_t* pDst,
+        int32_t stride,
+        uint32_t rowStart,
+        uint32_t rowEnd) const;
+
+    // The ramp straight in NV12 (Y plane, then the UV plane at stride * height) or YUY2, BT.601 limited range, with
+    // no RGB32 frame to convert: the pixels of a row have one color, converted once. The chroma of an NV12 row pair is
+    // the average of both rows, rowStart must be even. Whatever the pattern of the settings is
+    void RenderRampRowsNV12(int64_t time, uint32_t rgbMask, uint8_t* pDst, int32_t stride, uint32_t rowStart, uint32_t rowEnd) const;
+    void RenderRampRowsYUY2(int64_t time, uint32_t rgbMask, uint8_t* pDst, int32_t stride, uint32_t rowStart, uint32_t rowEnd) const;
+
+    typedef void (*PFN_NOISEROW)(uint32_t key, uint32_t index, uint32_t width, uint32_t* pDst);
+
+private:
+    struct Box
+    {
+        int32_t x, y;           // at frame 0
+        int32_t vx, vy;         // per frame
+        uint32_t color[2];      // checkerboard
+    };
+
+    void _RenderRamp(uint32_t row, int64_t time, uint32_t rgbMask, uint32_t* pRow) const;
+    void _RampYUV(uint32_t row, int64_t time, uint32_t rgbMask, uint8_t* pY, uint8_t* pU, uint8_t* pV) const;
+    void _RenderBars(uint32_t row, uint32_t* pRow) const;
+    void _RenderZonePlate(uint32_t row, uint64_t frameNumber, uint32_t* pRow) const;
+    void _RenderMovingBoxes(uint32_t row, uint64_t frameNumber, uint32_t* pRow) const;
+    void _RenderOverlay(uint32_t row, uint64_t frameNumber, int64_t time, uint32_t* pRow) const;
+    void _Fill(uint32_t* pRow, uint32_t start, uint32_t end, uint32_t pixel) const;
+
+    TestPatternSettings m_settings = {};
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    PFN_NOISEROW m_pfnNoiseRow = nullptr;
+
+    uint64_t m_zonePlateScale = 0;          // 16 bit phase of the squared distance to the center, in 1/65536
+    std::vector<uint32_t> m_background;     // MovingBoxes gradient row
+    std::vector<Box> m_boxes;
+    uint32_t m_boxWidth = 0;
+    uint32_t m_boxHeight = 0;
+    uint32_t m_glyphScale = 1;              // pixels of a font dot
+};
+
+#endif
@@ -37,6 +37,33 @@ DEFINE_GUID(VCAM_DEVICE_INFO,
 DEFINE_GUID(VCAM_KIND,
     0xc7f7c57b, 0xdf30, 0x41d0, 0xaf, 0xfc, 0x15, 0x20, 0x1c, 0xdf, 0x92, 0xd);
 
+// {57ED9007-9342-4173-83DC-773023A167DE}
+// Media types of the SimpleMediaSource stream, in order of preference: a blob of VCAM_MEDIATYPE_LADDER_ENTRY.
+// Without it the stream offers 640x480 at 30 fps in NV12, RGB32 and YUY2.
+DEFINE_GUID(VCAM_MEDIATYPE_LADDER,
+    0x57ed9007, 0x9342, 0x4173, 0x83, 0xdc, 0x77, 0x30, 0x23, 0xa1, 0x67, 0xde);
+
+typedef struct {
+    uint32_t      Width;                  // even
+    uint32_t      Height;                 // even
+    uint32_t      FrameRateNumerator;
+    uint32_t      FrameRateDenominator;
+    GUID          SubType;                // MFVideoFormat_NV12, MFVideoFormat_RGB32 or MFVideoFormat_YUY2
+} VCAM_MEDIATYPE_LADDER_ENTRY, * PVCAM_MEDIATYPE_LADDER_ENTRY;
+
+// {DD18EA10-3D1B-474B-84B5-E050679B2CAC}
+// UINT32, frames the SimpleMediaSource stream renders ahead of the requests, 1 to 8 (2 by default).
+// The sample allocator gets 2 more samples for the pipeline downstream.
+DEFINE_GUID(VCAM_SAMPLE_RING_DEPTH,
+    0xdd18ea10, 0x3d1b, 0x474b, 0x84, 0xb5, 0xe0, 0x50, 0x67, 0x9b, 0x2c, 0xac);
+
+// {7D01F463-AA44-4A52-9E58-037B53329BD5}
+// UINT32, nonzero: the SimpleMediaSource stream does not write a frame again into a system memory sample that
+// already holds it, with the sample allocator it creates itself only (0 by default). Only for pipelines that
+// never write into the samples they get, the stream cannot tell.
+DEFINE_GUID(VCAM_REUSE_SAMPLE_CONTENT,
+    0x7d01f463, 0xaa44, 0x4a52, 0x9e, 0x58, 0x03, 0x7b, 0x53, 0x32, 0x9b, 0xd5);
+
 // <-- VirtualCameraMediaSource activation attributes
 
 // Example Custom Property implemented by SimpleMediaSource
@@ -48,6 +75,8 @@ static const GUID PROPSETID_SIMPLEMEDIASOURCE_CUSTOMCONTROL =
 enum
 {
     KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_COLORING = 0,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN = 1,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK = 2,
     KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_END  // all ids must be defined before this.
 };
 
@@ -63,6 +92,45 @@ typedef struct {
     uint32_t      ColorMode;
 } KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_COLORMODE_S, * PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_COLORMODE_S;
 
+// Test pattern of the frames, the color mode only applies to the ramp
+enum
+{
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_RAMP = 0,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_BARS = 1,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_ZONEPLATE = 2,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_MOVINGBOXES = 3,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_NOISE = 4,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_END  // all patterns must be defined before this.
+};
+
+// Burned in text, in the top left corner
+enum
+{
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_OVERLAY_FRAMECOUNTER = 0x1,
+    KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_OVERLAY_TIMESTAMP = 0x2  // MFGetSystemTime of the frame, HH:MM:SS.mmm
+};
+
+typedef struct {
+    uint32_t      Pattern;
+    int32_t       MotionX;  // moving boxes: pixels per frame of the first box; zone plate: phase advance per frame in 1/256 cycle
+    int32_t       MotionY;  // moving boxes
+    uint32_t      Seed;     // noise
+    uint32_t      Overlay;  // KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_OVERLAY_* flags
+} KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S, * PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_PATTERN_S;
+
+// Frame pacing and timestamp statistics of the stream since it started, times in 100ns.
+// Set only changes Pacing, and restarts the statistics
+typedef struct {
+    uint32_t      Pacing;           // 1 (default): each frame is delivered at its timestamp, 0: as soon as it is requested
+    uint32_t      Reserved;
+    uint64_t      FramesDelivered;
+    uint64_t      FramesSkipped;    // timestamps given up to catch up with the clock after a stall
+    int64_t       MeanJitter;       // difference between the delivery interval and the timestamp interval
+    int64_t       MaxJitter;
+    int64_t       MeanLateness;     // delivery time - timestamp, negative when delivered ahead
+    int64_t       MaxLateness;
+} KSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S, * PKSPROPERTY_SIMPLEMEDIASOURCE_CUSTOMCONTROL_FRAMECLOCK_S;
+
 // Example custom control implemented by the AugmentedMediaSource
 // 
 // {0C4384E1-B457-43A7-B776-6D031DD88B12}
@@ -25,6 +25,12 @@
 
 #include <mfvirtualcamera.h>
 
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <deque>
+
 #define RESULT_DIAGNOSTICS_LEVEL 4 // include function name
 
 #include <wil\cppwinrt.h> // must be before the first C++ WinRT header, ref:https://github.com/Microsoft/wil/wiki/Error-handling-helpers
@@ -32,6 +38,11 @@
 #include <wil\com.h>
 
 #include "EventHandler.h"
+#include "PixelConverter.h"
+#include "RowParallelExecutor.h"
+#include "TestPattern.h"
+#include "FrameClock.h"
+#include "ImageScaler.h"
 #include "SimpleFrameGenerator.h"
 #include "SimpleMediaSource.h"
 #include "SimpleMediaStream.h"
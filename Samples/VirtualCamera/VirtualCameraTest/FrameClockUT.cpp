@@ -0,0 +1,108 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include "pch.h"
+#include "FrameClockUT.h"
+
+namespace VirtualCameraTest::impl
+{
+    HRESULT FrameClockUT::TestFrameTimes()
+    {
+        FrameClock clock;
+        if (clock.Start(0, 0, 1) || clock.Start(0, 30, 0) || clock.Start(0, 0xFFFFFFFF, 0xFFFFFFFF))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Start accepted an invalid frame rate");
+        }
+
+        // 29.97 fps: 30000 frames last exactly 1001 seconds, each frame 333666 or 333667
+        const INT64 startTime = 123456789;
+        if (!clock.Start(startTime, 30000, 1001))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Start failed for 30000/1001");
+        }
+        if (clock.FrameTime(30000) != startTime + 1001 * 10000000LL)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Frame 30000 at %I64d, expected %I64d", clock.FrameTime(30000), startTime + 1001 * 10000000LL);
+        }
+        for (UINT64 i = 0; i < 30000; i++)
+        {
+            INT64 duration = clock.FrameDuration(i);
+            if ((duration != 333666) && (duration != 333667))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Frame %I64u lasts %I64d", i, duration);
+            }
+            if ((clock.FrameIndex(clock.FrameTime(i)) != i) || ((i > 0) && (clock.FrameIndex(clock.FrameTime(i) - 1) != i - 1)))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Frame %I64u: FrameIndex doesn't match FrameTime", i);
+            }
+        }
+
+        // a day later, still on the exact time
+        const UINT64 day = 30000ULL * 60 * 60 * 24 / 1001;
+        INT64 expected = startTime + (INT64)((day * 1001 * 10000000ULL + 29999) / 30000);
+        if (clock.FrameTime(day) != expected)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Frame %I64u at %I64d, expected %I64d", day, clock.FrameTime(day), expected);
+        }
+
+        return S_OK;
+    }
+
+    HRESULT FrameClockUT::TestDriftAndStats()
+    {
+        const INT64 period = 333333;
+        FrameClock clock;
+        if (!clock.Start(0, 30, 1, 2))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Start failed for 30/1");
+        }
+
+        // in time, then up to 2 frames late: no skip
+        for (UINT64 i = 0; i < 10; i++)
+        {
+            UINT64 frameIndex = clock.NextFrame(clock.FrameTime(i) + ((i < 5) ? 0 : 2 * period));
+            if (frameIndex != i)
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Frame %I64u instead of %I64u", frameIndex, i);
+            }
+        }
+
+        // a 1 second stall skips to the frame showing now
+        UINT64 frameIndex = clock.NextFrame(clock.FrameTime(40) + 1);
+        if ((frameIndex != 40) || (clock.Stats().framesSkipped != 30))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"After the stall frame %I64u (expected 40), %I64u skipped (expected 30)", frameIndex, clock.Stats().framesSkipped);
+        }
+        if (!clock.IsTooLate(10, clock.FrameTime(13)) || clock.IsTooLate(10, clock.FrameTime(13) - 1))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"IsTooLate doesn't allow exactly 2 frames of lateness");
+        }
+
+        // deliveries 100us late, except one 1ms late: jitter 900us twice
+        clock.ResetStats();
+        for (UINT64 i = 0; i < 10; i++)
+        {
+            clock.RecordDelivery(i, clock.FrameTime(i) + ((i == 5) ? 10000 : 1000));
+        }
+        FrameClockStats stats = clock.Stats();
+        if ((stats.framesDelivered != 10) || (stats.framesSkipped != 0) || (stats.maxJitter != 9000) || (stats.meanJitter != 2000)
+            || (stats.maxLateness != 10000) || (stats.meanLateness != 1900))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected stats: delivered %I64u, skipped %I64u, jitter %I64d/%I64d, lateness %I64d/%I64d",
+                stats.framesDelivered, stats.framesSkipped, stats.meanJitter, stats.maxJitter, stats.meanLateness, stats.maxLateness);
+        }
+
+        // delivered ahead: negative lateness; a skipped frame is not jitter
+        clock.ResetStats();
+        clock.RecordDelivery(0, clock.FrameTime(0) - 500);
+        clock.RecordDelivery(3, clock.FrameTime(3) - 500);
+        stats = clock.Stats();
+        if ((stats.maxLateness != -500) || (stats.meanLateness != -500) || (stats.maxJitter != 0))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected stats: jitter max %I64d, lateness %I64d/%I64d", stats.maxJitter, stats.meanLateness, stats.maxLateness);
+        }
+
+        return S_OK;
+    }
+}
@@ -0,0 +1,23 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#ifndef FRAMECLOCKUT_H
+#define FRAMECLOCKUT_H
+
+#include "FrameClock.h"
+namespace VirtualCameraTest::impl
+{
+    class FrameClockUT
+    {
+    public:
+        // Frame times follow the rate exactly, without rounding error building up
+        HRESULT TestFrameTimes();
+        // Skipping after a stall, and the jitter and lateness statistics
+        HRESULT TestDriftAndStats();
+    };
+}
+
+#endif
@@ -0,0 +1,231 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include "pch.h"
+#include "ImageScalerUT.h"
+#include <chrono>
+
+namespace VirtualCameraTest::impl
+{
+    HRESULT ImageScalerUT::TestSimdAndTiles()
+    {
+        const ScaleFilter filters[] = { ScaleFilter::Box, ScaleFilter::Bilinear, ScaleFilter::Lanczos2 };
+        const ScaleFormat formats[] = { ScaleFormat::NV12, ScaleFormat::I420 };
+        // downscales, upscales, widths with and without a remainder for the C++ kernels, sources narrower than the SIMD taps
+        const UINT32 sizes[][4] = { { 1920, 1080, 640, 360 }, { 3840, 2160, 320, 180 }, { 640, 360, 1920, 1080 }, { 640, 480, 640, 360 },
+            { 64, 48, 30, 22 }, { 10, 6, 4, 2 }, { 2, 2, 6, 6 } };
+
+        std::mt19937 random(42);
+        for (auto& size : sizes)
+        {
+            UINT32 srcWidth = size[0], srcHeight = size[1], dstWidth = size[2], dstHeight = size[3];
+            LONG srcStride = srcWidth + 16;
+            LONG dstStride = dstWidth + 8;
+            std::vector<BYTE> src(srcStride * srcHeight * 3 / 2);
+            for (auto& b : src)
+            {
+                b = (BYTE)random();
+            }
+
+            // the whole frame and its center
+            const ScaleRect crops[] = { { 0, 0, 0, 0 }, { (srcWidth / 4) & ~1u, (srcHeight / 4) & ~1u, (srcWidth / 2) & ~1u, (srcHeight / 2) & ~1u } };
+            for (auto& crop : crops)
+            {
+                for (auto format : formats)
+                {
+                    for (auto filter : filters)
+                    {
+                        ImageScalerSettings settings = { format, srcWidth, srcHeight, crop, dstWidth, dstHeight, filter };
+                        ImageScaler simd, reference;
+                        if (!simd.Initialize(settings, true) || !reference.Initialize(settings, false))
+                        {
+                            if (crop.width == 0)
+                            {
+                                LOG_ERROR_RETURN(E_TEST_FAILED, L"Initialize failed for %dx%d to %dx%d", srcWidth, srcHeight, dstWidth, dstHeight);
+                            }
+                            continue;
+                        }
+
+                        std::vector<BYTE> expected(dstStride * dstHeight * 3 / 2), actual(expected.size()), tiled(expected.size());
+                        reference.Scale(src.data(), srcStride, expected.data(), dstStride);
+                        simd.Scale(src.data(), srcStride, actual.data(), dstStride);
+
+                        // last tile first, with another workspace
+                        ImageScaler::Workspace workspace;
+                        for (UINT32 tile = simd.TileCount(); tile > 0; tile--)
+                        {
+                            simd.ScaleTiles(src.data(), srcStride, tiled.data(), dstStride, tile - 1, tile, &workspace);
+                        }
+
+                        auto mismatch = std::mismatch(actual.begin(), actual.end(), expected.begin());
+                        auto tileMismatch = std::mismatch(tiled.begin(), tiled.end(), expected.begin());
+                        if ((mismatch.first != actual.end()) || (tileMismatch.first != tiled.end()))
+                        {
+                            LOG_ERROR_RETURN(E_TEST_FAILED, L"%dx%d (crop %dx%d) to %dx%d, format %d, filter %d: byte %d of the SIMD output, %d of the tiles differ",
+                                srcWidth, srcHeight, crop.width, crop.height, dstWidth, dstHeight, (int)format, (int)filter,
+                                (int)(mismatch.first - actual.begin()), (int)(tileMismatch.first - tiled.begin()));
+                        }
+                    }
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT ImageScalerUT::TestQuality()
+    {
+        const ScaleFilter filters[] = { ScaleFilter::Box, ScaleFilter::Bilinear, ScaleFilter::Lanczos2 };
+        const double minPsnr = 40.0;
+
+        for (auto filter : filters)
+        {
+            // downscales, upscale and a 2x digital zoom of the center
+            const struct { UINT32 srcWidth, srcHeight; ScaleRect crop; UINT32 dstWidth, dstHeight; } cases[] =
+            {
+                { 1920, 1080, { 0, 0, 1920, 1080 }, 640, 360 },
+                { 1920, 1080, { 0, 0, 1920, 1080 }, 1280, 720 },
+                { 640, 360, { 0, 0, 640, 360 }, 1280, 720 },
+                { 1280, 720, { 320, 180, 640, 360 }, 1280, 720 },
+            };
+            for (auto& c : cases)
+            {
+                std::vector<BYTE> src, dst(c.dstWidth * c.dstHeight * 3 / 2);
+                RenderSmoothPattern(c.srcWidth, c.srcHeight, src);
+
+                ImageScaler scaler;
+                if (!scaler.Initialize({ ScaleFormat::NV12, c.srcWidth, c.srcHeight, c.crop, c.dstWidth, c.dstHeight, filter }))
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"Initialize failed for %dx%d to %dx%d", c.srcWidth, c.srcHeight, c.dstWidth, c.dstHeight);
+                }
+                scaler.Scale(src.data(), c.srcWidth, dst.data(), c.dstWidth);
+
+                double psnr = Psnr(dst, c.dstWidth, c.dstHeight, c.crop, c.srcWidth, c.srcHeight);
+                if (psnr < minPsnr)
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"Filter %d, %dx%d (crop %dx%d) to %dx%d: PSNR %.1f dB, expected %.1f dB or more",
+                        (int)filter, c.srcWidth, c.srcHeight, c.crop.width, c.crop.height, c.dstWidth, c.dstHeight, psnr, minPsnr);
+                }
+                LOG_COMMENT(L"Filter %d, %dx%d (crop %dx%d) to %dx%d: PSNR %.1f dB",
+                    (int)filter, c.srcWidth, c.srcHeight, c.crop.width, c.crop.height, c.dstWidth, c.dstHeight, psnr);
+            }
+
+            // without scaling every filter gives the source pixels back, chroma included
+            const UINT32 width = 640, height = 480;
+            const ScaleRect crop = { 100, 60, 320, 240 };
+            std::mt19937 random(7);
+            std::vector<BYTE> src(width * height * 3 / 2), dst(crop.width * crop.height * 3 / 2);
+            for (auto& b : src)
+            {
+                b = (BYTE)random();
+            }
+            for (auto format : { ScaleFormat::NV12, ScaleFormat::I420 })
+            {
+                ImageScaler scaler;
+                if (!scaler.Initialize({ format, width, height, crop, crop.width, crop.height, filter }))
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"Initialize failed for the crop");
+                }
+                scaler.Scale(src.data(), width, dst.data(), crop.width);
+
+                // Y rows, then chroma rows: full width UV or half width U and V
+                UINT32 chromaSize = (format == ScaleFormat::NV12) ? crop.width : crop.width / 2;
+                UINT32 chromaStride = (format == ScaleFormat::NV12) ? width : width / 2;
+                UINT32 chromaX = (format == ScaleFormat::NV12) ? crop.x : crop.x / 2;
+                UINT32 chromaPlanes = (format == ScaleFormat::NV12) ? 1 : 2;
+                bool bSame = true;
+                for (UINT32 y = 0; y < crop.height; y++)
+                {
+                    bSame &= std::equal(dst.begin() + y * crop.width, dst.begin() + (y + 1) * crop.width, src.begin() + (crop.y + y) * width + crop.x);
+                }
+                for (UINT32 plane = 0; plane < chromaPlanes; plane++)
+                {
+                    auto dstPlane = dst.begin() + crop.width * crop.height + plane * chromaSize * crop.height / 2;
+                    auto srcPlane = src.begin() + width * height + plane * chromaStride * height / 2;
+                    for (UINT32 y = 0; y < crop.height / 2; y++)
+                    {
+                        bSame &= std::equal(dstPlane + y * chromaSize, dstPlane + (y + 1) * chromaSize, srcPlane + (crop.y / 2 + y) * chromaStride + chromaX);
+                    }
+                }
+                if (!bSame)
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"Filter %d, format %d: the crop at 1x is not the source region", (int)filter, (int)format);
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT ImageScalerUT::TestThroughput()
+    {
+        const ScaleFilter filters[] = { ScaleFilter::Box, ScaleFilter::Bilinear, ScaleFilter::Lanczos2 };
+        const UINT32 srcWidth = 1920, srcHeight = 1080, dstWidth = 640, dstHeight = 360;
+        const UINT32 frames = 50;
+
+        std::vector<BYTE> src, dst(dstWidth * dstHeight * 3 / 2);
+        RenderSmoothPattern(srcWidth, srcHeight, src);
+        for (auto filter : filters)
+        {
+            double msPerFrame[2] = {};
+            for (UINT32 simd = 0; simd < 2; simd++)
+            {
+                ImageScaler scaler;
+                if (!scaler.Initialize({ ScaleFormat::NV12, srcWidth, srcHeight, {}, dstWidth, dstHeight, filter }, simd != 0))
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"Initialize failed for filter %d", (int)filter);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                for (UINT32 i = 0; i < frames; i++)
+                {
+                    scaler.Scale(src.data(), srcWidth, dst.data(), dstWidth);
+                }
+                msPerFrame[simd] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+            }
+            LOG_COMMENT(L"Filter %d, %dx%d to %dx%d: %.2f ms per frame, %.2f ms with the C++ kernels",
+                (int)filter, srcWidth, srcHeight, dstWidth, dstHeight, msPerFrame[1], msPerFrame[0]);
+        }
+
+        return S_OK;
+    }
+
+    double ImageScalerUT::SmoothPattern(double x, double y)
+    {
+        // x and y in frame widths and heights: 10 horizontal and 7.5 vertical periods, far below the Nyquist frequency at 360p
+        const double pi = 3.14159265358979323846;
+        return 128.0 + 60.0 * sin(2 * pi * 10 * x) * cos(2 * pi * 7.5 * y);
+    }
+
+    void ImageScalerUT::RenderSmoothPattern(UINT32 width, UINT32 height, std::vector<BYTE>& frame)
+    {
+        frame.assign(width * height * 3 / 2, 128);
+        for (UINT32 y = 0; y < height; y++)
+        {
+            for (UINT32 x = 0; x < width; x++)
+            {
+                frame[y * width + x] = (BYTE)lround(SmoothPattern((x + 0.5) / width, (y + 0.5) / height));
+            }
+        }
+    }
+
+    double ImageScalerUT::Psnr(std::vector<BYTE> const& frame, UINT32 width, UINT32 height, ScaleRect const& crop, UINT32 srcWidth, UINT32 srcHeight)
+    {
+        // Y plane against the pattern at the center of each destination pixel in the source
+        double scaleX = (double)crop.width / width;
+        double scaleY = (double)crop.height / height;
+        double sum = 0;
+        for (UINT32 y = 0; y < height; y++)
+        {
+            for (UINT32 x = 0; x < width; x++)
+            {
+                double expected = SmoothPattern((crop.x + (x + 0.5) * scaleX) / srcWidth, (crop.y + (y + 0.5) * scaleY) / srcHeight);
+                double error = frame[y * width + x] - expected;
+                sum += error * error;
+            }
+        }
+        double mse = std::max<double>(sum / (width * height), 1e-10);
+        return 10.0 * log10(255.0 * 255.0 / mse);
+    }
+}
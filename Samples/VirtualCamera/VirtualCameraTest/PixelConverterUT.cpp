@@ -0,0 +1,197 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include "pch.h"
+#include "PixelConverterUT.h"
+#include <chrono>
+
+namespace VirtualCameraTest::impl
+{
+    HRESULT PixelConverterUT::TestBitExactness()
+    {
+        if (!PixelConverter::IsSimdSupported())
+        {
+            LOG_WARNING(L"No SIMD support on this machine, nothing to compare");
+            return S_OK;
+        }
+
+        const YUVFormat formats[] = { YUVFormat::NV12, YUVFormat::I420, YUVFormat::YUY2, YUVFormat::P010 };
+        const YUVMatrix matrices[] = { YUVMatrix::BT601, YUVMatrix::BT709, YUVMatrix::BT2020 };
+        const YUVRange ranges[] = { YUVRange::Limited, YUVRange::Full };
+        // widths with and without a remainder for the C++ kernels
+        const UINT32 sizes[][2] = { { 6, 4 }, { 18, 2 }, { 638, 480 }, { 1920, 1080 } };
+
+        std::mt19937 random(42);
+        for (auto& size : sizes)
+        {
+            UINT32 width = size[0], height = size[1];
+            LONG srcStride = width * 4 + 16;
+            std::vector<BYTE> src(srcStride * height);
+            for (auto& b : src)
+            {
+                b = (BYTE)random();
+            }
+
+            for (auto format : formats)
+            {
+                bool b16 = (format == YUVFormat::P010) || (format == YUVFormat::YUY2);
+                LONG dstStride = (b16 ? width * 2 : width) + 8;
+                size_t cbDst = (size_t)dstStride * height * 2;
+
+                for (auto matrix : matrices)
+                {
+                    for (auto range : ranges)
+                    {
+                        PixelConverter simd, reference;
+                        RETURN_HR_IF(E_INVALIDARG, !simd.Initialize(matrix, range, true));
+                        RETURN_HR_IF(E_INVALIDARG, !reference.Initialize(matrix, range, false));
+
+                        std::vector<BYTE> simdOut(cbDst, 0xCD), referenceOut(cbDst, 0xCD);
+                        RETURN_HR_IF(E_INVALIDARG, !simd.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, simdOut.data(), cbDst, dstStride));
+                        RETURN_HR_IF(E_INVALIDARG, !reference.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, referenceOut.data(), cbDst, dstStride));
+
+                        auto mismatch = std::mismatch(simdOut.begin(), simdOut.end(), referenceOut.begin());
+                        if (mismatch.first != simdOut.end())
+                        {
+                            LOG_ERROR_RETURN(E_TEST_FAILED, L"format %d %dx%d matrix %d range %d: byte %d is %d, expected %d",
+                                (int)format, width, height, (int)matrix, (int)range,
+                                (int)(mismatch.first - simdOut.begin()), *mismatch.first, *mismatch.second);
+                        }
+                    }
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT PixelConverterUT::TestReferenceColors()
+    {
+        const struct { YUVMatrix matrix; double kr; double kb; } matrices[] =
+        {
+            { YUVMatrix::BT601, 0.299, 0.114 },
+            { YUVMatrix::BT709, 0.2126, 0.0722 },
+            { YUVMatrix::BT2020, 0.2627, 0.0593 },
+        };
+        const BYTE colors[][3] =
+        {
+            { 0, 0, 0 }, { 255, 255, 255 }, { 128, 128, 128 },
+            { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 },
+            { 255, 255, 0 }, { 0, 255, 255 }, { 255, 0, 255 }, { 12, 200, 97 },
+        };
+
+        for (auto& m : matrices)
+        {
+            for (auto range : { YUVRange::Limited, YUVRange::Full })
+            {
+                double yScale = (range == YUVRange::Full) ? 1.0 : 219.0 / 255.0;
+                double cScale = (range == YUVRange::Full) ? 1.0 : 224.0 / 255.0;
+                double yOffset = (range == YUVRange::Full) ? 0.0 : 16.0;
+
+                for (auto& color : colors)
+                {
+                    BYTE R = color[0], G = color[1], B = color[2];
+                    BYTE Y, U, V;
+                    RETURN_IF_FAILED(ConvertSolidColor(m.matrix, range, R, G, B, &Y, &U, &V));
+
+                    double luma = m.kr * R + (1.0 - m.kr - m.kb) * G + m.kb * B;
+                    double expectedY = yOffset + yScale * luma;
+                    double expectedU = std::clamp(128.0 + cScale * (B - luma) / (2.0 * (1.0 - m.kb)), 0.0, 255.0);
+                    double expectedV = std::clamp(128.0 + cScale * (R - luma) / (2.0 * (1.0 - m.kr)), 0.0, 255.0);
+                    if ((std::abs(Y - expectedY) > 1.0) || (std::abs(U - expectedU) > 1.0) || (std::abs(V - expectedV) > 1.0))
+                    {
+                        LOG_ERROR_RETURN(E_TEST_FAILED, L"RGB(%d, %d, %d) matrix %d range %d: YUV(%d, %d, %d), expected (%.1f, %.1f, %.1f)",
+                            R, G, B, (int)m.matrix, (int)range, Y, U, V, expectedY, expectedU, expectedV);
+                    }
+                    if ((R == G) && (G == B) && ((U != 128) || (V != 128)))
+                    {
+                        LOG_ERROR_RETURN(E_TEST_FAILED, L"Gray %d has chroma (%d, %d)", R, U, V);
+                    }
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT PixelConverterUT::TestThroughput()
+    {
+        const UINT32 sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        const YUVFormat formats[] = { YUVFormat::NV12, YUVFormat::I420, YUVFormat::YUY2, YUVFormat::P010 };
+        const UINT32 frames = 20;
+
+        std::mt19937 random(42);
+        for (auto& size : sizes)
+        {
+            UINT32 width = size[0], height = size[1];
+            LONG srcStride = width * 4;
+            std::vector<BYTE> src((size_t)srcStride * height);
+            for (auto& b : src)
+            {
+                b = (BYTE)random();
+            }
+
+            for (auto format : formats)
+            {
+                bool b16 = (format == YUVFormat::P010) || (format == YUVFormat::YUY2);
+                LONG dstStride = b16 ? width * 2 : width;
+                size_t cbDst = (size_t)dstStride * height * ((format == YUVFormat::YUY2) ? 2 : 3) / 2;
+                std::vector<BYTE> dst(cbDst);
+
+                double msPerFrame[2] = {};
+                for (UINT32 simd = 0; simd < 2; simd++)
+                {
+                    PixelConverter converter;
+                    RETURN_HR_IF(E_INVALIDARG, !converter.Initialize(YUVMatrix::BT709, YUVRange::Limited, simd != 0));
+
+                    auto start = std::chrono::steady_clock::now();
+                    for (UINT32 i = 0; i < frames; i++)
+                    {
+                        RETURN_HR_IF(E_INVALIDARG, !converter.ConvertFromRGB32(src.data(), src.size(), srcStride, width, height, format, dst.data(), cbDst, dstStride));
+                    }
+                    msPerFrame[simd] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+                }
+
+                // memcpy of the RGB32 frame reads the same bytes and writes more: a converter close to it is bound by
+                // the memory, not by the arithmetic, and wider kernels would not make it faster
+                std::vector<BYTE> copy(src.size());
+                auto start = std::chrono::steady_clock::now();
+                for (UINT32 i = 0; i < frames; i++)
+                {
+                    memcpy(copy.data(), src.data(), src.size());
+                }
+                double msCopy = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+                double gbPerFrame = (double)(src.size() + cbDst) / 1e9;
+                LOG_COMMENT(L"Format %d %dx%d: %.2f ms per frame (%.0f frames/s, %.1f GB/s), %.2f ms with the C++ kernels, %.2f ms for memcpy of the RGB32 frame",
+                    (int)format, width, height, msPerFrame[1], 1000.0 / msPerFrame[1], gbPerFrame / (msPerFrame[1] / 1000.0), msPerFrame[0], msCopy);
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT PixelConverterUT::ConvertSolidColor(YUVMatrix matrix, YUVRange range, BYTE R, BYTE G, BYTE B, BYTE* pY, BYTE* pU, BYTE* pV)
+    {
+        const UINT32 width = 16, height = 2;
+        std::vector<BYTE> src(width * height * 4);
+        for (size_t i = 0; i < src.size(); i += 4)
+        {
+            src[i] = B;
+            src[i + 1] = G;
+            src[i + 2] = R;
+            src[i + 3] = 0xFF;
+        }
+        std::vector<BYTE> nv12(width * height * 3 / 2);
+
+        PixelConverter converter;
+        RETURN_HR_IF(E_INVALIDARG, !converter.Initialize(matrix, range));
+        RETURN_HR_IF(E_INVALIDARG, !converter.ConvertFromRGB32(src.data(), src.size(), width * 4, width, height, YUVFormat::NV12, nv12.data(), nv12.size(), width));
+
+        *pY = nv12[0];
+        *pU = nv12[width * height];
+        *pV = nv12[width * height + 1];
+        return S_OK;
+    }
+}
@@ -0,0 +1,28 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#ifndef PIXELCONVERTERUT_H
+#define PIXELCONVERTERUT_H
+
+#include "PixelConverter.h"
+namespace VirtualCameraTest::impl
+{
+    class PixelConverterUT
+    {
+    public:
+        // SIMD kernels give the same output as the C++ ones, for every format, matrix and range
+        HRESULT TestBitExactness();
+        // Output of solid colors against the floating point conversion
+        HRESULT TestReferenceColors();
+        // Time per 1080p and 4K frame of each format, SIMD and C++, against memcpy of the RGB32 frame
+        HRESULT TestThroughput();
+
+    private:
+        static HRESULT ConvertSolidColor(YUVMatrix matrix, YUVRange range, BYTE R, BYTE G, BYTE B, BYTE* pY, BYTE* pU, BYTE* pV);
+    };
+}
+
+#endif
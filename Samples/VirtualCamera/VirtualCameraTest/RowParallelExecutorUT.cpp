@@ -0,0 +1,78 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include "pch.h"
+#include "RowParallelExecutorUT.h"
+#include <chrono>
+
+namespace
+{
+    const UINT32 WIDTH = 3840;
+    const UINT32 HEIGHT = 2160;
+}
+
+namespace VirtualCameraTest::impl
+{
+    HRESULT RowParallelExecutorUT::TestScaling()
+    {
+        const UINT32 frames = 20;
+
+        TestPattern pattern;
+        RETURN_HR_IF(E_INVALIDARG, !pattern.Initialize({ TestPatternKind::ZonePlate, 8, 0, 0, TestPatternOverlay_All }, WIDTH, HEIGHT));
+        PixelConverter converter;
+        RETURN_HR_IF(E_INVALIDARG, !converter.Initialize(YUVMatrix::BT601, YUVRange::Limited));
+
+        std::vector<BYTE> rgbFrame(WIDTH * HEIGHT * 4), nv12Frame(WIDTH * HEIGHT * 3 / 2), reference;
+        double msOneThread = 0;
+        for (UINT32 threads = 1; threads <= RowParallelExecutor::MAX_THREADS; threads++)
+        {
+            RowParallelExecutor executor;
+            RETURN_HR_IF(E_OUTOFMEMORY, !executor.Initialize(threads));
+
+            auto start = std::chrono::steady_clock::now();
+            for (UINT32 i = 0; i < frames; i++)
+            {
+                RETURN_IF_FAILED(RenderAndConvert(executor, pattern, converter, i, rgbFrame, nv12Frame));
+            }
+            double msPerFrame = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+
+            // the last frame is the same whatever the split
+            if (threads == 1)
+            {
+                reference = nv12Frame;
+                msOneThread = msPerFrame;
+            }
+            else if (nv12Frame != reference)
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"%d threads: the frame differs from the one of a single thread", threads);
+            }
+
+            double speedup = msOneThread / msPerFrame;
+            LOG_COMMENT(L"%d threads, %dx%d: %.2f ms per frame, %.2fx speedup, %.0f%% scaling efficiency",
+                threads, WIDTH, HEIGHT, msPerFrame, speedup, 100.0 * speedup / threads);
+        }
+        if (std::thread::hardware_concurrency() < RowParallelExecutor::MAX_THREADS)
+        {
+            LOG_COMMENT(L"%d cores: no speedup is expected past that many threads", std::thread::hardware_concurrency());
+        }
+
+        return S_OK;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+    // helper function
+
+    HRESULT RowParallelExecutorUT::RenderAndConvert(RowParallelExecutor& executor, TestPattern const& pattern, PixelConverter const& converter,
+        UINT64 frameNumber, std::vector<BYTE>& rgbFrame, std::vector<BYTE>& nv12Frame)
+    {
+        // each band converts the rows it just rendered, while they are still in the cache
+        return executor.Run(HEIGHT, RowParallelExecutor::BandRows(WIDTH * 4, 2), [&](UINT32 rowStart, UINT32 rowEnd)
+        {
+            pattern.RenderRows(frameNumber, 123456789, 0xFFFFFF, rgbFrame.data(), WIDTH * 4, rowStart, rowEnd);
+            RETURN_HR_IF(E_INVALIDARG, !converter.ConvertRowsFromRGB32(rgbFrame.data(), rgbFrame.size(), WIDTH * 4, WIDTH, HEIGHT,
+                YUVFormat::NV12, nv12Frame.data(), nv12Frame.size(), WIDTH, rowStart, rowEnd));
+            return S_OK;
+        });
+    }
+}
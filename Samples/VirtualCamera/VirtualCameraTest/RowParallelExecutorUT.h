@@ -0,0 +1,28 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#ifndef ROWPARALLELEXECUTORUT_H
+#define ROWPARALLELEXECUTORUT_H
+
+#include "RowParallelExecutor.h"
+#include "TestPattern.h"
+#include "PixelConverter.h"
+namespace VirtualCameraTest::impl
+{
+    class RowParallelExecutorUT
+    {
+    public:
+        // Time per 4K frame rendered and converted to NV12 a band at a time, as SimpleFrameGenerator does, with 1 to
+        // MAX_THREADS threads: the frames are the same, the speedup and the scaling efficiency are logged
+        HRESULT TestScaling();
+
+    private:
+        static HRESULT RenderAndConvert(RowParallelExecutor& executor, TestPattern const& pattern, PixelConverter const& converter,
+            UINT64 frameNumber, std::vector<BYTE>& rgbFrame, std::vector<BYTE>& nv12Frame);
+    };
+}
+
+#endif
@@ -25,8 +25,8 @@ namespace VirtualCameraTest::impl
 
     HRESULT SimpleMediaSourceUT::TestMediaSourceStream()
     {
-        // SimpleMediaSource 1 stream, with 2 mediatypes
-        // This test validate we can 1. access the stream, 2. stream from each mediatype
+        // SimpleMediaSource 2 streams: the capture stream with 3 mediatypes and the preview stream with 2
+        // This test validate we can 1. access the streams, 2. stream from each mediatype
         wil::com_ptr_nothrow<IMFMediaSource> spMediaSource;
         RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, nullptr, &spMediaSource));
 
@@ -35,9 +35,9 @@ namespace VirtualCameraTest::impl
 
         DWORD streamCount = 0;
         RETURN_IF_FAILED(spPD->GetStreamDescriptorCount(&streamCount));
-        if (streamCount != 1)
+        if (streamCount != 2)
         {
-            LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected stream count: %d (expected: %d)", streamCount, 1);
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected stream count: %d (expected: %d)", streamCount, 2);
         }
 
         for (unsigned int streamIdx = 0; streamIdx < streamCount; streamIdx++)
@@ -51,9 +51,10 @@ namespace VirtualCameraTest::impl
             RETURN_IF_FAILED(spStreamDescriptor->GetMediaTypeHandler(&spMediaTypeHandler));
 
             RETURN_IF_FAILED(spMediaTypeHandler->GetMediaTypeCount(&mediaTypeCount));
-            if (mediaTypeCount != 2)
+            DWORD expectedCount = (streamIdx == 0) ? 3 : 2;
+            if (mediaTypeCount != expectedCount)
             {
-                LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected media type count: %d (expected: %d) ", mediaTypeCount, 2);
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected media type count: %d (expected: %d) ", mediaTypeCount, expectedCount);
             }
         }
         RETURN_IF_FAILED(MediaSourceUT_Common::TestMediaSourceStream(spMediaSource.get()));
@@ -61,6 +62,156 @@ namespace VirtualCameraTest::impl
         return S_OK;
     }
 
+    HRESULT SimpleMediaSourceUT::TestMediaTypeLadder()
+    {
+        // 720p, 1080p and 4K at 15, 30 and 60 fps in NV12, YUY2 and RGB32
+        const UINT32 sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+        const UINT32 frameRates[] = { 15, 30, 60 };
+        const GUID subTypes[] = { MFVideoFormat_NV12, MFVideoFormat_YUY2, MFVideoFormat_RGB32 };
+        std::vector<VCAM_MEDIATYPE_LADDER_ENTRY> ladder;
+        for (auto& size : sizes)
+        {
+            for (auto frameRate : frameRates)
+            {
+                for (auto& subType : subTypes)
+                {
+                    ladder.push_back({ size[0], size[1], frameRate, 1, subType });
+                }
+            }
+        }
+
+        wil::com_ptr_nothrow<IMFAttributes> spAttributes;
+        RETURN_IF_FAILED(CreateSourceAttributes(&spAttributes));
+        RETURN_IF_FAILED(spAttributes->SetBlob(VCAM_MEDIATYPE_LADDER, (const UINT8*)ladder.data(), (UINT32)(ladder.size() * sizeof(VCAM_MEDIATYPE_LADDER_ENTRY))));
+
+        wil::com_ptr_nothrow<IMFMediaSource> spMediaSource;
+        RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource));
+
+        wil::com_ptr_nothrow<IMFPresentationDescriptor> spPD;
+        wil::com_ptr_nothrow<IMFStreamDescriptor> spStreamDescriptor;
+        wil::com_ptr_nothrow<IMFMediaTypeHandler> spMediaTypeHandler;
+        BOOL selected = FALSE;
+        RETURN_IF_FAILED(spMediaSource->CreatePresentationDescriptor(&spPD));
+        RETURN_IF_FAILED(spPD->GetStreamDescriptorByIndex(0, &selected, &spStreamDescriptor));
+        RETURN_IF_FAILED(spStreamDescriptor->GetMediaTypeHandler(&spMediaTypeHandler));
+
+        DWORD mediaTypeCount = 0;
+        RETURN_IF_FAILED(spMediaTypeHandler->GetMediaTypeCount(&mediaTypeCount));
+        if (mediaTypeCount != ladder.size())
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected media type count: %d (expected: %d) ", mediaTypeCount, ladder.size());
+        }
+
+        for (DWORD i = 0; i < mediaTypeCount; i++)
+        {
+            wil::com_ptr_nothrow<IMFMediaType> spMediaType;
+            GUID subType = GUID_NULL;
+            UINT32 width = 0, height = 0, numerator = 0, denominator = 0;
+            RETURN_IF_FAILED(spMediaTypeHandler->GetMediaTypeByIndex(i, &spMediaType));
+            RETURN_IF_FAILED(spMediaType->GetGUID(MF_MT_SUBTYPE, &subType));
+            RETURN_IF_FAILED(MFGetAttributeSize(spMediaType.get(), MF_MT_FRAME_SIZE, &width, &height));
+            RETURN_IF_FAILED(MFGetAttributeRatio(spMediaType.get(), MF_MT_FRAME_RATE, &numerator, &denominator));
+            if ((subType != ladder[i].SubType) || (width != ladder[i].Width) || (height != ladder[i].Height)
+                || (numerator != ladder[i].FrameRateNumerator) || (denominator != ladder[i].FrameRateDenominator))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Media type %d does not match the ladder: %s", i, LogMediaType(spMediaType.get()).data());
+            }
+        }
+
+        // stream from a smaller ladder, the allocator and the frame generator follow the media type
+        const VCAM_MEDIATYPE_LADDER_ENTRY streamingLadder[] =
+        {
+            { 1280, 720, 60, 1, MFVideoFormat_NV12 },
+            { 1920, 1080, 15, 1, MFVideoFormat_YUY2 },
+        };
+        RETURN_IF_FAILED(spAttributes->SetBlob(VCAM_MEDIATYPE_LADDER, (const UINT8*)streamingLadder, sizeof(streamingLadder)));
+        spMediaSource.reset();
+        RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource));
+        RETURN_IF_FAILED(MediaSourceUT_Common::TestMediaSourceStream(spMediaSource.get()));
+
+        return S_OK;
+    }
+
+    HRESULT SimpleMediaSourceUT::TestSampleRingDepth()
+    {
+        // the deepest ring streams, with the largest frames of the default media types
+        wil::com_ptr_nothrow<IMFAttributes> spAttributes;
+        RETURN_IF_FAILED(CreateSourceAttributes(&spAttributes));
+        RETURN_IF_FAILED(spAttributes->SetUINT32(VCAM_SAMPLE_RING_DEPTH, 8));
+
+        wil::com_ptr_nothrow<IMFMediaSource> spMediaSource;
+        RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource));
+        RETURN_IF_FAILED(MediaSourceUT_Common::TestMediaSourceStream(spMediaSource.get()));
+
+        // an empty ring or a ring deeper than the allocator allows fails the activation
+        const UINT32 invalidDepths[] = { 0, 9 };
+        for (auto depth : invalidDepths)
+        {
+            RETURN_IF_FAILED(spAttributes->SetUINT32(VCAM_SAMPLE_RING_DEPTH, depth));
+            spMediaSource.reset();
+            HRESULT hr = CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource);
+            if (SUCCEEDED(hr))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Activation succeeded with a sample ring depth of %d", depth);
+            }
+        }
+
+        // samples that still hold the frame are not written again once opted in, the stream is the same
+        RETURN_IF_FAILED(spAttributes->DeleteItem(VCAM_SAMPLE_RING_DEPTH));
+        RETURN_IF_FAILED(spAttributes->SetUINT32(VCAM_REUSE_SAMPLE_CONTENT, TRUE));
+        spMediaSource.reset();
+        RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource));
+        RETURN_IF_FAILED(MediaSourceUT_Common::TestMediaSourceStream(spMediaSource.get()));
+
+        return S_OK;
+    }
+
+    HRESULT SimpleMediaSourceUT::TestDerivedStreams()
+    {
+        // 1080p NV12 capture and the 640x360 preview scaled from it, streaming together:
+        // the preview frames have the timestamps of capture frames
+        wil::com_ptr_nothrow<IMFSourceReader> spSourceReader;
+        RETURN_IF_FAILED(CreateDerivedStreamsReader(true, &spSourceReader));
+
+        std::vector<LONGLONG> timestamps[2];
+        for (uint32_t i = 0; i < 60; i++)
+        {
+            RETURN_IF_FAILED(ReadDerivedStreamsSample(spSourceReader.get(), i % 2, timestamps));
+        }
+        RETURN_IF_FAILED(CheckDerivedTimestamps(timestamps));
+
+        return S_OK;
+    }
+
+    HRESULT SimpleMediaSourceUT::TestDerivedStreamFirst()
+    {
+        // the preview started alone renders its own frames
+        wil::com_ptr_nothrow<IMFSourceReader> spSourceReader;
+        RETURN_IF_FAILED(CreateDerivedStreamsReader(false, &spSourceReader));
+
+        std::vector<LONGLONG> timestamps[2];
+        for (uint32_t i = 0; i < 10; i++)
+        {
+            RETURN_IF_FAILED(ReadDerivedStreamsSample(spSourceReader.get(), 1, timestamps));
+        }
+        if (timestamps[1].empty())
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"The preview started before the capture stream delivered no frame");
+        }
+
+        // then the capture stream starts and feeds it: the frame the preview was rendering is dropped without an
+        // error, and the next ones have the timestamps of capture frames
+        RETURN_IF_FAILED(spSourceReader->SetStreamSelection(0, true));
+        timestamps[1].clear();
+        for (uint32_t i = 0; i < 60; i++)
+        {
+            RETURN_IF_FAILED(ReadDerivedStreamsSample(spSourceReader.get(), i % 2, timestamps));
+        }
+        RETURN_IF_FAILED(CheckDerivedTimestamps(timestamps));
+
+        return S_OK;
+    }
+
     HRESULT SimpleMediaSourceUT::TestKsControl()
     {
         wil::com_ptr_nothrow<IMFMediaSource> spMediaSource;
@@ -181,6 +332,114 @@ namespace VirtualCameraTest::impl
 
     ////////////////////////////////////////////////////////////////////
     // helper function
+
+    // Reader of the 1080p NV12 capture stream and of the 640x360 preview scaled from it, with an allocator each.
+    // The preview is selected, the capture stream only if bSelectCapture
+    HRESULT SimpleMediaSourceUT::CreateDerivedStreamsReader(bool bSelectCapture, IMFSourceReader** ppSourceReader)
+    {
+        RETURN_HR_IF_NULL(E_POINTER, ppSourceReader);
+        const VCAM_MEDIATYPE_LADDER_ENTRY ladder[] = { { 1920, 1080, 30, 1, MFVideoFormat_NV12 } };
+
+        wil::com_ptr_nothrow<IMFAttributes> spAttributes;
+        RETURN_IF_FAILED(CreateSourceAttributes(&spAttributes));
+        RETURN_IF_FAILED(spAttributes->SetBlob(VCAM_MEDIATYPE_LADDER, (const UINT8*)ladder, sizeof(ladder)));
+
+        wil::com_ptr_nothrow<IMFMediaSource> spMediaSource;
+        RETURN_IF_FAILED(CoCreateAndActivateMediaSource(CLSID_VirtualCameraMediaSource, spAttributes.get(), &spMediaSource));
+
+        wil::com_ptr_nothrow<IMFPresentationDescriptor> spPD;
+        RETURN_IF_FAILED(spMediaSource->CreatePresentationDescriptor(&spPD));
+
+        wil::com_ptr_nothrow<IMFSampleAllocatorControl> spAllocatorControl;
+        RETURN_IF_FAILED(spMediaSource->QueryInterface(IID_PPV_ARGS(&spAllocatorControl)));
+
+        // an allocator for each stream
+        wil::com_ptr_nothrow<IMFMediaType> spMediaTypes[2];
+        for (DWORD streamIdx = 0; streamIdx < 2; streamIdx++)
+        {
+            BOOL selected = FALSE;
+            wil::com_ptr_nothrow<IMFStreamDescriptor> spStreamDescriptor;
+            wil::com_ptr_nothrow<IMFMediaTypeHandler> spMediaTypeHandler;
+            RETURN_IF_FAILED(spPD->GetStreamDescriptorByIndex(streamIdx, &selected, &spStreamDescriptor));
+            RETURN_IF_FAILED(spStreamDescriptor->GetMediaTypeHandler(&spMediaTypeHandler));
+            RETURN_IF_FAILED(spMediaTypeHandler->GetMediaTypeByIndex(0, &spMediaTypes[streamIdx]));
+
+            GUID category = GUID_NULL;
+            RETURN_IF_FAILED(spStreamDescriptor->GetGUID(MF_DEVICESTREAM_STREAM_CATEGORY, &category));
+            if (category != ((streamIdx == 0) ? PINNAME_VIDEO_CAPTURE : PINNAME_VIDEO_PREVIEW))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"Unexpected category of stream %d: %s", streamIdx, winrt::to_hstring(category).data());
+            }
+
+            DWORD dwStreamId = 0;
+            wil::com_ptr_nothrow<IMFVideoSampleAllocator> spSampleAllocator;
+            RETURN_IF_FAILED(spStreamDescriptor->GetStreamIdentifier(&dwStreamId));
+            RETURN_IF_FAILED(MFCreateVideoSampleAllocatorEx(IID_PPV_ARGS(&spSampleAllocator)));
+            RETURN_IF_FAILED(spAllocatorControl->SetDefaultAllocator(dwStreamId, spSampleAllocator.get()));
+        }
+
+        wil::com_ptr_nothrow<IMFAttributes> spReaderAttributes;
+        wil::com_ptr_nothrow<IMFSourceReader> spSourceReader;
+        RETURN_IF_FAILED(MFCreateAttributes(&spReaderAttributes, 1));
+        RETURN_IF_FAILED(MFCreateSourceReaderFromMediaSource(spMediaSource.get(), spReaderAttributes.get(), &spSourceReader));
+        for (DWORD streamIdx = 0; streamIdx < 2; streamIdx++)
+        {
+            RETURN_IF_FAILED(spSourceReader->SetStreamSelection(streamIdx, (streamIdx == 1) || bSelectCapture));
+            RETURN_IF_FAILED(spSourceReader->SetCurrentMediaType(streamIdx, NULL, spMediaTypes[streamIdx].get()));
+        }
+
+        *ppSourceReader = spSourceReader.detach();
+        return S_OK;
+    }
+
+    // Reads a sample of stream streamIdx of a CreateDerivedStreamsReader reader and adds its timestamp.
+    // Fails on a stream error, such as the MEError of a derived stream that fails to render a frame
+    HRESULT SimpleMediaSourceUT::ReadDerivedStreamsSample(IMFSourceReader* pSourceReader, DWORD streamIdx, std::vector<LONGLONG> (&timestamps)[2])
+    {
+        const UINT32 previewWidth = 640, previewHeight = 360;
+        DWORD actualStreamIdx = 0;
+        DWORD flags = 0;
+        LONGLONG llTimeStamp = 0;
+        wil::com_ptr_nothrow<IMFSample> spSample;
+        RETURN_IF_FAILED(pSourceReader->ReadSample(streamIdx, 0, &actualStreamIdx, &flags, &llTimeStamp, &spSample));
+        if (flags & (MF_SOURCE_READERF_ERROR | MF_SOURCE_READERF_ENDOFSTREAM))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Stream %d stopped, flags 0x%x", streamIdx, flags);
+        }
+        if ((spSample == nullptr) || (actualStreamIdx != streamIdx))
+        {
+            return S_OK;
+        }
+        timestamps[streamIdx].push_back(llTimeStamp);
+
+        DWORD length = 0;
+        RETURN_IF_FAILED(spSample->GetTotalLength(&length));
+        if ((streamIdx == 1) && (length < previewWidth * previewHeight * 3 / 2))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Preview sample too small: %d bytes", length);
+        }
+
+        return S_OK;
+    }
+
+    // Most preview frames have the timestamp of a capture frame
+    HRESULT SimpleMediaSourceUT::CheckDerivedTimestamps(std::vector<LONGLONG> const (&timestamps)[2])
+    {
+        size_t matches = 0;
+        for (auto timestamp : timestamps[1])
+        {
+            matches += (std::find(timestamps[0].begin(), timestamps[0].end(), timestamp) != timestamps[0].end()) ? 1 : 0;
+        }
+        if (timestamps[0].empty() || timestamps[1].empty() || (matches * 2 < timestamps[1].size()))
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"Capture frames: %d, preview frames: %d, preview frames with a capture timestamp: %d",
+                timestamps[0].size(), timestamps[1].size(), matches);
+        }
+        LOG_SUCCESS(L"Capture frames: %d, preview frames: %d, preview frames with a capture timestamp: %d",
+            timestamps[0].size(), timestamps[1].size(), matches);
+
+        return S_OK;
+    }
     HRESULT SimpleMediaSourceUT::CreateVirtualCamera(MFVirtualCameraLifetime vcamLifetime, MFVirtualCameraAccess vcamAccess, IMFVirtualCamera** ppVirtualCamera)
     {
         winrt::hstring physicalCamSymLink;
@@ -21,6 +21,10 @@ namespace VirtualCameraTest::impl
 
         // General simplemediasource test
         HRESULT TestMediaSourceStream();
+        HRESULT TestMediaTypeLadder();
+        HRESULT TestSampleRingDepth();
+        HRESULT TestDerivedStreams();
+        HRESULT TestDerivedStreamFirst();
         HRESULT TestKsControl();
 
         // virtualcamera with simplemediasource test
@@ -30,6 +34,9 @@ namespace VirtualCameraTest::impl
         HRESULT CreateVirtualCamera(MFVirtualCameraLifetime vcamLifetime, MFVirtualCameraAccess vcamAccess, IMFVirtualCamera** ppVirtualCamera);
         static HRESULT GetColorMode(IMFMediaSource* pMediaSource, uint32_t* pColorMode);
         static HRESULT SetColorMode(IMFMediaSource* pMediaSource, uint32_t colorMode);
+        HRESULT CreateDerivedStreamsReader(bool bSelectCapture, IMFSourceReader** ppSourceReader);
+        static HRESULT ReadDerivedStreamsSample(IMFSourceReader* pSourceReader, DWORD streamIdx, std::vector<LONGLONG> (&timestamps)[2]);
+        static HRESULT CheckDerivedTimestamps(std::vector<LONGLONG> const (&timestamps)[2]);
 
     protected:
         virtual HRESULT CreateSourceAttributes(_Outptr_ IMFAttributes** ppAttributes);
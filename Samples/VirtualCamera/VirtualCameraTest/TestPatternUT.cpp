@@ -0,0 +1,183 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#include "pch.h"
+#include "TestPatternUT.h"
+#include <chrono>
+
+namespace VirtualCameraTest::impl
+{
+    HRESULT TestPatternUT::TestBandsAndSimd()
+    {
+        const TestPatternKind kinds[] = { TestPatternKind::Ramp, TestPatternKind::Bars, TestPatternKind::ZonePlate, TestPatternKind::MovingBoxes, TestPatternKind::Noise };
+        // widths with and without a remainder for the C++ noise kernel
+        const UINT32 sizes[][2] = { { 6, 4 }, { 18, 2 }, { 638, 480 }, { 1920, 1080 } };
+
+        for (auto& size : sizes)
+        {
+            for (auto kind : kinds)
+            {
+                TestPatternSettings settings = { kind, 3, -2, 42, TestPatternOverlay_All };
+                std::vector<uint32_t> reference, banded;
+                RETURN_IF_FAILED(Render(settings, size[0], size[1], false, size[1], 17, reference));
+                RETURN_IF_FAILED(Render(settings, size[0], size[1], true, 7, 17, banded));
+
+                auto mismatch = std::mismatch(banded.begin(), banded.end(), reference.begin());
+                if (mismatch.first != banded.end())
+                {
+                    LOG_ERROR_RETURN(E_TEST_FAILED, L"pattern %d %dx%d: pixel %d is 0x%06x, expected 0x%06x",
+                        (int)kind, size[0], size[1], (int)(mismatch.first - banded.begin()), *mismatch.first, *mismatch.second);
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT TestPatternUT::TestPatternContent()
+    {
+        const UINT32 width = 1280, height = 720;
+        std::vector<uint32_t> frame, other;
+
+        // middle of each 75% bar, then the 100% white of the bottom row
+        const uint32_t bars[] = { 0xBFBFBF, 0xBFBF00, 0x00BFBF, 0x00BF00, 0xBF00BF, 0xBF0000, 0x0000BF };
+        TestPatternSettings settings = { TestPatternKind::Bars, 0, 0, 0, 0 };
+        RETURN_IF_FAILED(Render(settings, width, height, true, height, 0, frame));
+        for (UINT32 i = 0; i < ARRAYSIZE(bars); i++)
+        {
+            uint32_t pixel = frame[(height / 3) * width + (2 * i + 1) * width / 14];
+            if (pixel != bars[i])
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"bar %d is 0x%06x, expected 0x%06x", i, pixel, bars[i]);
+            }
+        }
+        if (frame[(height - 1) * width + width / 4] != 0xFFFFFF)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"bottom white is 0x%06x", frame[(height - 1) * width + width / 4]);
+        }
+
+        // the same seed gives the same noise, another seed or frame another one
+        settings = { TestPatternKind::Noise, 0, 0, 1234, 0 };
+        RETURN_IF_FAILED(Render(settings, width, height, true, height, 5, frame));
+        RETURN_IF_FAILED(Render(settings, width, height, true, height, 5, other));
+        if (frame != other)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"noise of the same seed and frame differs");
+        }
+        RETURN_IF_FAILED(Render(settings, width, height, true, height, 6, other));
+        if (frame == other)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"noise does not change between frames");
+        }
+        settings.seed++;
+        RETURN_IF_FAILED(Render(settings, width, height, true, height, 5, other));
+        if (frame == other)
+        {
+            LOG_ERROR_RETURN(E_TEST_FAILED, L"noise does not depend on the seed");
+        }
+
+        // boxes without motion and bars stay, so the frame generator can reuse them
+        const struct { TestPatternSettings settings; bool bAnimated; } animations[] =
+        {
+            { { TestPatternKind::Bars, 0, 0, 0, 0 }, false },
+            { { TestPatternKind::Bars, 0, 0, 0, TestPatternOverlay_FrameCounter }, true },
+            { { TestPatternKind::MovingBoxes, 0, 0, 0, 0 }, false },
+            { { TestPatternKind::MovingBoxes, 4, 0, 0, 0 }, true },
+            { { TestPatternKind::ZonePlate, 0, 0, 0, 0 }, false },
+            { { TestPatternKind::ZonePlate, 8, 0, 0, 0 }, true },
+            { { TestPatternKind::Noise, 0, 0, 0, 0 }, true },
+        };
+        for (auto& animation : animations)
+        {
+            RETURN_IF_FAILED(Render(animation.settings, width, height, true, height, 1, frame));
+            RETURN_IF_FAILED(Render(animation.settings, width, height, true, height, 2, other));
+            bool bAnimated = TestPattern::IsAnimated(animation.settings);
+            if ((bAnimated != animation.bAnimated) || (bAnimated != (frame != other)))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"pattern %d motion %d overlay %d: animated is %d, expected %d",
+                    (int)animation.settings.kind, animation.settings.motionX, animation.settings.overlay, bAnimated, animation.bAnimated);
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT TestPatternUT::TestThroughput()
+    {
+        const UINT32 sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        const TestPatternKind kinds[] = { TestPatternKind::Bars, TestPatternKind::ZonePlate, TestPatternKind::MovingBoxes, TestPatternKind::Noise };
+        const UINT32 frames = 30;
+        const int64_t time = 50000000;  // 5 s, the ramp is scrolled by 5 rows
+
+        for (auto& size : sizes)
+        {
+            UINT32 width = size[0], height = size[1];
+            std::vector<uint8_t> frame(width * height * 4);
+
+            TestPattern ramp;
+            RETURN_HR_IF(E_INVALIDARG, !ramp.Initialize({ TestPatternKind::Ramp, 0, 0, 0, 0 }, width, height));
+            double framesPerSecond[3] = {};
+            for (UINT32 format = 0; format < ARRAYSIZE(framesPerSecond); format++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (UINT32 i = 0; i < frames; i++)
+                {
+                    switch (format)
+                    {
+                    case 0:
+                        ramp.RenderRows(i, time, 0xFFFFFF, frame.data(), width * 4, 0, height);
+                        break;
+                    case 1:
+                        ramp.RenderRampRowsNV12(time, 0xFFFFFF, frame.data(), width, 0, height);
+                        break;
+                    default:
+                        ramp.RenderRampRowsYUY2(time, 0xFFFFFF, frame.data(), width * 2, 0, height);
+                        break;
+                    }
+                }
+                framesPerSecond[format] = frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            LOG_COMMENT(L"Ramp %dx%d: %.0f frames/s in RGB32, %.0f in NV12, %.0f in YUY2",
+                width, height, framesPerSecond[0], framesPerSecond[1], framesPerSecond[2]);
+
+            // gray 100 + 5 on the 100th row: Y = (220 * 105 + 128) / 256 + 16
+            ramp.RenderRampRowsNV12(time, 0xFFFFFF, frame.data(), width, 0, height);
+            if ((frame[100 * width] != 106) || (frame[100 * width + width - 1] != 106))
+            {
+                LOG_ERROR_RETURN(E_TEST_FAILED, L"NV12 ramp %dx%d: Y of row 100 is %d, expected 106", width, height, frame[100 * width]);
+            }
+
+            for (auto kind : kinds)
+            {
+                TestPattern pattern;
+                RETURN_HR_IF(E_INVALIDARG, !pattern.Initialize({ kind, 4, 2, 42, 0 }, width, height));
+                auto start = std::chrono::steady_clock::now();
+                for (UINT32 i = 0; i < frames; i++)
+                {
+                    pattern.RenderRows(i, time, 0xFFFFFF, frame.data(), width * 4, 0, height);
+                }
+                LOG_COMMENT(L"Pattern %d %dx%d: %.0f frames/s in RGB32",
+                    (int)kind, width, height, frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+
+        return S_OK;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+    // helper function
+    HRESULT TestPatternUT::Render(TestPatternSettings const& settings, UINT32 width, UINT32 height, bool bUseSimd, UINT32 bandRows, UINT64 frameNumber, std::vector<uint32_t>& frame)
+    {
+        TestPattern pattern;
+        RETURN_HR_IF(E_INVALIDARG, !pattern.Initialize(settings, width, height, bUseSimd));
+
+        frame.assign(width * height, 0xCDCDCDCD);
+        for (UINT32 row = 0; row < height; row += bandRows)
+        {
+            pattern.RenderRows(frameNumber, 123456789, 0xFFFFFF, (uint8_t*)frame.data(), width * 4, row, row + bandRows);
+        }
+
+        return S_OK;
+    }
+}
@@ -0,0 +1,29 @@
+//
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+
+#pragma once
+
+#ifndef TESTPATTERNUT_H
+#define TESTPATTERNUT_H
+
+#include "TestPattern.h"
+namespace VirtualCameraTest::impl
+{
+    class TestPatternUT
+    {
+    public:
+        // Any split of a frame in bands, with or without SIMD, gives the same frame
+        HRESULT TestBandsAndSimd();
+        // Bar colors, noise seeding and which patterns change between frames
+        HRESULT TestPatternContent();
+        // Frames/s at 1080p and 4K of the ramp rendered straight to RGB32, NV12 and YUY2 as SimpleFrameGenerator does,
+        // and of the other patterns in RGB32, on one thread; the NV12 ramp is checked against its BT.601 value
+        HRESULT TestThroughput();
+
+    private:
+        static HRESULT Render(TestPatternSettings const& settings, UINT32 width, UINT32 height, bool bUseSimd, UINT32 bandRows, UINT64 frameNumber, std::vector<uint32_t>& frame);
+    };
+}
+
+#endif
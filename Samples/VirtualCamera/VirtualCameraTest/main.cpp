@@ -7,6 +7,11 @@
 #include "HWMediaSourceUT.h"
 #include "CustomMediaSourceUT.h"
 #include "AugmentedMediaSourceUT.h"
+#include "PixelConverterUT.h"
+#include "TestPatternUT.h"
+#include "FrameClockUT.h"
+#include "ImageScalerUT.h"
+#include "RowParallelExecutorUT.h"
 #include "VCamUtils.h"
 
 using namespace winrt;
@@ -27,12 +32,123 @@ TEST(SimpleMediaSourceTest, TestMediaSourceStream)
     EXPECT_HRESULT_SUCCEEDED(test.TestMediaSourceStream());
 }
 
+TEST(SimpleMediaSourceTest, TestMediaTypeLadder)
+{
+    VirtualCameraTest::impl::SimpleMediaSourceUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestMediaTypeLadder());
+}
+
+TEST(SimpleMediaSourceTest, TestSampleRingDepth)
+{
+    VirtualCameraTest::impl::SimpleMediaSourceUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestSampleRingDepth());
+}
+
+TEST(SimpleMediaSourceTest, TestDerivedStreams)
+{
+    VirtualCameraTest::impl::SimpleMediaSourceUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestDerivedStreams());
+}
+
+TEST(SimpleMediaSourceTest, TestDerivedStreamFirst)
+{
+    VirtualCameraTest::impl::SimpleMediaSourceUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestDerivedStreamFirst());
+}
+
 TEST(SimpleMediaSourceTest, TestKsControl)
 {
     VirtualCameraTest::impl::SimpleMediaSourceUT test;
     EXPECT_HRESULT_SUCCEEDED(test.TestKsControl());
 }
 
+//
+// Define PixelConverter test case
+//
+TEST(PixelConverterTest, TestBitExactness)
+{
+    VirtualCameraTest::impl::PixelConverterUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestBitExactness());
+}
+
+TEST(PixelConverterTest, TestReferenceColors)
+{
+    VirtualCameraTest::impl::PixelConverterUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestReferenceColors());
+}
+
+TEST(PixelConverterTest, TestThroughput)
+{
+    VirtualCameraTest::impl::PixelConverterUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestThroughput());
+}
+
+//
+// Define TestPattern test case
+//
+TEST(TestPatternTest, TestBandsAndSimd)
+{
+    VirtualCameraTest::impl::TestPatternUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestBandsAndSimd());
+}
+
+TEST(TestPatternTest, TestPatternContent)
+{
+    VirtualCameraTest::impl::TestPatternUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestPatternContent());
+}
+
+TEST(TestPatternTest, TestThroughput)
+{
+    VirtualCameraTest::impl::TestPatternUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestThroughput());
+}
+
+//
+// Define FrameClock test case
+//
+TEST(FrameClockTest, TestFrameTimes)
+{
+    VirtualCameraTest::impl::FrameClockUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestFrameTimes());
+}
+
+TEST(FrameClockTest, TestDriftAndStats)
+{
+    VirtualCameraTest::impl::FrameClockUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestDriftAndStats());
+}
+
+//
+// Define ImageScaler test case
+//
+TEST(ImageScalerTest, TestSimdAndTiles)
+{
+    VirtualCameraTest::impl::ImageScalerUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestSimdAndTiles());
+}
+
+TEST(ImageScalerTest, TestQuality)
+{
+    VirtualCameraTest::impl::ImageScalerUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestQuality());
+}
+
+TEST(ImageScalerTest, TestThroughput)
+{
+    VirtualCameraTest::impl::ImageScalerUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestThroughput());
+}
+
+//
+// Define RowParallelExecutor test case
+//
+TEST(RowParallelExecutorTest, TestScaling)
+{
+    VirtualCameraTest::impl::RowParallelExecutorUT test;
+    EXPECT_HRESULT_SUCCEEDED(test.TestScaling());
+}
+
 //
 // Define VirtualCamera_SimpleMediaSource test case
 //
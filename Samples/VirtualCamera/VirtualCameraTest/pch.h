@@ -27,6 +27,8 @@
 #include <d3d9types.h>
 
 #include <iostream>
+#include <algorithm>
+#include <random>
 
 #include <XmlLite.h> // include unknown.h this must come before winrt header
 